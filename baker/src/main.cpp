@@ -0,0 +1,542 @@
+// main.cpp
+
+// note: offline texture baker, converts source images into '.stex'
+//       containers holding a full mip chain of bc1/bc3 blocks that
+//       the runtime maps and uploads without decoding.
+//
+//       usage:
+//          baker <image> [output]                    bake a single texture
+//          baker --cube <output> <+x> <-x> <+y> <-y> <+z> <-z>
+//          baker --array <output> <width> <height> <layer>...
+//                                                    scale every layer to one
+//                                                    size, one array container
+//          baker --data <directory>                  bake every png in the
+//                                                    directory, its skybox and
+//                                                    the planet array
+
+#include "asset_format.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+struct image {
+   int width{};
+   int height{};
+   std::vector<uint8> pixels; // note: always rgba
+};
+
+struct color {
+   float r, g, b;
+};
+
+static bool
+load_image(image &result, const char *filename)
+{
+   int width = 0, height = 0, components = 0;
+   uint8 *data = stbi_load(filename, &width, &height, &components, 4);
+   if (data == nullptr) {
+      printf("!!! could not load '%s'\n", filename);
+      return false;
+   }
+
+   result.width = width;
+   result.height = height;
+   result.pixels.assign(data, data + std::size_t(width) * height * 4);
+   stbi_image_free(data);
+
+   return true;
+}
+
+static bool
+has_alpha(const image &source)
+{
+   for (std::size_t index = 3; index < source.pixels.size(); index += 4) {
+      if (source.pixels[index] != 255) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+// note: 2x2 box filter, odd dimensions clamp to the last row/column
+static image
+downsample(const image &source)
+{
+   image result;
+   result.width = source.width > 1 ? source.width / 2 : 1;
+   result.height = source.height > 1 ? source.height / 2 : 1;
+   result.pixels.resize(std::size_t(result.width) * result.height * 4);
+
+   for (int y = 0; y < result.height; y++) {
+      for (int x = 0; x < result.width; x++) {
+         const int x0 = x * 2 < source.width ? x * 2 : source.width - 1;
+         const int y0 = y * 2 < source.height ? y * 2 : source.height - 1;
+         const int x1 = x0 + 1 < source.width ? x0 + 1 : x0;
+         const int y1 = y0 + 1 < source.height ? y0 + 1 : y0;
+
+         for (int channel = 0; channel < 4; channel++) {
+            const int sum = source.pixels[(std::size_t(y0) * source.width + x0) * 4 + channel] +
+                            source.pixels[(std::size_t(y0) * source.width + x1) * 4 + channel] +
+                            source.pixels[(std::size_t(y1) * source.width + x0) * 4 + channel] +
+                            source.pixels[(std::size_t(y1) * source.width + x1) * 4 + channel];
+            result.pixels[(std::size_t(y) * result.width + x) * 4 + channel] = uint8((sum + 2) / 4);
+         }
+      }
+   }
+
+   return result;
+}
+
+// note: bilinear, texel centers line up at both sizes
+static image
+resample(const image &source, const int width, const int height)
+{
+   image result;
+   result.width = width;
+   result.height = height;
+   result.pixels.resize(std::size_t(width) * height * 4);
+
+   for (int y = 0; y < height; y++) {
+      const float sy = std::fmax((float(y) + 0.5f) * float(source.height) / float(height) - 0.5f, 0.0f);
+      const int y0 = int(sy);
+      const int y1 = y0 + 1 < source.height ? y0 + 1 : y0;
+      const float fy = sy - float(y0);
+      for (int x = 0; x < width; x++) {
+         const float sx = std::fmax((float(x) + 0.5f) * float(source.width) / float(width) - 0.5f, 0.0f);
+         const int x0 = int(sx);
+         const int x1 = x0 + 1 < source.width ? x0 + 1 : x0;
+         const float fx = sx - float(x0);
+
+         for (int channel = 0; channel < 4; channel++) {
+            auto texel = [&](const int tx, const int ty) {
+               return float(source.pixels[(std::size_t(ty) * source.width + tx) * 4 + channel]);
+            };
+            const float top = texel(x0, y0) + (texel(x1, y0) - texel(x0, y0)) * fx;
+            const float bottom = texel(x0, y1) + (texel(x1, y1) - texel(x0, y1)) * fx;
+            result.pixels[(std::size_t(y) * width + x) * 4 + channel] = uint8(top + (bottom - top) * fy + 0.5f);
+         }
+      }
+   }
+
+   return result;
+}
+
+static uint16
+pack_565(const color &c)
+{
+   const int r = int(c.r * 31.0f / 255.0f + 0.5f);
+   const int g = int(c.g * 63.0f / 255.0f + 0.5f);
+   const int b = int(c.b * 31.0f / 255.0f + 0.5f);
+   return uint16((r << 11) | (g << 5) | b);
+}
+
+static color
+unpack_565(const uint16 value)
+{
+   const int r = (value >> 11) & 31;
+   const int g = (value >> 5) & 63;
+   const int b = value & 31;
+   return { float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)), float((b << 3) | (b >> 2)) };
+}
+
+static float
+distance_squared(const color &a, const color &b)
+{
+   const float dr = a.r - b.r;
+   const float dg = a.g - b.g;
+   const float db = a.b - b.b;
+   return dr * dr + dg * dg + db * db;
+}
+
+// note: endpoints along the principal axis of the block colors,
+//       always in four color mode
+static void
+encode_bc1_block(const uint8 block[16][4], uint8 *output)
+{
+   color mean{ 0.0f, 0.0f, 0.0f };
+   for (int index = 0; index < 16; index++) {
+      mean.r += block[index][0];
+      mean.g += block[index][1];
+      mean.b += block[index][2];
+   }
+   mean = { mean.r / 16.0f, mean.g / 16.0f, mean.b / 16.0f };
+
+   float covariance[6] = {};
+   for (int index = 0; index < 16; index++) {
+      const float r = block[index][0] - mean.r;
+      const float g = block[index][1] - mean.g;
+      const float b = block[index][2] - mean.b;
+      covariance[0] += r * r;
+      covariance[1] += r * g;
+      covariance[2] += r * b;
+      covariance[3] += g * g;
+      covariance[4] += g * b;
+      covariance[5] += b * b;
+   }
+
+   // note: power iteration for the dominant eigenvector
+   color axis{ 1.0f, 1.0f, 1.0f };
+   for (int iteration = 0; iteration < 8; iteration++) {
+      const color next{
+         axis.r * covariance[0] + axis.g * covariance[1] + axis.b * covariance[2],
+         axis.r * covariance[1] + axis.g * covariance[3] + axis.b * covariance[4],
+         axis.r * covariance[2] + axis.g * covariance[4] + axis.b * covariance[5],
+      };
+      const float length = sqrtf(next.r * next.r + next.g * next.g + next.b * next.b);
+      if (length < 1e-6f) {
+         break;
+      }
+      axis = { next.r / length, next.g / length, next.b / length };
+   }
+
+   float min_projection = 1e9f;
+   float max_projection = -1e9f;
+   for (int index = 0; index < 16; index++) {
+      const float projection = (block[index][0] - mean.r) * axis.r +
+                               (block[index][1] - mean.g) * axis.g +
+                               (block[index][2] - mean.b) * axis.b;
+      min_projection = projection < min_projection ? projection : min_projection;
+      max_projection = projection > max_projection ? projection : max_projection;
+   }
+
+   auto clamp_color = [](const color &c) {
+      auto clamp = [](const float v) { return v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v); };
+      return color{ clamp(c.r), clamp(c.g), clamp(c.b) };
+   };
+
+   uint16 color0 = pack_565(clamp_color({ mean.r + axis.r * max_projection, mean.g + axis.g * max_projection, mean.b + axis.b * max_projection }));
+   uint16 color1 = pack_565(clamp_color({ mean.r + axis.r * min_projection, mean.g + axis.g * min_projection, mean.b + axis.b * min_projection }));
+   if (color0 < color1) {
+      const uint16 swap = color0;
+      color0 = color1;
+      color1 = swap;
+   }
+
+   uint32 indices = 0;
+   if (color0 != color1) {
+      const color c0 = unpack_565(color0);
+      const color c1 = unpack_565(color1);
+      const color palette[4] = {
+         c0,
+         c1,
+         { (2.0f * c0.r + c1.r) / 3.0f, (2.0f * c0.g + c1.g) / 3.0f, (2.0f * c0.b + c1.b) / 3.0f },
+         { (c0.r + 2.0f * c1.r) / 3.0f, (c0.g + 2.0f * c1.g) / 3.0f, (c0.b + 2.0f * c1.b) / 3.0f },
+      };
+
+      for (int index = 0; index < 16; index++) {
+         const color pixel{ float(block[index][0]), float(block[index][1]), float(block[index][2]) };
+         uint32 best = 0;
+         float best_distance = distance_squared(pixel, palette[0]);
+         for (uint32 candidate = 1; candidate < 4; candidate++) {
+            const float d = distance_squared(pixel, palette[candidate]);
+            if (d < best_distance) {
+               best_distance = d;
+               best = candidate;
+            }
+         }
+         indices |= best << (index * 2);
+      }
+   }
+
+   output[0] = uint8(color0 & 0xff);
+   output[1] = uint8(color0 >> 8);
+   output[2] = uint8(color1 & 0xff);
+   output[3] = uint8(color1 >> 8);
+   output[4] = uint8(indices & 0xff);
+   output[5] = uint8((indices >> 8) & 0xff);
+   output[6] = uint8((indices >> 16) & 0xff);
+   output[7] = uint8((indices >> 24) & 0xff);
+}
+
+// note: eight alpha mode, alpha0 > alpha1
+static void
+encode_bc3_alpha_block(const uint8 block[16][4], uint8 *output)
+{
+   int alpha_min = 255;
+   int alpha_max = 0;
+   for (int index = 0; index < 16; index++) {
+      alpha_min = block[index][3] < alpha_min ? block[index][3] : alpha_min;
+      alpha_max = block[index][3] > alpha_max ? block[index][3] : alpha_max;
+   }
+
+   output[0] = uint8(alpha_max);
+   output[1] = uint8(alpha_min);
+
+   uint64 indices = 0;
+   if (alpha_max != alpha_min) {
+      int palette[8] = { alpha_max, alpha_min };
+      for (int step = 1; step < 7; step++) {
+         palette[step + 1] = ((7 - step) * alpha_max + step * alpha_min) / 7;
+      }
+
+      for (int index = 0; index < 16; index++) {
+         uint64 best = 0;
+         int best_distance = 256;
+         for (uint64 candidate = 0; candidate < 8; candidate++) {
+            const int d = abs(int(block[index][3]) - palette[candidate]);
+            if (d < best_distance) {
+               best_distance = d;
+               best = candidate;
+            }
+         }
+         indices |= best << (index * 3);
+      }
+   }
+
+   for (int byte = 0; byte < 6; byte++) {
+      output[2 + byte] = uint8((indices >> (byte * 8)) & 0xff);
+   }
+}
+
+static std::vector<uint8>
+compress(const image &source, const texture_format format)
+{
+   const int block_size = format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+   const int blocks_x = (source.width + 3) / 4;
+   const int blocks_y = (source.height + 3) / 4;
+
+   std::vector<uint8> result(std::size_t(blocks_x) * blocks_y * block_size);
+   uint8 *output = result.data();
+   for (int by = 0; by < blocks_y; by++) {
+      for (int bx = 0; bx < blocks_x; bx++) {
+         // note: edge blocks repeat the last row/column
+         uint8 block[16][4];
+         for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+               const int sx = bx * 4 + x < source.width ? bx * 4 + x : source.width - 1;
+               const int sy = by * 4 + y < source.height ? by * 4 + y : source.height - 1;
+               memcpy(block[y * 4 + x], &source.pixels[(std::size_t(sy) * source.width + sx) * 4], 4);
+            }
+         }
+
+         if (format == TEXTURE_FORMAT_BC3) {
+            encode_bc3_alpha_block(block, output);
+            output += 8;
+         }
+
+         encode_bc1_block(block, output);
+         output += 8;
+      }
+   }
+
+   return result;
+}
+
+static bool
+write_container(const char *filename, const std::vector<image> &faces, const texture_format format)
+{
+   using namespace asset_format;
+
+   // note: build every level of every face
+   std::vector<std::vector<uint8>> levels;
+   uint32 mip_count = 0;
+   for (const auto &face : faces) {
+      image level = face;
+      uint32 count = 0;
+      while (true) {
+         levels.push_back(compress(level, format));
+         count++;
+         if (level.width == 1 && level.height == 1) {
+            break;
+         }
+         level = downsample(level);
+      }
+      mip_count = count;
+   }
+
+   texture_header header{};
+   header.magic_ = TEXTURE_MAGIC;
+   header.version_ = TEXTURE_VERSION;
+   header.format_ = uint32(format);
+   header.width_ = uint32(faces[0].width);
+   header.height_ = uint32(faces[0].height);
+   header.mip_count_ = mip_count;
+   header.face_count_ = uint32(faces.size());
+
+   std::vector<texture_level> table(levels.size());
+   uint64 offset = sizeof(texture_header) + sizeof(texture_level) * table.size();
+   for (std::size_t index = 0; index < levels.size(); index++) {
+      offset = (offset + DATA_ALIGNMENT - 1) & ~uint64(DATA_ALIGNMENT - 1);
+      table[index].offset_ = offset;
+      table[index].size_ = levels[index].size();
+      offset += levels[index].size();
+   }
+
+   FILE *fout = nullptr;
+   fopen_s(&fout, filename, "wb");
+   if (fout == nullptr) {
+      printf("!!! could not create '%s'\n", filename);
+      return false;
+   }
+
+   fwrite(&header, sizeof(header), 1, fout);
+   fwrite(table.data(), sizeof(texture_level), table.size(), fout);
+   for (std::size_t index = 0; index < levels.size(); index++) {
+      const uint8 zero[DATA_ALIGNMENT] = {};
+      const long padding = long(table[index].offset_) - ftell(fout);
+      fwrite(zero, 1, std::size_t(padding), fout);
+      fwrite(levels[index].data(), 1, levels[index].size(), fout);
+   }
+   fclose(fout);
+
+   printf("%s: %dx%d, %u mips, %u faces, %s, %llu bytes\n",
+          filename,
+          faces[0].width,
+          faces[0].height,
+          mip_count,
+          uint32(faces.size()),
+          format == TEXTURE_FORMAT_BC1 ? "bc1" : "bc3",
+          offset);
+
+   return true;
+}
+
+static std::string
+output_filename(const std::string &input)
+{
+   return std::filesystem::path(input).replace_extension(".stex").string();
+}
+
+static bool
+bake_texture(const std::string &input, const std::string &output)
+{
+   image source;
+   if (!load_image(source, input.c_str())) {
+      return false;
+   }
+
+   const texture_format format = has_alpha(source) ? TEXTURE_FORMAT_BC3 : TEXTURE_FORMAT_BC1;
+   return write_container(output.c_str(), { source }, format);
+}
+
+static bool
+bake_cubemap(const std::string &output, const std::string inputs[6])
+{
+   std::vector<image> faces(6);
+   bool alpha = false;
+   for (int index = 0; index < 6; index++) {
+      if (!load_image(faces[index], inputs[index].c_str())) {
+         return false;
+      }
+
+      if (faces[index].width != faces[0].width || faces[index].height != faces[0].height) {
+         printf("!!! cubemap faces differ in size: '%s'\n", inputs[index].c_str());
+         return false;
+      }
+
+      alpha = alpha || has_alpha(faces[index]);
+   }
+
+   return write_container(output.c_str(), faces, alpha ? TEXTURE_FORMAT_BC3 : TEXTURE_FORMAT_BC1);
+}
+
+static bool
+bake_array(const std::string &output, const int width, const int height, const std::vector<std::string> &inputs)
+{
+   if (width <= 0 || height <= 0 || inputs.empty()) {
+      printf("!!! array needs a size and at least one layer\n");
+      return false;
+   }
+
+   std::vector<image> layers(inputs.size());
+   bool alpha = false;
+   for (std::size_t index = 0; index < inputs.size(); index++) {
+      image source;
+      if (!load_image(source, inputs[index].c_str())) {
+         return false;
+      }
+
+      layers[index] = resample(source, width, height);
+      alpha = alpha || has_alpha(layers[index]);
+   }
+
+   return write_container(output.c_str(), layers, alpha ? TEXTURE_FORMAT_BC3 : TEXTURE_FORMAT_BC1);
+}
+
+static bool
+bake_data_directory(const std::string &directory)
+{
+   namespace fs = std::filesystem;
+
+   bool success = true;
+   for (const auto &entry : fs::directory_iterator(directory)) {
+      if (!entry.is_regular_file() || entry.path().extension() != ".png") {
+         continue;
+      }
+
+      // note: the debug font is sampled with nearest filtering, keep it as is
+      if (entry.path().filename() == "font8x8.png") {
+         continue;
+      }
+
+      const std::string input = entry.path().string();
+      success = bake_texture(input, output_filename(input)) && success;
+   }
+
+   const fs::path skybox = fs::path(directory) / "skybox";
+   if (fs::exists(skybox / "xpos.jpg")) {
+      const char *names[6] = { "xpos.jpg", "xneg.jpg", "ypos.jpg", "yneg.jpg", "zpos.jpg", "zneg.jpg" };
+      std::string inputs[6];
+      for (int index = 0; index < 6; index++) {
+         inputs[index] = (skybox / names[index]).string();
+      }
+
+      success = bake_cubemap((skybox / "skybox.stex").string(), inputs) && success;
+   }
+
+   // note: in the layer order of application::update_planet_layers, at
+   //       the size of the array the runtime would otherwise fill
+   const char *planets[] = {
+      "sun.png", "mercury.png", "venus.png", "earth.png", "moon.png",
+      "mars.png", "jupiter.png", "saturn.png", "uranus.png", "neptune.png",
+   };
+   std::vector<std::string> layers;
+   for (const char *name : planets) {
+      if (fs::exists(fs::path(directory) / name)) {
+         layers.push_back((fs::path(directory) / name).string());
+      }
+   }
+   if (layers.size() == sizeof(planets) / sizeof(planets[0])) {
+      success = bake_array((fs::path(directory) / "planets.stex").string(), 512, 256, layers) && success;
+   }
+
+   return success;
+}
+
+int main(int argc, char **argv)
+{
+   if (argc >= 3 && strcmp(argv[1], "--data") == 0) {
+      return bake_data_directory(argv[2]) ? 0 : 1;
+   }
+
+   if (argc >= 9 && strcmp(argv[1], "--cube") == 0) {
+      const std::string inputs[6] = { argv[3], argv[4], argv[5], argv[6], argv[7], argv[8] };
+      return bake_cubemap(argv[2], inputs) ? 0 : 1;
+   }
+
+   if (argc >= 6 && strcmp(argv[1], "--array") == 0) {
+      const std::vector<std::string> inputs(argv + 5, argv + argc);
+      return bake_array(argv[2], atoi(argv[3]), atoi(argv[4]), inputs) ? 0 : 1;
+   }
+
+   if (argc >= 2 && argv[1][0] != '-') {
+      const std::string input = argv[1];
+      const std::string output = argc >= 3 ? argv[2] : output_filename(input);
+      return bake_texture(input, output) ? 0 : 1;
+   }
+
+   printf("usage: baker <image> [output]\n"
+          "       baker --cube <output> <+x> <-x> <+y> <-y> <+z> <-z>\n"
+          "       baker --array <output> <width> <height> <layer>...\n"
+          "       baker --data <directory>\n");
+   return 1;
+}
@@ -0,0 +1,110 @@
+#version 430
+
+layout (local_size_x = 64) in;
+
+struct instance {
+	mat4 world;
+	mat4 previous_world;
+};
+
+// note: static, only the matrices move
+layout (std430, binding = 0) readonly buffer sphere_block {
+	vec4 spheres[];
+};
+
+layout (std430, binding = 1) writeonly buffer instance_block {
+	instance instances[];
+};
+
+// note: the indirect draw command, instance_count is the append counter
+layout (std430, binding = 2) buffer command_block {
+	uint count;
+	uint instance_count;
+	uint first;
+	uint base_instance;
+};
+
+// note: occlusion pyramid levels one after the other, linear depth
+layout (std430, binding = 3) readonly buffer pyramid_block {
+	float depths[];
+};
+
+// note: a range of the streaming buffer, written by the cpu this frame
+layout (std430, binding = 4) readonly buffer world_block {
+	mat4 worlds[];
+};
+
+// note: the worlds of the last dispatch, every body rolls its own forward
+layout (std430, binding = 5) buffer previous_world_block {
+	mat4 previous_worlds[];
+};
+
+uniform int u_body_count;
+uniform mat4 u_view;
+uniform mat4 u_projection;
+uniform vec4 u_planes[6];
+uniform ivec2 u_pyramid_size;
+uniform int u_pyramid_levels;
+
+bool is_occluded(vec3 center, float radius) {
+	float nearest = -center.z - radius;
+	if (u_pyramid_levels == 0 || nearest <= 0.0) {
+		return false;
+	}
+
+	// note: same test as the cpu culler, bounds from the nearest depth
+	vec4 clip = u_projection * vec4(center, 1.0);
+	vec2 position = (clip.xy / clip.w * 0.5 + 0.5) * vec2(u_pyramid_size);
+	vec2 extent = radius * vec2(u_projection[0][0], u_projection[1][1]) / nearest * 0.5 * vec2(u_pyramid_size);
+	ivec2 lower = ivec2(max(floor(position - extent), vec2(0.0)));
+	ivec2 upper = ivec2(min(floor(position + extent), vec2(u_pyramid_size - 1)));
+	if (any(greaterThan(lower, upper))) {
+		return false;
+	}
+
+	int size = max(upper.x - lower.x, upper.y - lower.y);
+	int level = 0;
+	int offset = 0;
+	ivec2 dimensions = u_pyramid_size;
+	while (level < u_pyramid_levels - 1 && (size >> level) > 2) {
+		offset += dimensions.x * dimensions.y;
+		dimensions >>= 1;
+		level++;
+	}
+
+	for (int y = lower.y >> level; y <= (upper.y >> level); y++) {
+		for (int x = lower.x >> level; x <= (upper.x >> level); x++) {
+			if (depths[offset + y * dimensions.x + x] >= nearest) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void main() {
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= uint(u_body_count)) {
+		return;
+	}
+
+	mat4 world = worlds[index];
+	mat4 previous_world = previous_worlds[index];
+	previous_worlds[index] = world;
+
+	vec4 sphere = spheres[index];
+	for (int plane = 0; plane < 6; plane++) {
+		if (dot(u_planes[plane].xyz, sphere.xyz) + u_planes[plane].w < -sphere.w) {
+			return;
+		}
+	}
+
+	if (is_occluded((u_view * vec4(sphere.xyz, 1.0)).xyz, sphere.w)) {
+		return;
+	}
+
+	uint slot = atomicAdd(instance_count, 1u);
+	instances[slot].world = world;
+	instances[slot].previous_world = previous_world;
+}
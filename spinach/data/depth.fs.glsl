@@ -0,0 +1,5 @@
+#version 330
+
+// note: depth only, color writes are off
+void main() {
+}
\ No newline at end of file
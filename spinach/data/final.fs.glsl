@@ -1,6 +1,7 @@
 #version 330
 
 uniform sampler2D u_diffuse;
+uniform float u_heatmap;
 
 in  vec2 v_texcoord;
 
@@ -8,4 +9,13 @@ out vec4 final_color;
 
 void main() {
 	final_color = texture(u_diffuse, v_texcoord);
+
+	// note: overdraw count to blue, green, yellow, red
+	if (u_heatmap > 0.0) {
+		float count = final_color.r * u_heatmap;
+		vec3 ramp = vec3(clamp(count - 2.0, 0.0, 1.0),
+		                 clamp(count - 1.0, 0.0, 1.0) - clamp(count - 3.0, 0.0, 1.0),
+		                 clamp(1.0 - abs(count - 1.0), 0.0, 1.0));
+		final_color = vec4(ramp, 1.0);
+	}
 }
\ No newline at end of file
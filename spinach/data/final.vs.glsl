@@ -3,9 +3,11 @@
 layout (location = 0) in vec2 a_position;
 layout (location = 1) in vec2 a_texcoord;
 
+uniform vec2 u_texcoord_scale;
+
 out vec2 v_texcoord;
 
 void main() {
 	gl_Position = vec4(a_position, 0, 1);
-	v_texcoord  = a_texcoord;
+	v_texcoord  = a_texcoord * u_texcoord_scale;
 }
\ No newline at end of file
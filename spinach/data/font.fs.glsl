@@ -1,11 +1,32 @@
 #version 330
 
 uniform sampler2D u_diffuse;
+layout (std140) uniform material {
+	vec2 u_glyph_size;
+	mat4 u_projection;
+};
 
 in  vec2 v_texcoord;
+flat in int v_bar;
 
 out vec4 final_color;
 
+// note: by debug_overlay::bar_color
+const vec4 bar_colors[3] = vec4[3](
+	vec4(0.3, 0.9, 0.3, 0.8),
+	vec4(0.9, 0.3, 0.3, 0.8),
+	vec4(1.0, 1.0, 1.0, 0.5)
+);
+
 void main() {
-	final_color = texture(u_diffuse, v_texcoord);
+	if (v_bar > 0) {
+		final_color = bar_colors[clamp(v_bar - 1, 0, 2)];
+	}
+	else {
+		// note: distance field, the edge at 0.5 and a pixel wide ramp
+		float distance = texture(u_diffuse, v_texcoord).r;
+		float width = fwidth(distance);
+		float alpha = smoothstep(0.5 - width, 0.5 + width, distance);
+		final_color = vec4(1.0, 1.0, 1.0, alpha);
+	}
 }
\ No newline at end of file
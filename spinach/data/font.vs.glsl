@@ -1,13 +1,38 @@
 #version 330
 
+// note: per glyph instance, the quad corners come from gl_VertexID
 layout (location = 0) in vec2 a_position;
-layout (location = 1) in vec2 a_texcoord;
+layout (location = 1) in vec4 a_glyph;
 
-uniform mat4 u_projection;
+// note: written by the material, at the offsets the driver reports
+layout (std140) uniform material {
+	vec2 u_glyph_size;
+	mat4 u_projection;
+};
 
 out vec2 v_texcoord;
+flat out int v_bar;
+
+const vec2 corners[6] = vec2[6](
+	vec2(0, 0), vec2(1, 0), vec2(1, 1),
+	vec2(1, 1), vec2(0, 1), vec2(0, 0)
+);
 
 void main() {
-	gl_Position = u_projection * vec4(a_position, 0, 1);
-	v_texcoord = a_texcoord;
+	vec2 corner = corners[gl_VertexID];
+	float character = a_glyph.x;
+	float scale = a_glyph.y;
+	vec2 cell = vec2(mod(character, 16.0), floor(character / 16.0));
+
+	// note: a width makes it a solid bar, sized in pixels
+	if (a_glyph.z > 0.0) {
+		gl_Position = u_projection * vec4(a_position + corner * a_glyph.zw, 0, 1);
+		v_texcoord = vec2(0.0);
+		v_bar = int(character) + 1;
+		return;
+	}
+
+	gl_Position = u_projection * vec4(a_position + corner * u_glyph_size * scale, 0, 1);
+	v_texcoord = (cell + corner) / 16.0;
+	v_bar = 0;
 }
\ No newline at end of file
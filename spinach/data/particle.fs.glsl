@@ -0,0 +1,16 @@
+#version 330
+
+in vec4 v_color;
+
+layout (location = 0) out vec4 final_color;
+layout (location = 1) out vec2 final_velocity;
+
+void main() {
+	// note: soft round sprite, blended additively so no sorting
+	vec2 offset = gl_PointCoord * 2.0 - 1.0;
+	float falloff = max(1.0 - dot(offset, offset), 0.0);
+	final_color = v_color * (falloff * falloff);
+
+	// note: adds nothing to the motion of what lies behind
+	final_velocity = vec2(0.0);
+}
@@ -0,0 +1,30 @@
+#version 330
+
+layout (location = 0) in vec4 a_position;
+layout (location = 1) in vec4 a_velocity;
+layout (location = 2) in float a_emitter;
+
+uniform mat4 u_projection;
+uniform mat4 u_view;
+uniform vec4 u_emitter_color[4];
+uniform float u_point_size;
+
+out vec4 v_color;
+
+void main() {
+	// note: unborn and dead particles fall outside the clip volume
+	float life = a_position.w / max(a_velocity.w, 1e-4);
+	if (a_position.w < 0.0 || life >= 1.0) {
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		gl_PointSize = 1.0;
+		v_color = vec4(0.0);
+		return;
+	}
+
+	gl_Position = u_projection * u_view * vec4(a_position.xyz, 1.0);
+	gl_PointSize = max(u_point_size / gl_Position.w, 1.0);
+
+	// note: fades in quickly and out slowly
+	float fade = min(life * 8.0, 1.0) * (1.0 - life);
+	v_color = u_emitter_color[int(a_emitter)] * fade;
+}
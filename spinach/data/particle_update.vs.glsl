@@ -0,0 +1,72 @@
+#version 330
+
+// note: one particle per vertex, the outputs are its next state
+layout (location = 0) in vec4 a_position;
+layout (location = 1) in vec4 a_velocity;
+layout (location = 2) in float a_emitter;
+
+// note: xyz position and spawn radius, xyz velocity and spawn speed
+uniform vec4 u_emitter_position[4];
+uniform vec4 u_emitter_velocity[4];
+uniform float u_emitter_lifetime[4];
+uniform int u_emitter_count;
+uniform vec3 u_sun;
+uniform float u_wind;
+uniform float u_deltatime;
+uniform int u_seed;
+
+// note: xyz position and age, xyz velocity and lifetime
+out vec4 v_position;
+out vec4 v_velocity;
+out float v_emitter;
+
+uint hash(uint value) {
+	value ^= value >> 16;
+	value *= 0x7feb352du;
+	value ^= value >> 15;
+	value *= 0x846ca68bu;
+	value ^= value >> 16;
+	return value;
+}
+
+float random(inout uint state) {
+	state = hash(state);
+	return float(state >> 8) / 16777216.0;
+}
+
+void main() {
+	float age = a_position.w + u_deltatime;
+	v_position = vec4(a_position.xyz, age);
+	v_velocity = a_velocity;
+	v_emitter = a_emitter;
+
+	// note: not born yet, or waiting for an emitter
+	if (age < 0.0 || u_emitter_count == 0) {
+		return;
+	}
+
+	// note: a dead particle respawns right away in its emitter, every 
+	//       emitter owns a fixed share of the slots
+	if (age >= a_velocity.w) {
+		uint state = uint(gl_VertexID) * 747796405u + uint(u_seed);
+		int emitter = gl_VertexID % u_emitter_count;
+		float z = random(state) * 2.0 - 1.0;
+		float angle = random(state) * 6.2831853;
+		vec3 direction = vec3(sqrt(1.0 - z * z) * vec2(cos(angle), sin(angle)), z);
+
+		float lifetime = u_emitter_lifetime[emitter] * (0.75 + random(state) * 0.5);
+		float speed = u_emitter_velocity[emitter].w * (0.5 + random(state));
+		vec3 position = u_emitter_position[emitter].xyz + direction * u_emitter_position[emitter].w;
+		v_position = vec4(position, age - a_velocity.w);
+		v_velocity = vec4(u_emitter_velocity[emitter].xyz + direction * speed, lifetime);
+		v_emitter = float(emitter);
+		return;
+	}
+
+	// note: the solar wind pushes everything away from the sun, which
+	//       is what turns comet tails away from it
+	vec3 away = a_position.xyz - u_sun;
+	vec3 velocity = a_velocity.xyz + normalize(away + vec3(0.0, 1e-4, 0.0)) * (u_wind * u_deltatime);
+	v_position = vec4(a_position.xyz + velocity * u_deltatime, age);
+	v_velocity = vec4(velocity, a_velocity.w);
+}
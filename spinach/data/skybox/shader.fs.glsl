@@ -1,10 +1,19 @@
 #version 330
 
 uniform samplerCube u_cubemap;
+uniform float u_overdraw;
 
 in  vec3 v_texcoord;
-out vec4 final_color;
+in  vec4 v_current;
+in  vec4 v_previous;
+
+layout (location = 0) out vec4 final_color;
+layout (location = 1) out vec2 final_velocity;
 
 void main() {
 	final_color = texture(u_cubemap, v_texcoord);
+	if (u_overdraw > 0.0) {
+		final_color = vec4(u_overdraw);
+	}
+	final_velocity = (v_current.xy / v_current.w - v_previous.xy / v_previous.w) * 0.5;
 }
@@ -4,11 +4,18 @@ layout(location = 0) in vec3 a_position;
 
 uniform mat4 u_projection;
 uniform mat4 u_view;
+uniform mat4 u_view_projection;
+uniform mat4 u_previous_view_projection;
 
 out vec3 v_texcoord;
+out vec4 v_current;
+out vec4 v_previous;
 
 void main()
 {
-	gl_Position = (u_projection * u_view * vec4(a_position, 1));
+	// note: w for z puts the sky on the far plane
+	gl_Position = (u_projection * u_view * vec4(a_position, 1)).xyww;
 	v_texcoord = a_position;
+	v_current = u_view_projection * vec4(a_position, 1);
+	v_previous = u_previous_view_projection * vec4(a_position, 1);
 }
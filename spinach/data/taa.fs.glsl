@@ -0,0 +1,45 @@
+#version 330
+
+uniform sampler2D u_current;
+uniform sampler2D u_velocity;
+uniform sampler2D u_history;
+uniform vec2 u_source_size;
+uniform vec2 u_jitter;
+uniform float u_blend;
+uniform float u_history_valid;
+
+in  vec2 v_texcoord;
+
+out vec4 final_color;
+
+void main() {
+	vec2 position = v_texcoord * u_source_size;
+	ivec2 limit = ivec2(u_source_size) - 1;
+	ivec2 pixel = clamp(ivec2(position), ivec2(0), limit);
+
+	// note: the history is clamped to the neighbourhood of the current 
+	//       frame, keeps disoccluded and moving areas from ghosting
+	vec3 current = texelFetch(u_current, pixel, 0).rgb;
+	vec3 low = current;
+	vec3 high = current;
+	for (int y = -1; y <= 1; y++) {
+		for (int x = -1; x <= 1; x++) {
+			vec3 neighbour = texelFetch(u_current, clamp(pixel + ivec2(x, y), ivec2(0), limit), 0).rgb;
+			low = min(low, neighbour);
+			high = max(high, neighbour);
+		}
+	}
+
+	vec2 velocity = texelFetch(u_velocity, pixel, 0).rg;
+	vec2 previous = v_texcoord - velocity;
+	vec3 history = clamp(texture(u_history, previous).rgb, low, high);
+
+	// note: the source pixel was shaded at its jittered centre, output 
+	//       pixels close to that point take more of it
+	vec2 offset = position - (vec2(pixel) + 0.5 + u_jitter);
+	float weight = exp(-2.0 * dot(offset, offset));
+
+	bool inside = all(greaterThanEqual(previous, vec2(0.0))) && all(lessThanEqual(previous, vec2(1.0)));
+	float alpha = (inside && u_history_valid > 0.5) ? max(u_blend * weight, 0.02) : 1.0;
+	final_color = vec4(mix(history, current, alpha), 1.0);
+}
@@ -1,11 +1,23 @@
 #version 330
 
 uniform sampler2D u_diffuse;
+uniform float u_overdraw;
 
 in  vec2 v_texcoord;
+in  vec4 v_current;
+in  vec4 v_previous;
 
-out vec4 final_color;
+layout (location = 0) out vec4 final_color;
+layout (location = 1) out vec2 final_velocity;
 
 void main() {
 	final_color = texture(u_diffuse, v_texcoord);
+
+	// note: heatmap mode, blended additively per shaded fragment
+	if (u_overdraw > 0.0) {
+		final_color = vec4(u_overdraw);
+	}
+
+	// note: screen space motion since the last frame, in texcoords
+	final_velocity = (v_current.xy / v_current.w - v_previous.xy / v_previous.w) * 0.5;
 }
\ No newline at end of file
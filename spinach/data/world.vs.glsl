@@ -5,11 +5,25 @@ layout (location = 1) in vec2 a_texcoord;
 
 uniform mat4 u_projection;
 uniform mat4 u_view;
-uniform mat4 u_world;
+uniform mat4 u_view_projection;
+uniform mat4 u_previous_view_projection;
+
+// note: written by the material, at the offsets the driver reports
+layout (std140) uniform material {
+	mat4 u_world;
+	mat4 u_previous_world;
+};
 
 out vec2 v_texcoord;
+out vec4 v_current;
+out vec4 v_previous;
+
+// note: matches the depth prepass bit for bit
+invariant gl_Position;
 
 void main() {
 	gl_Position = u_projection * u_view * u_world * vec4(a_position, 1);
 	v_texcoord = a_texcoord;
+	v_current = u_view_projection * u_world * vec4(a_position, 1);
+	v_previous = u_previous_view_projection * u_previous_world * vec4(a_position, 1);
 }
\ No newline at end of file
@@ -0,0 +1,33 @@
+#version 430
+
+layout (location = 0) in vec3 a_position;
+layout (location = 1) in vec2 a_texcoord;
+
+struct instance {
+	mat4 world;
+	mat4 previous_world;
+};
+
+// note: written by the cull pass, one entry per visible body
+layout (std430, binding = 1) readonly buffer instance_block {
+	instance instances[];
+};
+
+uniform mat4 u_projection;
+uniform mat4 u_view;
+uniform mat4 u_view_projection;
+uniform mat4 u_previous_view_projection;
+
+out vec2 v_texcoord;
+out vec4 v_current;
+out vec4 v_previous;
+
+void main() {
+	mat4 world = instances[gl_InstanceID].world;
+	gl_Position = u_projection * u_view * world * vec4(a_position, 1);
+	v_texcoord = a_texcoord;
+
+	// note: the bodies tumble, their motion is in the previous world
+	v_current = u_view_projection * world * vec4(a_position, 1);
+	v_previous = u_previous_view_projection * instances[gl_InstanceID].previous_world * vec4(a_position, 1);
+}
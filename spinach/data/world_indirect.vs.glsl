@@ -0,0 +1,28 @@
+#version 330
+
+layout (location = 0) in vec3 a_position;
+layout (location = 1) in vec2 a_texcoord;
+layout (location = 4) in mat4 a_world;
+layout (location = 8) in mat4 a_previous_world;
+layout (location = 12) in float a_layer;
+
+uniform mat4 u_projection;
+uniform mat4 u_view;
+uniform mat4 u_view_projection;
+uniform mat4 u_previous_view_projection;
+
+out vec2 v_texcoord;
+flat out float v_layer;
+out vec4 v_current;
+out vec4 v_previous;
+
+// note: matches the depth prepass bit for bit
+invariant gl_Position;
+
+void main() {
+	gl_Position = u_projection * u_view * a_world * vec4(a_position, 1);
+	v_texcoord = a_texcoord;
+	v_layer = a_layer;
+	v_current = u_view_projection * a_world * vec4(a_position, 1);
+	v_previous = u_previous_view_projection * a_previous_world * vec4(a_position, 1);
+}
\ No newline at end of file
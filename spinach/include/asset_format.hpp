@@ -0,0 +1,82 @@
+// asset_format.hpp
+
+#pragma once
+
+#include <render.hpp>
+
+// note: on-disk layouts shared between the runtime and the offline tools.
+//       all offsets are from the start of the file, all data is little endian
+namespace asset_format
+{
+   constexpr uint32 make_fourcc(const char a, const char b, const char c, const char d)
+   {
+      return uint32(uint8(a)) | (uint32(uint8(b)) << 8) | (uint32(uint8(c)) << 16) | (uint32(uint8(d)) << 24);
+   }
+
+   constexpr uint32 DATA_ALIGNMENT = 16;
+
+   // note: texture container, '.stex'
+   //       header, followed by face_count * mip_count level entries
+   //       (face major), followed by the level data
+   constexpr uint32 TEXTURE_MAGIC = make_fourcc('S', 'T', 'E', 'X');
+   constexpr uint32 TEXTURE_VERSION = 1;
+
+   struct texture_header {
+      uint32 magic_;
+      uint32 version_;
+      uint32 format_;      // note: texture_format
+      uint32 width_;
+      uint32 height_;
+      uint32 mip_count_;
+      uint32 face_count_;  // note: 1, 6 (cubemap) or the layer count (array)
+      uint32 reserved_;
+   };
+
+   struct texture_level {
+      uint64 offset_;
+      uint64 size_;
+   };
+
+   static_assert(sizeof(texture_header) == 32, "texture header layout changed");
+   static_assert(sizeof(texture_level) == 16, "texture level layout changed");
+
+   // note: mesh container, '.smesh', written on first import
+   //       header, followed by submesh_count submesh entries, the vertex
+   //       data and the index data, each section at DATA_ALIGNMENT.
+   //       source_hash_ is the hash of the imported file and the files
+   //       it references, a mismatch means the container is stale. one
+   //       submesh per node and mesh, indices are relative to
+   //       base_vertex_ and ranges may be shared
+   constexpr uint32 MESH_MAGIC = make_fourcc('S', 'M', 'S', 'H');
+   constexpr uint32 MESH_VERSION = 4;
+
+   struct mesh_header {
+      uint32 magic_;
+      uint32 version_;
+      uint64 source_hash_;
+      uint32 vertex_stride_;
+      uint32 vertex_count_;
+      uint32 index_type_;     // note: index_type
+      uint32 index_count_;
+      uint32 submesh_count_;
+      uint32 reserved_;
+      uint64 submesh_offset_;
+      uint64 vertex_offset_;
+      uint64 index_offset_;
+      float bounds_min_[3];   // note: submesh space, covering every submesh,
+      float bounds_max_[3];   //       positions are quantized against these
+   };
+
+   struct mesh_submesh {
+      uint32 first_index_;
+      uint32 index_count_;
+      int32 base_vertex_;
+      uint32 vertex_count_;
+      float transform_[16];   // note: submesh to model space, column major
+      float bounds_min_[3];   // note: submesh space
+      float bounds_max_[3];
+   };
+
+   static_assert(sizeof(mesh_header) == 88, "mesh header layout changed");
+   static_assert(sizeof(mesh_submesh) == 104, "mesh submesh layout changed");
+} // !asset_format
@@ -18,6 +18,7 @@ enum uniform_type
    UNIFORM_TYPE_VEC3,
    UNIFORM_TYPE_VEC4,
    UNIFORM_TYPE_INT,
+   UNIFORM_TYPE_IVEC2,
    UNIFORM_TYPE_BOOL,
    UNIFORM_TYPE_SAMPLER,
    UNIFORM_TYPE_MATRIX,
@@ -27,6 +28,9 @@ enum texture_format
 {
    TEXTURE_FORMAT_RGB8,
    TEXTURE_FORMAT_RGBA8,
+   TEXTURE_FORMAT_R8,
+   TEXTURE_FORMAT_BC1,
+   TEXTURE_FORMAT_BC3,
    TEXTURE_FORMAT_COUNT,
    TEXTURE_FORMAT_UNKNOWN,
 };
@@ -157,11 +161,15 @@ enum framebuffer_format
    FRAMEBUFFER_FORMAT_RGB8,
    FRAMEBUFFER_FORMAT_RGBA8,
    FRAMEBUFFER_FORMAT_D32,
+   FRAMEBUFFER_FORMAT_RG16F,
+   FRAMEBUFFER_FORMAT_RGBA16F,
    FRAMEBUFFER_FORMAT_COUNT,
    FRAMEBUFFER_FORMAT_INVALID,
 };
 
 // note: resources
+struct streaming_buffer;
+
 struct shader_program {
    shader_program();
 
@@ -170,7 +178,36 @@ struct shader_program {
                const char *fragment_shader_source);
    void destroy();
 
+   // note: create split in two, so that several programs can compile at
+   //       once on drivers with GL_KHR_parallel_shader_compile. begin all,
+   //       poll is_ready and finish each when ready
+   bool begin(const char *vertex_shader_source,
+              const char *fragment_shader_source);
+   // note: compute only program, needs gl 4.3
+   bool create_compute(const char *compute_shader_source);
+   // note: vertex only program whose outputs are captured with
+   //       transform feedback, interleaved in the order of varyings
+   bool create_feedback(const char *vertex_shader_source,
+                        const int32 varying_count,
+                        const char **varyings);
+   bool is_ready() const;
+   bool finish();
+
+   // note: driver specific program binaries, e.g. for an on-disk cache
+   bool create_from_binary(const uint32 format,
+                           const void *data,
+                           const int32 size);
+   int32 binary_size() const;
+   bool get_binary(uint32 &format,
+                   void *data,
+                   const int32 size) const;
+
+   static bool is_binary_supported();
+   static bool is_parallel_compile_supported();
+
    uint32 id_;
+   uint32 vertex_id_;
+   uint32 fragment_id_;
 };
 
 struct texture {
@@ -186,12 +223,44 @@ struct texture {
                const int32 height,
                const int32 count,
                const void **data);
+   bool create_compressed(const texture_format format,
+                          const int32 width,
+                          const int32 height,
+                          const int32 mip_count,
+                          const void **data,
+                          const int32 *sizes);
    void update(const texture_format format,
                const int32 width,
                const int32 height,
                const void *data);
+   void generate_mipmaps();
    void destroy();
 
+   // note: storage for all levels without data, filled with upload
+   bool allocate(const texture_format format,
+                 const int32 width,
+                 const int32 height,
+                 const int32 mip_count);
+   void upload(const texture_format format,
+               const int32 level,
+               const int32 width,
+               const int32 height,
+               const streaming_buffer &source,
+               const int32 offset,
+               const int32 size);
+   void upload(const texture_format format,
+               const int32 level,
+               const int32 width,
+               const int32 height,
+               const void *data,
+               const int32 size);
+
+   static bool is_compressed(const texture_format format);
+   static bool is_supported(const texture_format format);
+   static int32 level_size(const texture_format format,
+                           const int32 width,
+                           const int32 height);
+
    uint32 id_;
 };
 
@@ -203,9 +272,70 @@ struct cubemap {
                const int32 width,
                const int32 height,
                const void *data[6]);
+   // note: data and sizes are face major, CUBEMAP_FACE_COUNT * mip_count entries
+   bool create_compressed(const texture_format format,
+                          const int32 width,
+                          const int32 height,
+                          const int32 mip_count,
+                          const void **data,
+                          const int32 *sizes);
+   bool allocate(const texture_format format,
+                 const int32 width,
+                 const int32 height,
+                 const int32 mip_count);
+   void upload(const texture_format format,
+               const int32 face,
+               const int32 level,
+               const int32 width,
+               const int32 height,
+               const streaming_buffer &source,
+               const int32 offset,
+               const int32 size);
+   void upload(const texture_format format,
+               const int32 face,
+               const int32 level,
+               const int32 width,
+               const int32 height,
+               const void *data,
+               const int32 size);
+   void destroy();
+
+   uint32 id_;
+};
+
+// note: layers of one size and format, sampled as a sampler2DArray.
+//       a layer is filled by scaling a texture into it on the gpu, so
+//       sources of any size can share one array
+struct texture_array {
+   texture_array();
+
+   bool is_valid() const;
+   bool allocate(const texture_format format,
+                 const int32 width,
+                 const int32 height,
+                 const int32 layer_count,
+                 const int32 mip_count);
+   // note: every level of every layer, layer major, as baked offline
+   bool create_compressed(const texture_format format,
+                          const int32 width,
+                          const int32 height,
+                          const int32 layer_count,
+                          const int32 mip_count,
+                          const void **data,
+                          const int32 *sizes);
+   // note: level 0 of source stretched over level 0 of the layer, false
+   //       when source can not be read as a color attachment, which
+   //       block compressed sources can not. leaves the default
+   //       framebuffer bound
+   bool copy_layer(const int32 layer,
+                   const texture &source);
+   void generate_mipmaps();
    void destroy();
 
    uint32 id_;
+   int32 width_;
+   int32 height_;
+   int32 layer_count_;
 };
 
 struct vertex_buffer {
@@ -217,21 +347,84 @@ struct vertex_buffer {
                const buffer_usage_hint hint = BUFFER_USAGE_HINT_STATIC);
    void update(const int32 size,
                const void *data);
+   // note: writes into the existing storage, no reallocation
+   void write(const int32 offset,
+              const int32 size,
+              const void *data);
+   // note: reads the storage back, waits for the gpu
+   bool read(const int32 offset,
+             const int32 size,
+             void *data) const;
    void destroy();
 
    uint32 id_;
     int32 size_;
 };
 
+// note: ring of per-frame segments for dynamic data, a segment is 
+//       only rewritten after the gpu signaled the fence of the frame
+//       that last used it. persistently mapped when the context 
+//       supports buffer storage, unsynchronized map range otherwise.
+struct streaming_buffer {
+   static constexpr int32 FRAME_LIMIT = 4;
+
+   streaming_buffer();
+
+   bool is_valid() const;
+   bool create(const int32 segment_size,
+               const int32 frames_in_flight = 3);
+   void begin_frame();
+   int32 write(const int32 size,
+               const void *data,
+               const int32 alignment = 4);
+   int32 available() const;
+   // note: the next multiple of alignment from position, both counted
+   //       from the start of the buffer. segments need not be multiples
+   //       of the alignment, so offset / stride stays a whole element
+   static int32 align_offset(const int32 position,
+                             const int32 alignment);
+   void end_frame();
+   void destroy();
+
+   uint32 id_;
+   uint8 *mapped_;
+   int32 segment_size_;
+   int32 segment_count_;
+   int32 segment_index_;
+   int32 head_;
+   void *fences_[FRAME_LIMIT];
+};
+
 struct index_buffer {
    index_buffer();
 
    bool is_valid() const;
    bool create(const int32 size,
                const void *data);
+   void write(const int32 offset,
+              const int32 size,
+              const void *data);
    void destroy();
 
    uint32 id_;
+    int32 size_;
+};
+
+// note: read and written by shaders, e.g. compute shader output that 
+//       is consumed as indirect commands without a round trip
+struct storage_buffer {
+   storage_buffer();
+
+   bool is_valid() const;
+   bool create(const int32 size,
+               const void *data);
+   void write(const int32 offset,
+              const int32 size,
+              const void *data);
+   void destroy();
+
+   uint32 id_;
+   int32 size_;
 };
 
 struct sampler_state {
@@ -270,12 +463,54 @@ struct framebuffer {
    uint32 color_attachments_[ATTACHMENT_LIMIT];
 };
 
+// note: gpu time spent on the commands between begin and end. results
+//       are read back frames later so the cpu never waits for them
+struct gpu_timer {
+   static constexpr int32 QUERY_LIMIT = 4;
+
+   gpu_timer();
+
+   bool is_valid() const;
+   bool create(const int32 latency = 3);
+   void destroy();
+   void begin();
+   void end();
+   // note: true when the oldest query has finished, in milliseconds
+   bool resolve(float &milliseconds);
+
+   uint32 queries_[QUERY_LIMIT];
+   int32 count_;
+   int32 index_;
+   int32 pending_;
+   bool active_;
+};
+
+// note: signaled once the gpu has finished every command issued
+//       before insert
+struct gpu_fence {
+   gpu_fence();
+
+   bool is_valid() const;
+   void insert();
+   // note: flushes and blocks for at most the timeout, true when signaled
+   bool wait(const int64 timeout_microseconds);
+   bool is_signaled() const;
+   void destroy();
+
+   void *sync_;
+};
+
 struct vertex_layout
 {
    enum attribute_format
    {
       ATTRIBUTE_FORMAT_FLOAT,
       ATTRIBUTE_FORMAT_BYTE,
+      ATTRIBUTE_FORMAT_SIGNED_BYTE,
+      ATTRIBUTE_FORMAT_HALF_FLOAT,
+      ATTRIBUTE_FORMAT_SHORT,
+      ATTRIBUTE_FORMAT_UNSIGNED_SHORT,
+      ATTRIBUTE_FORMAT_INT_2_10_10_10, // note: count must be 4, packed into 32 bits
    };
 
    struct attribute
@@ -284,31 +519,91 @@ struct vertex_layout
       attribute_format format_;
       int32 count_;
       int32 offset_;
+      int32 divisor_;
       bool normalized_;
    };
 
+   static constexpr int32 ATTRIBUTE_LIMIT = 16;
+
    vertex_layout();
 
    void add_attribute(const int32 index,
                       attribute_format format,
                       const int32 count,
-                      const bool normalized);
+                      const bool normalized,
+                      const int32 divisor = 0);
    void clear();
 
    int32 stride_;
    int32 attribute_count_;
-   attribute attributes_[8];
+   attribute attributes_[ATTRIBUTE_LIMIT];
+};
+
+// note: layouts expected by the gl indirect draws, filled by the cpu
+//       and read from the buffer bound with set_indirect_buffer
+struct draw_arrays_command {
+   uint32 count_;
+   uint32 instance_count_;
+   uint32 first_;
+   uint32 base_instance_;
+};
+
+struct draw_elements_command {
+   uint32 count_;
+   uint32 instance_count_;
+   uint32 first_index_;
+    int32 base_vertex_;
+   uint32 base_instance_;
+};
+
+// note: a member of a std140 uniform block, where the driver placed it
+struct uniform_block_member {
+   char name_[64];
+   int32 offset_;
+};
+
+// note: what the backend was asked to do since the last reset. state
+//       changes are binds and pipeline state, not whether they changed
+//       anything. buffer bytes are counted by the buffers, their writes
+//       do not go through the backend
+struct render_counters {
+   int32 draw_calls_;
+   int32 dispatches_;
+   int32 state_changes_;
+   int32 uniform_uploads_;
+   int32 texture_binds_;
+   int64 upload_bytes_;
 };
 
 struct render_backend {
    render_backend();
    ~render_backend();
 
+   // note: once per frame, read before the reset
+   render_counters counters() const;
+   void reset_counters();
+
+   const char *vendor() const;
+   const char *renderer() const;
+   const char *version() const;
+
    void clear(const float red,
               const float green,
               const float blue,
               const float alpha = 1.0f,
               const float depth = 1.0f);
+   void clear_color(const float red,
+                    const float green,
+                    const float blue,
+                    const float alpha = 1.0f);
+   void clear_depth(const float depth = 1.0f);
+   // note: contents are not needed anymore, lets the driver skip the
+   //       store (tilers) or the copy on the next use. no-op before gl 4.3
+   void invalidate_framebuffer(const framebuffer &handle,
+                               const bool color,
+                               const bool depth);
+   void invalidate_backbuffer(const bool color,
+                              const bool depth);
    void set_viewport(const int32 x,
                      const int32 y,
                      const int32 width,
@@ -323,11 +618,48 @@ struct render_backend {
                            const void *value);
    void set_index_buffer(const index_buffer &handle);
    void set_vertex_buffer(const vertex_buffer &handle);
-   void set_vertex_layout(const vertex_layout &layout);
+   void set_vertex_buffer(const streaming_buffer &handle);
+   void set_vertex_layout(const vertex_layout &layout,
+                          const int32 offset = 0);
+   // note: sources only the attributes of the layout from the stream,
+   //       the others are left alone, e.g. per-draw data next to the
+   //       vertices set with set_vertex_layout
+   void set_vertex_stream(const streaming_buffer &handle,
+                          const vertex_layout &layout,
+                          const int32 offset);
+   void set_indirect_buffer(const streaming_buffer &handle);
+   void set_indirect_buffer(const storage_buffer &handle);
+   void set_storage_buffer(const storage_buffer &handle,
+                           const int32 binding);
+   // note: std430 storage read from a range of a streaming buffer, the
+   //       offset a multiple of storage_buffer_alignment
+   void set_storage_buffer(const streaming_buffer &handle,
+                           const int32 binding,
+                           const int32 offset,
+                           const int32 size);
+   // note: std140 uniform block, a range of a streaming buffer is bound
+   //       as its storage. set_uniform_block points the named block of a
+   //       program at a binding and returns the size the driver reports
+   //       for it, -1 when the program has no such block
+   int32 set_uniform_block(const shader_program &handle,
+                           const char *name,
+                           const int32 binding);
+   // note: the active members of the named block with their offsets,
+   //       at most capacity of them. -1 when the program has no such block
+   int32 uniform_block_members(const shader_program &handle,
+                               const char *name,
+                               uniform_block_member *members,
+                               const int32 capacity);
+   void set_uniform_buffer(const streaming_buffer &handle,
+                           const int32 binding,
+                           const int32 offset,
+                           const int32 size);
    void set_texture(const texture &handle,
                     const int32 unit = 0);
    void set_cubemap(const cubemap &handle,
                     const int32 unit = 0);
+   void set_texture_array(const texture_array &handle,
+                          const int32 unit = 0);
    void set_sampler_state(const sampler_state &handle,
                           const int32 unit = 0);
    void set_blend_state(const bool enabled,
@@ -342,14 +674,55 @@ struct render_backend {
                         const float range_near = 0.0f,
                         const float range_far = 1.0f,
                         const compare_func func = COMPARE_FUNC_LESS);
+   // note: off for depth only passes, stays off until turned back on
+   void set_color_write(const bool enabled);
+   // note: point sprites sized by gl_PointSize in the vertex shader
+   void set_program_point_size(const bool enabled);
    void set_rasterizer_state(const cull_mode cull_mode = CULL_MODE_NONE,
                              const front_face front_face = FRONT_FACE_CCW,
                              const polygon_mode polygon = POLYGON_MODE_FILL);
    void draw(const primitive_topology topology,
              const int32 start_index,
              const int32 primitive_count);
+   void draw_instanced(const primitive_topology topology,
+                       const int32 start_index,
+                       const int32 primitive_count,
+                       const int32 instance_count);
+   // note: base_vertex is added to every index, so meshes sharing
+   //       one buffer keep their own zero based indices
    void draw_indexed(const primitive_topology topology,
                      const index_type type,
                      const int32 start_index,
-                     const int32 primitive_count);
+                     const int32 primitive_count,
+                     const int32 base_vertex = 0);
+   // note: offset is in bytes into the indirect buffer, draw_count
+   //       commands are read from there in one call
+   void draw_indirect(const primitive_topology topology,
+                      const int32 offset,
+                      const int32 draw_count);
+   void draw_indexed_indirect(const primitive_topology topology,
+                              const index_type type,
+                              const int32 offset,
+                              const int32 draw_count);
+
+   // note: group counts, the group size is declared by the shader
+   void dispatch(const int32 group_count_x,
+                 const int32 group_count_y = 1,
+                 const int32 group_count_z = 1);
+   // note: vertices drawn between begin and end are written to handle
+   //       instead of rasterized. points only, into one buffer, so the
+   //       vertex shader outputs are the next state of each vertex
+   void begin_feedback(const vertex_buffer &handle);
+   void end_feedback();
+
+   // note: compute writes become visible to indirect commands and to
+   //       shader storage reads that follow
+   void storage_barrier();
+
+   static bool is_multi_draw_indirect_supported();
+   static bool is_compute_supported();
+   static int32 uniform_buffer_alignment();
+   static int32 storage_buffer_alignment();
+
+   render_counters counters_;
 };
\ No newline at end of file
@@ -2,33 +2,495 @@
 
 #pragma once
 
+#include <cassert>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
 #include <render.hpp>
 #include <glm/glm.hpp> // vecN,matN,quat
 
+namespace asset_format
+{
+   struct texture_level;
+} // !asset_format
+
+// note: read-only view of a whole file, memory mapped
+struct mapped_file {
+   mapped_file() = default;
+   mapped_file(const mapped_file &) = delete;
+   mapped_file &operator=(const mapped_file &) = delete;
+   ~mapped_file();
+
+   bool valid() const;
+   bool open(const char *filename);
+   void close();
+
+   const uint8 *m_data{};
+   std::size_t m_size{};
+   void *m_file{};
+   void *m_mapping{};
+};
+
+// note: pixels in system memory, e.g. decoded off the context thread
+struct image_data {
+   texture_format m_format{ TEXTURE_FORMAT_UNKNOWN };
+   int32 m_width{};
+   int32 m_height{};
+   std::vector<uint8> m_pixels;
+};
+
 namespace utility
 {
    // note: milliseconds since process start
    int64 get_current_tick();
+   // note: microseconds since process start, from a steady clock
+   int64 get_current_microseconds();
+
+   // note: 64-bit fnv-1a, usable at compile time
+   constexpr uint64 hash_fnv1a(const std::string_view data, uint64 hash = 14695981039346656037ull)
+   {
+      for (const char ch : data) {
+         hash ^= uint64(uint8(ch));
+         hash *= 1099511628211ull;
+      }
+      return hash;
+   }
+
+   bool read_text_file(std::string &result,
+                       const char *filename);
+
+   bool load_image_from_file(image_data &image,
+                             const char *filename);
+
+   // note: turns a 16x16 grid of bitmap glyphs, set where alpha is, into
+   //       a single channel distance field with cells of cell_size texels.
+   //       the edge sits at 0.5 and one source pixel spans the 0..1 range
+   bool bake_sdf_font(image_data &result,
+                      const image_data &bitmap,
+                      const int cell_size);
 
    bool create_shader_program_from_files(shader_program &program,
                                          const char *vertex_filename,
                                          const char *fragment_filename);
 
+   // note: uses the baked '.stex' container next to the file when
+   //       present, decodes the source image otherwise
    bool create_texture_from_file(texture &texture,
                                  const char *filename);
 
+   bool create_texture_from_baked_file(texture &texture,
+                                       const char *filename);
+
    bool create_cubemap_from_files(cubemap &cubemap,
                                   const int count,
                                   const char **filenames);
+
+   bool create_cubemap_from_baked_file(cubemap &cubemap,
+                                       const char *filename);
+
+   bool create_texture_array_from_baked_file(texture_array &array,
+                                             const char *filename,
+                                             const int32 layer_count);
+
+   // note: '.stex' container next to the source image
+   std::string get_baked_filename(const char *filename);
+
+   // note: validates the container and returns the level table, or
+   //       nullptr when the file is not a usable texture container
+   const asset_format::texture_level *get_texture_levels(const mapped_file &file,
+                                                         const uint32 face_count);
 } // !utility
 
 namespace debug
 {
    void log(const char *format, ...);
+   // note: heap allocations made by the calling thread, only counted
+   //       in debug builds
+   int64 allocation_count();
+   // note: checks that need no window or context, false when one fails
+   bool self_test();
 } // !debug
 
+// note: bump allocator for data that lives at most a frame or two.
+//       allocating moves an offset, reset gives everything back at once
+//       and single allocations are never freed. when the block runs out
+//       allocations fall through to the heap and are counted, so the
+//       capacity can be raised
+struct linear_arena {
+   linear_arena() = default;
+   linear_arena(const linear_arena &) = delete;
+   linear_arena &operator=(const linear_arena &) = delete;
+   ~linear_arena();
+
+   bool valid() const;
+   bool create(const int64 capacity);
+   void destroy();
+   void reset();
+   bool owns(const void *pointer) const;
+   void *allocate(const int64 size, const int64 alignment);
+   // note: only gives back what fell through to the heap, with the
+   //       alignment it was allocated with
+   void deallocate(void *pointer, const int64 alignment);
+
+   uint8 *m_base{};
+   int64 m_capacity{};
+   int64 m_offset{};
+   int64 m_peak{};
+   int32 m_overflow_count{};
+};
+
+// note: standard allocator over a linear_arena, without an arena it
+//       falls back to the heap so containers can be default constructed
+template <typename T>
+struct arena_allocator {
+   using value_type = T;
+   using propagate_on_container_move_assignment = std::true_type;
+
+   arena_allocator() = default;
+   arena_allocator(linear_arena &arena) : m_arena(&arena) {}
+   template <typename U>
+   arena_allocator(const arena_allocator<U> &other) : m_arena(other.m_arena) {}
+
+   T *allocate(const std::size_t count)
+   {
+      if (m_arena == nullptr) {
+         return static_cast<T *>(::operator new(count * sizeof(T)));
+      }
+      return static_cast<T *>(m_arena->allocate(int64(count * sizeof(T)), int64(alignof(T))));
+   }
+
+   void deallocate(T *pointer, const std::size_t count)
+   {
+      if (m_arena == nullptr) {
+         ::operator delete(pointer);
+         return;
+      }
+      m_arena->deallocate(pointer, int64(alignof(T)));
+   }
+
+   template <typename U>
+   bool operator==(const arena_allocator<U> &other) const { return m_arena == other.m_arena; }
+   template <typename U>
+   bool operator!=(const arena_allocator<U> &other) const { return m_arena != other.m_arena; }
+
+   linear_arena *m_arena{};
+};
+
+template <typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+
+// note: two arenas that trade places every frame. what is written to the
+//       current one in frame n is still intact in frame n + 1, so a reader
+//       one frame behind, e.g. the overlay line cache, needs no copy. the
+//       render thread owns both, data for other threads needs a lifetime
+//       of its own
+struct double_buffered_arena {
+   bool valid() const;
+   bool create(const int64 capacity);
+   void destroy();
+   // note: resets the arena that becomes current
+   void swap();
+   linear_arena &current();
+   const linear_arena &previous() const;
+
+   linear_arena m_arenas[2];
+   int32 m_current{};
+};
+
+// note: fixed set of threads draining a shared job queue,
+//       jobs must not touch the graphics context.
+//       threading headers declare ::time, they stay out of this header
+struct worker_pool {
+   struct state;
+
+   worker_pool() = default;
+   worker_pool(const worker_pool &) = delete;
+   worker_pool &operator=(const worker_pool &) = delete;
+   ~worker_pool();
+
+   bool valid() const;
+   bool create(const int thread_count = 0);
+   void destroy();
+   void submit(std::function<void()> job);
+   int thread_count() const;
+
+   state *m_state{};
+};
+
+// note: decodes images on the worker pool and uploads them through a
+//       pixel buffer ring, at most upload_budget bytes per frame.
+//       targets hold a 1x1 placeholder until all of their data has
+//       arrived, then the texture object is swapped in place
+struct texture_streamer {
+   struct request;
+
+   texture_streamer() = default;
+
+   bool create(worker_pool *pool, const int32 upload_budget);
+   void destroy();
+
+   void load(texture &texture, const char *filename);
+   void load(cubemap &cubemap, const char *baked_filename, const int count, const char **filenames);
+   void update();
+   int pending() const;
+   bool is_pending(const texture &texture) const;
+
+   worker_pool *m_pool{};
+   streaming_buffer m_staging;
+   int32 m_upload_budget{};
+   std::vector<request *> m_requests;
+};
+
+// note: program binaries on disk, one file per program named by a hash of
+//       its sources and the driver. stale entries fail to load and are
+//       replaced once the program has been compiled from source again
+struct shader_cache {
+   struct entry {
+      shader_program *m_program{};
+      const char *m_vertex_source{};
+      const char *m_fragment_source{};
+   };
+
+   bool create(const char *directory, const render_backend &backend);
+   // note: programs missing from the cache are compiled together and
+   //       polled, so the driver can work on them in parallel
+   bool create_programs(const int count, const entry *entries);
+
+   uint64 key(const char *vertex_source, const char *fragment_source) const;
+   std::string filename(const uint64 key) const;
+   bool load(shader_program &program, const uint64 key) const;
+   void store(const shader_program &program, const uint64 key) const;
+
+   std::string m_directory;
+   uint64 m_driver_hash{};
+};
+
+// note: 32-bit generational handle, the low bits index a pool slot and
+//       the high bits must match the generation of that slot, so stale
+//       handles are caught with one compare. zero is never valid
+template <typename T>
+struct resource_handle {
+   static constexpr uint32 INDEX_BITS = 20;
+   static constexpr uint32 INDEX_MASK = (1u << INDEX_BITS) - 1;
+   static constexpr uint32 GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+
+   constexpr resource_handle() = default;
+   constexpr resource_handle(const uint32 index, const uint32 generation)
+      : m_value(((generation & GENERATION_MASK) << INDEX_BITS) | (index & INDEX_MASK))
+   {
+   }
+
+   constexpr bool valid() const { return m_value != 0; }
+   constexpr uint32 index() const { return m_value & INDEX_MASK; }
+   constexpr uint32 generation() const { return m_value >> INDEX_BITS; }
+   constexpr bool operator==(const resource_handle &rhs) const { return m_value == rhs.m_value; }
+
+   uint32 m_value{};
+};
+
+using texture_handle = resource_handle<texture>;
+using buffer_handle = resource_handle<vertex_buffer>;
+using program_handle = resource_handle<shader_program>;
+using sampler_handle = resource_handle<sampler_state>;
+
+// note: what a pooled resource was made from, the hash indexes the
+//       lookup. the check is a second, independently seeded hash of the
+//       same bytes, a hit has to match size and check as well
+struct resource_key {
+   uint64 m_hash{};
+   uint64 m_size{};
+   uint64 m_check{};
+};
+
+// note: slots live in a deque so resources never move, pointers taken
+//       from a live handle stay valid until the handle is destroyed
+template <typename T>
+struct resource_pool {
+   using handle = resource_handle<T>;
+
+   struct slot {
+      T m_resource;
+      resource_key m_key;
+      uint32 m_generation{ 1 };
+      int32 m_references{};
+      bool m_alive{};
+   };
+
+   handle allocate(const resource_key &key)
+   {
+      uint32 index = 0;
+      if (!m_free.empty()) {
+         index = m_free.back();
+         m_free.pop_back();
+      }
+      else {
+         index = uint32(m_slots.size());
+         assert(index <= handle::INDEX_MASK);
+         m_slots.emplace_back();
+      }
+
+      auto &entry = m_slots[index];
+      entry.m_key = key;
+      entry.m_references = 1;
+      entry.m_alive = true;
+      // note: on a hash collision the first entry keeps the key, the
+      //       second is simply never shared
+      m_lookup.emplace(key.m_hash, index);
+
+      return handle(index, entry.m_generation);
+   }
+
+   void free(const handle id)
+   {
+      auto entry = find(id);
+      assert(entry);
+
+      // note: skip zero so that no live handle is ever zero
+      entry->m_resource = T{};
+      entry->m_alive = false;
+      entry->m_generation = (entry->m_generation + 1) & handle::GENERATION_MASK;
+      if (entry->m_generation == 0) {
+         entry->m_generation = 1;
+      }
+
+      auto it = m_lookup.find(entry->m_key.m_hash);
+      if (it != m_lookup.end() && it->second == id.index()) {
+         m_lookup.erase(it);
+      }
+      m_free.push_back(id.index());
+   }
+
+   slot *find(const handle id)
+   {
+      if (!id.valid() || id.index() >= m_slots.size()) {
+         return nullptr;
+      }
+
+      auto &entry = m_slots[id.index()];
+      return entry.m_alive && entry.m_generation == id.generation() ? &entry : nullptr;
+   }
+
+   const slot *find(const handle id) const
+   {
+      return const_cast<resource_pool *>(this)->find(id);
+   }
+
+   handle find_key(const resource_key &key) const
+   {
+      auto it = m_lookup.find(key.m_hash);
+      if (it == m_lookup.end()) {
+         return handle{};
+      }
+
+      const auto &entry = m_slots[it->second];
+      if (entry.m_key.m_size != key.m_size || entry.m_key.m_check != key.m_check) {
+         return handle{};
+      }
+
+      return handle(it->second, m_slots[it->second].m_generation);
+   }
+
+   std::deque<slot> m_slots;
+   std::vector<uint32> m_free;
+   std::unordered_map<uint64, uint32> m_lookup;
+};
+
+// note: owns pooled gpu resources behind generational handles. loads are
+//       deduplicated by path or content and reference counted, a
+//       resource released to zero references is destroyed DESTROY_DELAY
+//       frames later, once the gpu can no longer be using it. every load
+//       takes a reference the caller releases. pointers from get() stay
+//       valid only while a reference is held, so whatever keeps one, e.g.
+//       a material, has to let go of it before the release
+struct resource_manager {
+   static constexpr uint64 DESTROY_DELAY = 3;
+
+   resource_manager() = default;
+
+   bool create(texture_streamer *streamer);
+   void destroy();
+
+   texture_handle load_texture(const char *filename);
+   buffer_handle create_vertex_buffer(const int32 size, const void *data);
+   sampler_handle create_sampler(const sampler_filter_mode filter,
+                                 const sampler_address_mode address_u,
+                                 const sampler_address_mode address_v);
+   // note: created is set when the caller has to compile the program
+   program_handle acquire_program(const char *vertex_source,
+                                  const char *fragment_source,
+                                  bool &created);
+
+   texture *get(const texture_handle id);
+   vertex_buffer *get(const buffer_handle id);
+   shader_program *get(const program_handle id);
+   sampler_state *get(const sampler_handle id);
+
+   void add_reference(const texture_handle id);
+   void add_reference(const buffer_handle id);
+   void add_reference(const program_handle id);
+   void add_reference(const sampler_handle id);
+   void release(const texture_handle id);
+   void release(const buffer_handle id);
+   void release(const program_handle id);
+   void release(const sampler_handle id);
+
+   // note: call once per frame, after the frame has been submitted
+   void end_frame();
+
+   struct pending_destroy {
+      uint32 m_type;
+      uint32 m_handle;
+      uint64 m_frame;
+   };
+
+   texture_streamer *m_streamer{};
+   resource_pool<texture> m_textures;
+   resource_pool<vertex_buffer> m_buffers;
+   resource_pool<shader_program> m_programs;
+   resource_pool<sampler_state> m_samplers;
+   std::vector<pending_destroy> m_pending;
+   uint64 m_frame{};
+   int m_created{};
+   int m_reused{};
+};
+
+enum task_thread {
+   TASK_THREAD_WORKER,
+   TASK_THREAD_CONTEXT,
+};
+
+// note: dependency graph of one-shot work, e.g. startup. worker tasks run
+//       on the pool, context tasks on the thread calling run, which owns
+//       the graphics context. tasks behind a failed dependency are skipped
+struct task_graph {
+   struct task {
+      std::string m_name;
+      task_thread m_thread{};
+      std::function<bool()> m_work;
+      std::vector<int> m_dependencies;
+      std::vector<int> m_dependents;
+      int m_waiting{};
+      bool m_skipped{};
+      bool m_result{};
+      int64 m_start{}; // note: microseconds since run started
+      int64 m_end{};
+   };
+
+   int add(const char *name,
+           const task_thread thread,
+           std::function<bool()> work,
+           std::initializer_list<int> dependencies = {});
+   bool run(worker_pool &pool);
+   void log_timings() const;
+
+   std::vector<task> m_tasks;
+   int64 m_duration{};
+};
+
+// note: a duration in microseconds
 struct time {
    static time now();
    static time deltatime();
@@ -98,6 +560,11 @@ struct camera {
    void rotate_y(const float amount);
    void rotate_z(const float amount);
    void set_projection(const glm::mat4 &projection);
+   // note: sub-pixel offset of the projection, in pixels of a target of
+   //       the given size, moved every frame for temporal accumulation
+   void set_jitter(const glm::vec2 &offset, const int32 width, const int32 height);
+   // note: remembers the view of this frame for motion vectors
+   void end_frame();
    void bind(render_backend &backend, const shader_program &program);
 
    float m_pitch{};
@@ -109,6 +576,10 @@ struct camera {
    glm::vec3 m_position;
    glm::mat4 m_view;
    glm::mat4 m_projection;
+   glm::mat4 m_jittered_projection;
+   glm::mat4 m_previous_view;
+   glm::vec2 m_jitter{};
+   bool m_has_previous{};
 };
 
 struct controller {
@@ -128,15 +599,30 @@ struct controller {
    glm::vec2 m_mouse_position;
 };
 
+// note: how a pass wants its meshes drawn
+enum draw_flags {
+   DRAW_FLAGS_NONE = 0,
+   DRAW_FLAGS_DEPTH_PREPASSED = 1 << 0, // note: depth is in place, test less equal without writing
+   DRAW_FLAGS_OVERDRAW = 1 << 1,        // note: additive, every shaded fragment adds to the pixel
+};
+
 struct skybox {
    skybox() = default;
 
    bool valid() const;
    bool create(const char *path);
+   bool create(const char *path, texture_streamer &streamer);
    void destroy();
 
-   void draw(render_backend &backend, const camera &camera);
+   // note: at the far plane behind everything else, draw it last so
+   //       only the pixels nothing covered get shaded
+   void draw(render_backend &backend, const camera &camera, const uint32 flags = DRAW_FLAGS_NONE);
+
+private:
+   bool create_program(const std::string &base_path);
+   bool create_sampler_and_buffer();
 
+public:
    shader_program m_program;
    cubemap m_cubemap;
    sampler_state m_sampler;
@@ -145,54 +631,164 @@ struct skybox {
    int32 m_primitive_count{};
 };
 
+// note: parameters live in one flat block laid out like the uniform
+//       block named 'material' of the program. the member offsets are
+//       read back from the program when it is first bound, until then
+//       values are kept std140 packed in the order they are first set.
+//       binding copies the block into a streaming buffer and binds that
+//       range, parameters are addressed by a name hash computed at
+//       compile time
 struct material {
-   struct parameter {
-      parameter() = default;
-      parameter(uniform_type type,
-                std::string  name,
-                const glm::vec4 &data);
-      parameter(uniform_type type,
-                std::string  name,
-                const glm::mat4 &data);
+   static constexpr int32 BLOCK_BINDING = 1;
+   static constexpr int32 BLOCK_SIZE = 256;
+   static constexpr int32 PARAMETER_LIMIT = 8;
 
+   struct parameter {
+      uint64 m_id{};
       uniform_type m_type{};
-      std::string  m_name;
-      union {
-         glm::vec4 m_v4;
-         glm::mat4 m_m4;
-      } m_data;
+      int32 m_offset{};    // note: -1 when the program does not use it
    };
 
+   struct member {
+      uint64 m_id{};
+      int32 m_offset{};
+   };
+
+   static consteval uint64 parameter_id(const std::string_view name)
+   {
+      return utility::hash_fnv1a(name);
+   }
+
    material() = default;
    material(const shader_program *program, const texture *texture, const sampler_state *sampler);
 
    void set_shader_program(const shader_program *program);
    void set_texture(const texture *texture);
    void set_sampler_state(const sampler_state *sampler);
-   void set_parameter(const std::string &name, const glm::vec2 &value);
-   void set_parameter(const std::string &name, const glm::vec3 &value);
-   void set_parameter(const std::string &name, const glm::vec4 &value);
-   void set_parameter(const std::string &name, const glm::mat4 &value);
-   void bind(render_backend &backend);
+   // note: the same image as the texture, as a layer of a shared array.
+   //       only the batched path samples it
+   void set_texture_layer(const texture_array *array, const int32 layer);
+   void set_parameter(const uint64 id, const float value);
+   void set_parameter(const uint64 id, const glm::vec2 &value);
+   void set_parameter(const uint64 id, const glm::vec3 &value);
+   void set_parameter(const uint64 id, const glm::vec4 &value);
+   void set_parameter(const uint64 id, const glm::mat4 &value);
+   void bind(render_backend &backend, streaming_buffer &stream);
+   // note: streams the block again and rebinds only its range, for
+   //       draws that change parameters under an already bound material
+   void bind_parameters(render_backend &backend, streaming_buffer &stream);
 
    const shader_program *m_program{};
    const texture *m_texture{};
    const sampler_state *m_sampler{};
-   std::vector<parameter> m_parameters;
+   const texture_array *m_texture_array{};
+   int32 m_layer{};
+   uint32 m_block_program{};
+   int32 m_parameter_count{};
+   int32 m_member_count{};
+   int32 m_size{};
+   parameter m_parameters[PARAMETER_LIMIT];
+   member m_members[PARAMETER_LIMIT];
+   uint8 m_data[BLOCK_SIZE]{};
+
+private:
+   void write(const uint64 id, const uniform_type type, const void *data, const int32 size);
+   void apply_program_layout(render_backend &backend);
+   int32 find_member(const uint64 id, const int32 size) const;
+};
+
+// note: one vertex and one index buffer shared by many meshes, so 
+//       drawing them needs no rebinding. space is handed out front to 
+//       back and is never given back, indices stay relative to the 
+//       first vertex of their range (base vertex). with a position 
+//       stride the positions are kept again in a buffer of their own,
+//       at the same vertex index, for depth only passes
+struct geometry_buffer {
+   bool valid() const;
+   bool create(const int32 vertex_stride, 
+               const int32 vertex_capacity, 
+               const index_type type, 
+               const int32 index_capacity,
+               const int32 position_stride = 0);
+   void destroy();
+   // note: false when either buffer is out of space
+   bool append(const int32 vertex_count, 
+               const void *vertices, 
+               const int32 index_count, 
+               const void *indices, 
+               int32 &first_vertex, 
+               int32 &first_index,
+               const void *positions = nullptr);
+
+   vertex_buffer m_vertices;
+   vertex_buffer m_positions;
+   index_buffer m_indices;
+   index_type m_index_type{};
+   int32 m_vertex_stride{};
+   int32 m_position_stride{};
+   int32 m_vertex_capacity{};
+   int32 m_vertex_count{};
+   int32 m_index_capacity{};
+   int32 m_index_count{};
 };
 
 struct mesh {
-   static bool create_from_file(mesh &model, const char *filename);
+   // note: what every shaded fragment adds in the overdraw heatmap
+   static constexpr float OVERDRAW_STEP = 1.0f / 16.0f;
+
+   // note: a range of the index buffer placed in the model by a node
+   struct submesh {
+      int32 m_first_index{};
+      int32 m_index_count{};
+      int32 m_base_vertex{};
+      glm::mat4 m_transform{ 1.0f };
+   };
+
+   // note: with a geometry buffer the vertices and indices are appended
+   //       to it, otherwise the mesh gets buffers of its own
+   static bool create_from_file(mesh &model, const char *filename, geometry_buffer *geometry = nullptr);
+   // note: logs the import against the container load, needs no context
+   static void benchmark(const char *filename);
+   static const vertex_layout &quantized_vertex_layout();
+   // note: quantized positions alone, padded to 8 bytes
+   static const vertex_layout &quantized_position_layout();
+   static void set_draw_state(render_backend &backend, const uint32 flags);
 
    mesh(const vertex_layout *vertex_layout);
 
    bool valid() const;
    bool create(const primitive_topology topology, const int stride, const int count, const void *data);
-   void update(const int stride, const int count, const void *data);
+   bool create(const primitive_topology topology, 
+               const int stride, 
+               const int vertex_count, 
+               const void *vertices, 
+               const index_type type, 
+               const int index_count, 
+               const void *indices);
+   // note: vertices in a buffer owned elsewhere, e.g. shared between meshes
+   bool create(const primitive_topology topology, const vertex_buffer *buffer, const int count);
+   // note: dynamic data lives in the streaming buffer for the current 
+   //       frame only, call once per frame
+   void update(streaming_buffer &stream, const int stride, const int count, const void *data);
+   // note: the streamed vertices are gone with the frame, a mesh that
+   //       is not updated again draws and batches from its own buffers
+   void end_frame();
    void destroy();
 
    void set_transform(const glm::mat4 &transform);
-   void draw(render_backend &backend);
+   // note: the transform drawn last frame, for motion vectors. stored
+   //       by whatever draws the mesh, once per frame
+   const glm::mat4 &previous_transform() const;
+   void store_previous_transform();
+   // note: positions only split out of the interleaved vertices, so a 
+   //       depth only pass fetches a fraction of the vertex data
+   void set_position_stream(const vertex_buffer *buffer, const vertex_layout *layout);
+   // note: model space bounding sphere, occluder radius is a sphere
+   //       the mesh covers completely, zero when it is no occluder
+   void set_bounds(const glm::vec3 &center, const float radius, const float occluder_radius = 0.0f);
+   void world_bounds(glm::vec3 &center, float &radius, float &occluder_radius) const;
+   void draw(render_backend &backend, streaming_buffer &stream, const uint32 flags = DRAW_FLAGS_NONE);
+   void draw_depth(render_backend &backend, const shader_program &program);
 
    // note: we are cheating a bit, the model does not usually
    //       have a transform matrix. 
@@ -200,29 +796,686 @@ struct mesh {
    //       scene graph or something like that.
    glm::mat4 m_transform;
 
+   // note: maps quantized positions back into model space, 
+   //       folded into the world transform
+   glm::mat4 m_dequantize;
+   glm::mat4 m_previous_transform;
+   bool m_has_previous{};
+
    material m_material;
    vertex_buffer m_buffer;
+   const vertex_buffer *m_shared_buffer{};
+   const vertex_buffer *m_position_buffer{};
+   const vertex_layout *m_position_layout{};
+   index_buffer m_index_buffer;
+   const index_buffer *m_shared_index_buffer{};
+   index_type m_index_type{};
+   std::vector<submesh> m_submeshes;
+   const streaming_buffer *m_stream{};
+   int m_stream_first{};
+   int m_stream_count{};
    const vertex_layout *m_layout{};
    primitive_topology m_topology{};
    int m_primitive_count{};
+   glm::vec3 m_bounds_center{};
+   float m_bounds_radius{};
+   float m_occluder_radius{};
+};
+
+// note: collects the visible meshes of a pass and submits them with
+//       multi-draw indirect, one call per run of draws that share their
+//       buffers, layout, texture array and sampler. the world matrices
+//       and texture layer of every draw are per-instance data selected
+//       by the base instance, so the batch program replaces the material
+//       program. meshes without a layer, and all of them without
+//       multi-draw indirect, are drawn one by one. submit_depth lays 
+//       down depth from the position streams before submit, whichever
+//       comes first builds the commands for both
+struct draw_batch {
+   // note: per-draw data read through the base instance
+   struct instance {
+      glm::mat4 m_world;
+      glm::mat4 m_previous_world;
+      float m_layer;
+   };
+
+   bool create(const shader_program *program,
+               const shader_program *depth_program,
+               const shader_program *depth_indirect_program);
+   void begin();
+   void add(mesh &model);
+   // note: false without depth programs, nothing was drawn
+   bool submit_depth(render_backend &backend, streaming_buffer &stream);
+   void submit(render_backend &backend, streaming_buffer &stream, const uint32 flags = DRAW_FLAGS_NONE);
+
+private:
+   void prepare(streaming_buffer &stream);
+
+public:
+   const shader_program *m_program{};
+   const shader_program *m_depth_program{};
+   const shader_program *m_depth_indirect_program{};
+   vertex_layout m_instance_layout;
+   std::vector<mesh *> m_meshes;
+   std::vector<mesh *> m_unbatched;
+   std::vector<instance> m_instances;
+   std::vector<draw_arrays_command> m_array_commands;
+   std::vector<draw_elements_command> m_element_commands;
+   int32 m_instance_offset{ -1 };
+   int32 m_array_offset{ -1 };
+   int32 m_element_offset{ -1 };
+   bool m_prepared{};
+   int32 m_draw_count{};
+   int32 m_call_count{};
+   int32 m_depth_call_count{};
+};
+
+// note: cpu occlusion culling against the largest nearby bodies. the
+//       occluders are drawn as discs into a small linear depth buffer,
+//       four pixels at a time, a max pyramid is built on top and the 
+//       bounds of each body are tested against the level where they
+//       cover at most 3x3 texels. a body is culled only when every 
+//       texel is nearer than its nearest point
+struct occlusion_culler {
+   static constexpr int32 WIDTH = 256;
+   static constexpr int32 HEIGHT = 128;
+   static constexpr int32 LEVEL_COUNT = 6;
+   static constexpr int32 OCCLUDER_LIMIT = 8;
+   // note: occluders smaller than this on screen, in pixels, hide too
+   //       little to be worth drawing
+   static constexpr float MIN_OCCLUDER_SIZE = 4.0f;
+
+   struct occluder {
+      glm::vec3 m_center{};
+      float m_radius{};
+      float m_depth{};
+      float m_size{};
+   };
+
+   occlusion_culler();
+
+   void begin_frame(const camera &camera);
+   void add_occluder(const glm::vec3 &center, const float radius);
+   // note: after every occluder is added, before the first test
+   void build();
+   bool is_visible(const glm::vec3 &center, const float radius);
+   void end_frame();
+
+   glm::mat4 m_view{ 1.0f };
+   glm::mat4 m_projection{ 1.0f };
+   std::vector<occluder> m_occluders;
+   std::vector<float> m_levels[LEVEL_COUNT];
+   int64 m_start{};
+   int32 m_occluder_count{};
+   int32 m_tested{};
+   int32 m_culled{};
+   float m_time{};
+};
+
+// note: culls many static bodies on the gpu. a compute pass tests the
+//       bounding sphere of every body against the frustum and against
+//       the pyramid of the cpu culler, and appends the world matrix of
+//       each visible one through an atomic counter. that counter is the
+//       instance count of an indirect draw, so nothing is read back and
+//       the cpu cost does not grow with the body count
+struct gpu_culler {
+   static constexpr int32 GROUP_SIZE = 64;
+
+   // note: the bounding spheres are static and live on the gpu, the
+   //       world matrices move every step and are read from a range of
+   //       a streaming buffer. the worlds of the last dispatch stay on
+   //       the gpu for the velocity buffer, see cull.cs.glsl
+   bool create(const shader_program *program,
+               const int32 vertex_count,
+               const int32 body_count,
+               const glm::vec4 *spheres,
+               const glm::mat4 *worlds);
+   void destroy();
+   // note: body_count column major matrices at offset, a multiple of
+   //       storage_buffer_alignment. null to skip the bodies
+   void set_worlds(const streaming_buffer *stream, const int32 offset);
+   // note: the pyramid built this frame, null to test the frustum only
+   void set_pyramid(const occlusion_culler *occlusion);
+   void dispatch(render_backend &backend, const camera &camera);
+   // note: instance n of the draw reads its current and previous world
+   //       matrix from storage binding 1, program and vertex buffer are
+   //       set by the caller
+   void draw(render_backend &backend, const primitive_topology topology);
+
+   const shader_program *m_program{};
+   storage_buffer m_spheres;
+   storage_buffer m_previous_worlds;
+   storage_buffer m_instances;
+   storage_buffer m_command;
+   storage_buffer m_pyramid;
+   const streaming_buffer *m_worlds{};
+   int32 m_world_offset{};
+   int32 m_vertex_count{};
+   int32 m_body_count{};
+   int32 m_pyramid_levels{};
+};
+
+// note: position, rotation and scale of many bodies as structure of
+//       arrays. compose writes them out as column major 4x4 matrices with
+//       no trig and no matrix products, eight at a time with avx2 when
+//       the cpu has it and four at a time with sse otherwise. the output
+//       stride lets the matrices land inside larger records
+struct transform_batch {
+   enum stream {
+      STREAM_POSITION_X,
+      STREAM_POSITION_Y,
+      STREAM_POSITION_Z,
+      STREAM_ROTATION_X,
+      STREAM_ROTATION_Y,
+      STREAM_ROTATION_Z,
+      STREAM_ROTATION_W,
+      STREAM_SCALE,
+      STREAM_ANGULAR_VELOCITY_X,
+      STREAM_ANGULAR_VELOCITY_Y,
+      STREAM_ANGULAR_VELOCITY_Z,
+      STREAM_COUNT,
+   };
+
+   enum path {
+      PATH_SCALAR,
+      PATH_SSE,
+      PATH_AVX2,
+   };
+
+   bool create(const int32 capacity);
+   void destroy();
+   // note: rotation is a unit quaternion (x, y, z, w), the angular 
+   //       velocity is in radians per second around the world axes.
+   //       index of the new body, -1 when the batch is full
+   int32 add(const glm::vec3 &position,
+             const glm::vec4 &rotation,
+             const float scale,
+             const glm::vec3 &angular_velocity);
+   // note: 32 byte aligned and padded to a multiple of eight
+   float *get(const stream which);
+   const float *get(const stream which) const;
+   // note: advances every rotation by its angular velocity
+   void integrate(const float deltatime);
+   void compose(void *output, const int32 stride) const;
+   void compose(void *output, const int32 stride, const path which) const;
+
+   static bool is_avx2_supported();
+   // note: every path against glm at 1k, 100k and 1m bodies, logged
+   static void benchmark();
+
+   std::vector<float> m_streams[STREAM_COUNT];
+   int32 m_capacity{};
+   int32 m_count{};
+   path m_path{ PATH_SSE };
+};
+
+// note: fixed capacity pool of particles as structure of arrays, with
+//       the live ones packed at the front. allocation takes the slot
+//       after the last live one and release moves the last live one
+//       into the freed slot, so both are constant time and the live
+//       range can be integrated four particles at a time
+struct particle_pool {
+   enum stream {
+      STREAM_POSITION_X,
+      STREAM_POSITION_Y,
+      STREAM_POSITION_Z,
+      STREAM_VELOCITY_X,
+      STREAM_VELOCITY_Y,
+      STREAM_VELOCITY_Z,
+      STREAM_AGE,
+      STREAM_LIFETIME,
+      STREAM_EMITTER,
+      STREAM_COUNT,
+   };
+
+   bool create(const int32 capacity);
+   void destroy();
+   // note: index of the new particle, -1 when the pool is full
+   int32 allocate();
+   void release(const int32 index);
+   float *get(const stream which);
+
+   // note: every stream is padded to a multiple of four
+   std::vector<float> m_streams[STREAM_COUNT];
+   int32 m_capacity{};
+   int32 m_count{};
+};
+
+// note: comet tails and solar wind. the state of every particle lives in
+//       two vertex buffers, an update pass reads one and writes the other
+//       with transform feedback, so the cpu cost does not depend on the
+//       particle count. a dead particle respawns in its emitter, each 
+//       emitter owning a fixed share of the slots. the cpu path keeps 
+//       fewer particles in a pool, integrated with sse and streamed to
+//       the gpu every frame. both are drawn as additive point sprites,
+//       which need no sorting
+struct particle_system {
+   static constexpr int32 EMITTER_LIMIT = 4;
+   // note: streamed every frame, so it has to fit the stream segment
+   static constexpr int32 CPU_CAPACITY = 16 * 1024;
+
+   struct emitter {
+      glm::vec3 m_position{};
+      // note: particles spawn on a sphere of this radius
+      float m_radius{};
+      glm::vec3 m_velocity{};
+      // note: spawn speed away from the center
+      float m_speed{};
+      glm::vec4 m_color{ 1.0f };
+      float m_lifetime{ 1.0f };
+   };
+
+   // note: vertex layout of the particle buffers and of the captured
+   //       outputs, see particle_update.vs.glsl
+   struct particle {
+      glm::vec4 m_position; // note: w is the age
+      glm::vec4 m_velocity; // note: w is the lifetime
+      float m_emitter;
+   };
+
+   // note: the cpu path is used without an update program
+   bool create(const shader_program *update_program, const int32 capacity);
+   void destroy();
+   int32 add_emitter(const emitter &source);
+   void set_gpu(const bool enabled);
+   // note: integrates the cpu path, the gpu path only keeps the time
+   //       for the next update pass
+   void simulate(const float deltatime);
+   void draw(render_backend &backend, streaming_buffer &stream, const shader_program &program);
+   int32 live_count() const;
+
+private:
+   void update_gpu(render_backend &backend);
+   void emit_cpu(const float deltatime);
+   void integrate_cpu(const float deltatime);
+
+public:
+   const shader_program *m_update_program{};
+   vertex_buffer m_buffers[2];
+   vertex_layout m_layout;
+   particle_pool m_pool;
+   std::vector<particle> m_staging;
+   emitter m_emitters[EMITTER_LIMIT];
+   float m_emit_accumulator[EMITTER_LIMIT]{};
+   glm::vec3 m_sun{};
+   float m_wind{};
+   float m_point_size{ 1.0f };
+   float m_pending_time{};
+   int32 m_emitter_count{};
+   int32 m_capacity{};
+   int32 m_current{};
+   uint32 m_seed{ 1u };
+   bool m_gpu{};
+   // note: milliseconds spent on the cpu path last frame
+   float m_cpu_time{};
+};
+
+// note: holds the frame within budget by scaling the resolution of the
+//       world render target between min and max scale of the base size.
+//       gpu frame time comes from timer queries, cpu frame time tells 
+//       whether there is room to scale up. the target size is rounded up
+//       to a bucket and the viewport covers the scaled part, so most 
+//       scale changes do not need another render target
+struct dynamic_resolution {
+   bool create(const int32 width,
+               const int32 height,
+               const float min_scale,
+               const float max_scale,
+               const float budget_ms);
+   void destroy();
+   // note: brackets the whole frame, end before swapping buffers
+   void begin_frame();
+   void end_frame();
+   // note: size of the render target to draw into, a bucket
+   int32 target_width() const;
+   int32 target_height() const;
+   // note: the scaled viewport within the target
+   void set_viewport(render_backend &backend) const;
+   glm::vec2 texcoord_scale() const;
+
+   int32 m_base_width{};
+   int32 m_base_height{};
+   float m_min_scale{};
+   float m_max_scale{};
+   float m_budget{};
+   float m_scale{ 1.0f };
+   int32 m_width{};
+   int32 m_height{};
+   // note: smoothed, they only steer the scale
+   float m_gpu_time{};
+   float m_cpu_time{};
+   // note: unsmoothed, the cpu time of the frame that just ended and
+   //       the timer queries that finished during it, older frames
+   float m_frame_cpu_time{};
+   float m_resolved_gpu_times[gpu_timer::QUERY_LIMIT]{};
+   int32 m_resolved_count{};
+   int64 m_frame{};
+   int64 m_frame_start{};
+   int64 m_next_change{};
+   gpu_timer m_timer;
+};
+
+// note: accumulates the jittered low resolution world target into a
+//       history at output resolution. the camera jitter walks a halton
+//       sequence, the history is reprojected with the motion vectors and
+//       clamped to the current neighbourhood against ghosting
+struct temporal_upscaler {
+   static constexpr int32 JITTER_PHASES = 8;
+
+   bool create(const shader_program *program,
+               const vertex_buffer *quad,
+               const vertex_layout *layout,
+               const sampler_state *nearest,
+               const sampler_state *linear);
+   void destroy();
+   // note: jitter for the coming frame, in pixels of the world target
+   glm::vec2 next_jitter();
+   // note: forget the history, e.g. after a camera cut
+   void reset();
+   // note: the history to resolve into this frame, resized to the
+   //       output when needed, bind it before resolve
+   framebuffer &next_history(const int32 width, const int32 height);
+   void resolve(render_backend &backend,
+                const texture &color,
+                const texture &velocity,
+                const glm::vec2 &source_size);
+   texture output() const;
+
+   const shader_program *m_program{};
+   const vertex_buffer *m_quad{};
+   const vertex_layout *m_layout{};
+   const sampler_state *m_nearest{};
+   const sampler_state *m_linear{};
+   framebuffer m_history[2];
+   int32 m_current{};
+   uint32 m_frame{};
+   glm::vec2 m_jitter{};
+   float m_blend{ 0.1f };
+   bool m_history_valid{};
+};
+
+// note: the passes of a frame, declared with the targets they read and
+//       write, then compiled and executed in order. passes whose output
+//       is never used are culled, transient targets with the same size
+//       and formats share a framebuffer when their lifetimes do not
+//       overlap, clears of outputs a pass covers completely are dropped
+//       and attachments are invalidated after their last use
+struct render_graph {
+   // note: -1 is the backbuffer
+   using target_id = int32;
+   static constexpr target_id BACKBUFFER = -1;
+   static constexpr int64 TARGET_LIFETIME = 300;
+
+   struct target_desc {
+      int32 m_width{};
+      int32 m_height{};
+      int32 m_format_count{};
+      framebuffer_format m_formats[framebuffer::ATTACHMENT_LIMIT]{};
+   };
+
+   struct target {
+      const char *m_name{};
+      target_desc m_desc;
+      framebuffer *m_imported{};
+      int32 m_physical{ -1 };
+      int32 m_first_use{ -1 };
+      int32 m_last_use{ -1 };
+      int32 m_last_depth_use{ -1 };
+   };
+
+   struct pass {
+      const char *m_name{};
+      target_id m_output{ BACKBUFFER };
+      arena_vector<target_id> m_inputs;
+      std::function<void(render_backend &)> m_execute;
+      glm::vec4 m_clear_color{ 0.0f };
+      bool m_clear{};
+      bool m_covers_output{};
+      bool m_uses_depth{};
+      bool m_culled{};
+   };
+
+   struct physical {
+      framebuffer m_framebuffer;
+      target_desc m_desc;
+      int64 m_last_frame{};
+      int32 m_busy_until{ -1 };
+   };
+
+   void destroy();
+   // note: drops the passes and targets of the previous frame, what the
+   //       graph needs for this frame comes from the arena
+   void begin_frame(const int32 width, const int32 height, linear_arena &arena);
+   // note: transient, allocated from the pool for this frame only
+   target_id create_target(const char *name, const target_desc &desc);
+   // note: persistent, owned outside the graph and never invalidated
+   target_id import_target(const char *name, framebuffer &handle);
+   int32 add_pass(const char *name,
+                  const target_id output,
+                  std::initializer_list<target_id> inputs,
+                  std::function<void(render_backend &)> execute);
+   // note: clear the output before the pass, depth always when the
+   //       pass uses depth, color unless the pass covers every pixel
+   void set_clear(const int32 pass_index, const glm::vec4 &color, const bool covers_output, const bool uses_depth);
+   void compile();
+   void execute(render_backend &backend);
+   // note: valid between compile and the end of the frame
+   const framebuffer &get(const target_id id) const;
+   texture get_texture(const target_id id, const int32 attachment) const;
+
+   int32 m_width{};
+   int32 m_height{};
+   int64 m_frame{};
+   linear_arena *m_arena{};
+   std::vector<target> m_targets;
+   std::vector<pass> m_passes;
+   std::deque<physical> m_pool;
+   int32 m_culled_count{};
+   int32 m_physical_count{};
+   int32 m_elided_clears{};
+   int32 m_invalidations{};
+};
+
+// note: per frame counters and rolling timings. counters collect during
+//       a frame and end_frame moves them over to what is shown. timings
+//       go into log-linear histograms, in the manner of hdr histograms:
+//       every power of two is split in SUB_BUCKETS / 2 linear steps, so
+//       a percentile is off by at most 2 / SUB_BUCKETS of its value at
+//       any magnitude. only the last WINDOW_SIZE samples count, the
+//       oldest one leaves its bucket when a new one comes in
+struct metrics {
+   static constexpr int32 GRAPH_SIZE = 120;
+
+   enum counter {
+      COUNTER_DRAW_CALLS,
+      COUNTER_DISPATCHES,
+      COUNTER_STATE_CHANGES,
+      COUNTER_UNIFORM_UPLOADS,
+      COUNTER_TEXTURE_BINDS,
+      COUNTER_UPLOAD_BYTES,
+      COUNTER_BODIES_UPDATED,
+      COUNTER_BODIES_CULLED,
+      COUNTER_BODIES_VISIBLE,
+      COUNTER_COUNT,
+   };
+
+   // note: microseconds
+   enum timing {
+      TIMING_FRAME,
+      TIMING_CPU,
+      TIMING_GPU,
+      TIMING_SIMULATION,
+      TIMING_COUNT,
+   };
+
+   struct histogram {
+      static constexpr int32 SUB_BUCKET_BITS = 5;
+      static constexpr int32 SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+      // note: values are clamped below 2^30us, about 18 minutes
+      static constexpr int32 VALUE_BITS = 30;
+      static constexpr int32 BUCKET_COUNT = (VALUE_BITS - SUB_BUCKET_BITS + 2) * (SUB_BUCKETS / 2);
+      static constexpr int32 WINDOW_SIZE = 600;
+
+      void record(const int64 value);
+      // note: the highest value of the bucket the percentile falls in, 
+      //       zero before the first sample
+      int64 percentile(const float percent) const;
+      // note: exact, the largest sample in the window
+      int64 highest() const;
+
+      int32 m_counts[BUCKET_COUNT]{};
+      int64 m_window[WINDOW_SIZE]{};
+      int32 m_window_index{};
+      int32 m_sample_count{};
+   };
+
+   static const char *name(const counter index);
+   static const char *name(const timing index);
+
+   void add(const counter index, const int64 value);
+   void record(const timing index, const int64 microseconds);
+   void end_frame();
+   // note: the frame times of the graph, oldest first
+   int32 graph(float *milliseconds, const int32 capacity) const;
+   bool write_json(const char *filename) const;
+
+   int64 m_counters[COUNTER_COUNT]{};
+   int64 m_last[COUNTER_COUNT]{};
+   histogram m_timings[TIMING_COUNT];
+   float m_graph[GRAPH_SIZE]{};
+   int32 m_graph_index{};
+   int32 m_graph_count{};
+   int64 m_frame_count{};
 };
 
 struct debug_overlay {
+   static constexpr int32 GRAPH_HEIGHT = 64;
+   static constexpr int32 GRAPH_BAR_WIDTH = 2;
+   // note: the bars and the budget line share one byte of width
+   static constexpr int32 GRAPH_BAR_LIMIT = 255 / GRAPH_BAR_WIDTH;
+   // note: reserved up front so that no frame allocates, lines past
+   //       the limit are dropped and glyphs past it are cut off
+   static constexpr int32 LINE_LIMIT = 48;
+   static constexpr int32 LINE_GLYPH_LIMIT = 192;
+
+   // note: one instance per glyph, the quad is expanded in the vertex shader.
+   //       with a width it is a solid bar of that many pixels instead,
+   //       the character picks its color
+   struct glyph {
+      uint16 m_x;
+      uint16 m_y;
+      uint8 m_character;
+      uint8 m_scale;
+      uint8 m_width;
+      uint8 m_height;
+   };
+
+   enum bar_color {
+      BAR_COLOR_NORMAL,
+      BAR_COLOR_OVER_BUDGET,
+      BAR_COLOR_BUDGET,
+   };
+
+   struct cached_line {
+      std::string_view m_text;
+      int m_y{ -1 };
+      std::vector<glyph> m_glyphs;
+   };
+
    debug_overlay(shader_program *program, 
                  texture *texture, 
                  sampler_state *sampler, 
-                 vertex_layout *layout);
+                 streaming_buffer *stream);
 
    void push_line(const char *format, ...);
-   void pre_frame(const int width, const int height);
+   // note: bars below the lines, in milliseconds. the budget is drawn
+   //       halfway up the graph and bars above it stand out
+   void push_graph(const float *milliseconds, const int32 count, const float budget);
+   // note: the lines live in the arena, which must keep them intact
+   //       through the next frame for the line cache to compare against
+   void pre_frame(const int width, const int height, linear_arena &arena);
+   // note: lays out the lines and the bars, needs no context
+   void build();
    void draw(render_backend &backend);
 
    glm::mat4 m_projection;
    material m_material;
-   vertex_layout *m_layout{};
-   vertex_buffer m_buffer;
-   int m_vertex_count{};
-   std::vector<std::string> m_lines;
+   vertex_layout m_layout;
+   streaming_buffer *m_stream{};
+   linear_arena *m_arena{};
+   std::vector<std::string_view> m_lines;
+   const float *m_graph{};
+   int32 m_graph_count{};
+   float m_graph_budget{};
+   std::vector<cached_line> m_cache;
+   int32 m_cache_count{};
+   // note: the text run, concatenated again only when a line changed
+   std::vector<glyph> m_glyphs;
+   bool m_glyphs_changed{};
+   std::vector<glyph> m_bars;
+};
+
+// note: paces frames and measures how evenly they reach the screen.
+//       begin_frame runs before input is sampled. it can wait for the gpu
+//       to finish the previous frame, so the cpu never queues frames
+//       ahead on stale input, then holds the frame rate cap by sleeping
+//       most of the remaining time and spinning the rest. the end of each
+//       frame is fenced, and the time from the oldest input event in a 
+//       frame to its fence signaling is the input latency
+struct frame_pacer {
+   static constexpr int32 HISTORY_SIZE = 128;
+   static constexpr int32 FRAME_LIMIT = 4;
+
+   struct frame {
+      gpu_fence m_fence;
+      int64 m_input_time{};
+   };
+
+   bool create();
+   void destroy();
+   // note: frames per second, zero for no cap
+   void set_frame_limit(const int32 frames_per_second);
+   // note: the oldest input that went into the next frame
+   void on_input(const int64 input_time);
+   void begin_frame();
+   // note: after the swap
+   void end_frame();
+
+private:
+   void resolve(const int64 now);
+
+public:
+   frame m_frames[FRAME_LIMIT];
+   int32 m_frame_index{};
+   int32 m_frame_limit{};
+   bool m_fence_wait{};
+   // note: off where precision matters less than the cpu time, the 
+   //       whole wait is slept then
+   bool m_spin{ true };
+   int64 m_next_frame{};
+   int64 m_pending_input{};
+   int64 m_last_present{};
+   int64 m_history[HISTORY_SIZE]{};
+   int32 m_history_count{};
+   int32 m_history_index{};
+   // note: milliseconds, over the history
+   float m_frame_average{};
+   float m_frame_min{};
+   float m_frame_max{};
+   float m_frame_deviation{};
+   // note: milliseconds, the last frame
+   float m_wait_time{};
+   float m_latency{};
+   float m_latency_average{};
+};
+
+enum present_mode {
+   PRESENT_MODE_IMMEDIATE,
+   PRESENT_MODE_VSYNC,
+   // note: waits for vsync when on time, tears instead of waiting
+   //       a whole refresh when late
+   PRESENT_MODE_ADAPTIVE,
+   PRESENT_MODE_COUNT,
 };
 
 struct GLFWwindow;
@@ -233,35 +1486,171 @@ struct render_context {
    bool valid() const;
    bool poll_events();
    void swap_buffers();
+   // note: adaptive falls back to vsync without swap control tear
+   void set_present_mode(const present_mode mode);
 
    GLFWwindow *m_window{};
+   present_mode m_present_mode{ PRESENT_MODE_VSYNC };
+};
+
+enum input_event_kind {
+   INPUT_EVENT_KIND_KEY,
+   INPUT_EVENT_KIND_MOVE,
+   INPUT_EVENT_KIND_BUTTON,
+   // note: asks the consumer to stop
+   INPUT_EVENT_KIND_QUIT,
+};
+
+struct input_event {
+   input_event_kind m_kind{};
+   int32 m_index{};
+   int32 m_x{};
+   int32 m_y{};
+   bool m_state{};
+   // note: microseconds, when the window system delivered it
+   int64 m_time{};
+};
+
+// note: single producer single consumer ring of input events, from 
+//       the window thread to the simulation. neither side blocks, push
+//       fails when the ring is full
+struct input_queue {
+   static constexpr int32 CAPACITY = 256;
+   struct state;
+
+   input_queue() = default;
+   input_queue(const input_queue &) = delete;
+   input_queue &operator=(const input_queue &) = delete;
+   ~input_queue();
+
+   bool create();
+   void destroy();
+   bool push(const input_event &event);
+   bool pop(input_event &event);
+
+   state *m_state{};
+   input_event m_events[CAPACITY];
+};
+
+// note: toggled by the simulation, applied by the renderer
+struct render_settings {
+   bool m_temporal{ true };
+   bool m_prepass{ true };
+   bool m_overdraw{};
+   bool m_occlusion_culling{ true };
+   bool m_gpu_culling{ true };
+   bool m_gpu_particles{ true };
+   bool m_fence_wait{};
+   present_mode m_present_mode{ PRESENT_MODE_VSYNC };
+   int32 m_frame_limit{};
+   // note: bumped for every metrics dump asked for
+   int32 m_metrics_dump{};
+};
+
+// note: everything the renderer takes from one simulation step. fixed
+//       size or sized once in create, so publishing one never allocates
+struct frame_snapshot {
+   static constexpr int32 BODY_LIMIT = 16;
+   static constexpr int32 TEXT_LIMIT = 512;
+
+   void clear_text();
+   void push_text(const char *format, ...);
+
+   glm::mat4 m_transforms[BODY_LIMIT];
+   int32 m_body_count{};
+   glm::mat4 m_view{ 1.0f };
+   glm::vec3 m_camera_position{};
+   glm::vec3 m_comet_position{};
+   render_settings m_settings;
+   int64 m_sequence{};
+   // note: the oldest input event this step consumed, zero for none
+   int64 m_input_time{};
+   bool m_quit{};
+   // note: milliseconds, the step before this one
+   float m_step_time{};
+   // note: overlay lines, separated by newlines
+   char m_text[TEXT_LIMIT]{};
+   int32 m_text_size{};
+   // note: the asteroid belt composed by the step, zero bodies when
+   //       the gpu path is off. milliseconds to integrate and compose
+   std::vector<glm::mat4> m_belt;
+   int32 m_belt_count{};
+   float m_belt_time{};
+};
+
+// note: lock free triple buffer. the writer fills its own slot and
+//       swaps it with the shared middle slot on publish, the reader 
+//       swaps its slot with the middle one when that holds something
+//       newer. neither side waits and the reader always holds the 
+//       latest complete snapshot
+struct snapshot_buffer {
+   struct state;
+
+   snapshot_buffer() = default;
+   snapshot_buffer(const snapshot_buffer &) = delete;
+   snapshot_buffer &operator=(const snapshot_buffer &) = delete;
+   ~snapshot_buffer();
+
+   // note: every slot holds up to belt_capacity belt matrices
+   bool create(const int32 belt_capacity);
+   void destroy();
+   frame_snapshot &write_slot();
+   void publish();
+   // note: true when a newer snapshot was taken over
+   bool acquire();
+   const frame_snapshot &read_slot() const;
+
+   state *m_state{};
+   frame_snapshot m_slots[3];
+   int32 m_write{ 0 };
+   int32 m_read{ 1 };
 };
 
 struct application {
    application(const char *title, int width, int height);
 
-   void run();
+   // note: frame_limit 0 runs until the window closes. false when 
+   //       creation failed or, in debug builds, when a frame past the
+   //       warmup touched the heap
+   bool run(const int64 frame_limit = 0);
 
    void on_key(int key, bool state);
    void on_mouse(int x, int y);
    void on_button(int button, bool state);
 
 private:
-   void tick(const time &dt);
+   // note: the simulation thread, steps at a fixed rate until told to quit
+   void simulate();
+   // note: false when told to quit
+   bool step_simulation();
+   void tick(const time &dt, frame_snapshot &snapshot);
+   void apply_snapshot(const frame_snapshot &snapshot, const float deltatime);
+   void update_debug_text(const frame_snapshot &snapshot, const float deltatime);
+   void update_metrics(const float deltatime, const bool stepped);
    void draw();
 
    bool create_resources();
    bool create_framebuffers();
+   bool load_shader_sources();
    bool create_shaders();
+   bool load_font();
    bool create_textures();
+   void update_planet_layers();
    bool create_samplers();
    bool create_buffers();
    bool create_layouts();
    bool create_skybox();
    bool create_models();
+   bool create_asteroids();
+   void update_asteroids(const frame_snapshot &snapshot);
+   bool create_particles();
    bool create_misc();
+   void destroy_resources();
 
    void draw_world_render_pass();
+   void draw_occlusion_culled();
+   void draw_asteroids(const uint32 flags);
+   void draw_temporal_render_pass();
    void draw_framebuffer_render_pass();
    void draw_debug_text_render_pass();
    void post_frame();
@@ -270,38 +1659,80 @@ private:
    glm::vec3 orbit(glm::vec3 thisPlanet, glm::vec3 otherPlanet, float rotSpeed, const time& dt, float radius, float &angle);
    
 private:
+   // note: staged by worker tasks during startup
+   struct shader_source {
+      shader_program *m_program{};
+      const char *m_vertex_filename{};
+      const char *m_fragment_filename{};
+      bool m_needs_compute{};
+      std::string m_vertex;
+      std::string m_fragment;
+   };
+
    bool m_running{};
    int m_width{};
    int m_height{};
-   mouse m_mouse;
-   keyboard m_keyboard;
    render_context m_context;
    render_backend m_backend;
 
-   framebuffer m_rendertarget;
+   dynamic_resolution m_resolution;
+   temporal_upscaler m_upscaler;
+   render_settings m_settings;
+   render_graph m_graph;
+   render_graph::target_id m_world_target{ render_graph::BACKBUFFER };
+   render_graph::target_id m_history_target{ render_graph::BACKBUFFER };
    shader_program m_program_world;
+   shader_program m_program_world_indirect;
+   shader_program m_program_depth;
+   shader_program m_program_depth_indirect;
+   shader_program m_program_world_gpu;
+   shader_program m_program_cull;
+   std::string m_cull_source;
+   shader_program m_program_particle;
+   shader_program m_program_particle_update;
+   std::string m_particle_update_source;
    shader_program m_program_final;
+   shader_program m_program_taa;
    shader_program m_program_font;
+   shader_cache m_shader_cache;
+   std::vector<shader_source> m_shader_sources;
+   image_data m_font_image;
    texture m_texture_font;
-   texture m_texture_sun;
-   texture m_texture_mercury;
-   texture m_texture_venus;
-   texture m_texture_earth;
-   texture m_texture_moon;
-   texture m_texture_mars;
-   texture m_texture_jupiter;
-   texture m_texture_saturn;
-   texture m_texture_uranus;
-   texture m_texture_neptune;
+   texture_handle m_texture_sun;
+   texture_handle m_texture_mercury;
+   texture_handle m_texture_venus;
+   texture_handle m_texture_earth;
+   texture_handle m_texture_moon;
+   texture_handle m_texture_mars;
+   texture_handle m_texture_jupiter;
+   texture_handle m_texture_saturn;
+   texture_handle m_texture_uranus;
+   texture_handle m_texture_neptune;
+   texture_handle m_texture_avocado;
+
+   // note: the planet textures again, one layer each, so the batch draws
+   //       every planet in one call. a bit per layer that is filled
+   static constexpr int32 PLANET_LAYER_COUNT = 10;
+   texture_array m_planet_textures;
+   bool m_planet_textures_baked{};
+   uint32 m_planet_layers{};
    sampler_state m_sampler_nearest;
    sampler_state m_sampler_linear;
+   sampler_handle m_sampler_trilinear;
+   streaming_buffer m_stream;
+   worker_pool m_workers;
+   texture_streamer m_streamer;
+   resource_manager m_resources;
+   buffer_handle m_buffer_cube;
    vertex_buffer m_buffer_screen_quad;
+   vertex_buffer m_buffer_cube_positions;
+   geometry_buffer m_geometry;
    vertex_layout m_layout_3d;
+   vertex_layout m_layout_position;
    vertex_layout m_layout_2d;
 
    debug_overlay m_overlay;
    camera m_camera;
-   controller m_controller;
    skybox m_skybox;
 
    mesh m_sun;
@@ -314,7 +1745,46 @@ private:
    mesh m_saturn;
    mesh m_uranus;
    mesh m_neptune;
+   mesh m_avocado;
    std::vector<mesh *> m_meshes;
+   draw_batch m_batch;
+   occlusion_culler m_occlusion;
+   gpu_culler m_asteroids;
+   streaming_buffer m_belt_stream;
+   frame_pacer m_pacer;
+   particle_system m_particles;
+   int32 m_comet_emitter{ -1 };
+   int64 m_last_frame{};
+
+   // note: transient memory, reset every other frame
+   static constexpr int64 FRAME_MEMORY_SIZE = 256 * 1024;
+   static constexpr int64 WARMUP_FRAMES = 120;
+   double_buffered_arena m_frame_memory;
+   int64 m_frame_count{};
+   int64 m_frame_allocations{};
+   int64 m_allocating_frames{};
+   metrics m_metrics;
+
+   // note: handed from the window thread to the simulation and from
+   //       the simulation back to the renderer
+   input_queue m_input;
+   snapshot_buffer m_snapshots;
+
+   // note: owned by the simulation thread
+   static constexpr int32 SIMULATION_RATE = 240;
+   worker_pool m_simulation;
+   frame_pacer m_simulation_pacer;
+   mouse m_mouse;
+   keyboard m_keyboard;
+   camera m_simulation_camera;
+   controller m_controller;
+   render_settings m_simulation_settings;
+   int64 m_sequence{};
+   float m_tick_time{};
+   bool m_quit{};
+   float m_comet_angle{};
+   transform_batch m_planets;
+   transform_batch m_belt;
 
    float m_cube_rotation{};
    glm::vec3 m_sun_position{};
@@ -5,6 +5,7 @@
 #include <GLFW/glfw3.h> // keycodes, ...
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 struct vertex2d
 {
@@ -23,8 +24,8 @@ application::application(const char* title, int width, int height)
     , m_height(height)
     , m_context(title, width, height, this)
     , m_camera(glm::perspective(3.1415926f * 0.25f, float(width) / float(height), 1.0f, 1000.0f))
-    , m_controller(m_camera)
-    , m_overlay(&m_program_font, &m_texture_font, &m_sampler_nearest, &m_layout_2d)
+    , m_controller(m_simulation_camera)
+    , m_overlay(&m_program_font, &m_texture_font, &m_sampler_linear, &m_stream)
     , m_sun(&m_layout_3d)
     , m_mercury(&m_layout_3d)
     , m_venus(&m_layout_3d)
@@ -35,6 +36,7 @@ application::application(const char* title, int width, int height)
     , m_saturn(&m_layout_3d)
     , m_uranus(&m_layout_3d)
     , m_neptune(&m_layout_3d)
+    , m_avocado(&m_layout_3d)
     , m_sun_position(0.0f, 0.0f, 0.0f)
     , m_mercury_position(0.0f, 0.0f, -20.0f)
     , m_venus_position(0.0f, 0.0f, -30.0f)
@@ -85,45 +87,193 @@ glm::vec3 application::orbit(glm::vec3 thisPlanet, glm::vec3 otherPlanet, float
     return glm::vec3(x, thisPlanet.y, z);
 }
 
-void application::run()
+bool application::run(const int64 frame_limit)
 {
    m_running = m_context.valid();
    if (!m_running) {
       debug::log("could not initialize context!");
-      return;
+      return false;
    }
 
    if (!create_resources()) {
-      return;
+      return false;
+   }
+
+   if (!m_frame_memory.create(FRAME_MEMORY_SIZE)) {
+      debug::log("could not create frame memory!");
+      return false;
    }
 
-   while (m_running && m_context.poll_events()) {
-      tick(time::deltatime());
+   // note: one step before the thread starts, so the first frame has
+   //       a snapshot to draw
+   m_input.create();
+   m_snapshots.create(m_belt.m_count);
+   // note: the sun and the nine that circle it, each step writes their
+   //       positions and rotation. the sun is five times the size
+   const float planet_scales[] = { 5.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+   m_planets.create(frame_snapshot::BODY_LIMIT);
+   for (const float scale : planet_scales) {
+      m_planets.add(glm::vec3(0.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), scale, glm::vec3(0.0f));
+   }
+   m_simulation_pacer.create();
+   m_simulation_pacer.m_spin = false;
+   m_simulation_pacer.set_frame_limit(SIMULATION_RATE);
+   step_simulation();
+   if (!m_simulation.create(1)) {
+      debug::log("could not create simulation thread!");
+      return false;
+   }
+   m_simulation.submit([this]() { simulate(); });
+
+   m_pacer.create();
+   m_last_frame = utility::get_current_microseconds();
+   while (m_running) {
+      // note: paced before the events are polled, so the frame starts
+      //       with the freshest input
+      m_pacer.begin_frame();
+      if (!m_context.poll_events()) {
+         break;
+      }
+
+      const int64 now = utility::get_current_microseconds();
+      const float deltatime = float(now - m_last_frame) / 1000000.0f;
+      m_last_frame = now;
+      const int64 allocations = debug::allocation_count();
+      m_frame_memory.swap();
+
+      // note: the latest snapshot is drawn until a newer one arrives,
+      //       its input counts against the first frame that shows it
+      const bool stepped = m_snapshots.acquire();
+      if (stepped && m_snapshots.read_slot().m_input_time > 0) {
+         m_pacer.on_input(m_snapshots.read_slot().m_input_time);
+      }
+      const frame_snapshot &snapshot = m_snapshots.read_slot();
+      apply_snapshot(snapshot, deltatime);
+
+      m_resolution.begin_frame();
+      update_debug_text(snapshot, deltatime);
       draw();
+      m_pacer.end_frame();
+      update_metrics(deltatime, stepped);
+
+      // note: past the first frames a frame should not touch the heap,
+      //       debug builds count allocations and fail the run when one does
+      const int64 frame_allocations = debug::allocation_count() - allocations;
+      if (frame_allocations > 0 && m_frame_count > WARMUP_FRAMES) {
+         if (m_frame_allocations == 0) {
+            debug::log("frame %lld made %lld heap allocations", m_frame_count, frame_allocations);
+         }
+         m_allocating_frames++;
+      }
+      m_frame_allocations = frame_allocations;
+      m_frame_count++;
+      if (frame_limit > 0 && m_frame_count >= frame_limit) {
+         m_running = false;
+      }
 
       post_frame();
    }
+   m_pacer.destroy();
+
+   // note: the quit event has to get through, the simulation drains
+   //       the queue every step
+   input_event quit;
+   quit.m_kind = INPUT_EVENT_KIND_QUIT;
+   while (!m_input.push(quit)) {
+   }
+   m_simulation.destroy();
+   m_simulation_pacer.destroy();
+
+   destroy_resources();
+
+   if (m_allocating_frames > 0) {
+      debug::log("%lld frames past the warmup made heap allocations", m_allocating_frames);
+      return false;
+   }
+
+   return true;
 }
 
+// note: window thread, input only crosses over to the simulation
 void application::on_key(int key, bool state)
 {
-   m_keyboard.on_key(key, state);
+   input_event event;
+   event.m_kind = INPUT_EVENT_KIND_KEY;
+   event.m_index = key;
+   event.m_state = state;
+   event.m_time = utility::get_current_microseconds();
+   m_input.push(event);
 }
 
 void application::on_mouse(int x, int y)
 {
-   m_mouse.on_move(x, y);
+   input_event event;
+   event.m_kind = INPUT_EVENT_KIND_MOVE;
+   event.m_x = x;
+   event.m_y = y;
+   event.m_time = utility::get_current_microseconds();
+   m_input.push(event);
 }
 
 void application::on_button(int button, bool state)
 {
-   m_mouse.on_button(button, state);
+   input_event event;
+   event.m_kind = INPUT_EVENT_KIND_BUTTON;
+   event.m_index = button;
+   event.m_state = state;
+   event.m_time = utility::get_current_microseconds();
+   m_input.push(event);
 }
 
-void application::tick(const time &dt)
+void application::tick(const time &dt, frame_snapshot &snapshot)
 {
+   auto &settings = m_simulation_settings;
    if (m_keyboard.key_released(GLFW_KEY_ESCAPE)) {
-      m_running = false;
+      m_quit = true;
+   }
+
+   // note: compare the temporal upscaler against the plain upscale
+   if (m_keyboard.key_released(GLFW_KEY_T)) {
+      settings.m_temporal = !settings.m_temporal;
+   }
+
+   // note: depth prepass and the overdraw heatmap, to see what the 
+   //       prepass saves in shaded fragments
+   if (m_keyboard.key_released(GLFW_KEY_P)) {
+      settings.m_prepass = !settings.m_prepass;
+   }
+   if (m_keyboard.key_released(GLFW_KEY_C)) {
+      settings.m_occlusion_culling = !settings.m_occlusion_culling;
+   }
+   if (m_keyboard.key_released(GLFW_KEY_G)) {
+      settings.m_gpu_culling = !settings.m_gpu_culling;
+   }
+   // note: frame pacing, cycles through the present modes and caps
+   if (m_keyboard.key_released(GLFW_KEY_V)) {
+      settings.m_present_mode = present_mode((settings.m_present_mode + 1) % PRESENT_MODE_COUNT);
+   }
+   if (m_keyboard.key_released(GLFW_KEY_F)) {
+      const int32 limits[] = { 0, 30, 60, 120, 144 };
+      const int32 count = int32(sizeof(limits) / sizeof(limits[0]));
+      int32 next = 0;
+      for (int32 index = 0; index < count; index++) {
+         if (limits[index] == settings.m_frame_limit) {
+            next = (index + 1) % count;
+         }
+      }
+      settings.m_frame_limit = limits[next];
+   }
+   if (m_keyboard.key_released(GLFW_KEY_L)) {
+      settings.m_fence_wait = !settings.m_fence_wait;
+   }
+   if (m_keyboard.key_released(GLFW_KEY_K)) {
+      settings.m_gpu_particles = !settings.m_gpu_particles;
+   }
+   if (m_keyboard.key_released(GLFW_KEY_O)) {
+      settings.m_overdraw = !settings.m_overdraw;
+   }
+   if (m_keyboard.key_released(GLFW_KEY_J)) {
+      settings.m_metrics_dump++;
    }
 
    m_controller.update(m_keyboard, m_mouse, dt);
@@ -148,182 +298,581 @@ void application::tick(const time &dt)
 
    m_neptune_position = orbit(m_neptune_position, m_sun_position, 1.3f, dt);
 
+   // note: the comet swings around the sun on an ellipse with the sun 
+   //       in one focus, close enough at perihelion to light up
+   const float comet_major = 60.0f;
+   const float comet_minor = 35.0f;
+   m_comet_angle += dt.as_seconds() * 0.25f;
+   const float focus = sqrtf(comet_major * comet_major - comet_minor * comet_minor);
+   const glm::vec3 comet(cosf(m_comet_angle) * comet_major - focus, 4.0f, sinf(m_comet_angle) * comet_minor);
+   snapshot.m_comet_position = m_sun_position + comet;
 
-   glm::mat4 sun = glm::translate(glm::scale(glm::mat4(1.0f), glm::vec3(5.0f, 5.0f, 5.0f)), m_sun_position)
-       * glm::rotate(glm::mat4(1.0f), m_cube_rotation, glm::normalize(glm::vec3(1.0f, 1.0f, -1.0f)));
-
-   glm::mat4 mercury = glm::translate(glm::mat4(1.0f), m_mercury_position)
-       * glm::rotate(glm::mat4(1.0f), m_cube_rotation, glm::normalize(glm::vec3(1.0f, 1.0f, -1.0f)));
 
-   glm::mat4 venus = glm::translate(glm::mat4(1.0f), m_venus_position)
-       * glm::rotate(glm::mat4(1.0f), m_cube_rotation, glm::normalize(glm::vec3(1.0f, 1.0f, -1.0f)));
-
-   glm::mat4 earth = glm::translate(glm::mat4(1.0f), m_earth_position)
-       * glm::rotate(glm::mat4(1.0f), m_cube_rotation, glm::normalize(glm::vec3(1.0f, 1.0f, -1.0f)));
+   // note: in the order of m_meshes, the renderer applies them by index.
+   //       they all turn the same way, the sun at five times the size
+   //       with its orbit scaled along
+   const glm::vec3 positions[] =
+   {
+      m_sun_position * 5.0f,
+      m_mercury_position,
+      m_venus_position,
+      m_earth_position,
+      m_moon_position,
+      m_mars_position,
+      m_jupiter_position,
+      m_saturn_position,
+      m_uranus_position,
+      m_neptune_position,
+   };
+   const glm::quat rotation = glm::angleAxis(m_cube_rotation, glm::normalize(glm::vec3(1.0f, 1.0f, -1.0f)));
+   for (int32 index = 0; index < m_planets.m_count; index++) {
+      m_planets.get(transform_batch::STREAM_POSITION_X)[index] = positions[index].x;
+      m_planets.get(transform_batch::STREAM_POSITION_Y)[index] = positions[index].y;
+      m_planets.get(transform_batch::STREAM_POSITION_Z)[index] = positions[index].z;
+      m_planets.get(transform_batch::STREAM_ROTATION_X)[index] = rotation.x;
+      m_planets.get(transform_batch::STREAM_ROTATION_Y)[index] = rotation.y;
+      m_planets.get(transform_batch::STREAM_ROTATION_Z)[index] = rotation.z;
+      m_planets.get(transform_batch::STREAM_ROTATION_W)[index] = rotation.w;
+   }
+   m_planets.compose(snapshot.m_transforms, int32(sizeof(glm::mat4)));
+   snapshot.m_body_count = m_planets.m_count;
+
+   // note: the belt steps with the rest of the world, the renderer only
+   //       copies the matrices out to the gpu
+   snapshot.m_belt_count = 0;
+   if (settings.m_gpu_culling && m_belt.m_count > 0) {
+      const int64 start = utility::get_current_microseconds();
+      m_belt.integrate(dt.as_seconds());
+      m_belt.compose(snapshot.m_belt.data(), int32(sizeof(glm::mat4)));
+      snapshot.m_belt_count = m_belt.m_count;
+      snapshot.m_belt_time = float(utility::get_current_microseconds() - start) / 1000.0f;
+   }
 
-   glm::mat4 moon = glm::translate(glm::mat4(1.0f), m_moon_position)
-       * glm::rotate(glm::mat4(1.0f), m_cube_rotation, glm::normalize(glm::vec3(1.0f, 1.0f, -1.0f)));
+   snapshot.m_view = m_simulation_camera.m_view;
+   snapshot.m_camera_position = m_simulation_camera.m_position;
+   snapshot.m_settings = settings;
+   snapshot.m_quit = m_quit;
+}
 
-   glm::mat4 mars = glm::translate(glm::mat4(1.0f), m_mars_position)
-       * glm::rotate(glm::mat4(1.0f), m_cube_rotation, glm::normalize(glm::vec3(1.0f, 1.0f, -1.0f)));
+bool application::step_simulation()
+{
+   const int64 start = utility::get_current_microseconds();
+
+   int64 input_time = 0;
+   int32 input_count = 0;
+   input_event event;
+   while (m_input.pop(event)) {
+      switch (event.m_kind) {
+         case INPUT_EVENT_KIND_KEY:
+         {
+            m_keyboard.on_key(event.m_index, event.m_state);
+         } break;
+         case INPUT_EVENT_KIND_MOVE:
+         {
+            m_mouse.on_move(event.m_x, event.m_y);
+         } break;
+         case INPUT_EVENT_KIND_BUTTON:
+         {
+            m_mouse.on_button(event.m_index, event.m_state);
+         } break;
+         case INPUT_EVENT_KIND_QUIT:
+         {
+            return false;
+         } break;
+      }
+
+      input_time = input_time == 0 ? event.m_time : input_time;
+      input_count++;
+   }
 
-   glm::mat4 jupiter = glm::translate(glm::mat4(1.0f), m_jupiter_position)
-       * glm::rotate(glm::mat4(1.0f), m_cube_rotation, glm::normalize(glm::vec3(1.0f, 1.0f, -1.0f)));
+   frame_snapshot &snapshot = m_snapshots.write_slot();
+   snapshot.m_sequence = ++m_sequence;
+   snapshot.m_input_time = input_time;
+   snapshot.m_step_time = m_tick_time;
+   snapshot.clear_text();
+   // note: every step advances the same amount, the pacer only decides
+   //       when it runs. its wake-up jitter stays out of the simulation
+   tick(time(1000000 / SIMULATION_RATE), snapshot);
+   snapshot.push_text("simulation: %d hz, step %lld, %.3fms, %d input events",
+                      SIMULATION_RATE,
+                      snapshot.m_sequence,
+                      m_tick_time,
+                      input_count);
+   m_snapshots.publish();
 
-   glm::mat4 saturn = glm::translate(glm::mat4(1.0f), m_saturn_position)
-       * glm::rotate(glm::mat4(1.0f), m_cube_rotation, glm::normalize(glm::vec3(1.0f, 1.0f, -1.0f)));
+   m_mouse.update();
+   m_keyboard.update();
+   m_tick_time = float(utility::get_current_microseconds() - start) / 1000.0f;
 
-   glm::mat4 uranus = glm::translate(glm::mat4(1.0f), m_uranus_position)
-       * glm::rotate(glm::mat4(1.0f), m_cube_rotation, glm::normalize(glm::vec3(1.0f, 1.0f, -1.0f)));
+   return true;
+}
 
-   glm::mat4 neptune = glm::translate(glm::mat4(1.0f), m_neptune_position)
-       * glm::rotate(glm::mat4(1.0f), m_cube_rotation, glm::normalize(glm::vec3(1.0f, 1.0f, -1.0f)));
+void application::simulate()
+{
+   do {
+      m_simulation_pacer.begin_frame();
+   } while (step_simulation());
+}
 
+void application::apply_snapshot(const frame_snapshot &snapshot, const float deltatime)
+{
+   m_running = m_running && !snapshot.m_quit;
 
-   m_sun.set_transform(sun);
-   m_mercury.set_transform(mercury);
-   m_venus.set_transform(venus);
-   m_earth.set_transform(earth);
-   m_moon.set_transform(moon);
-   m_mars.set_transform(mars);
-   m_jupiter.set_transform(jupiter);
-   m_saturn.set_transform(saturn);
-   m_uranus.set_transform(uranus);
-   m_neptune.set_transform(neptune);
+   const auto &settings = snapshot.m_settings;
+   // note: the history no longer matches what is drawn
+   if (settings.m_temporal != m_settings.m_temporal || settings.m_overdraw != m_settings.m_overdraw) {
+      m_upscaler.reset();
+   }
+   if (settings.m_present_mode != m_settings.m_present_mode) {
+      m_context.set_present_mode(settings.m_present_mode);
+   }
+   if (settings.m_frame_limit != m_settings.m_frame_limit) {
+      m_pacer.set_frame_limit(settings.m_frame_limit);
+   }
+   m_pacer.m_fence_wait = settings.m_fence_wait;
+   m_particles.set_gpu(settings.m_gpu_particles);
+   if (settings.m_metrics_dump != m_settings.m_metrics_dump && m_metrics.write_json("metrics.json")) {
+      debug::log("metrics written to 'metrics.json'");
+   }
+   m_settings = settings;
 
-   const int frames_per_second = int(1.0f / dt.as_seconds());
-   const int frame_timing_ms = int(dt.as_milliseconds());
+   // note: a snapshot drawn twice keeps the bodies where they are, so
+   //       the second frame has no motion
+   const int32 body_count = snapshot.m_body_count < int32(m_meshes.size()) ? snapshot.m_body_count : int32(m_meshes.size());
+   for (int32 index = 0; index < body_count; index++) {
+      m_meshes[index]->set_transform(snapshot.m_transforms[index]);
+   }
+   m_metrics.add(metrics::COUNTER_BODIES_UPDATED, body_count + snapshot.m_belt_count);
+   m_camera.m_view = snapshot.m_view;
+   m_camera.m_position = snapshot.m_camera_position;
 
-   m_overlay.pre_frame(m_width, m_height);
-   m_overlay.push_line("FPS: %d (%dms)", frames_per_second, frame_timing_ms);
+   // note: the particles are drawn state, they step with the frame
+   if (m_comet_emitter >= 0) {
+      m_particles.m_emitters[m_comet_emitter].m_position = snapshot.m_comet_position;
+   }
+   m_particles.simulate(deltatime);
 }
 
-void application::draw()
+void application::update_asteroids(const frame_snapshot &snapshot)
 {
-   draw_world_render_pass();
-   draw_framebuffer_render_pass();
-   draw_debug_text_render_pass();
-   m_context.swap_buffers();
+   m_asteroids.set_worlds(nullptr, 0);
+   if (!m_belt_stream.is_valid()) {
+      return;
+   }
+
+   // note: the matrices of the step go straight into mapped memory, the
+   //       segment was fenced frames ago so the copy never waits
+   m_belt_stream.begin_frame();
+   if (snapshot.m_belt_count != m_asteroids.m_body_count) {
+      return;
+   }
+
+   const int32 size = int32(sizeof(glm::mat4)) * snapshot.m_belt_count;
+   const int32 offset = m_belt_stream.write(size, snapshot.m_belt.data(), render_backend::storage_buffer_alignment());
+   if (offset >= 0) {
+      m_asteroids.set_worlds(&m_belt_stream, offset);
+   }
 }
 
-bool application::create_resources()
+void application::update_debug_text(const frame_snapshot &snapshot, const float deltatime)
 {
-   if (!create_framebuffers()) {
-      debug::log("could not create framebuffers!");
-      return false;
+   const int frames_per_second = deltatime > 0.0f ? int(1.0f / deltatime) : 0;
+   const int frame_timing_ms = int(deltatime * 1000.0f);
+
+   const auto &frame = m_metrics.m_timings[metrics::TIMING_FRAME];
+   m_overlay.pre_frame(m_width, m_height, m_frame_memory.current());
+   m_overlay.push_line("FPS: %d (%dms), p50: %.2fms, p95: %.2fms, p99: %.2fms",
+                       frames_per_second,
+                       frame_timing_ms,
+                       float(frame.percentile(50.0f)) / 1000.0f,
+                       float(frame.percentile(95.0f)) / 1000.0f,
+                       float(frame.percentile(99.0f)) / 1000.0f);
+   for (const char *line = snapshot.m_text; *line != '\0';) {
+      const char *end = line;
+      while (*end != '\0' && *end != '\n') {
+         end++;
+      }
+      m_overlay.push_line("%.*s", int(end - line), line);
+      line = *end == '\n' ? end + 1 : end;
    }
-   if (!create_shaders()) {
-      debug::log("could not create shader programs!");
-      return false;
+   const char *present_modes[] = { "immediate", "vsync", "adaptive" };
+   m_overlay.push_line("present: %s (v), cap: %d (f), fence wait: %s (l), waited: %.2fms",
+                       present_modes[m_context.m_present_mode],
+                       m_pacer.m_frame_limit,
+                       m_pacer.m_fence_wait ? "on" : "off",
+                       m_pacer.m_wait_time);
+   m_overlay.push_line("frame: %.2fms avg, %.2f min, %.2f max, %.2f dev, latency: %.1fms (%.1f avg)",
+                       m_pacer.m_frame_average,
+                       m_pacer.m_frame_min,
+                       m_pacer.m_frame_max,
+                       m_pacer.m_frame_deviation,
+                       m_pacer.m_latency,
+                       m_pacer.m_latency_average);
+   m_overlay.push_line("draws: %d in %d calls, depth prepass: %s in %d calls (p)",
+                       m_batch.m_draw_count,
+                       m_batch.m_call_count,
+                       m_settings.m_prepass ? "on" : "off",
+                       m_batch.m_depth_call_count);
+   m_overlay.push_line("resolution: %dx%d (%d%%) gpu: %.2fms cpu: %.2fms", 
+                       m_resolution.m_width, 
+                       m_resolution.m_height, 
+                       int(m_resolution.m_scale * 100.0f + 0.5f),
+                       m_resolution.m_gpu_time,
+                       m_resolution.m_cpu_time);
+   m_overlay.push_line("occlusion: %s (c), %d of %d culled by %d occluders in %.3fms",
+                       m_settings.m_occlusion_culling ? "on" : "off",
+                       m_occlusion.m_culled,
+                       m_occlusion.m_tested,
+                       m_occlusion.m_occluder_count,
+                       m_occlusion.m_time);
+   if (m_asteroids.m_body_count > 0) {
+      m_overlay.push_line("asteroids: %s (g), %d tested on the gpu in %d groups, composed in %.3fms (%s)",
+                          m_settings.m_gpu_culling ? "on" : "off",
+                          m_asteroids.m_body_count,
+                          (m_asteroids.m_body_count + gpu_culler::GROUP_SIZE - 1) / gpu_culler::GROUP_SIZE,
+                          snapshot.m_belt_time,
+                          m_belt.m_path == transform_batch::PATH_AVX2 ? "avx2" : "sse");
    }
-   if (!create_textures()) {
-      debug::log("could not create textures!");
-      return false;
+   m_overlay.push_line("particles: %d on the %s (k), cpu: %.3fms",
+                       m_particles.live_count(),
+                       m_particles.m_gpu ? "gpu" : "cpu",
+                       m_particles.m_cpu_time);
+   m_overlay.push_line("temporal upscale: %s (t), overdraw: %s (o)", m_settings.m_temporal ? "on" : "off", m_settings.m_overdraw ? "on" : "off");
+   m_overlay.push_line("graph: %d passes, %d culled, %d framebuffers, %d clears elided",
+                       int(m_graph.m_passes.size()) - m_graph.m_culled_count,
+                       m_graph.m_culled_count,
+                       m_graph.m_physical_count,
+                       m_graph.m_elided_clears);
+   const linear_arena &arena = m_frame_memory.previous();
+   m_overlay.push_line("memory: %lld allocations, arena %lld of %lld kb, %d overflows",
+                       m_frame_allocations,
+                       arena.m_peak / 1024,
+                       arena.m_capacity / 1024,
+                       arena.m_overflow_count);
+   if (m_streamer.pending() > 0) {
+      m_overlay.push_line("streaming: %d textures", m_streamer.pending());
    }
-   if (!create_samplers()) {
-      debug::log("could not create sampler states!");
-      return false;
+
+   // note: counters are from the frame before, this one is not drawn yet
+   const int64 *counters = m_metrics.m_last;
+   const auto &simulation = m_metrics.m_timings[metrics::TIMING_SIMULATION];
+   m_overlay.push_line("backend: %lld draws, %lld dispatches, %lld state changes, %lld uniforms, %lld textures, %lld kb uploaded",
+                       counters[metrics::COUNTER_DRAW_CALLS],
+                       counters[metrics::COUNTER_DISPATCHES],
+                       counters[metrics::COUNTER_STATE_CHANGES],
+                       counters[metrics::COUNTER_UNIFORM_UPLOADS],
+                       counters[metrics::COUNTER_TEXTURE_BINDS],
+                       counters[metrics::COUNTER_UPLOAD_BYTES] / 1024);
+   m_overlay.push_line("bodies: %lld updated, %lld culled, %lld visible, step p99: %.3fms, dump: metrics.json (j)",
+                       counters[metrics::COUNTER_BODIES_UPDATED],
+                       counters[metrics::COUNTER_BODIES_CULLED],
+                       counters[metrics::COUNTER_BODIES_VISIBLE],
+                       float(simulation.percentile(99.0f)) / 1000.0f);
+
+   float frames[metrics::GRAPH_SIZE];
+   const int32 frame_count = m_metrics.graph(frames, metrics::GRAPH_SIZE);
+   const float budget = 1000.0f / float(m_pacer.m_frame_limit > 0 ? m_pacer.m_frame_limit : 60);
+   m_overlay.push_graph(frames, frame_count, budget);
+}
+
+void application::update_metrics(const float deltatime, const bool stepped)
+{
+   const render_counters counters = m_backend.counters();
+   m_backend.reset_counters();
+   m_metrics.add(metrics::COUNTER_DRAW_CALLS, counters.draw_calls_);
+   m_metrics.add(metrics::COUNTER_DISPATCHES, counters.dispatches_);
+   m_metrics.add(metrics::COUNTER_STATE_CHANGES, counters.state_changes_);
+   m_metrics.add(metrics::COUNTER_UNIFORM_UPLOADS, counters.uniform_uploads_);
+   m_metrics.add(metrics::COUNTER_TEXTURE_BINDS, counters.texture_binds_);
+   m_metrics.add(metrics::COUNTER_UPLOAD_BYTES, counters.upload_bytes_);
+
+   // note: the bodies the cpu decided on, the asteroids are culled on
+   //       the gpu and their results are never read back
+   const int32 culled = m_settings.m_occlusion_culling ? m_occlusion.m_culled : 0;
+   const int32 tested = m_settings.m_occlusion_culling ? m_occlusion.m_tested : int32(m_meshes.size());
+   m_metrics.add(metrics::COUNTER_BODIES_CULLED, culled);
+   m_metrics.add(metrics::COUNTER_BODIES_VISIBLE, tested - culled);
+
+   m_metrics.record(metrics::TIMING_FRAME, int64(deltatime * 1000000.0f));
+   // note: the raw timings, the smoothed ones would hide the spikes
+   //       the percentiles are there for. a gpu sample is a frame that
+   //       finished a few frames back, none when no query was ready
+   m_metrics.record(metrics::TIMING_CPU, int64(m_resolution.m_frame_cpu_time * 1000.0f));
+   for (int32 index = 0; index < m_resolution.m_resolved_count; index++) {
+      m_metrics.record(metrics::TIMING_GPU, int64(m_resolution.m_resolved_gpu_times[index] * 1000.0f));
    }
-   if (!create_buffers()) {
-      debug::log("could not create vertex buffers!");
-      return false;
+   // note: steps the renderer never saw are not sampled
+   if (stepped) {
+      m_metrics.record(metrics::TIMING_SIMULATION, int64(m_snapshots.read_slot().m_step_time * 1000.0f));
    }
-   if (!create_layouts()) {
-      debug::log("could not create vertex layouts!");
-      return false;
+   m_metrics.end_frame();
+}
+
+void application::draw()
+{
+   m_streamer.update();
+   update_planet_layers();
+   m_stream.begin_frame();
+   update_asteroids(m_snapshots.read_slot());
+
+   // note: the world target is transient, the graph hands out a pooled
+   //       framebuffer of the current bucket size. the history belongs
+   //       to the upscaler and outlives the frame
+   render_graph::target_desc world_desc;
+   world_desc.m_width = m_resolution.target_width();
+   world_desc.m_height = m_resolution.target_height();
+   world_desc.m_format_count = 3;
+   world_desc.m_formats[0] = FRAMEBUFFER_FORMAT_RGBA8;
+   world_desc.m_formats[1] = FRAMEBUFFER_FORMAT_D32;
+   world_desc.m_formats[2] = FRAMEBUFFER_FORMAT_RG16F;
+
+   m_graph.begin_frame(m_width, m_height, m_frame_memory.current());
+   m_world_target = m_graph.create_target("world", world_desc);
+   // note: the heatmap counts, it is shown as is
+   const bool temporal = m_settings.m_temporal && !m_settings.m_overdraw;
+   m_history_target = render_graph::BACKBUFFER;
+   if (temporal) {
+      m_history_target = m_graph.import_target("history", m_upscaler.next_history(m_width, m_height));
    }
-   if (!create_skybox()) {
-      debug::log("could not create skybox!");
-      return false;
+
+   // note: the skybox covers the world target and the final quad the
+   //       backbuffer, so only depth is actually cleared. the heatmap
+   //       adds up from zero
+   const int32 world = m_graph.add_pass("world", m_world_target, {}, [this](render_backend &) { draw_world_render_pass(); });
+   m_graph.set_clear(world, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), !m_settings.m_overdraw, true);
+   if (temporal) {
+      m_graph.add_pass("temporal", m_history_target, { m_world_target }, [this](render_backend &) { draw_temporal_render_pass(); });
    }
-   if (!create_models()) {
-      debug::log("could not create models!");
-      return false;
+   const int32 present = m_graph.add_pass("final", render_graph::BACKBUFFER, { temporal ? m_history_target : m_world_target }, [this](render_backend &) { draw_framebuffer_render_pass(); });
+   m_graph.set_clear(present, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), true, false);
+   m_graph.add_pass("debug text", render_graph::BACKBUFFER, {}, [this](render_backend &) { draw_debug_text_render_pass(); });
+
+   m_graph.compile();
+   m_graph.execute(m_backend);
+
+   m_stream.end_frame();
+   if (m_belt_stream.is_valid()) {
+      m_belt_stream.end_frame();
    }
-   if (!create_misc()) {
-      debug::log("could not create misc resources!");
+   m_resolution.end_frame();
+   m_context.swap_buffers();
+}
+
+bool application::create_resources()
+{
+   if (!m_workers.create() || !m_resources.create(&m_streamer)) {
+      debug::log("could not create worker threads!");
       return false;
    }
 
-   return true;
+   // note: file i/o and decoding run on the workers, gl object creation
+   //       stays on this thread
+   task_graph graph;
+   const int framebuffers = graph.add("framebuffers", TASK_THREAD_CONTEXT, [this]() { return create_framebuffers(); });
+   const int shader_sources = graph.add("shader sources", TASK_THREAD_WORKER, [this]() { return load_shader_sources(); });
+   const int shaders = graph.add("shaders", TASK_THREAD_CONTEXT, [this]() { return create_shaders(); }, { shader_sources });
+   const int font = graph.add("font", TASK_THREAD_WORKER, [this]() { return load_font(); });
+   const int textures = graph.add("textures", TASK_THREAD_CONTEXT, [this]() { return create_textures(); }, { font });
+   const int samplers = graph.add("samplers", TASK_THREAD_CONTEXT, [this]() { return create_samplers(); });
+   const int buffers = graph.add("buffers", TASK_THREAD_CONTEXT, [this]() { return create_buffers(); });
+   const int layouts = graph.add("layouts", TASK_THREAD_WORKER, [this]() { return create_layouts(); });
+   const int skybox = graph.add("skybox", TASK_THREAD_CONTEXT, [this]() { return create_skybox(); }, { shaders, textures });
+   const int models = graph.add("models", TASK_THREAD_CONTEXT, [this]() { return create_models(); }, { shaders, textures, samplers, buffers, layouts });
+   const int asteroids = graph.add("asteroids", TASK_THREAD_CONTEXT, [this]() { return create_asteroids(); }, { models });
+   const int particles = graph.add("particles", TASK_THREAD_CONTEXT, [this]() { return create_particles(); }, { shaders, layouts });
+   graph.add("misc", TASK_THREAD_CONTEXT, [this]() { return create_misc(); }, { framebuffers, buffers, skybox, models, asteroids, particles });
+
+   const bool result = graph.run(m_workers);
+   graph.log_timings();
+   debug::log("resources: %d created, %d shared", m_resources.m_created, m_resources.m_reused);
+
+   return result;
 }
 
 bool application::create_framebuffers()
 {
-   const framebuffer_format formats[] = { FRAMEBUFFER_FORMAT_RGBA8, FRAMEBUFFER_FORMAT_D32 };
-   if (!m_rendertarget.create(320, 180, 2, formats)) {
+   // note: 320x180 at scale 1, the scale follows the gpu frame time
+   if (!m_upscaler.create(&m_program_taa, &m_buffer_screen_quad, &m_layout_2d, &m_sampler_nearest, &m_sampler_linear)) {
+      return false;
+   }
+
+   if (!m_resolution.create(320, 180, 0.5f, 2.0f, 1000.0f / 60.0f)) {
       return false;
    }
 
    return true;
 }
 
-bool application::create_shaders()
+bool application::load_shader_sources()
 {
-   if (!utility::create_shader_program_from_files(m_program_world, "data/world.vs.glsl", "data/world.fs.glsl")) {
-      return false;
+   m_shader_sources = {
+      { &m_program_world, "data/world.vs.glsl", "data/world.fs.glsl" },
+      { &m_program_world_indirect, "data/world_indirect.vs.glsl", "data/world_indirect.fs.glsl" },
+      { &m_program_depth, "data/depth.vs.glsl", "data/depth.fs.glsl" },
+      { &m_program_depth_indirect, "data/depth_indirect.vs.glsl", "data/depth.fs.glsl" },
+      { &m_program_world_gpu, "data/world_gpu.vs.glsl", "data/world.fs.glsl", true },
+      { &m_program_particle, "data/particle.vs.glsl", "data/particle.fs.glsl" },
+      { &m_program_final, "data/final.vs.glsl", "data/final.fs.glsl" },
+      { &m_program_taa, "data/final.vs.glsl", "data/taa.fs.glsl" },
+      { &m_program_font, "data/font.vs.glsl", "data/font.fs.glsl" },
+      { &m_skybox.m_program, "data/skybox/shader.vs.glsl", "data/skybox/shader.fs.glsl" },
+   };
+
+   for (auto &source : m_shader_sources) {
+      if (!utility::read_text_file(source.m_vertex, source.m_vertex_filename) ||
+          !utility::read_text_file(source.m_fragment, source.m_fragment_filename))
+      {
+         debug::log("could not read shader sources: '%s', '%s'", source.m_vertex_filename, source.m_fragment_filename);
+         return false;
+      }
    }
 
-   if (!utility::create_shader_program_from_files(m_program_final, "data/final.vs.glsl", "data/final.fs.glsl")) {
+   if (!utility::read_text_file(m_cull_source, "data/cull.cs.glsl")) {
+      debug::log("could not read shader source: 'data/cull.cs.glsl'");
       return false;
    }
 
-   if (!utility::create_shader_program_from_files(m_program_font, "data/font.vs.glsl", "data/font.fs.glsl")) {
+   if (!utility::read_text_file(m_particle_update_source, "data/particle_update.vs.glsl")) {
+      debug::log("could not read shader source: 'data/particle_update.vs.glsl'");
       return false;
    }
 
    return true;
 }
 
-bool application::create_textures()
+bool application::create_shaders()
 {
-   if (!utility::create_texture_from_file(m_texture_font, "data/font8x8.png")) {
+   if (!m_shader_cache.create("cache/shaders", m_backend)) {
       return false;
    }
 
-   if (!utility::create_texture_from_file(m_texture_sun, "data/sun.png")) {
-       return false;
+   // note: programs for the compute path do not compile before gl 4.3
+   std::vector<shader_cache::entry> entries;
+   for (auto &source : m_shader_sources) {
+      if (source.m_needs_compute && !render_backend::is_compute_supported()) {
+         continue;
+      }
+      entries.push_back({ source.m_program, source.m_vertex.c_str(), source.m_fragment.c_str() });
    }
 
-   if (!utility::create_texture_from_file(m_texture_mercury, "data/mercury.png")) {
-       return false;
+   if (!m_shader_cache.create_programs(int(entries.size()), entries.data())) {
+      return false;
    }
 
-   if (!utility::create_texture_from_file(m_texture_venus, "data/venus.png")) {
-       return false;
-   }
+   m_shader_sources.clear();
 
-   if (!utility::create_texture_from_file(m_texture_earth, "data/earth.png")) {
-       return false;
+   if (render_backend::is_compute_supported() && !m_program_cull.create_compute(m_cull_source.c_str())) {
+      return false;
    }
+   m_cull_source.clear();
 
-   if (!utility::create_texture_from_file(m_texture_moon, "data/moon.png")) {
-       return false;
+   // note: the particles fall back to the cpu without it
+   const char *varyings[] = { "v_position", "v_velocity", "v_emitter" };
+   if (!m_program_particle_update.create_feedback(m_particle_update_source.c_str(), 3, varyings)) {
+      debug::log("could not create particle update program, particles run on the cpu");
    }
+   m_particle_update_source.clear();
 
-   if (!utility::create_texture_from_file(m_texture_mars, "data/mars.png")) {
-       return false;
-   }
+   return true;
+}
 
-   if (!utility::create_texture_from_file(m_texture_jupiter, "data/jupiter.png")) {
-       return false;
+bool application::load_font()
+{
+   // note: the bitmap font is turned into a distance field here, on a
+   //       worker, so the text stays sharp when the overlay is scaled
+   image_data bitmap;
+   if (!utility::load_image_from_file(bitmap, "data/font8x8.png")) {
+      return false;
    }
 
-   if (!utility::create_texture_from_file(m_texture_saturn, "data/saturn.png")) {
-       return false;
+   return utility::bake_sdf_font(m_font_image, bitmap, 16);
+}
+
+bool application::create_textures()
+{
+   // note: decode on workers, upload at most 2mb per frame
+   if (!m_streamer.create(&m_workers, 2 * 1024 * 1024)) {
+      return false;
    }
 
-   if (!utility::create_texture_from_file(m_texture_uranus, "data/uranus.png")) {
-       return false;
+   if (!m_texture_font.create(m_font_image.m_format, m_font_image.m_width, m_font_image.m_height, m_font_image.m_pixels.data())) {
+      return false;
+   }
+   m_font_image = image_data{};
+
+   // note: planets show a placeholder until their texture has streamed in
+   m_texture_sun = m_resources.load_texture("data/sun.png");
+   m_texture_mercury = m_resources.load_texture("data/mercury.png");
+   m_texture_venus = m_resources.load_texture("data/venus.png");
+   m_texture_earth = m_resources.load_texture("data/earth.png");
+   m_texture_moon = m_resources.load_texture("data/moon.png");
+   m_texture_mars = m_resources.load_texture("data/mars.png");
+   m_texture_jupiter = m_resources.load_texture("data/jupiter.png");
+   m_texture_saturn = m_resources.load_texture("data/saturn.png");
+   m_texture_uranus = m_resources.load_texture("data/uranus.png");
+   m_texture_neptune = m_resources.load_texture("data/neptune.png");
+   m_texture_avocado = m_resources.load_texture("data/model/Avocado_baseColor.png");
+
+   // note: the baker scales the planets into one block compressed array,
+   //       without it they are copied in as they stream in
+   m_planet_textures_baked = utility::create_texture_array_from_baked_file(m_planet_textures, "data/planets.stex", PLANET_LAYER_COUNT);
+   if (m_planet_textures_baked) {
+      return true;
    }
 
-   if (!utility::create_texture_from_file(m_texture_neptune, "data/neptune.png")) {
-       return false;
+   // note: the planet images are about 320x160, scaled to one size
+   const int32 layer_width = 512;
+   const int32 layer_height = 256;
+   int32 mip_count = 1;
+   while ((layer_width >> mip_count) > 0) {
+      mip_count++;
+   }
+   if (!m_planet_textures.allocate(TEXTURE_FORMAT_RGBA8, layer_width, layer_height, PLANET_LAYER_COUNT, mip_count)) {
+      return false;
    }
 
    return true;
 }
 
+void application::update_planet_layers()
+{
+   // note: a planet joins the batch once its texture has streamed in
+   //       and was scaled into its layer, until then it draws on its own.
+   //       a baked array holds every layer already
+   mesh *planets[PLANET_LAYER_COUNT] = {
+      &m_sun, &m_mercury, &m_venus, &m_earth, &m_moon,
+      &m_mars, &m_jupiter, &m_saturn, &m_uranus, &m_neptune,
+   };
+
+   bool copied = false;
+   for (int32 layer = 0; layer < PLANET_LAYER_COUNT; layer++) {
+      auto &material = planets[layer]->m_material;
+      if (m_planet_layers & (1u << layer)) {
+         continue;
+      }
+
+      if (!m_planet_textures_baked) {
+         if (!material.m_texture || m_streamer.is_pending(*material.m_texture)) {
+            continue;
+         }
+
+         m_planet_layers |= 1u << layer;
+         if (!m_planet_textures.copy_layer(layer, *material.m_texture)) {
+            debug::log("planet %d: texture can not be copied into the array, bake data/planets.stex", layer);
+            continue;
+         }
+         copied = true;
+      }
+
+      m_planet_layers |= 1u << layer;
+      material.set_texture_layer(&m_planet_textures, layer);
+   }
+
+   if (copied) {
+      m_planet_textures.generate_mipmaps();
+   }
+}
+
 bool application::create_samplers()
 {
    if (!m_sampler_nearest.create(SAMPLER_FILTER_MODE_NEAREST, SAMPLER_ADDRESS_MODE_CLAMP, SAMPLER_ADDRESS_MODE_CLAMP)) {
@@ -334,6 +883,11 @@ bool application::create_samplers()
       return false;
    }
 
+   m_sampler_trilinear = m_resources.create_sampler(SAMPLER_FILTER_MODE_LINEAR_MIP_LINEAR, SAMPLER_ADDRESS_MODE_CLAMP, SAMPLER_ADDRESS_MODE_CLAMP);
+   if (!m_sampler_trilinear.valid()) {
+      return false;
+   }
+
    return true;
 }
 
@@ -353,6 +907,22 @@ bool application::create_buffers()
       return false;
    }
 
+   // note: per-frame dynamic vertex data, e.g. debug text
+   if (!m_stream.create(1024 * 1024, 3)) {
+      return false;
+   }
+
+   // note: static imported geometry, every model is appended to the 
+   //       same pair of buffers
+   if (!m_geometry.create(mesh::quantized_vertex_layout().stride_,
+                          256 * 1024,
+                          INDEX_TYPE_UNSIGNED_SHORT,
+                          1024 * 1024,
+                          mesh::quantized_position_layout().stride_))
+   {
+      return false;
+   }
+
    return true;
 }
 
@@ -361,6 +931,8 @@ bool application::create_layouts()
    m_layout_3d.add_attribute(0, vertex_layout::ATTRIBUTE_FORMAT_FLOAT, 3, false);
    m_layout_3d.add_attribute(1, vertex_layout::ATTRIBUTE_FORMAT_FLOAT, 2, false);
 
+   m_layout_position.add_attribute(0, vertex_layout::ATTRIBUTE_FORMAT_FLOAT, 3, false);
+
    m_layout_2d.add_attribute(0, vertex_layout::ATTRIBUTE_FORMAT_FLOAT, 2, false);
    m_layout_2d.add_attribute(1, vertex_layout::ATTRIBUTE_FORMAT_FLOAT, 2, false);
 
@@ -369,7 +941,7 @@ bool application::create_layouts()
 
 bool application::create_skybox()
 {
-   if (!m_skybox.create("data/skybox")) {
+   if (!m_skybox.create("data/skybox", m_streamer)) {
       return false;
    }
 
@@ -429,87 +1001,106 @@ bool application::create_models()
       { -1.0f, -1.0f,  1.0f,   0.0f, 1.0f, },
    };
 
+   // note: every planet draws the same cube, it is uploaded once and
+   //       held by one reference until shutdown
+   const int cube_vertex_count = sizeof(cube_data) / sizeof(cube_data[0]);
+   m_buffer_cube = m_resources.create_vertex_buffer(sizeof(cube_data), cube_data);
+   const vertex_buffer *cube_buffer = m_resources.get(m_buffer_cube);
+   if (cube_buffer == nullptr) {
+      return false;
+   }
+
    m_sun.set_transform(glm::scale(glm::mat4(1.0f), glm::vec3(5.0f, 5.0f, 5.0f)));
    m_sun.m_material.set_shader_program(&m_program_world);
-   m_sun.m_material.set_texture(&m_texture_sun);
-   m_sun.m_material.set_sampler_state(&m_sampler_linear);
-   if (!m_sun.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(vertex3d), sizeof(cube_data) / sizeof(cube_data[0]), cube_data)) {
+   m_sun.m_material.set_texture(m_resources.get(m_texture_sun));
+   m_sun.m_material.set_sampler_state(m_resources.get(m_sampler_trilinear));
+   if (!m_sun.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, cube_buffer, cube_vertex_count)) {
        return false;
    }
 
    m_mercury.set_transform(glm::mat4(1.0f));
    m_mercury.m_material.set_shader_program(&m_program_world);
-   m_mercury.m_material.set_texture(&m_texture_mercury);
-   m_mercury.m_material.set_sampler_state(&m_sampler_linear);
-   if (!m_mercury.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(vertex3d), sizeof(cube_data) / sizeof(cube_data[0]), cube_data)) {
+   m_mercury.m_material.set_texture(m_resources.get(m_texture_mercury));
+   m_mercury.m_material.set_sampler_state(m_resources.get(m_sampler_trilinear));
+   if (!m_mercury.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, cube_buffer, cube_vertex_count)) {
        return false;
    }
 
    m_venus.set_transform(glm::mat4(1.0f));
    m_venus.m_material.set_shader_program(&m_program_world);
-   m_venus.m_material.set_texture(&m_texture_venus);
-   m_venus.m_material.set_sampler_state(&m_sampler_linear);
-   if (!m_venus.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(vertex3d), sizeof(cube_data) / sizeof(cube_data[0]), cube_data)) {
+   m_venus.m_material.set_texture(m_resources.get(m_texture_venus));
+   m_venus.m_material.set_sampler_state(m_resources.get(m_sampler_trilinear));
+   if (!m_venus.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, cube_buffer, cube_vertex_count)) {
        return false;
    }
 
    m_earth.set_transform(glm::mat4(1.0f));
    m_earth.m_material.set_shader_program(&m_program_world);
-   m_earth.m_material.set_texture(&m_texture_earth);
-   m_earth.m_material.set_sampler_state(&m_sampler_linear);
-   if (!m_earth.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(vertex3d), sizeof(cube_data) / sizeof(cube_data[0]), cube_data)) {
+   m_earth.m_material.set_texture(m_resources.get(m_texture_earth));
+   m_earth.m_material.set_sampler_state(m_resources.get(m_sampler_trilinear));
+   if (!m_earth.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, cube_buffer, cube_vertex_count)) {
        return false;
    }
 
    m_moon.set_transform(glm::mat4(1.0f));
    m_moon.m_material.set_shader_program(&m_program_world);
-   m_moon.m_material.set_texture(&m_texture_moon);
-   m_moon.m_material.set_sampler_state(&m_sampler_linear);
-   if (!m_moon.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(vertex3d), sizeof(cube_data) / sizeof(cube_data[0]), cube_data)) {
+   m_moon.m_material.set_texture(m_resources.get(m_texture_moon));
+   m_moon.m_material.set_sampler_state(m_resources.get(m_sampler_trilinear));
+   if (!m_moon.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, cube_buffer, cube_vertex_count)) {
        return false;
    }
 
    m_mars.set_transform(glm::mat4(1.0f));
    m_mars.m_material.set_shader_program(&m_program_world);
-   m_mars.m_material.set_texture(&m_texture_mars);
-   m_mars.m_material.set_sampler_state(&m_sampler_linear);
-   if (!m_mars.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(vertex3d), sizeof(cube_data) / sizeof(cube_data[0]), cube_data)) {
+   m_mars.m_material.set_texture(m_resources.get(m_texture_mars));
+   m_mars.m_material.set_sampler_state(m_resources.get(m_sampler_trilinear));
+   if (!m_mars.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, cube_buffer, cube_vertex_count)) {
        return false;
    }
 
    m_jupiter.set_transform(glm::mat4(1.0f));
    m_jupiter.m_material.set_shader_program(&m_program_world);
-   m_jupiter.m_material.set_texture(&m_texture_jupiter);
-   m_jupiter.m_material.set_sampler_state(&m_sampler_linear);
-   if (!m_jupiter.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(vertex3d), sizeof(cube_data) / sizeof(cube_data[0]), cube_data)) {
+   m_jupiter.m_material.set_texture(m_resources.get(m_texture_jupiter));
+   m_jupiter.m_material.set_sampler_state(m_resources.get(m_sampler_trilinear));
+   if (!m_jupiter.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, cube_buffer, cube_vertex_count)) {
        return false;
    }
 
    m_saturn.set_transform(glm::mat4(1.0f));
    m_saturn.m_material.set_shader_program(&m_program_world);
-   m_saturn.m_material.set_texture(&m_texture_saturn);
-   m_saturn.m_material.set_sampler_state(&m_sampler_linear);
-   if (!m_saturn.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(vertex3d), sizeof(cube_data) / sizeof(cube_data[0]), cube_data)) {
+   m_saturn.m_material.set_texture(m_resources.get(m_texture_saturn));
+   m_saturn.m_material.set_sampler_state(m_resources.get(m_sampler_trilinear));
+   if (!m_saturn.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, cube_buffer, cube_vertex_count)) {
        return false;
    }
 
 
    m_uranus.set_transform(glm::mat4(1.0f));
    m_uranus.m_material.set_shader_program(&m_program_world);
-   m_uranus.m_material.set_texture(&m_texture_uranus);
-   m_uranus.m_material.set_sampler_state(&m_sampler_linear);
-   if (!m_uranus.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(vertex3d), sizeof(cube_data) / sizeof(cube_data[0]), cube_data)) {
+   m_uranus.m_material.set_texture(m_resources.get(m_texture_uranus));
+   m_uranus.m_material.set_sampler_state(m_resources.get(m_sampler_trilinear));
+   if (!m_uranus.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, cube_buffer, cube_vertex_count)) {
        return false;
    }
 
    m_neptune.set_transform(glm::mat4(1.0f));
    m_neptune.m_material.set_shader_program(&m_program_world);
-   m_neptune.m_material.set_texture(&m_texture_neptune);
-   m_neptune.m_material.set_sampler_state(&m_sampler_linear);
-   if (!m_neptune.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(vertex3d), sizeof(cube_data) / sizeof(cube_data[0]), cube_data)) {
+   m_neptune.m_material.set_texture(m_resources.get(m_texture_neptune));
+   m_neptune.m_material.set_sampler_state(m_resources.get(m_sampler_trilinear));
+   if (!m_neptune.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, cube_buffer, cube_vertex_count)) {
        return false;
    }
 
+   // note: the first launch imports through assimp and writes a mesh
+   //       container next to the source, later launches map that instead
+   m_avocado.set_transform(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 12.0f, 0.0f)), glm::vec3(60.0f)));
+   m_avocado.m_material.set_shader_program(&m_program_world);
+   m_avocado.m_material.set_texture(m_resources.get(m_texture_avocado));
+   m_avocado.m_material.set_sampler_state(m_resources.get(m_sampler_trilinear));
+   if (!mesh::create_from_file(m_avocado, "data/model/Avocado.gltf", &m_geometry)) {
+      return false;
+   }
+
    // note: model list
    m_meshes.push_back(&m_sun);
    m_meshes.push_back(&m_mercury);
@@ -521,7 +1112,110 @@ bool application::create_models()
    m_meshes.push_back(&m_saturn);
    m_meshes.push_back(&m_uranus);
    m_meshes.push_back(&m_neptune);
+   m_meshes.push_back(&m_avocado);
 
+   // note: the cubes get a position stream of their own for the prepass,
+   //       imported models get theirs from the geometry buffer
+   glm::vec3 cube_positions[cube_vertex_count];
+   for (int index = 0; index < cube_vertex_count; index++) {
+      cube_positions[index] = glm::vec3(cube_data[index].x, cube_data[index].y, cube_data[index].z);
+   }
+   if (!m_buffer_cube_positions.create(sizeof(cube_positions), cube_positions)) {
+      return false;
+   }
+   // note: a unit cube, the inscribed sphere makes it an occluder
+   for (auto &model : m_meshes) {
+      if (model != &m_avocado) {
+         model->set_position_stream(&m_buffer_cube_positions, &m_layout_position);
+         model->set_bounds(glm::vec3(0.0f), sqrtf(3.0f), 1.0f);
+      }
+   }
+
+   if (!m_batch.create(&m_program_world_indirect, &m_program_depth, &m_program_depth_indirect)) {
+      return false;
+   }
+
+   return true;
+}
+
+bool application::create_asteroids()
+{
+   // note: the gpu path only, without compute there is no belt
+   if (!render_backend::is_compute_supported()) {
+      return true;
+   }
+
+   // note: a belt of small cubes between mars and jupiter, placed by a 
+   //       fixed sequence so every run looks the same
+   const int32 asteroid_count = 32 * 1024;
+   uint32 state = 0x9e3779b9u;
+   auto random = [&state]() {
+      state = state * 1664525u + 1013904223u;
+      return float(state >> 8) / float(1 << 24);
+   };
+
+   // note: each one tumbles around its own axis, the simulation steps
+   //       the belt and the renderer streams the matrices of each step
+   m_belt.create(asteroid_count);
+   std::vector<glm::vec4> spheres(asteroid_count);
+   for (auto &sphere : spheres) {
+      const float angle = random() * 2.0f * 3.1415926f;
+      const float distance = 56.0f + random() * 6.0f;
+      const float scale = 0.1f + random() * 0.2f;
+      const glm::vec3 position(cosf(angle) * distance, (random() - 0.5f) * 3.0f, sinf(angle) * distance);
+      const glm::vec3 axis = glm::normalize(glm::vec3(random() - 0.5f, random() - 0.5f, random() - 0.5f) + glm::vec3(0.0f, 0.01f, 0.0f));
+      const float half_turn = random() * 3.0f;
+      const float spin = 0.2f + random() * 0.8f;
+
+      m_belt.add(position, glm::vec4(axis * sinf(half_turn), cosf(half_turn)), scale, axis * spin);
+      sphere = glm::vec4(position, scale * sqrtf(3.0f));
+   }
+   std::vector<glm::mat4> worlds(asteroid_count);
+   m_belt.compose(worlds.data(), int32(sizeof(glm::mat4)));
+
+   const int cube_vertex_count = 36;
+   if (!m_asteroids.create(&m_program_cull, cube_vertex_count, asteroid_count, spheres.data(), worlds.data())) {
+      return false;
+   }
+
+   // note: room for one belt per frame in flight, each at an offset
+   //       storage ranges can be bound at
+   const int32 belt_size = int32(sizeof(glm::mat4)) * asteroid_count;
+   if (!m_belt_stream.create(belt_size + render_backend::storage_buffer_alignment())) {
+      debug::log("could not create belt stream!");
+      return false;
+   }
+
+   return true;
+}
+
+bool application::create_particles()
+{
+   const int32 particle_count = 256 * 1024;
+   if (!m_particles.create(&m_program_particle_update, particle_count)) {
+      return false;
+   }
+
+   m_particles.m_sun = m_sun_position;
+   m_particles.m_wind = 3.0f;
+   m_particles.m_point_size = 120.0f;
+
+   // note: solar wind off the surface of the sun
+   particle_system::emitter wind;
+   wind.m_position = m_sun_position;
+   wind.m_radius = 5.5f;
+   wind.m_speed = 4.0f;
+   wind.m_color = glm::vec4(0.06f, 0.04f, 0.01f, 0.0f);
+   wind.m_lifetime = 6.0f;
+   m_particles.add_emitter(wind);
+
+   // note: a slow puff of gas around the nucleus, the tail is all wind
+   particle_system::emitter comet;
+   comet.m_radius = 0.4f;
+   comet.m_speed = 0.5f;
+   comet.m_color = glm::vec4(0.03f, 0.06f, 0.09f, 0.0f);
+   comet.m_lifetime = 4.0f;
+   m_comet_emitter = m_particles.add_emitter(comet);
 
    return true;
 }
@@ -533,30 +1227,131 @@ bool application::create_misc()
 
 void application::draw_world_render_pass()
 {
-   m_backend.set_framebuffer(m_rendertarget);
-   m_backend.clear(0.0f, 0.0f, 0.0f, 1.0f);
+   const glm::vec2 jitter = (m_settings.m_temporal && !m_settings.m_overdraw) ? m_upscaler.next_jitter() : glm::vec2(0.0f);
+   m_camera.set_jitter(jitter, m_resolution.m_width, m_resolution.m_height);
 
-   m_skybox.draw(m_backend, m_camera);
+   m_resolution.set_viewport(m_backend);
+
+   uint32 flags = m_settings.m_overdraw ? DRAW_FLAGS_OVERDRAW : DRAW_FLAGS_NONE;
+   const float overdraw = m_settings.m_overdraw ? mesh::OVERDRAW_STEP : 0.0f;
 
    m_camera.bind(m_backend, m_program_world);
+   m_backend.set_shader_uniform(m_program_world, UNIFORM_TYPE_FLOAT, "u_overdraw", 1, &overdraw);
+   m_camera.bind(m_backend, m_program_world_indirect);
+   m_backend.set_shader_uniform(m_program_world_indirect, UNIFORM_TYPE_FLOAT, "u_overdraw", 1, &overdraw);
+   m_batch.begin();
+   if (m_settings.m_occlusion_culling) {
+      draw_occlusion_culled();
+   }
+   else {
+      for (const auto &mesh : m_meshes) {
+         m_batch.add(*mesh);
+      }
+   }
+
+   // note: with depth laid down first every pixel is shaded once, by
+   //       the nearest surface
+   if (m_settings.m_prepass) {
+      m_camera.bind(m_backend, m_program_depth);
+      m_camera.bind(m_backend, m_program_depth_indirect);
+      if (m_batch.submit_depth(m_backend, m_stream)) {
+         flags |= DRAW_FLAGS_DEPTH_PREPASSED;
+      }
+   }
+   m_batch.submit(m_backend, m_stream, flags);
+
+   if (m_settings.m_gpu_culling && m_asteroids.m_worlds) {
+      draw_asteroids(flags & DRAW_FLAGS_OVERDRAW);
+   }
+
+   // note: last, it only fills what the bodies left uncovered
+   m_skybox.draw(m_backend, m_camera, flags & DRAW_FLAGS_OVERDRAW);
+
+   // note: additive over everything, left out of the heatmap
+   if (!m_settings.m_overdraw) {
+      m_camera.bind(m_backend, m_program_particle);
+      m_particles.draw(m_backend, m_stream, m_program_particle);
+   }
+}
+
+void application::draw_asteroids(const uint32 flags)
+{
+   // note: occluded by the same bodies as the cpu path, the pyramid 
+   //       was built for this frame by draw_occlusion_culled
+   m_asteroids.set_pyramid(m_settings.m_occlusion_culling ? &m_occlusion : nullptr);
+   m_asteroids.dispatch(m_backend, m_camera);
+
+   // note: not in the prepass, so they test and write depth themselves
+   const float overdraw = (flags & DRAW_FLAGS_OVERDRAW) ? mesh::OVERDRAW_STEP : 0.0f;
+   m_camera.bind(m_backend, m_program_world_gpu);
+   m_backend.set_shader_uniform(m_program_world_gpu, UNIFORM_TYPE_FLOAT, "u_overdraw", 1, &overdraw);
+   m_backend.set_texture(*m_resources.get(m_texture_moon));
+   m_backend.set_sampler_state(*m_resources.get(m_sampler_trilinear));
+   m_backend.set_vertex_buffer(*m_resources.get(m_buffer_cube));
+   m_backend.set_vertex_layout(m_layout_3d);
+   m_backend.set_rasterizer_state(CULL_MODE_BACK, FRONT_FACE_CW);
+   mesh::set_draw_state(m_backend, flags);
+   m_asteroids.draw(m_backend, PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+}
+
+void application::draw_occlusion_culled()
+{
+   m_occlusion.begin_frame(m_camera);
    for (const auto &mesh : m_meshes) {
-      mesh->draw(m_backend);
+      glm::vec3 center;
+      float radius = 0.0f;
+      float occluder_radius = 0.0f;
+      mesh->world_bounds(center, radius, occluder_radius);
+      if (occluder_radius > 0.0f) {
+         m_occlusion.add_occluder(center, occluder_radius);
+      }
    }
+
+   m_occlusion.build();
+   for (const auto &mesh : m_meshes) {
+      glm::vec3 center;
+      float radius = 0.0f;
+      float occluder_radius = 0.0f;
+      mesh->world_bounds(center, radius, occluder_radius);
+      if (m_occlusion.is_visible(center, radius)) {
+         m_batch.add(*mesh);
+      }
+      else {
+         // note: motion starts from here when it shows up again
+         mesh->store_previous_transform();
+      }
+   }
+   m_occlusion.end_frame();
+}
+
+void application::draw_temporal_render_pass()
+{
+   const glm::vec2 source_size(float(m_resolution.m_width), float(m_resolution.m_height));
+   m_upscaler.resolve(m_backend,
+                      m_graph.get_texture(m_world_target, 0),
+                      m_graph.get_texture(m_world_target, 2),
+                      source_size);
 }
 
 void application::draw_framebuffer_render_pass()
 {
-   auto screen_texture = m_rendertarget.color_attachment_as_texture(0);
+   auto screen_texture = m_graph.get_texture(m_world_target, 0);
+   glm::vec2 texcoord_scale = m_resolution.texcoord_scale();
+   const float heatmap = m_settings.m_overdraw ? 1.0f / mesh::OVERDRAW_STEP : 0.0f;
+   if (m_settings.m_temporal && !m_settings.m_overdraw) {
+      screen_texture = m_upscaler.output();
+      texcoord_scale = glm::vec2(1.0f);
+   }
 
-   m_backend.reset_framebuffer();
-   m_backend.clear(0.0f, 0.0f, 0.0f, 1.0f);
-   m_backend.set_viewport(0, 0, m_width, m_height);
    m_backend.set_shader_program(m_program_final);
+   m_backend.set_shader_uniform(m_program_final, UNIFORM_TYPE_VEC2, "u_texcoord_scale", 1, glm::value_ptr(texcoord_scale));
+   m_backend.set_shader_uniform(m_program_final, UNIFORM_TYPE_FLOAT, "u_heatmap", 1, &heatmap);
    m_backend.set_vertex_buffer(m_buffer_screen_quad);
    m_backend.set_vertex_layout(m_layout_2d);
    m_backend.set_texture(screen_texture);
    m_backend.set_sampler_state(m_sampler_nearest);
    m_backend.set_blend_state(false);
+   m_backend.set_depth_state(false, false);
    m_backend.set_rasterizer_state(CULL_MODE_NONE, FRONT_FACE_CW);
    m_backend.draw(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, 6);
 }
@@ -566,8 +1361,44 @@ void application::draw_debug_text_render_pass()
    m_overlay.draw(m_backend);
 }
 
+void application::destroy_resources()
+{
+   // note: nothing may point into the pools once the references go
+   for (auto &mesh : m_meshes) {
+      mesh->m_material.set_texture(nullptr);
+      mesh->m_material.set_sampler_state(nullptr);
+      mesh->m_material.set_texture_layer(nullptr, 0);
+      mesh->destroy();
+   }
+   m_planet_textures.destroy();
+   m_planet_textures_baked = false;
+   m_planet_layers = 0;
+
+   const texture_handle textures[] = {
+      m_texture_sun, m_texture_mercury, m_texture_venus, m_texture_earth,
+      m_texture_moon, m_texture_mars, m_texture_jupiter, m_texture_saturn,
+      m_texture_uranus, m_texture_neptune, m_texture_avocado,
+   };
+   for (const auto &id : textures) {
+      if (id.valid()) {
+         m_resources.release(id);
+      }
+   }
+   if (m_sampler_trilinear.valid()) {
+      m_resources.release(m_sampler_trilinear);
+   }
+   if (m_buffer_cube.valid()) {
+      m_resources.release(m_buffer_cube);
+   }
+
+   m_resources.destroy();
+}
+
 void application::post_frame()
 {
-   m_mouse.update();
-   m_keyboard.update();
+   for (auto &mesh : m_meshes) {
+      mesh->end_frame();
+   }
+   m_camera.end_frame();
+   m_resources.end_frame();
 }
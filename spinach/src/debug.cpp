@@ -5,6 +5,63 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstdarg>
+#include <new>
+
+#if defined(_DEBUG)
+static thread_local int64 t_allocation_count = 0;
+
+// note: counts every plain new, the sized and array forms end up here.
+//       aligned new has a pair of its own, counted the same way
+void *operator new(std::size_t size)
+{
+   t_allocation_count++;
+   void *result = malloc(size == 0 ? 1 : size);
+   if (result == nullptr) {
+      throw std::bad_alloc();
+   }
+   return result;
+}
+
+void operator delete(void *pointer) noexcept
+{
+   free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t size) noexcept
+{
+   free(pointer);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+   t_allocation_count++;
+#if defined(_WIN32)
+   void *result = _aligned_malloc(size == 0 ? 1 : size, std::size_t(alignment));
+#else
+   // note: aligned_alloc wants the size in whole alignments
+   const std::size_t align = std::size_t(alignment);
+   void *result = aligned_alloc(align, ((size == 0 ? 1 : size) + align - 1) & ~(align - 1));
+#endif
+   if (result == nullptr) {
+      throw std::bad_alloc();
+   }
+   return result;
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept
+{
+#if defined(_WIN32)
+   _aligned_free(pointer);
+#else
+   free(pointer);
+#endif
+}
+
+void operator delete(void *pointer, std::size_t, std::align_val_t alignment) noexcept
+{
+   operator delete(pointer, alignment);
+}
+#endif
 
 namespace debug
 {
@@ -17,4 +74,13 @@ namespace debug
       va_end(args);
       puts(message);
    }
+
+   int64 allocation_count()
+   {
+#if defined(_DEBUG)
+      return t_allocation_count;
+#else
+      return 0;
+#endif
+   }
 } // !debug
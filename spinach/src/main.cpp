@@ -2,8 +2,31 @@
 
 #include "spinach.hpp"
 
+#include <cstdlib>
+#include <cstring>
+
 int main(int argc, char **argv)
 {
-   application{"Spinach",1920,1080}.run();
-   return 0;
+   if (argc > 1 && strcmp(argv[1], "--benchmark-transforms") == 0) {
+      transform_batch::benchmark();
+      return 0;
+   }
+
+   if (argc > 1 && strcmp(argv[1], "--benchmark-mesh") == 0) {
+      mesh::benchmark(argc > 2 ? argv[2] : "data/model/Avocado.gltf");
+      return 0;
+   }
+
+   if (argc > 1 && strcmp(argv[1], "--self-test") == 0) {
+      return debug::self_test() ? 0 : 1;
+   }
+
+   // note: runs that many frames and exits, non-zero when a frame past
+   //       the warmup allocated. the check only counts in debug builds
+   int64 frame_limit = 0;
+   if (argc > 2 && strcmp(argv[1], "--frames") == 0) {
+      frame_limit = strtoll(argv[2], nullptr, 10);
+   }
+
+   return application{"Spinach",1920,1080}.run(frame_limit) ? 0 : 1;
 }
@@ -3,8 +3,17 @@
 #include "render.hpp"
 
 #include <cassert>
+#include <cstring>
 #include <glad/glad.h>
 
+// note: s3tc is an extension, the loader is generated for core only
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
 template<class T, size_t N>
 constexpr size_t array_size(T(&)[N])
 {
@@ -39,20 +48,49 @@ static const GLenum gl_texture_format_internal[] =
 {
    GL_RGB8,
    GL_RGBA8,
+   GL_R8,
+   GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+   GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
 };
 
 static const GLenum gl_texture_format[] =
 {
    GL_RGB,
    GL_RGBA,
+   GL_RED,
+   GL_NONE,
+   GL_NONE,
 };
 
 static const GLenum gl_texture_format_type[] =
 {
    GL_UNSIGNED_BYTE,
    GL_UNSIGNED_BYTE,
+   GL_UNSIGNED_BYTE,
+   GL_NONE,
+   GL_NONE,
 };
 
+// note: GL_KHR_parallel_shader_compile, the loader is core only
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+static bool
+gl_has_extension(const char *name)
+{
+   GLint count = 0;
+   glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+   for (GLint index = 0; index < count; index++) {
+      const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, index);
+      if (extension && strcmp(extension, name) == 0) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
 static const GLenum gl_sampler_filter[] =
 {
    GL_NEAREST,
@@ -169,6 +207,8 @@ const GLenum gl_framebuffer_format_internal[] =
    GL_RGB8,
    GL_RGBA8,
    GL_DEPTH24_STENCIL8,
+   GL_RG16F,
+   GL_RGBA16F,
 };
 
 const GLenum gl_framebuffer_format[] =
@@ -177,6 +217,8 @@ const GLenum gl_framebuffer_format[] =
    GL_RGB,
    GL_RGBA,
    GL_DEPTH_STENCIL,
+   GL_RG,
+   GL_RGBA,
 };
 
 static GLenum gl_framebuffer_type[] =
@@ -185,22 +227,38 @@ static GLenum gl_framebuffer_type[] =
    GL_UNSIGNED_BYTE,
    GL_UNSIGNED_BYTE,
    GL_UNSIGNED_INT_24_8,
+   GL_HALF_FLOAT,
+   GL_HALF_FLOAT,
 };
 
 static const GLenum gl_attribute_type[] =
 {
    GL_FLOAT,
    GL_UNSIGNED_BYTE,
+   GL_BYTE,
+   GL_HALF_FLOAT,
+   GL_SHORT,
+   GL_UNSIGNED_SHORT,
+   GL_INT_2_10_10_10_REV,
 };
 
+// note: size per component, packed formats store the size of
+//       all components divided by the component count
 static const GLuint gl_attribute_size[] =
 {
    sizeof(float),
    sizeof(char),
+   sizeof(char),
+   sizeof(uint16),
+   sizeof(int16),
+   sizeof(uint16),
+   sizeof(uint32) / 4,
 };
 
 shader_program::shader_program()
    : id_(0)
+   , vertex_id_(0)
+   , fragment_id_(0)
 {
 }
 
@@ -209,8 +267,45 @@ bool shader_program::is_valid() const
    return id_ != 0;
 }
 
+// note: setting the sampler uniform locations in the order
+//       the sampler uniforms are defined in the shaders 
+static void
+gl_bind_sampler_units(const GLuint pid)
+{
+   glUseProgram(pid);
+   GLint sampler_count = 0;
+   GLint active_uniform_count = 0;
+   glGetProgramiv(pid, GL_ACTIVE_UNIFORMS, &active_uniform_count);
+   for (int32 index = 0; index < active_uniform_count; index++) {
+      GLint size = 0;
+      GLenum type;
+      GLchar name[128] = {};
+      glGetActiveUniform(pid, index, sizeof(name), nullptr, &size, &type, name);
+      if (type == GL_SAMPLER_2D ||
+          type == GL_SAMPLER_CUBE) {
+         GLint location = glGetUniformLocation(pid, name);
+         if (location == -1) {
+            continue;
+         }
+
+         glUniform1i(location, sampler_count);
+         sampler_count++;
+      }
+   }
+}
+
 bool shader_program::create(const char *vertex_shader_source,
                             const char *fragment_shader_source)
+{
+   if (!begin(vertex_shader_source, fragment_shader_source)) {
+      return false;
+   }
+
+   return finish();
+}
+
+bool shader_program::begin(const char *vertex_shader_source,
+                           const char *fragment_shader_source)
 {
    GLuint vid = glCreateShader(GL_VERTEX_SHADER);
    glShaderSource(vid, 1, &vertex_shader_source, nullptr);
@@ -223,13 +318,114 @@ bool shader_program::create(const char *vertex_shader_source,
    GLuint pid = glCreateProgram();
    glAttachShader(pid, vid);
    glAttachShader(pid, fid);
+   if (is_binary_supported()) {
+      glProgramParameteri(pid, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+   }
+   glLinkProgram(pid);
+
+   // note: nothing above waits on the driver
+   id_ = pid;
+   vertex_id_ = vid;
+   fragment_id_ = fid;
+
+   return true;
+}
+
+bool shader_program::create_compute(const char *compute_shader_source)
+{
+   if (!render_backend::is_compute_supported()) {
+      return false;
+   }
+
+   GLuint cid = glCreateShader(GL_COMPUTE_SHADER);
+   glShaderSource(cid, 1, &compute_shader_source, nullptr);
+   glCompileShader(cid);
+
+   GLuint pid = glCreateProgram();
+   glAttachShader(pid, cid);
+   glLinkProgram(pid);
+
+   GLint link_status = 0;
+   glGetProgramiv(pid, GL_LINK_STATUS, &link_status);
+   if (link_status == GL_FALSE) {
+      GLchar compute_error[1024]{};
+      glGetShaderInfoLog(cid, sizeof(compute_error), NULL, compute_error);
+
+      GLchar program_error[1024];
+      glGetProgramInfoLog(pid, sizeof(program_error), NULL, program_error);
+      assert(!"shader program error");
+
+      glDetachShader(pid, cid);
+      glDeleteShader(cid);
+      glDeleteProgram(pid);
+      return false;
+   }
+
+   glDetachShader(pid, cid);
+   glDeleteShader(cid);
+   id_ = pid;
+
+   return is_valid();
+}
+
+bool shader_program::create_feedback(const char *vertex_shader_source,
+                                     const int32 varying_count,
+                                     const char **varyings)
+{
+   GLuint vid = glCreateShader(GL_VERTEX_SHADER);
+   glShaderSource(vid, 1, &vertex_shader_source, nullptr);
+   glCompileShader(vid);
+
+   GLuint pid = glCreateProgram();
+   glAttachShader(pid, vid);
+   glTransformFeedbackVaryings(pid, varying_count, varyings, GL_INTERLEAVED_ATTRIBS);
    glLinkProgram(pid);
 
    GLint link_status = 0;
    glGetProgramiv(pid, GL_LINK_STATUS, &link_status);
    if (link_status == GL_FALSE) {
       GLchar vertex_error[1024]{};
-      glGetShaderInfoLog(fid, sizeof(vertex_error), NULL, vertex_error);
+      glGetShaderInfoLog(vid, sizeof(vertex_error), NULL, vertex_error);
+
+      GLchar program_error[1024];
+      glGetProgramInfoLog(pid, sizeof(program_error), NULL, program_error);
+      assert(!"shader program error");
+
+      glDetachShader(pid, vid);
+      glDeleteShader(vid);
+      glDeleteProgram(pid);
+      return false;
+   }
+
+   glDetachShader(pid, vid);
+   glDeleteShader(vid);
+   id_ = pid;
+
+   return is_valid();
+}
+
+bool shader_program::is_ready() const
+{
+   if (vertex_id_ == 0 || !is_parallel_compile_supported()) {
+      return true;
+   }
+
+   GLint completed = GL_FALSE;
+   glGetProgramiv(id_, GL_COMPLETION_STATUS_KHR, &completed);
+   return completed == GL_TRUE;
+}
+
+bool shader_program::finish()
+{
+   const GLuint pid = id_;
+   const GLuint vid = vertex_id_;
+   const GLuint fid = fragment_id_;
+
+   GLint link_status = 0;
+   glGetProgramiv(pid, GL_LINK_STATUS, &link_status);
+   if (link_status == GL_FALSE) {
+      GLchar vertex_error[1024]{};
+      glGetShaderInfoLog(vid, sizeof(vertex_error), NULL, vertex_error);
 
       GLchar fragment_error[1024]{};
       glGetShaderInfoLog(fid, sizeof(fragment_error), NULL, fragment_error);
@@ -242,40 +438,105 @@ bool shader_program::create(const char *vertex_shader_source,
       glDetachShader(pid, vid);
       glDetachShader(pid, fid);
       glDeleteProgram(pid);
+      id_ = 0;
    }
    else {
-      id_ = pid;
+      glDetachShader(pid, vid);
+      glDetachShader(pid, fid);
    }
 
    glDeleteShader(vid);
    glDeleteShader(fid);
+   vertex_id_ = 0;
+   fragment_id_ = 0;
 
-   // note: setting the sampler uniform locations in the order
-   //       the sampler uniforms are defined in the shaders 
-   glUseProgram(pid);
-   GLint sampler_count = 0;
-   GLint active_uniform_count = 0;
-   glGetProgramiv(pid, GL_ACTIVE_UNIFORMS, &active_uniform_count);
-   for (int32 index = 0; index < active_uniform_count; index++) {
-      GLint size = 0;
-      GLenum type;
-      GLchar name[128] = {};
-      glGetActiveUniform(pid, index, sizeof(name), nullptr, &size, &type, name);
-      if (type == GL_SAMPLER_2D ||
-          type == GL_SAMPLER_CUBE) {
-         GLint location = glGetUniformLocation(pid, name);
-         if (location == -1) {
-            continue;
-         }
+   if (!is_valid()) {
+      return false;
+   }
 
-         glUniform1i(location, sampler_count);
-         sampler_count++;
-      }
+   gl_bind_sampler_units(pid);
+
+   return is_valid();
+}
+
+bool shader_program::create_from_binary(const uint32 format,
+                                        const void *data,
+                                        const int32 size)
+{
+   if (!is_binary_supported()) {
+      return false;
+   }
+
+   // note: a driver update invalidates binaries, linking fails and the
+   //       caller falls back to source
+   GLuint pid = glCreateProgram();
+   glProgramBinary(pid, format, data, size);
+
+   GLint link_status = 0;
+   glGetProgramiv(pid, GL_LINK_STATUS, &link_status);
+   if (link_status == GL_FALSE) {
+      glDeleteProgram(pid);
+      return false;
    }
 
+   id_ = pid;
+   gl_bind_sampler_units(pid);
+
    return is_valid();
 }
 
+int32 shader_program::binary_size() const
+{
+   if (!is_valid() || !is_binary_supported()) {
+      return 0;
+   }
+
+   GLint size = 0;
+   glGetProgramiv(id_, GL_PROGRAM_BINARY_LENGTH, &size);
+   return size;
+}
+
+bool shader_program::get_binary(uint32 &format,
+                                void *data,
+                                const int32 size) const
+{
+   if (!is_valid() || !is_binary_supported()) {
+      return false;
+   }
+
+   GLsizei length = 0;
+   GLenum binary_format = 0;
+   glGetProgramBinary(id_, size, &length, &binary_format, data);
+   format = binary_format;
+
+   return length == size;
+}
+
+// static
+bool shader_program::is_binary_supported()
+{
+   static const bool supported = []() {
+      if (!GLAD_GL_VERSION_4_1) {
+         return false;
+      }
+
+      GLint count = 0;
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+      return count > 0;
+   }();
+
+   return supported;
+}
+
+// static
+bool shader_program::is_parallel_compile_supported()
+{
+   static const bool supported =
+      gl_has_extension("GL_KHR_parallel_shader_compile") ||
+      gl_has_extension("GL_ARB_parallel_shader_compile");
+   return supported;
+}
+
 void shader_program::destroy()
 {
    glDeleteProgram(id_);
@@ -346,6 +607,42 @@ bool texture::create(const texture_format format,
    return is_valid();
 }
 
+bool texture::create_compressed(const texture_format format,
+                                const int32 width,
+                                const int32 height,
+                                const int32 mip_count,
+                                const void **data,
+                                const int32 *sizes)
+{
+   assert(is_compressed(format));
+   if (!is_supported(format)) {
+      return false;
+   }
+
+   GLuint id = 0;
+   glGenTextures(1, &id);
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D, id);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mip_count - 1);
+   for (int32 index = 0; index < mip_count; index++) {
+      const int32 w = (width >> index) > 0 ? (width >> index) : 1;
+      const int32 h = (height >> index) > 0 ? (height >> index) : 1;
+      glCompressedTexImage2D(GL_TEXTURE_2D,
+                             index, // mip level
+                             gl_texture_format_internal[format],
+                             w,
+                             h,
+                             0,
+                             sizes[index],
+                             data[index]);
+   }
+   glBindTexture(GL_TEXTURE_2D, 0);
+
+   id_ = id;
+
+   return is_valid();
+}
+
 void texture::update(const texture_format format,
                      const int32 width,
                      const int32 height,
@@ -365,6 +662,125 @@ void texture::update(const texture_format format,
    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+bool texture::allocate(const texture_format format,
+                       const int32 width,
+                       const int32 height,
+                       const int32 mip_count)
+{
+   GLuint id = 0;
+   glGenTextures(1, &id);
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D, id);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mip_count - 1);
+   for (int32 index = 0; index < mip_count; index++) {
+      const int32 w = (width >> index) > 0 ? (width >> index) : 1;
+      const int32 h = (height >> index) > 0 ? (height >> index) : 1;
+      if (is_compressed(format)) {
+         glCompressedTexImage2D(GL_TEXTURE_2D, index, gl_texture_format_internal[format], w, h, 0, level_size(format, w, h), nullptr);
+      }
+      else {
+         glTexImage2D(GL_TEXTURE_2D, index, gl_texture_format_internal[format], w, h, 0, gl_texture_format[format], gl_texture_format_type[format], nullptr);
+      }
+   }
+   glBindTexture(GL_TEXTURE_2D, 0);
+
+   id_ = id;
+
+   return is_valid();
+}
+
+static void
+gl_texture_upload(const GLenum target,
+                  const texture_format format,
+                  const int32 level,
+                  const int32 width,
+                  const int32 height,
+                  const void *data,
+                  const int32 size)
+{
+   // note: rows of rgb8 images are not 4 byte aligned in general
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+   if (texture::is_compressed(format)) {
+      glCompressedTexSubImage2D(target, level, 0, 0, width, height, gl_texture_format_internal[format], size, data);
+   }
+   else {
+      glTexSubImage2D(target, level, 0, 0, width, height, gl_texture_format[format], gl_texture_format_type[format], data);
+   }
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void texture::upload(const texture_format format,
+                     const int32 level,
+                     const int32 width,
+                     const int32 height,
+                     const streaming_buffer &source,
+                     const int32 offset,
+                     const int32 size)
+{
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D, id_);
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, source.id_);
+   gl_texture_upload(GL_TEXTURE_2D, format, level, width, height, (const void *)(uintptr_t)offset, size);
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+   glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void texture::upload(const texture_format format,
+                     const int32 level,
+                     const int32 width,
+                     const int32 height,
+                     const void *data,
+                     const int32 size)
+{
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D, id_);
+   gl_texture_upload(GL_TEXTURE_2D, format, level, width, height, data, size);
+   glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void texture::generate_mipmaps()
+{
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D, id_);
+   glGenerateMipmap(GL_TEXTURE_2D);
+   glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// static
+bool texture::is_compressed(const texture_format format)
+{
+   return format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_BC3;
+}
+
+// static
+bool texture::is_supported(const texture_format format)
+{
+   if (!is_compressed(format)) {
+      return format < TEXTURE_FORMAT_COUNT;
+   }
+
+   static const bool s3tc = gl_has_extension("GL_EXT_texture_compression_s3tc");
+   return s3tc;
+}
+
+// static
+int32 texture::level_size(const texture_format format,
+                          const int32 width,
+                          const int32 height)
+{
+   switch (format) {
+      case TEXTURE_FORMAT_RGB8:  return width * height * 3;
+      case TEXTURE_FORMAT_RGBA8: return width * height * 4;
+      case TEXTURE_FORMAT_R8:    return width * height;
+      case TEXTURE_FORMAT_BC1:   return ((width + 3) / 4) * ((height + 3) / 4) * 8;
+      case TEXTURE_FORMAT_BC3:   return ((width + 3) / 4) * ((height + 3) / 4) * 16;
+      default: break;
+   }
+
+   assert(!"unknown texture format");
+   return 0;
+}
+
 void texture::destroy()
 {
    glBindTexture(GL_TEXTURE_2D, 0);
@@ -407,33 +823,495 @@ bool cubemap::create(const texture_format format,
    return is_valid();
 }
 
-void cubemap::destroy()
+bool cubemap::create_compressed(const texture_format format,
+                                const int32 width,
+                                const int32 height,
+                                const int32 mip_count,
+                                const void **data,
+                                const int32 *sizes)
+{
+   assert(texture::is_compressed(format));
+   if (!texture::is_supported(format)) {
+      return false;
+   }
+
+   GLuint id = 0;
+   glGenTextures(1, &id);
+   glBindTexture(GL_TEXTURE_CUBE_MAP, id);
+   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, mip_count - 1);
+   for (int32 face = 0; face < CUBEMAP_FACE_COUNT; face++) {
+      for (int32 index = 0; index < mip_count; index++) {
+         const int32 at = face * mip_count + index;
+         const int32 w = (width >> index) > 0 ? (width >> index) : 1;
+         const int32 h = (height >> index) > 0 ? (height >> index) : 1;
+         glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                                index,
+                                gl_texture_format_internal[format],
+                                w,
+                                h,
+                                0,
+                                sizes[at],
+                                data[at]);
+      }
+   }
+
+   id_ = id;
+
+   return is_valid();
+}
+
+bool cubemap::allocate(const texture_format format,
+                       const int32 width,
+                       const int32 height,
+                       const int32 mip_count)
+{
+   GLuint id = 0;
+   glGenTextures(1, &id);
+   glBindTexture(GL_TEXTURE_CUBE_MAP, id);
+   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, mip_count - 1);
+   for (int32 face = 0; face < CUBEMAP_FACE_COUNT; face++) {
+      for (int32 index = 0; index < mip_count; index++) {
+         const GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+         const int32 w = (width >> index) > 0 ? (width >> index) : 1;
+         const int32 h = (height >> index) > 0 ? (height >> index) : 1;
+         if (texture::is_compressed(format)) {
+            glCompressedTexImage2D(target, index, gl_texture_format_internal[format], w, h, 0, texture::level_size(format, w, h), nullptr);
+         }
+         else {
+            glTexImage2D(target, index, gl_texture_format_internal[format], w, h, 0, gl_texture_format[format], gl_texture_format_type[format], nullptr);
+         }
+      }
+   }
+   glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+   id_ = id;
+
+   return is_valid();
+}
+
+void cubemap::upload(const texture_format format,
+                     const int32 face,
+                     const int32 level,
+                     const int32 width,
+                     const int32 height,
+                     const streaming_buffer &source,
+                     const int32 offset,
+                     const int32 size)
+{
+   glBindTexture(GL_TEXTURE_CUBE_MAP, id_);
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, source.id_);
+   gl_texture_upload(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, format, level, width, height, (const void *)(uintptr_t)offset, size);
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+   glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+void cubemap::upload(const texture_format format,
+                     const int32 face,
+                     const int32 level,
+                     const int32 width,
+                     const int32 height,
+                     const void *data,
+                     const int32 size)
+{
+   glBindTexture(GL_TEXTURE_CUBE_MAP, id_);
+   gl_texture_upload(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, format, level, width, height, data, size);
+   glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+void cubemap::destroy()
+{
+   glBindTexture(GL_TEXTURE_2D, 0);
+   glDeleteTextures(1, &id_);
+   id_ = 0;
+}
+
+texture_array::texture_array()
+   : id_(0)
+   , width_(0)
+   , height_(0)
+   , layer_count_(0)
+{
+}
+
+bool texture_array::is_valid() const
+{
+   return id_ != 0;
+}
+
+bool texture_array::allocate(const texture_format format,
+                             const int32 width,
+                             const int32 height,
+                             const int32 layer_count,
+                             const int32 mip_count)
+{
+   assert(!texture::is_compressed(format));
+
+   GLuint id = 0;
+   glGenTextures(1, &id);
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mip_count - 1);
+   for (int32 index = 0; index < mip_count; index++) {
+      const int32 w = (width >> index) > 0 ? (width >> index) : 1;
+      const int32 h = (height >> index) > 0 ? (height >> index) : 1;
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, index, gl_texture_format_internal[format], w, h, layer_count, 0, gl_texture_format[format], gl_texture_format_type[format], nullptr);
+   }
+   glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+   id_ = id;
+   width_ = width;
+   height_ = height;
+   layer_count_ = layer_count;
+
+   return is_valid();
+}
+
+bool texture_array::create_compressed(const texture_format format,
+                                      const int32 width,
+                                      const int32 height,
+                                      const int32 layer_count,
+                                      const int32 mip_count,
+                                      const void **data,
+                                      const int32 *sizes)
+{
+   assert(texture::is_compressed(format));
+   if (!texture::is_supported(format)) {
+      return false;
+   }
+
+   // note: a level of an array is one image, storage first and the
+   //       layers written into it one by one
+   GLuint id = 0;
+   glGenTextures(1, &id);
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mip_count - 1);
+   for (int32 index = 0; index < mip_count; index++) {
+      const int32 w = (width >> index) > 0 ? (width >> index) : 1;
+      const int32 h = (height >> index) > 0 ? (height >> index) : 1;
+      glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, index, gl_texture_format_internal[format], w, h, layer_count, 0, sizes[index] * layer_count, nullptr);
+      for (int32 layer = 0; layer < layer_count; layer++) {
+         glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+                                   index, // mip level
+                                   0, 0, layer,
+                                   w, h, 1,
+                                   gl_texture_format_internal[format],
+                                   sizes[layer * mip_count + index],
+                                   data[layer * mip_count + index]);
+      }
+   }
+   glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+   id_ = id;
+   width_ = width;
+   height_ = height;
+   layer_count_ = layer_count;
+
+   return is_valid();
+}
+
+bool texture_array::copy_layer(const int32 layer,
+                               const texture &source)
+{
+   assert(layer >= 0 && layer < layer_count_);
+
+   GLint width = 0;
+   GLint height = 0;
+   GLint compressed = GL_FALSE;
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D, source.id_);
+   glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+   glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+   glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+   glBindTexture(GL_TEXTURE_2D, 0);
+   if (compressed == GL_TRUE) {
+      return false;
+   }
+
+   GLuint framebuffers[2] = {};
+   glGenFramebuffers(2, framebuffers);
+   glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+   glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source.id_, 0);
+   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+   glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, id_, 0, layer);
+
+   const bool complete = glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE &&
+                         glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+   if (complete) {
+      glBlitFramebuffer(0, 0, width, height, 0, 0, width_, height_, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+   }
+
+   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   glDeleteFramebuffers(2, framebuffers);
+
+   return complete;
+}
+
+void texture_array::generate_mipmaps()
+{
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D_ARRAY, id_);
+   glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+   glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void texture_array::destroy()
+{
+   glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+   glDeleteTextures(1, &id_);
+   id_ = 0;
+   width_ = 0;
+   height_ = 0;
+   layer_count_ = 0;
+}
+
+vertex_buffer::vertex_buffer()
+   : id_(0)
+   , size_(0)
+{
+}
+
+bool vertex_buffer::is_valid() const
+{
+   return id_ != 0;
+}
+
+bool vertex_buffer::create(const int32 size,
+                           const void *data,
+                           const buffer_usage_hint hint)
+{
+   GLuint id = 0;
+   glGenBuffers(1, &id);
+   glBindBuffer(GL_ARRAY_BUFFER, id);
+   glBufferData(GL_ARRAY_BUFFER, size, data, gl_buffer_usage_hint[hint]);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+   id_ = id;
+   size_ = size;
+
+   return is_valid();
+}
+
+// note: bytes written into buffers after creation, the buffers write
+//       on their own so the backend picks this up when asked
+static int64 g_upload_bytes = 0;
+
+void vertex_buffer::update(const int32 size,
+                           const void *data)
+{
+   g_upload_bytes += size;
+   glBindBuffer(GL_ARRAY_BUFFER, id_);
+   if (size < size_) {
+      glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+   }
+   else {
+      glBufferData(GL_ARRAY_BUFFER, size_, 0, GL_STREAM_DRAW);
+      glBufferData(GL_ARRAY_BUFFER, size, data, GL_STREAM_DRAW);
+      size_ = size;
+   }
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void vertex_buffer::write(const int32 offset,
+                          const int32 size,
+                          const void *data)
+{
+   assert(offset + size <= size_);
+   g_upload_bytes += size;
+   glBindBuffer(GL_ARRAY_BUFFER, id_);
+   glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool vertex_buffer::read(const int32 offset,
+                         const int32 size,
+                         void *data) const
+{
+   if (!is_valid() || offset < 0 || offset + size > size_) {
+      return false;
+   }
+
+   glBindBuffer(GL_ARRAY_BUFFER, id_);
+   glGetBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+   return true;
+}
+
+void vertex_buffer::destroy()
+{
+   glDeleteBuffers(1, &id_);
+   id_ = 0;
+   size_ = 0;
+}
+
+streaming_buffer::streaming_buffer()
+   : id_(0)
+   , mapped_(nullptr)
+   , segment_size_(0)
+   , segment_count_(0)
+   , segment_index_(0)
+   , head_(0)
+   , fences_{}
+{
+}
+
+bool streaming_buffer::is_valid() const
+{
+   return id_ != 0;
+}
+
+bool streaming_buffer::create(const int32 segment_size,
+                              const int32 frames_in_flight)
+{
+   assert(segment_size > 0);
+   assert(frames_in_flight > 0 && frames_in_flight <= FRAME_LIMIT);
+
+   const GLsizeiptr size = GLsizeiptr(segment_size) * frames_in_flight;
+
+   GLuint id = 0;
+   glGenBuffers(1, &id);
+   glBindBuffer(GL_ARRAY_BUFFER, id);
+   if (GLAD_GL_VERSION_4_4) {
+      const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+      mapped_ = (uint8 *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+   }
+   else {
+      glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+   id_ = id;
+   segment_size_ = segment_size;
+   segment_count_ = frames_in_flight;
+   segment_index_ = 0;
+   head_ = 0;
+
+   return is_valid();
+}
+
+void streaming_buffer::begin_frame()
+{
+   // note: wait until the gpu is done with the segment we are about to reuse,
+   //       with enough frames in flight this never actually blocks
+   GLsync fence = (GLsync)fences_[segment_index_];
+   if (fence) {
+      GLenum result = glClientWaitSync(fence, 0, 0);
+      while (result == GL_TIMEOUT_EXPIRED) {
+         result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+      }
+      glDeleteSync(fence);
+      fences_[segment_index_] = nullptr;
+   }
+
+   head_ = 0;
+}
+
+int32 streaming_buffer::write(const int32 size,
+                              const void *data,
+                              const int32 alignment)
+{
+   assert(alignment > 0);
+
+   // note: alignment is not required to be a power of two, vertex data
+   //       is aligned to its stride so it can be addressed by first vertex
+   const int32 segment_start = segment_index_ * segment_size_;
+   const int32 offset = align_offset(segment_start + head_, alignment);
+   const int32 start = offset - segment_start;
+   if (start + size > segment_size_) {
+      assert(!"streaming buffer segment exhausted");
+      return -1;
+   }
+
+   if (size == 0) {
+      return offset;
+   }
+
+   g_upload_bytes += size;
+   if (mapped_) {
+      memcpy(mapped_ + offset, data, size);
+   }
+   else {
+      glBindBuffer(GL_ARRAY_BUFFER, id_);
+      void *dst = glMapBufferRange(GL_ARRAY_BUFFER,
+                                   offset,
+                                   size,
+                                   GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+      if (dst) {
+         memcpy(dst, data, size);
+      }
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+   }
+
+   head_ = start + size;
+
+   return offset;
+}
+
+int32 streaming_buffer::available() const
+{
+   return segment_size_ - head_;
+}
+
+// static
+int32 streaming_buffer::align_offset(const int32 position,
+                                     const int32 alignment)
+{
+   return ((position + alignment - 1) / alignment) * alignment;
+}
+
+void streaming_buffer::end_frame()
+{
+   fences_[segment_index_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   segment_index_ = (segment_index_ + 1) % segment_count_;
+   head_ = 0;
+}
+
+void streaming_buffer::destroy()
 {
-   glBindTexture(GL_TEXTURE_2D, 0);
-   glDeleteTextures(1, &id_);
+   for (auto &fence : fences_) {
+      if (fence) {
+         glDeleteSync((GLsync)fence);
+         fence = nullptr;
+      }
+   }
+
+   if (mapped_) {
+      glBindBuffer(GL_ARRAY_BUFFER, id_);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      mapped_ = nullptr;
+   }
+
+   glDeleteBuffers(1, &id_);
    id_ = 0;
+   segment_size_ = 0;
+   segment_count_ = 0;
+   segment_index_ = 0;
+   head_ = 0;
 }
 
-vertex_buffer::vertex_buffer()
+index_buffer::index_buffer()
    : id_(0)
    , size_(0)
 {
 }
 
-bool vertex_buffer::is_valid() const
+bool index_buffer::is_valid() const
 {
    return id_ != 0;
 }
 
-bool vertex_buffer::create(const int32 size,
-                           const void *data,
-                           const buffer_usage_hint hint)
+bool index_buffer::create(const int32 size,
+                          const void *data)
 {
    GLuint id = 0;
    glGenBuffers(1, &id);
-   glBindBuffer(GL_ARRAY_BUFFER, id);
-   glBufferData(GL_ARRAY_BUFFER, size, data, gl_buffer_usage_hint[hint]);
-   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
    id_ = id;
    size_ = size;
@@ -441,56 +1319,66 @@ bool vertex_buffer::create(const int32 size,
    return is_valid();
 }
 
-void vertex_buffer::update(const int32 size,
-                           const void *data)
+void index_buffer::write(const int32 offset,
+                         const int32 size,
+                         const void *data)
 {
-   glBindBuffer(GL_ARRAY_BUFFER, id_);
-   if (size < size_) {
-      glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
-   }
-   else {
-      glBufferData(GL_ARRAY_BUFFER, size_, 0, GL_STREAM_DRAW);
-      glBufferData(GL_ARRAY_BUFFER, size, data, GL_STREAM_DRAW);
-      size_ = size;
-   }
-   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   assert(offset + size <= size_);
+   g_upload_bytes += size;
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id_);
+   glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, size, data);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
-void vertex_buffer::destroy()
+void index_buffer::destroy()
 {
    glDeleteBuffers(1, &id_);
    id_ = 0;
    size_ = 0;
 }
 
-index_buffer::index_buffer()
+storage_buffer::storage_buffer()
    : id_(0)
+   , size_(0)
 {
 }
 
-bool index_buffer::is_valid() const
+bool storage_buffer::is_valid() const
 {
    return id_ != 0;
 }
 
-bool index_buffer::create(const int32 size,
-                          const void *data)
+bool storage_buffer::create(const int32 size,
+                            const void *data)
 {
    GLuint id = 0;
    glGenBuffers(1, &id);
-   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
-   glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
-   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+   glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+   glBufferData(GL_COPY_WRITE_BUFFER, size, data, GL_DYNAMIC_DRAW);
+   glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 
    id_ = id;
+   size_ = size;
 
    return is_valid();
 }
 
-void index_buffer::destroy()
+void storage_buffer::write(const int32 offset,
+                           const int32 size,
+                           const void *data)
+{
+   assert(offset + size <= size_);
+   g_upload_bytes += size;
+   glBindBuffer(GL_COPY_WRITE_BUFFER, id_);
+   glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+   glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void storage_buffer::destroy()
 {
    glDeleteBuffers(1, &id_);
    id_ = 0;
+   size_ = 0;
 }
 
 sampler_state::sampler_state()
@@ -669,6 +1557,133 @@ texture framebuffer::color_attachment_as_texture(const int32 index) const
    return result;
 }
 
+gpu_timer::gpu_timer()
+   : queries_{}
+   , count_(0)
+   , index_(0)
+   , pending_(0)
+   , active_(false)
+{
+}
+
+bool gpu_timer::is_valid() const
+{
+   return count_ > 0;
+}
+
+bool gpu_timer::create(const int32 latency)
+{
+   assert(latency > 0 && latency <= QUERY_LIMIT);
+
+   glGenQueries(latency, queries_);
+   count_ = latency;
+   index_ = 0;
+   pending_ = 0;
+
+   return is_valid();
+}
+
+void gpu_timer::destroy()
+{
+   if (count_ > 0) {
+      glDeleteQueries(count_, queries_);
+   }
+
+   for (auto &query : queries_) {
+      query = 0;
+   }
+   count_ = 0;
+   pending_ = 0;
+}
+
+void gpu_timer::begin()
+{
+   // note: every query is still in flight, this frame goes untimed
+   active_ = is_valid() && pending_ < count_;
+   if (active_) {
+      glBeginQuery(GL_TIME_ELAPSED, queries_[index_]);
+   }
+}
+
+void gpu_timer::end()
+{
+   if (!active_) {
+      return;
+   }
+
+   glEndQuery(GL_TIME_ELAPSED);
+   index_ = (index_ + 1) % count_;
+   pending_++;
+   active_ = false;
+}
+
+bool gpu_timer::resolve(float &milliseconds)
+{
+   if (pending_ == 0) {
+      return false;
+   }
+
+   const uint32 oldest = queries_[(index_ - pending_ + count_) % count_];
+   GLint available = 0;
+   glGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+   if (!available) {
+      return false;
+   }
+
+   GLuint64 nanoseconds = 0;
+   glGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &nanoseconds);
+   milliseconds = float(double(nanoseconds) / 1000000.0);
+   pending_--;
+
+   return true;
+}
+
+gpu_fence::gpu_fence()
+   : sync_(nullptr)
+{
+}
+
+bool gpu_fence::is_valid() const
+{
+   return sync_ != nullptr;
+}
+
+void gpu_fence::insert()
+{
+   destroy();
+   sync_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool gpu_fence::wait(const int64 timeout_microseconds)
+{
+   if (!is_valid()) {
+      return true;
+   }
+
+   const GLuint64 timeout = GLuint64(timeout_microseconds) * 1000;
+   const GLenum result = glClientWaitSync((GLsync)sync_, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+   return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+bool gpu_fence::is_signaled() const
+{
+   if (!is_valid()) {
+      return true;
+   }
+
+   GLint status = GL_UNSIGNALED;
+   glGetSynciv((GLsync)sync_, GL_SYNC_STATUS, sizeof(status), nullptr, &status);
+   return status == GL_SIGNALED;
+}
+
+void gpu_fence::destroy()
+{
+   if (sync_) {
+      glDeleteSync((GLsync)sync_);
+      sync_ = nullptr;
+   }
+}
+
 vertex_layout::vertex_layout()
    : stride_(0)
    , attribute_count_(0)
@@ -679,15 +1694,18 @@ vertex_layout::vertex_layout()
 void vertex_layout::add_attribute(const int32 index,
                                   attribute_format format,
                                   const int32 count,
-                                  const bool normalized)
+                                  const bool normalized,
+                                  const int32 divisor)
 {
    assert(attribute_count_ < array_size(attributes_));
+   assert(format != ATTRIBUTE_FORMAT_INT_2_10_10_10 || count == 4);
 
    const int32 at = attribute_count_++;
    attributes_[at].command_index_ = index;
    attributes_[at].format_ = format;
    attributes_[at].count_ = count;
    attributes_[at].offset_ = stride_;
+   attributes_[at].divisor_ = divisor;
    attributes_[at].normalized_ = normalized;
 
    stride_ += count * gl_attribute_size[format];
@@ -697,7 +1715,7 @@ void vertex_layout::clear()
 {
    stride_ = 0;
    attribute_count_ = 0;
-   for (int32 index = 0; index < 8; index++) {
+   for (int32 index = 0; index < ATTRIBUTE_LIMIT; index++) {
       attributes_[index] = {};
    }
 }
@@ -707,6 +1725,7 @@ void vertex_layout::clear()
 static GLuint g_vertex_array_object = 0;
 
 render_backend::render_backend()
+   : counters_{}
 {
    if (g_vertex_array_object == 0) {
       glGenVertexArrays(1, &g_vertex_array_object);
@@ -723,6 +1742,34 @@ render_backend::~render_backend()
    }
 }
 
+render_counters render_backend::counters() const
+{
+   render_counters result = counters_;
+   result.upload_bytes_ = g_upload_bytes;
+   return result;
+}
+
+void render_backend::reset_counters()
+{
+   counters_ = {};
+   g_upload_bytes = 0;
+}
+
+const char *render_backend::vendor() const
+{
+   return (const char *)glGetString(GL_VENDOR);
+}
+
+const char *render_backend::renderer() const
+{
+   return (const char *)glGetString(GL_RENDERER);
+}
+
+const char *render_backend::version() const
+{
+   return (const char *)glGetString(GL_VERSION);
+}
+
 void render_backend::clear(const float red,
                            const float green,
                            const float blue,
@@ -735,6 +1782,71 @@ void render_backend::clear(const float red,
    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
+void render_backend::clear_color(const float red,
+                                 const float green,
+                                 const float blue,
+                                 const float alpha)
+{
+   glClearColor(red, green, blue, alpha);
+   glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void render_backend::clear_depth(const float depth)
+{
+   glDepthMask(GL_TRUE);
+   glClearDepth(depth);
+   glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void render_backend::invalidate_framebuffer(const framebuffer &handle,
+                                            const bool color,
+                                            const bool depth)
+{
+   if (!GLAD_GL_VERSION_4_3) {
+      return;
+   }
+
+   // note: attachments the framebuffer does not have are ignored
+   GLenum attachments[framebuffer::ATTACHMENT_LIMIT + 1] = {};
+   GLsizei count = 0;
+   if (color) {
+      for (int32 index = 0; index < framebuffer::ATTACHMENT_LIMIT; index++) {
+         attachments[count++] = GL_COLOR_ATTACHMENT0 + index;
+      }
+   }
+   if (depth) {
+      attachments[count++] = GL_DEPTH_STENCIL_ATTACHMENT;
+   }
+
+   if (count > 0) {
+      glBindFramebuffer(GL_FRAMEBUFFER, handle.id_);
+      glInvalidateFramebuffer(GL_FRAMEBUFFER, count, attachments);
+   }
+}
+
+void render_backend::invalidate_backbuffer(const bool color,
+                                           const bool depth)
+{
+   if (!GLAD_GL_VERSION_4_3) {
+      return;
+   }
+
+   GLenum attachments[3] = {};
+   GLsizei count = 0;
+   if (color) {
+      attachments[count++] = GL_COLOR;
+   }
+   if (depth) {
+      attachments[count++] = GL_DEPTH;
+      attachments[count++] = GL_STENCIL;
+   }
+
+   if (count > 0) {
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glInvalidateFramebuffer(GL_FRAMEBUFFER, count, attachments);
+   }
+}
+
 void render_backend::set_viewport(const int32 x,
                                   const int32 y,
                                   const int32 width,
@@ -745,17 +1857,20 @@ void render_backend::set_viewport(const int32 x,
 
 void render_backend::set_framebuffer(const framebuffer &handle)
 {
+   counters_.state_changes_++;
    glBindFramebuffer(GL_FRAMEBUFFER, handle.id_);
    set_viewport(0, 0, handle.width_, handle.height_);
 }
 
 void render_backend::reset_framebuffer()
 {
+   counters_.state_changes_++;
    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void render_backend::set_shader_program(const shader_program &handle)
 {
+   counters_.state_changes_++;
    glUseProgram(handle.id_);
 }
 
@@ -765,6 +1880,7 @@ void render_backend::set_shader_uniform(const shader_program &handle,
                                         const int32 count,
                                         const void *value)
 {
+   counters_.uniform_uploads_++;
    GLint location = glGetUniformLocation(handle.id_, name);
    if (location == -1)
       return;
@@ -792,6 +1908,10 @@ void render_backend::set_shader_uniform(const shader_program &handle,
       {
          glUniform1iv(location, count, (const GLint *)value);
       } break;
+      case UNIFORM_TYPE_IVEC2:
+      {
+         glUniform2iv(location, count, (const GLint *)value);
+      } break;
       case UNIFORM_TYPE_MATRIX:
       {
          glUniformMatrix4fv(location, count, GL_FALSE, (const GLfloat *)value);
@@ -801,18 +1921,29 @@ void render_backend::set_shader_uniform(const shader_program &handle,
 
 void render_backend::set_index_buffer(const index_buffer &handle)
 {
+   counters_.state_changes_++;
    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle.id_);
 }
 
 void render_backend::set_vertex_buffer(const vertex_buffer &handle)
 {
+   counters_.state_changes_++;
+   glBindBuffer(GL_ARRAY_BUFFER, handle.id_);
+}
+
+void render_backend::set_vertex_buffer(const streaming_buffer &handle)
+{
+   counters_.state_changes_++;
    glBindBuffer(GL_ARRAY_BUFFER, handle.id_);
 }
 
-void render_backend::set_vertex_layout(const vertex_layout &layout)
+void render_backend::set_vertex_layout(const vertex_layout &layout,
+                                       const int32 offset)
 {
-   // note: disable all attributes
-   for (int32 index = 0; index < array_size(layout.attributes_); index++) {
+   counters_.state_changes_++;
+   // note: disable all attributes, including per-draw streams above
+   //       the layout limit (16 is the minimum gl guarantees)
+   for (int32 index = 0; index < 16; index++) {
       glDisableVertexAttribArray(index);
    }
 
@@ -829,13 +1960,122 @@ void render_backend::set_vertex_layout(const vertex_layout &layout)
                             gl_attribute_type[attribute.format_],
                             attribute.normalized_,
                             vertex_stride,
-                            (const void *)(uintptr_t)attribute.offset_);
+                            (const void *)(uintptr_t)(offset + attribute.offset_));
+      glVertexAttribDivisor(attribute.command_index_, attribute.divisor_);
+   }
+}
+
+void render_backend::set_vertex_stream(const streaming_buffer &handle,
+                                       const vertex_layout &layout,
+                                       const int32 offset)
+{
+   counters_.state_changes_++;
+   glBindBuffer(GL_ARRAY_BUFFER, handle.id_);
+   for (int32 attribute_index = 0;
+        attribute_index < layout.attribute_count_;
+        attribute_index++)
+   {
+      const auto &attribute = layout.attributes_[attribute_index];
+      glEnableVertexAttribArray(attribute.command_index_);
+      glVertexAttribPointer(attribute.command_index_,
+                            attribute.count_,
+                            gl_attribute_type[attribute.format_],
+                            attribute.normalized_,
+                            layout.stride_,
+                            (const void *)(uintptr_t)(offset + attribute.offset_));
+      glVertexAttribDivisor(attribute.command_index_, attribute.divisor_);
+   }
+}
+
+void render_backend::set_indirect_buffer(const streaming_buffer &handle)
+{
+   counters_.state_changes_++;
+   glBindBuffer(GL_DRAW_INDIRECT_BUFFER, handle.id_);
+}
+
+void render_backend::set_indirect_buffer(const storage_buffer &handle)
+{
+   counters_.state_changes_++;
+   glBindBuffer(GL_DRAW_INDIRECT_BUFFER, handle.id_);
+}
+
+void render_backend::set_storage_buffer(const storage_buffer &handle,
+                                        const int32 binding)
+{
+   counters_.state_changes_++;
+   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, handle.id_);
+}
+
+void render_backend::set_storage_buffer(const streaming_buffer &handle,
+                                        const int32 binding,
+                                        const int32 offset,
+                                        const int32 size)
+{
+   counters_.state_changes_++;
+   glBindBufferRange(GL_SHADER_STORAGE_BUFFER, GLuint(binding), handle.id_, GLintptr(offset), GLsizeiptr(size));
+}
+
+int32 render_backend::set_uniform_block(const shader_program &handle,
+                                         const char *name,
+                                         const int32 binding)
+{
+   const GLuint index = glGetUniformBlockIndex(handle.id_, name);
+   if (index == GL_INVALID_INDEX) {
+      return -1;
+   }
+
+   GLint size = 0;
+   glGetActiveUniformBlockiv(handle.id_, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+   glUniformBlockBinding(handle.id_, index, GLuint(binding));
+
+   return int32(size);
+}
+
+int32 render_backend::uniform_block_members(const shader_program &handle,
+                                            const char *name,
+                                            uniform_block_member *members,
+                                            const int32 capacity)
+{
+   const GLuint index = glGetUniformBlockIndex(handle.id_, name);
+   if (index == GL_INVALID_INDEX) {
+      return -1;
+   }
+
+   GLint count = 0;
+   glGetActiveUniformBlockiv(handle.id_, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &count);
+
+   GLint indices[32] = {};
+   if (count > GLint(array_size(indices))) {
+      assert(!"uniform block has too many members");
+      return -1;
+   }
+   glGetActiveUniformBlockiv(handle.id_, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices);
+
+   const int32 result = count < capacity ? int32(count) : capacity;
+   for (int32 at = 0; at < result; at++) {
+      const GLuint uniform = GLuint(indices[at]);
+      GLint offset = -1;
+      glGetActiveUniformsiv(handle.id_, 1, &uniform, GL_UNIFORM_OFFSET, &offset);
+      glGetActiveUniformName(handle.id_, uniform, GLsizei(sizeof(members[at].name_)), nullptr, members[at].name_);
+      members[at].offset_ = int32(offset);
    }
+
+   return result;
+}
+
+void render_backend::set_uniform_buffer(const streaming_buffer &handle,
+                                        const int32 binding,
+                                        const int32 offset,
+                                        const int32 size)
+{
+   counters_.uniform_uploads_++;
+   glBindBufferRange(GL_UNIFORM_BUFFER, GLuint(binding), handle.id_, GLintptr(offset), GLsizeiptr(size));
 }
 
 void render_backend::set_texture(const texture &handle,
                                  const int32 unit)
 {
+   counters_.texture_binds_++;
    assert(unit >= 0 && unit < 4);
    const GLenum units[] =
    {
@@ -852,13 +2092,23 @@ void render_backend::set_texture(const texture &handle,
 void render_backend::set_cubemap(const cubemap &handle,
                                  const int32 unit)
 {
+   counters_.texture_binds_++;
    glActiveTexture(GL_TEXTURE0 + unit);
    glBindTexture(GL_TEXTURE_CUBE_MAP, handle.id_);
 }
 
+void render_backend::set_texture_array(const texture_array &handle,
+                                       const int32 unit)
+{
+   counters_.texture_binds_++;
+   glActiveTexture(GL_TEXTURE0 + unit);
+   glBindTexture(GL_TEXTURE_2D_ARRAY, handle.id_);
+}
+
 void render_backend::set_sampler_state(const sampler_state &handle,
                                        const int32 unit)
 {
+   counters_.state_changes_++;
    glBindSampler(unit, handle.id_);
 }
 
@@ -870,6 +2120,7 @@ void render_backend::set_blend_state(const bool enabled,
                                      const blend_factor src_alpha,
                                      const blend_factor dst_alpha)
 {
+   counters_.state_changes_++;
    if (enabled) {
       glEnable(GL_BLEND);
       glBlendFuncSeparate(gl_blend_ft[src_rgb],
@@ -890,6 +2141,7 @@ void render_backend::set_depth_state(const bool testing,
                                      const float range_far,
                                      const compare_func func)
 {
+   counters_.state_changes_++;
    if (testing) {
       glEnable(GL_DEPTH_TEST);
       glDepthFunc(gl_compare_func[func]);
@@ -906,10 +2158,28 @@ void render_backend::set_depth_state(const bool testing,
    glDepthRange(range_near, range_far);
 }
 
+void render_backend::set_color_write(const bool enabled)
+{
+   counters_.state_changes_++;
+   const GLboolean mask = enabled ? GL_TRUE : GL_FALSE;
+   glColorMask(mask, mask, mask, mask);
+}
+
+void render_backend::set_program_point_size(const bool enabled)
+{
+   if (enabled) {
+      glEnable(GL_PROGRAM_POINT_SIZE);
+   }
+   else {
+      glDisable(GL_PROGRAM_POINT_SIZE);
+   }
+}
+
 void render_backend::set_rasterizer_state(const cull_mode cull_mode,
                                           const front_face front_face,
                                           const polygon_mode polygon)
 {
+   counters_.state_changes_++;
    if (cull_mode != CULL_MODE_NONE) {
       glEnable(GL_CULL_FACE);
       glCullFace(gl_cull_mode[cull_mode]);
@@ -926,19 +2196,130 @@ void render_backend::draw(const primitive_topology topology,
                           const int32 start_index,
                           const int32 primitive_count)
 {
+   counters_.draw_calls_++;
    glDrawArrays(gl_primitive_topology[topology],
                 start_index,
                 primitive_count);
 }
 
+void render_backend::draw_instanced(const primitive_topology topology,
+                                    const int32 start_index,
+                                    const int32 primitive_count,
+                                    const int32 instance_count)
+{
+   counters_.draw_calls_++;
+   glDrawArraysInstanced(gl_primitive_topology[topology],
+                         start_index,
+                         primitive_count,
+                         instance_count);
+}
+
 void render_backend::draw_indexed(const primitive_topology topology,
                                   const index_type type,
                                   const int32 start_index,
-                                  const int32 primitive_count)
+                                  const int32 primitive_count,
+                                  const int32 base_vertex)
+{
+   counters_.draw_calls_++;
+   glDrawElementsBaseVertex(gl_primitive_topology[topology],
+                            primitive_count,
+                            gl_index_type[type],
+                            (const void *)(uintptr_t)(gl_index_size[type] * start_index),
+                            base_vertex);
+}
+
+void render_backend::draw_indirect(const primitive_topology topology,
+                                   const int32 offset,
+                                   const int32 draw_count)
+{
+   counters_.draw_calls_++;
+   assert(is_multi_draw_indirect_supported());
+   glMultiDrawArraysIndirect(gl_primitive_topology[topology],
+                             (const void *)(uintptr_t)offset,
+                             draw_count,
+                             sizeof(draw_arrays_command));
+}
+
+void render_backend::draw_indexed_indirect(const primitive_topology topology,
+                                           const index_type type,
+                                           const int32 offset,
+                                           const int32 draw_count)
+{
+   counters_.draw_calls_++;
+   assert(is_multi_draw_indirect_supported());
+   glMultiDrawElementsIndirect(gl_primitive_topology[topology],
+                               gl_index_type[type],
+                               (const void *)(uintptr_t)offset,
+                               draw_count,
+                               sizeof(draw_elements_command));
+}
+
+// static
+bool render_backend::is_multi_draw_indirect_supported()
+{
+   // note: base instance (4.2) picks the per-draw data, the multi draw
+   //       entry points are only loaded by glad for a 4.3 context
+   static const bool supported = GLAD_GL_VERSION_4_3 != 0;
+   return supported;
+}
+
+// static
+int32 render_backend::uniform_buffer_alignment()
+{
+   // note: offsets of bound uniform ranges must be a multiple of this,
+   //       commonly 256 on desktop
+   static const int32 alignment = []() {
+      GLint value = 0;
+      glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &value);
+      return value > 0 ? int32(value) : 256;
+   }();
+   return alignment;
+}
+
+// static
+int32 render_backend::storage_buffer_alignment()
+{
+   // note: the same for bound storage ranges, 16 to 256 on desktop
+   static const int32 alignment = []() {
+      GLint value = 0;
+      glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &value);
+      return value > 0 ? int32(value) : 256;
+   }();
+   return alignment;
+}
+
+void render_backend::begin_feedback(const vertex_buffer &handle)
+{
+   glEnable(GL_RASTERIZER_DISCARD);
+   glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, handle.id_);
+   glBeginTransformFeedback(GL_POINTS);
+}
+
+void render_backend::end_feedback()
+{
+   glEndTransformFeedback();
+   glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+   glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void render_backend::dispatch(const int32 group_count_x,
+                              const int32 group_count_y,
+                              const int32 group_count_z)
+{
+   counters_.dispatches_++;
+   assert(is_compute_supported());
+   glDispatchCompute(GLuint(group_count_x), GLuint(group_count_y), GLuint(group_count_z));
+}
+
+void render_backend::storage_barrier()
+{
+   glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+// static
+bool render_backend::is_compute_supported()
 {
-   // todo: glDrawElementsBaseVertex
-   glDrawElements(gl_primitive_topology[topology],
-                  primitive_count,
-                  gl_index_type[type],
-                  (const void *)(uintptr_t)(gl_index_size[type] * start_index));
+   // note: compute shaders and shader storage buffers are both 4.3
+   static const bool supported = GLAD_GL_VERSION_4_3 != 0;
+   return supported;
 }
@@ -38,38 +38,74 @@ button_callback(GLFWwindow *window, int button, int action, int mods)
    app->on_button(button, action == GLFW_PRESS);
 }
 
+static void
+error_callback(int code, const char *message)
+{
+   printf("!!! %s (%d)\n", message, code);
+}
+
 render_context::render_context(const char *title, int width, int height, void *userdata)
    : m_window(nullptr)
 {
-   glfwSetErrorCallback([](int code, const char *message) {
-      printf("!!! %s (%d)\n", message, code);
-   });
+   glfwSetErrorCallback(error_callback);
 
    if (!glfwInit()) {
       return;
    }
 
-   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+   // note: ask for the newest context we can make use of, e.g. persistent
+   //       mapped buffers, and fall back to the 3.3 baseline. versions
+   //       the driver does not have are expected to fail, so errors are
+   //       only reported once nothing could be created
+   const int versions[][2] = { { 4, 6 }, { 4, 5 }, { 4, 4 }, { 4, 3 }, { 3, 3 } };
+   GLFWwindow *window = nullptr;
+   glfwSetErrorCallback(nullptr);
+   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-   GLFWwindow *window = glfwCreateWindow(width, height, title, nullptr, nullptr);
+   for (const auto &version : versions) {
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+      window = glfwCreateWindow(width, height, title, nullptr, nullptr);
+      if (window) {
+         break;
+      }
+   }
+   glfwSetErrorCallback(error_callback);
+
    if (window == nullptr) {
+      const char *message = nullptr;
+      const int code = glfwGetError(&message);
+      error_callback(code, message ? message : "could not create an opengl 3.3 core context");
       return;
    }
 
    glfwMakeContextCurrent(window);
-   glfwSwapInterval(1);
    if (gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) == 0) {
       glfwDestroyWindow(window);
       return;
    }
 
+   // note: let the driver compile shaders on as many threads as it likes
+   if (glfwExtensionSupported("GL_KHR_parallel_shader_compile") ||
+       glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+   {
+      using max_shader_compiler_threads_proc = void (APIENTRYP)(GLuint count);
+      auto max_shader_compiler_threads = (max_shader_compiler_threads_proc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+      if (max_shader_compiler_threads == nullptr) {
+         max_shader_compiler_threads = (max_shader_compiler_threads_proc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+      }
+      if (max_shader_compiler_threads) {
+         max_shader_compiler_threads(0xffffffffu);
+      }
+   }
+
    glfwSetKeyCallback(window, key_callback);
    glfwSetCursorPosCallback(window, mouse_callback);
    glfwSetMouseButtonCallback(window, button_callback);
    glfwSetWindowUserPointer(window, userdata);
 
    m_window = window;
+   set_present_mode(m_present_mode);
 }
 
 render_context::~render_context()
@@ -101,3 +137,23 @@ void render_context::swap_buffers()
 
    glfwSwapBuffers(m_window);
 }
+
+void render_context::set_present_mode(const present_mode mode)
+{
+   if (!valid()) {
+      return;
+   }
+
+   present_mode result = mode;
+   if (result == PRESENT_MODE_ADAPTIVE &&
+       !glfwExtensionSupported("WGL_EXT_swap_control_tear") &&
+       !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+   {
+      result = PRESENT_MODE_VSYNC;
+   }
+
+   // note: a negative interval is how swap control tear asks for adaptive
+   const int intervals[] = { 0, 1, -1 };
+   glfwSwapInterval(intervals[result]);
+   m_present_mode = result;
+}
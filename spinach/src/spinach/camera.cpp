@@ -13,6 +13,8 @@ camera::camera(const glm::mat4 &projection)
    , m_position(0.0f, 0.0f, 0.0f)
    , m_view(1.0f)
    , m_projection(projection)
+   , m_jittered_projection(projection)
+   , m_previous_view(1.0f)
 {
 }
 
@@ -96,11 +98,34 @@ void camera::rotate_z(const float amount)
 void camera::set_projection(const glm::mat4 &projection)
 {
    m_projection = projection;
+   m_jittered_projection = projection;
+   m_jitter = glm::vec2(0.0f);
+}
+
+void camera::set_jitter(const glm::vec2 &offset, const int32 width, const int32 height)
+{
+   // note: shifts clip space after the perspective divide, the image
+   //       moves by -offset pixels
+   m_jitter = offset;
+   m_jittered_projection = m_projection;
+   m_jittered_projection[2][0] += 2.0f * offset.x / float(width);
+   m_jittered_projection[2][1] += 2.0f * offset.y / float(height);
+}
+
+void camera::end_frame()
+{
+   m_previous_view = m_view;
+   m_has_previous = true;
 }
 
 void camera::bind(render_backend &backend, const shader_program &program)
 {
+   const glm::mat4 view_projection = m_projection * m_view;
+   const glm::mat4 previous_view_projection = m_projection * (m_has_previous ? m_previous_view : m_view);
+
    backend.set_shader_program(program);
-   backend.set_shader_uniform(program, UNIFORM_TYPE_MATRIX, "u_projection", 1, glm::value_ptr(m_projection));
+   backend.set_shader_uniform(program, UNIFORM_TYPE_MATRIX, "u_projection", 1, glm::value_ptr(m_jittered_projection));
    backend.set_shader_uniform(program, UNIFORM_TYPE_MATRIX, "u_view", 1, glm::value_ptr(m_view));
+   backend.set_shader_uniform(program, UNIFORM_TYPE_MATRIX, "u_view_projection", 1, glm::value_ptr(view_projection));
+   backend.set_shader_uniform(program, UNIFORM_TYPE_MATRIX, "u_previous_view_projection", 1, glm::value_ptr(previous_view_projection));
 }
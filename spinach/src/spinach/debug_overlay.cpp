@@ -5,36 +5,22 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstdarg>
+#include <cstring>
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-struct vertex2d
-{
-   float x, y;
-   float u, v;
-};
+static_assert(sizeof(debug_overlay::glyph) == 8, "unexpected glyph instance size");
+
+static const int32 k_text_scale = 2;
+static const float k_character_width = 8.0f;
+static const float k_character_height = 8.0f;
+static const float k_newline_advance_y = 10.0f;
+static const float k_tab_advance_x = k_character_width * 4;
 
 static void
-update_debug_text(vertex_buffer &buffer, int &count, const int scale, const float x, float y, const std::vector<std::string> &lines)
+build_line_glyphs(std::vector<debug_overlay::glyph> &glyphs, const std::string_view text, const int scale, const float x, const float y)
 {
-   std::size_t capacity = 0;
-   for (const auto &text : lines) {
-      capacity += text.size() * 6;
-   }
-
-   std::vector<float> vertices;
-   vertices.reserve(capacity);
-
-   const int32 character_column_count = 16;
-   const int32 character_row_count = 16;
-   const float character_width = 8.0f;
-   const float character_height = 8.0f;
-   const float newline_advance_y = 10.0f;
-   const float tab_advance_x = character_width * 4;
-   const float texture_width_factor = 1.0f / character_column_count;
-   const float texture_height_factor = 1.0f / character_row_count;
-
    const int32 first_valid_character = ' ';
    const int32 last_valid_character = '~';
    const int32 invalid_character_index = '?';
@@ -42,106 +28,248 @@ update_debug_text(vertex_buffer &buffer, int &count, const int scale, const floa
    float x_position = x;
    float y_position = y;
 
-   for (const auto &text : lines) {
-      for (auto &ch : text) {
-         int32 character_index = static_cast<int32>(ch);
-         if (character_index == int32('\n')) {
-            x_position = x;
-            y_position += newline_advance_y * scale;
-            continue;
-         }
-         else if (character_index == int32('\t')) {
-            x_position += tab_advance_x;
-            continue;
-         }
-
-         if (character_index < first_valid_character ||
-             character_index > last_valid_character)
-         {
-            character_index = invalid_character_index;
-         }
-
-         const float x0 = x_position;
-         const float y0 = y_position;
-         const float x1 = x0 + character_width * scale;
-         const float y1 = y0 + character_height * scale;
-
-         const float u0 = (character_index % character_column_count) * texture_width_factor;
-         const float v0 = (character_index / character_column_count) * texture_height_factor;
-         const float u1 = u0 + texture_width_factor;
-         const float v1 = v0 + texture_height_factor;
-
-         const float verts[] =
-         {
-            x0, y0, u0, v0,
-            x1, y0, u1, v0,
-            x1, y1, u1, v1,
-
-            x1, y1, u1, v1,
-            x0, y1, u0, v1,
-            x0, y0, u0, v0,
-         };
-
-         for (auto &vert : verts) {
-            vertices.push_back(vert);
-         }
-
-         x_position += character_width * scale;
+   glyphs.clear();
+   for (auto &ch : text) {
+      // note: the capacity is reserved up front, the rest is cut off
+      if (glyphs.size() == glyphs.capacity()) {
+         break;
       }
 
-      x_position = x;
-   }
+      int32 character_index = static_cast<int32>(ch);
+      if (character_index == int32('\n')) {
+         x_position = x;
+         y_position += k_newline_advance_y * scale;
+         continue;
+      }
+      else if (character_index == int32('\t')) {
+         x_position += k_tab_advance_x;
+         continue;
+      }
+      else if (character_index == int32(' ')) {
+         x_position += k_character_width * scale;
+         continue;
+      }
 
-   if (!buffer.is_valid()) {
-      if (!buffer.create(sizeof(vertex2d) * int(vertices.size()), vertices.data(), BUFFER_USAGE_HINT_DYNAMIC)) {
-         assert(false);
+      if (character_index < first_valid_character ||
+          character_index > last_valid_character)
+      {
+         character_index = invalid_character_index;
       }
+
+      debug_overlay::glyph result{};
+      result.m_x = uint16(x_position);
+      result.m_y = uint16(y_position);
+      result.m_character = uint8(character_index);
+      result.m_scale = uint8(scale);
+      glyphs.push_back(result);
+
+      x_position += k_character_width * scale;
    }
-   else {
-      buffer.update(sizeof(vertex2d) * int(vertices.size()), vertices.data());
+}
+
+static debug_overlay::glyph
+make_bar(const float x, const float y, const int32 width, const int32 height, const debug_overlay::bar_color color)
+{
+   debug_overlay::glyph result{};
+   result.m_x = uint16(x);
+   result.m_y = uint16(y);
+   result.m_character = uint8(color);
+   result.m_width = uint8(width);
+   result.m_height = uint8(height);
+   return result;
+}
+
+// note: bars grow up from the bottom of the graph, twice the budget 
+//       fills it. the budget line goes on top
+static void
+push_graph_bars(std::vector<debug_overlay::glyph> &glyphs, const float *milliseconds, const int32 count, const float budget, const float x, const float y)
+{
+   const int32 graph_height = debug_overlay::GRAPH_HEIGHT;
+   const int32 bar_width = debug_overlay::GRAPH_BAR_WIDTH;
+   const float bottom = y + float(graph_height);
+
+   for (int32 index = 0; index < count; index++) {
+      const float fraction = milliseconds[index] / (budget * 2.0f);
+      int32 height = int32(fraction * float(graph_height) + 0.5f);
+      height = height < 1 ? 1 : (height > graph_height ? graph_height : height);
+
+      const auto color = milliseconds[index] > budget ? debug_overlay::BAR_COLOR_OVER_BUDGET : debug_overlay::BAR_COLOR_NORMAL;
+      glyphs.push_back(make_bar(x + float(index * bar_width), bottom - float(height), bar_width, height, color));
    }
 
-   count = int(vertices.size());
+   int32 width = count * bar_width;
+   width = width > 255 ? 255 : width;
+   glyphs.push_back(make_bar(x, bottom - float(graph_height / 2), width, 1, debug_overlay::BAR_COLOR_BUDGET));
 }
 
-debug_overlay::debug_overlay(shader_program *program, 
-                             texture *texture, 
+debug_overlay::debug_overlay(shader_program *program,
+                             texture *texture,
                              sampler_state *sampler,
-                             vertex_layout *layout)
+                             streaming_buffer *stream)
    : m_projection(glm::mat4(1.0f))
    , m_material(program, texture, sampler)
-   , m_layout(layout)
+   , m_stream(stream)
 {
+   m_layout.add_attribute(0, vertex_layout::ATTRIBUTE_FORMAT_UNSIGNED_SHORT, 2, false, 1);
+   m_layout.add_attribute(1, vertex_layout::ATTRIBUTE_FORMAT_BYTE, 4, false, 1);
+
+   m_material.set_parameter(material::parameter_id("u_glyph_size"), glm::vec2(k_character_width, k_character_height));
+
+   m_lines.reserve(LINE_LIMIT);
+   m_cache.resize(LINE_LIMIT);
+   for (auto &line : m_cache) {
+      line.m_glyphs.reserve(LINE_GLYPH_LIMIT);
+   }
+   m_glyphs.reserve(std::size_t(LINE_LIMIT) * LINE_GLYPH_LIMIT);
+   m_bars.reserve(GRAPH_BAR_LIMIT + 1);
 }
 
 void debug_overlay::push_line(const char *format, ...)
 {
-   char message[1024] = {};
+   // note: measured first, so the text is formatted straight into the arena
    va_list args;
    va_start(args, format);
-   vsprintf_s(message, format, args);
+   va_list measure;
+   va_copy(measure, args);
+   const int length = vsnprintf(nullptr, 0, format, measure);
+   va_end(measure);
+   if (length < 0 || m_arena == nullptr) {
+      va_end(args);
+      return;
+   }
+
+   // note: a line that does not fit is dropped, text that fell through
+   //       to the heap would have no one to free it
+   if (m_lines.size() >= std::size_t(LINE_LIMIT) ||
+       m_arena->m_capacity - m_arena->m_offset <= int64(length))
+   {
+      m_arena->m_overflow_count++;
+      va_end(args);
+      return;
+   }
+
+   char *message = static_cast<char *>(m_arena->allocate(int64(length) + 1, 1));
+   vsnprintf(message, std::size_t(length) + 1, format, args);
    va_end(args);
 
-   m_lines.emplace_back(message);
+   m_lines.emplace_back(message, std::size_t(length));
+}
+
+void debug_overlay::push_graph(const float *milliseconds, const int32 count, const float budget)
+{
+   if (m_arena == nullptr || count <= 0 || budget <= 0.0f) {
+      return;
+   }
+
+   // note: copied, like the lines it has to last until the draw. only
+   //       the newest bars are kept when there are more than fit
+   const int32 kept = count < GRAPH_BAR_LIMIT ? count : GRAPH_BAR_LIMIT;
+   milliseconds += count - kept;
+   const int32 size = int32(sizeof(float)) * kept;
+   if (m_arena->m_capacity - m_arena->m_offset < int64(size) + int64(alignof(float))) {
+      m_arena->m_overflow_count++;
+      return;
+   }
+
+   float *values = static_cast<float *>(m_arena->allocate(size, int64(alignof(float))));
+   memcpy(values, milliseconds, std::size_t(size));
+   m_graph = values;
+   m_graph_count = kept;
+   m_graph_budget = budget;
 }
 
-void debug_overlay::pre_frame(const int width, const int height)
+void debug_overlay::pre_frame(const int width, const int height, linear_arena &arena)
 {
+   m_arena = &arena;
    m_lines.clear();
+   m_graph = nullptr;
+   m_graph_count = 0;
    m_projection = glm::ortho(0.0f, float(width), float(height), 0.0f);
-   m_material.set_parameter("u_projection", m_projection);
+   m_material.set_parameter(material::parameter_id("u_projection"), m_projection);
+}
+
+void debug_overlay::build()
+{
+   // note: only lines whose text or position changed are rebuilt
+   // note: slots that fall out keep text of an arena that is reused,
+   //       they are marked so that they are built again when they return
+   const int32 line_count = int32(m_lines.size());
+   m_glyphs_changed = m_cache_count != line_count;
+   for (int32 index = line_count; index < m_cache_count; index++) {
+      m_cache[index].m_text = {};
+      m_cache[index].m_y = -1;
+   }
+   m_cache_count = line_count;
+
+   const float x = 2.0f;
+   float y = 2.0f;
+   for (int32 index = 0; index < line_count; index++) {
+      const auto &text = m_lines[index];
+
+      // note: the cached text always moves over to this frame's copy,
+      //       the previous one goes away with its arena
+      auto &line = m_cache[index];
+      if (line.m_y != int(y) || line.m_text != text) {
+         line.m_y = int(y);
+         build_line_glyphs(line.m_glyphs, text, k_text_scale, x, y);
+         m_glyphs_changed = true;
+      }
+      line.m_text = text;
+
+      int newlines = 1;
+      for (const auto &ch : text) {
+         newlines += ch == '\n' ? 1 : 0;
+      }
+      y += k_newline_advance_y * k_text_scale * newlines;
+   }
+
+   // note: the text run is only concatenated again when a line changed
+   if (m_glyphs_changed) {
+      m_glyphs.clear();
+      for (int32 index = 0; index < line_count; index++) {
+         m_glyphs.insert(m_glyphs.end(), m_cache[index].m_glyphs.begin(), m_cache[index].m_glyphs.end());
+      }
+   }
+
+   m_bars.clear();
+   if (m_graph_count > 0) {
+      push_graph_bars(m_bars, m_graph, m_graph_count, m_graph_budget, x, y + 4.0f);
+   }
 }
 
 void debug_overlay::draw(render_backend &backend)
 {
-   update_debug_text(m_buffer, m_vertex_count, 2, 2.0f, 2.0f, m_lines);
+   build();
+
+   // note: the text run is written into the stream every frame like the
+   //       bars. the stream segment is not in flight, updating a buffer
+   //       the last frame still draws from would make the driver wait
+   int32 glyph_offset = -1;
+   if (!m_glyphs.empty()) {
+      glyph_offset = m_stream->write(int32(sizeof(glyph) * m_glyphs.size()), m_glyphs.data(), int32(sizeof(glyph)));
+   }
+
+   int32 bar_offset = -1;
+   if (!m_bars.empty()) {
+      bar_offset = m_stream->write(int32(sizeof(glyph) * m_bars.size()), m_bars.data(), int32(sizeof(glyph)));
+   }
 
-   m_material.bind(backend);
+   if (glyph_offset < 0 && bar_offset < 0) {
+      return;
+   }
+
+   m_material.bind(backend, *m_stream);
 
-   backend.set_vertex_buffer(m_buffer);
-   backend.set_vertex_layout(*m_layout);
    backend.set_blend_state(true);
    backend.set_depth_state(false, true);
    backend.set_rasterizer_state(CULL_MODE_NONE, FRONT_FACE_CW);
-   backend.draw(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, m_vertex_count);
+   backend.set_vertex_buffer(*m_stream);
+   if (glyph_offset >= 0) {
+      backend.set_vertex_layout(m_layout, glyph_offset);
+      backend.draw_instanced(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, 6, int32(m_glyphs.size()));
+   }
+   if (bar_offset >= 0) {
+      backend.set_vertex_layout(m_layout, bar_offset);
+      backend.draw_instanced(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, 6, int32(m_bars.size()));
+   }
 }
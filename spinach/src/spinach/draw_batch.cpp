@@ -0,0 +1,312 @@
+// draw_batch.cpp
+
+#include "spinach.hpp"
+
+#include <tuple>
+#include <algorithm>
+
+static_assert(sizeof(draw_arrays_command) == 16, "unexpected indirect command size");
+static_assert(sizeof(draw_elements_command) == 20, "unexpected indirect command size");
+
+// note: attribute locations 4 to 7 and 8 to 11, one vec4 column each,
+//       then the texture array layer
+static const int32 k_world_attribute = 4;
+static const int32 k_previous_world_attribute = 8;
+static const int32 k_layer_attribute = 12;
+
+static const vertex_buffer *
+get_vertex_buffer(const mesh &model)
+{
+   return model.m_shared_buffer ? model.m_shared_buffer : &model.m_buffer;
+}
+
+static const index_buffer *
+get_index_buffer(const mesh &model)
+{
+   return model.m_shared_index_buffer ? model.m_shared_index_buffer : &model.m_index_buffer;
+}
+
+static const vertex_buffer *
+get_position_buffer(const mesh &model)
+{
+   return model.m_position_buffer ? model.m_position_buffer : get_vertex_buffer(model);
+}
+
+static const vertex_layout *
+get_position_layout(const mesh &model)
+{
+   return model.m_position_buffer ? model.m_position_layout : model.m_layout;
+}
+
+static bool
+is_same_geometry(const mesh &lhs, const mesh &rhs)
+{
+   return get_vertex_buffer(lhs) == get_vertex_buffer(rhs) &&
+          get_position_buffer(lhs) == get_position_buffer(rhs) &&
+          get_index_buffer(lhs)->id_ == get_index_buffer(rhs)->id_ &&
+          lhs.m_layout == rhs.m_layout &&
+          lhs.m_topology == rhs.m_topology &&
+          lhs.m_index_type == rhs.m_index_type;
+}
+
+// note: draws are only merged when nothing has to be rebound between them,
+//       depth only draws ignore the material. the texture is a layer of
+//       the array picked per draw, so it does not split a run
+static bool
+is_same_run(const mesh &lhs, const mesh &rhs)
+{
+   return is_same_geometry(lhs, rhs) &&
+          lhs.m_material.m_texture_array == rhs.m_material.m_texture_array &&
+          lhs.m_material.m_sampler == rhs.m_material.m_sampler;
+}
+
+static bool
+is_run_order(const mesh *lhs, const mesh *rhs)
+{
+   const auto lhs_key = std::make_tuple(get_vertex_buffer(*lhs), get_position_buffer(*lhs), get_index_buffer(*lhs)->id_, lhs->m_layout, lhs->m_material.m_texture_array, lhs->m_material.m_sampler);
+   const auto rhs_key = std::make_tuple(get_vertex_buffer(*rhs), get_position_buffer(*rhs), get_index_buffer(*rhs)->id_, rhs->m_layout, rhs->m_material.m_texture_array, rhs->m_material.m_sampler);
+   return lhs_key < rhs_key;
+}
+
+static int32
+get_command_count(const mesh &model)
+{
+   const bool indexed = get_index_buffer(model)->is_valid();
+   return (indexed && !model.m_submeshes.empty()) ? int32(model.m_submeshes.size()) : 1;
+}
+
+bool draw_batch::create(const shader_program *program,
+                        const shader_program *depth_program,
+                        const shader_program *depth_indirect_program)
+{
+   m_program = program;
+   m_depth_program = depth_program;
+   m_depth_indirect_program = depth_indirect_program;
+   m_instance_layout.clear();
+   for (int32 column = 0; column < 4; column++) {
+      m_instance_layout.add_attribute(k_world_attribute + column, vertex_layout::ATTRIBUTE_FORMAT_FLOAT, 4, false, 1);
+   }
+   for (int32 column = 0; column < 4; column++) {
+      m_instance_layout.add_attribute(k_previous_world_attribute + column, vertex_layout::ATTRIBUTE_FORMAT_FLOAT, 4, false, 1);
+   }
+   m_instance_layout.add_attribute(k_layer_attribute, vertex_layout::ATTRIBUTE_FORMAT_FLOAT, 1, false, 1);
+   assert(m_instance_layout.stride_ == int32(sizeof(instance)));
+
+   return m_program != nullptr;
+}
+
+void draw_batch::begin()
+{
+   m_meshes.clear();
+   m_unbatched.clear();
+   m_prepared = false;
+   m_draw_count = 0;
+   m_call_count = 0;
+   m_depth_call_count = 0;
+}
+
+void draw_batch::add(mesh &model)
+{
+   // note: per-frame streamed vertices move every frame, not worth it.
+   //       the batch samples the texture array, without a layer the
+   //       mesh draws with its own texture
+   if (model.m_stream || !model.valid() || !model.m_material.m_texture_array) {
+      m_unbatched.push_back(&model);
+      return;
+   }
+
+   m_meshes.push_back(&model);
+}
+
+void draw_batch::prepare(streaming_buffer &stream)
+{
+   m_prepared = true;
+   m_instance_offset = -1;
+
+   if (!render_backend::is_multi_draw_indirect_supported() || !m_program || !m_program->is_valid()) {
+      m_unbatched.insert(m_unbatched.end(), m_meshes.begin(), m_meshes.end());
+      m_meshes.clear();
+   }
+
+   if (m_meshes.empty()) {
+      return;
+   }
+
+   std::stable_sort(m_meshes.begin(), m_meshes.end(), is_run_order);
+
+   // note: commands of a run are contiguous, the base instance is the
+   //       index of the draw into m_instances
+   m_instances.clear();
+   m_array_commands.clear();
+   m_element_commands.clear();
+   for (const auto &model : m_meshes) {
+      if (!get_index_buffer(*model)->is_valid()) {
+         draw_arrays_command command{};
+         command.count_ = uint32(model->m_primitive_count);
+         command.instance_count_ = 1;
+         command.base_instance_ = uint32(m_instances.size());
+         m_array_commands.push_back(command);
+         m_instances.push_back({ model->m_transform * model->m_dequantize,
+                                 model->previous_transform() * model->m_dequantize,
+                                 float(model->m_material.m_layer) });
+      }
+      else if (model->m_submeshes.empty()) {
+         draw_elements_command command{};
+         command.count_ = uint32(model->m_primitive_count);
+         command.instance_count_ = 1;
+         command.base_instance_ = uint32(m_instances.size());
+         m_element_commands.push_back(command);
+         m_instances.push_back({ model->m_transform * model->m_dequantize,
+                                 model->previous_transform() * model->m_dequantize,
+                                 float(model->m_material.m_layer) });
+      }
+      else {
+         for (const auto &part : model->m_submeshes) {
+            draw_elements_command command{};
+            command.count_ = uint32(part.m_index_count);
+            command.instance_count_ = 1;
+            command.first_index_ = uint32(part.m_first_index);
+            command.base_vertex_ = part.m_base_vertex;
+            command.base_instance_ = uint32(m_instances.size());
+            m_element_commands.push_back(command);
+            m_instances.push_back({ model->m_transform * part.m_transform * model->m_dequantize,
+                                    model->previous_transform() * part.m_transform * model->m_dequantize,
+                                    float(model->m_material.m_layer) });
+         }
+      }
+
+      model->store_previous_transform();
+   }
+
+   const int32 instance_offset = stream.write(int32(sizeof(instance) * m_instances.size()), m_instances.data(), 16);
+   const int32 array_offset = stream.write(int32(sizeof(draw_arrays_command) * m_array_commands.size()), m_array_commands.data());
+   const int32 element_offset = stream.write(int32(sizeof(draw_elements_command) * m_element_commands.size()), m_element_commands.data());
+   if (instance_offset < 0 || array_offset < 0 || element_offset < 0) {
+      return;
+   }
+
+   m_instance_offset = instance_offset;
+   m_array_offset = array_offset;
+   m_element_offset = element_offset;
+}
+
+bool draw_batch::submit_depth(render_backend &backend, streaming_buffer &stream)
+{
+   if (!m_depth_program || !m_depth_program->is_valid()) {
+      return false;
+   }
+
+   if (!m_prepared) {
+      prepare(stream);
+   }
+
+   backend.set_color_write(false);
+
+   for (auto &model : m_unbatched) {
+      model->draw_depth(backend, *m_depth_program);
+      m_depth_call_count += get_command_count(*model);
+   }
+
+   if (m_instance_offset >= 0 && m_depth_indirect_program && m_depth_indirect_program->is_valid()) {
+      backend.set_shader_program(*m_depth_indirect_program);
+      backend.set_indirect_buffer(stream);
+      backend.set_blend_state(false);
+      backend.set_depth_state(true, true);
+      backend.set_rasterizer_state(CULL_MODE_BACK, FRONT_FACE_CW);
+
+      int32 array_first = 0;
+      int32 element_first = 0;
+      for (std::size_t first = 0; first < m_meshes.size();) {
+         int32 count = get_command_count(*m_meshes[first]);
+         std::size_t last = first + 1;
+         while (last < m_meshes.size() && is_same_geometry(*m_meshes[first], *m_meshes[last])) {
+            count += get_command_count(*m_meshes[last]);
+            last++;
+         }
+
+         const mesh &model = *m_meshes[first];
+         backend.set_vertex_buffer(*get_position_buffer(model));
+         backend.set_vertex_layout(*get_position_layout(model));
+         backend.set_vertex_stream(stream, m_instance_layout, m_instance_offset);
+         if (get_index_buffer(model)->is_valid()) {
+            backend.set_index_buffer(*get_index_buffer(model));
+            backend.draw_indexed_indirect(model.m_topology,
+                                          model.m_index_type,
+                                          m_element_offset + int32(sizeof(draw_elements_command)) * element_first,
+                                          count);
+            element_first += count;
+         }
+         else {
+            backend.draw_indirect(model.m_topology,
+                                  m_array_offset + int32(sizeof(draw_arrays_command)) * array_first,
+                                  count);
+            array_first += count;
+         }
+
+         m_depth_call_count++;
+         first = last;
+      }
+   }
+
+   backend.set_color_write(true);
+
+   return true;
+}
+
+void draw_batch::submit(render_backend &backend, streaming_buffer &stream, const uint32 flags)
+{
+   if (!m_prepared) {
+      prepare(stream);
+   }
+
+   for (auto &model : m_unbatched) {
+      model->draw(backend, stream, flags);
+      m_draw_count += get_command_count(*model);
+      m_call_count += get_command_count(*model);
+   }
+
+   if (m_instance_offset < 0) {
+      return;
+   }
+
+   backend.set_shader_program(*m_program);
+   backend.set_indirect_buffer(stream);
+   backend.set_rasterizer_state(CULL_MODE_BACK, FRONT_FACE_CW);
+   mesh::set_draw_state(backend, flags);
+
+   int32 array_first = 0;
+   int32 element_first = 0;
+   for (std::size_t first = 0; first < m_meshes.size();) {
+      int32 count = get_command_count(*m_meshes[first]);
+      std::size_t last = first + 1;
+      while (last < m_meshes.size() && is_same_run(*m_meshes[first], *m_meshes[last])) {
+         count += get_command_count(*m_meshes[last]);
+         last++;
+      }
+
+      const mesh &model = *m_meshes[first];
+      backend.set_texture_array(*model.m_material.m_texture_array);
+      backend.set_sampler_state(*model.m_material.m_sampler);
+      backend.set_vertex_buffer(*get_vertex_buffer(model));
+      backend.set_vertex_layout(*model.m_layout);
+      backend.set_vertex_stream(stream, m_instance_layout, m_instance_offset);
+      if (get_index_buffer(model)->is_valid()) {
+         backend.set_index_buffer(*get_index_buffer(model));
+         backend.draw_indexed_indirect(model.m_topology,
+                                       model.m_index_type,
+                                       m_element_offset + int32(sizeof(draw_elements_command)) * element_first,
+                                       count);
+         element_first += count;
+      }
+      else {
+         backend.draw_indirect(model.m_topology,
+                               m_array_offset + int32(sizeof(draw_arrays_command)) * array_first,
+                               count);
+         array_first += count;
+      }
+
+      m_draw_count += count;
+      m_call_count++;
+      first = last;
+   }
+}
@@ -0,0 +1,121 @@
+// dynamic_resolution.cpp
+
+#include "spinach.hpp"
+
+#include <cmath>
+
+// note: targets are sized in steps of this many pixels
+static const int32 k_bucket_size = 64;
+// note: frames between two scale changes, gives the smoothed
+//       timings time to reflect the previous change
+static const int64 k_change_interval = 30;
+static const float k_smoothing = 0.1f;
+static const float k_scale_down_load = 0.95f;
+static const float k_scale_up_load = 0.75f;
+static const float k_target_load = 0.85f;
+static const float k_max_step = 0.25f;
+static const float k_scale_granularity = 1.0f / 32.0f;
+
+static int32
+round_up_to_bucket(const int32 size)
+{
+   return ((size + k_bucket_size - 1) / k_bucket_size) * k_bucket_size;
+}
+
+bool dynamic_resolution::create(const int32 width,
+                                const int32 height,
+                                const float min_scale,
+                                const float max_scale,
+                                const float budget_ms)
+{
+   assert(min_scale > 0.0f && min_scale <= max_scale);
+
+   m_base_width = width;
+   m_base_height = height;
+   m_min_scale = min_scale;
+   m_max_scale = max_scale;
+   m_budget = budget_ms;
+   m_scale = 1.0f < min_scale ? min_scale : 1.0f > max_scale ? max_scale : 1.0f;
+
+   return m_timer.create();
+}
+
+void dynamic_resolution::destroy()
+{
+   m_timer.destroy();
+}
+
+void dynamic_resolution::begin_frame()
+{
+   m_frame_start = utility::get_current_microseconds();
+   m_timer.begin();
+
+   m_width = int32(float(m_base_width) * m_scale + 0.5f);
+   m_height = int32(float(m_base_height) * m_scale + 0.5f);
+   m_width = m_width > 0 ? m_width : 1;
+   m_height = m_height > 0 ? m_height : 1;
+}
+
+void dynamic_resolution::end_frame()
+{
+   m_timer.end();
+
+   const float cpu_time = float(utility::get_current_microseconds() - m_frame_start) / 1000.0f;
+   m_frame_cpu_time = cpu_time;
+   m_cpu_time = m_cpu_time > 0.0f ? m_cpu_time + (cpu_time - m_cpu_time) * k_smoothing : cpu_time;
+
+   m_resolved_count = 0;
+   float gpu_time = 0.0f;
+   while (m_timer.resolve(gpu_time)) {
+      if (m_resolved_count < gpu_timer::QUERY_LIMIT) {
+         m_resolved_gpu_times[m_resolved_count++] = gpu_time;
+      }
+      m_gpu_time = m_gpu_time > 0.0f ? m_gpu_time + (gpu_time - m_gpu_time) * k_smoothing : gpu_time;
+   }
+
+   m_frame++;
+   if (m_frame < m_next_change || m_gpu_time <= 0.0f) {
+      return;
+   }
+
+   // note: scale up only when the cpu keeps up as well, a lower
+   //       resolution does nothing for a cpu bound frame
+   const float load = m_gpu_time / m_budget;
+   if (load < k_scale_down_load && (load > k_scale_up_load || m_cpu_time > m_budget)) {
+      return;
+   }
+
+   // note: gpu time follows the pixel count, the square of the scale
+   float desired = m_scale * sqrtf(k_target_load / load);
+   desired = desired < m_scale - k_max_step ? m_scale - k_max_step : desired;
+   desired = desired > m_scale + k_max_step ? m_scale + k_max_step : desired;
+   desired = desired < m_min_scale ? m_min_scale : desired;
+   desired = desired > m_max_scale ? m_max_scale : desired;
+   desired = floorf(desired / k_scale_granularity + 0.5f) * k_scale_granularity;
+   if (fabsf(desired - m_scale) < k_scale_granularity * 0.5f) {
+      return;
+   }
+
+   m_scale = desired;
+   m_next_change = m_frame + k_change_interval;
+}
+
+int32 dynamic_resolution::target_width() const
+{
+   return round_up_to_bucket(m_width);
+}
+
+int32 dynamic_resolution::target_height() const
+{
+   return round_up_to_bucket(m_height);
+}
+
+void dynamic_resolution::set_viewport(render_backend &backend) const
+{
+   backend.set_viewport(0, 0, m_width, m_height);
+}
+
+glm::vec2 dynamic_resolution::texcoord_scale() const
+{
+   return glm::vec2(float(m_width) / float(target_width()), float(m_height) / float(target_height()));
+}
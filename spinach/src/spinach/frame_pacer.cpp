@@ -0,0 +1,145 @@
+// frame_pacer.cpp
+
+#include "spinach.hpp"
+
+#include <cmath>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <timeapi.h>
+#endif
+
+// note: the last stretch before the deadline is spun, sleep overshoots
+//       by up to a scheduler tick
+static const int64 k_spin_threshold = 2000;
+// note: a blocked fence wait gives up after this long, e.g. a lost context
+static const int64 k_fence_timeout = 100000;
+static const float k_smoothing = 0.1f;
+
+bool frame_pacer::create()
+{
+#if defined(_WIN32)
+   // note: millisecond sleeps instead of the default 15.6ms tick
+   timeBeginPeriod(1);
+#endif
+
+   m_last_present = utility::get_current_microseconds();
+   return true;
+}
+
+void frame_pacer::destroy()
+{
+#if defined(_WIN32)
+   timeEndPeriod(1);
+#endif
+
+   for (auto &entry : m_frames) {
+      entry.m_fence.destroy();
+   }
+}
+
+void frame_pacer::set_frame_limit(const int32 frames_per_second)
+{
+   m_frame_limit = frames_per_second > 0 ? frames_per_second : 0;
+   m_next_frame = 0;
+}
+
+void frame_pacer::on_input(const int64 input_time)
+{
+   if (m_pending_input == 0 || input_time < m_pending_input) {
+      m_pending_input = input_time;
+   }
+}
+
+void frame_pacer::begin_frame()
+{
+   const int64 start = utility::get_current_microseconds();
+
+   // note: the previous frame is done before this one samples input
+   if (m_fence_wait) {
+      const int32 previous = (m_frame_index + FRAME_LIMIT - 1) % FRAME_LIMIT;
+      m_frames[previous].m_fence.wait(k_fence_timeout);
+   }
+
+   int64 now = utility::get_current_microseconds();
+   resolve(now);
+
+   if (m_frame_limit > 0) {
+      const int64 period = 1000000 / m_frame_limit;
+      const int64 spin = m_spin ? k_spin_threshold : 0;
+      if (m_next_frame - now > spin) {
+         std::this_thread::sleep_for(std::chrono::microseconds(m_next_frame - now - spin));
+      }
+      while (utility::get_current_microseconds() < m_next_frame) {
+         std::this_thread::yield();
+      }
+      now = utility::get_current_microseconds();
+
+      // note: a late frame starts the schedule over instead of running
+      //       the next ones early to catch up
+      m_next_frame = m_next_frame + period < now ? now + period : m_next_frame + period;
+   }
+
+   m_wait_time = float(now - start) / 1000.0f;
+}
+
+// note: the frames the gpu has finished by now, without the fence wait
+//       the latency is only known to the next frame
+void frame_pacer::resolve(const int64 now)
+{
+   for (auto &entry : m_frames) {
+      if (!entry.m_fence.is_valid() || !entry.m_fence.is_signaled()) {
+         continue;
+      }
+
+      if (entry.m_input_time > 0) {
+         m_latency = float(now - entry.m_input_time) / 1000.0f;
+         m_latency_average = m_latency_average > 0.0f ? m_latency_average + (m_latency - m_latency_average) * k_smoothing : m_latency;
+      }
+      entry.m_fence.destroy();
+      entry.m_input_time = 0;
+   }
+}
+
+void frame_pacer::end_frame()
+{
+   const int64 now = utility::get_current_microseconds();
+
+   // note: a frame still in flight after FRAME_LIMIT frames is dropped
+   auto &current = m_frames[m_frame_index];
+   current.m_fence.insert();
+   current.m_input_time = m_pending_input;
+   m_pending_input = 0;
+   m_frame_index = (m_frame_index + 1) % FRAME_LIMIT;
+
+   m_history[m_history_index] = now - m_last_present;
+   m_history_index = (m_history_index + 1) % HISTORY_SIZE;
+   m_history_count = m_history_count < HISTORY_SIZE ? m_history_count + 1 : HISTORY_SIZE;
+   m_last_present = now;
+
+   int64 sum = 0;
+   int64 minimum = m_history[0];
+   int64 maximum = m_history[0];
+   for (int32 index = 0; index < m_history_count; index++) {
+      const int64 value = m_history[index];
+      sum += value;
+      minimum = value < minimum ? value : minimum;
+      maximum = value > maximum ? value : maximum;
+   }
+
+   const double average = double(sum) / double(m_history_count);
+   double variance = 0.0;
+   for (int32 index = 0; index < m_history_count; index++) {
+      const double delta = double(m_history[index]) - average;
+      variance += delta * delta;
+   }
+   variance /= double(m_history_count);
+
+   m_frame_average = float(average / 1000.0);
+   m_frame_min = float(minimum) / 1000.0f;
+   m_frame_max = float(maximum) / 1000.0f;
+   m_frame_deviation = float(sqrt(variance) / 1000.0);
+}
@@ -0,0 +1,92 @@
+// geometry_buffer.cpp
+
+#include "spinach.hpp"
+
+static int32
+get_index_size(const index_type type)
+{
+   return type == INDEX_TYPE_UNSIGNED_BYTE  ? int32(sizeof(uint8))  :
+          type == INDEX_TYPE_UNSIGNED_SHORT ? int32(sizeof(uint16)) :
+                                              int32(sizeof(uint32));
+}
+
+bool geometry_buffer::valid() const
+{
+   return m_vertices.is_valid() && m_indices.is_valid();
+}
+
+bool geometry_buffer::create(const int32 vertex_stride,
+                             const int32 vertex_capacity,
+                             const index_type type,
+                             const int32 index_capacity,
+                             const int32 position_stride)
+{
+   m_index_type = type;
+   m_vertex_stride = vertex_stride;
+   m_position_stride = position_stride;
+   m_vertex_capacity = vertex_capacity;
+   m_vertex_count = 0;
+   m_index_capacity = index_capacity;
+   m_index_count = 0;
+
+   // note: storage only, filled through append
+   if (!m_vertices.create(vertex_stride * vertex_capacity, nullptr)) {
+      return false;
+   }
+
+   if (position_stride > 0 && !m_positions.create(position_stride * vertex_capacity, nullptr)) {
+      return false;
+   }
+
+   return m_indices.create(get_index_size(type) * index_capacity, nullptr);
+}
+
+void geometry_buffer::destroy()
+{
+   if (m_vertices.is_valid()) {
+      m_vertices.destroy();
+   }
+   if (m_positions.is_valid()) {
+      m_positions.destroy();
+   }
+   if (m_indices.is_valid()) {
+      m_indices.destroy();
+   }
+
+   m_vertex_count = 0;
+   m_index_count = 0;
+}
+
+bool geometry_buffer::append(const int32 vertex_count,
+                             const void *vertices,
+                             const int32 index_count,
+                             const void *indices,
+                             int32 &first_vertex,
+                             int32 &first_index,
+                             const void *positions)
+{
+   if (m_vertex_count + vertex_count > m_vertex_capacity ||
+       m_index_count + index_count > m_index_capacity)
+   {
+      debug::log("geometry buffer full: %d/%d vertices, %d/%d indices",
+                 m_vertex_count + vertex_count,
+                 m_vertex_capacity,
+                 m_index_count + index_count,
+                 m_index_capacity);
+      return false;
+   }
+
+   const int32 index_size = get_index_size(m_index_type);
+   m_vertices.write(m_vertex_count * m_vertex_stride, vertex_count * m_vertex_stride, vertices);
+   m_indices.write(m_index_count * index_size, index_count * index_size, indices);
+   if (positions && m_position_stride > 0) {
+      m_positions.write(m_vertex_count * m_position_stride, vertex_count * m_position_stride, positions);
+   }
+
+   first_vertex = m_vertex_count;
+   first_index = m_index_count;
+   m_vertex_count += vertex_count;
+   m_index_count += index_count;
+
+   return true;
+}
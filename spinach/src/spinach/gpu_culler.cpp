@@ -0,0 +1,140 @@
+// gpu_culler.cpp
+
+#include "spinach.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+static int32
+get_pyramid_size()
+{
+   int32 result = 0;
+   for (int32 level = 0; level < occlusion_culler::LEVEL_COUNT; level++) {
+      result += (occlusion_culler::WIDTH >> level) * (occlusion_culler::HEIGHT >> level);
+   }
+   return result * int32(sizeof(float));
+}
+
+// note: normalized planes facing inwards, from the rows of the view
+//       projection matrix
+static void
+get_frustum_planes(const glm::mat4 &view_projection, glm::vec4 (&planes)[6])
+{
+   const glm::vec4 row_x(view_projection[0][0], view_projection[1][0], view_projection[2][0], view_projection[3][0]);
+   const glm::vec4 row_y(view_projection[0][1], view_projection[1][1], view_projection[2][1], view_projection[3][1]);
+   const glm::vec4 row_z(view_projection[0][2], view_projection[1][2], view_projection[2][2], view_projection[3][2]);
+   const glm::vec4 row_w(view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3]);
+
+   planes[0] = row_w + row_x;
+   planes[1] = row_w - row_x;
+   planes[2] = row_w + row_y;
+   planes[3] = row_w - row_y;
+   planes[4] = row_w + row_z;
+   planes[5] = row_w - row_z;
+   for (auto &plane : planes) {
+      plane /= glm::length(glm::vec3(plane));
+   }
+}
+
+bool gpu_culler::create(const shader_program *program,
+                        const int32 vertex_count,
+                        const int32 body_count,
+                        const glm::vec4 *spheres,
+                        const glm::mat4 *worlds)
+{
+   if (!program || !program->is_valid() || !render_backend::is_compute_supported()) {
+      return false;
+   }
+
+   m_program = program;
+   m_vertex_count = vertex_count;
+   m_body_count = body_count;
+   m_pyramid_levels = 0;
+   m_worlds = nullptr;
+
+   const draw_arrays_command command{ uint32(vertex_count), 0, 0, 0 };
+   if (!m_spheres.create(int32(sizeof(glm::vec4)) * body_count, spheres) ||
+       !m_previous_worlds.create(int32(sizeof(glm::mat4)) * body_count, worlds) ||
+       !m_instances.create(int32(sizeof(glm::mat4)) * 2 * body_count, nullptr) ||
+       !m_command.create(int32(sizeof(command)), &command) ||
+       !m_pyramid.create(get_pyramid_size(), nullptr))
+   {
+      debug::log("could not create gpu culler buffers for %d bodies", body_count);
+      return false;
+   }
+
+   return true;
+}
+
+void gpu_culler::destroy()
+{
+   storage_buffer *buffers[] = { &m_spheres, &m_previous_worlds, &m_instances, &m_command, &m_pyramid };
+   for (auto &buffer : buffers) {
+      if (buffer->is_valid()) {
+         buffer->destroy();
+      }
+   }
+}
+
+void gpu_culler::set_worlds(const streaming_buffer *stream, const int32 offset)
+{
+   m_worlds = stream;
+   m_world_offset = offset;
+}
+
+void gpu_culler::set_pyramid(const occlusion_culler *occlusion)
+{
+   m_pyramid_levels = 0;
+   if (!occlusion || occlusion->m_occluder_count == 0) {
+      return;
+   }
+
+   int32 offset = 0;
+   for (const auto &level : occlusion->m_levels) {
+      const int32 size = int32(level.size() * sizeof(float));
+      m_pyramid.write(offset, size, level.data());
+      offset += size;
+   }
+   m_pyramid_levels = occlusion_culler::LEVEL_COUNT;
+}
+
+void gpu_culler::dispatch(render_backend &backend, const camera &camera)
+{
+   if (!m_worlds) {
+      return;
+   }
+
+   // note: the counter starts over, the previous draw has read it by now
+   const draw_arrays_command command{ uint32(m_vertex_count), 0, 0, 0 };
+   m_command.write(0, int32(sizeof(command)), &command);
+
+   glm::vec4 planes[6];
+   get_frustum_planes(camera.m_projection * camera.m_view, planes);
+   const int32 pyramid_size[] = { occlusion_culler::WIDTH, occlusion_culler::HEIGHT };
+
+   backend.set_shader_program(*m_program);
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_INT, "u_body_count", 1, &m_body_count);
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_MATRIX, "u_view", 1, glm::value_ptr(camera.m_view));
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_MATRIX, "u_projection", 1, glm::value_ptr(camera.m_projection));
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_VEC4, "u_planes", 6, planes);
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_IVEC2, "u_pyramid_size", 1, pyramid_size);
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_INT, "u_pyramid_levels", 1, &m_pyramid_levels);
+   backend.set_storage_buffer(m_spheres, 0);
+   backend.set_storage_buffer(m_instances, 1);
+   backend.set_storage_buffer(m_command, 2);
+   backend.set_storage_buffer(m_pyramid, 3);
+   backend.set_storage_buffer(*m_worlds, 4, m_world_offset, int32(sizeof(glm::mat4)) * m_body_count);
+   backend.set_storage_buffer(m_previous_worlds, 5);
+   backend.dispatch((m_body_count + GROUP_SIZE - 1) / GROUP_SIZE);
+   backend.storage_barrier();
+}
+
+void gpu_culler::draw(render_backend &backend, const primitive_topology topology)
+{
+   if (!m_worlds) {
+      return;
+   }
+
+   backend.set_storage_buffer(m_instances, 1);
+   backend.set_indirect_buffer(m_command);
+   backend.draw_indirect(topology, 0, 1);
+}
@@ -0,0 +1,67 @@
+// input_queue.cpp
+
+#include "spinach.hpp"
+
+#include <atomic>
+
+static_assert((input_queue::CAPACITY & (input_queue::CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+// note: free running counters, the producer only writes the tail and
+//       the consumer only the head. padded apart so they do not share a
+//       cache line, alignas would trip the padding warning
+struct input_queue::state {
+   std::atomic<uint32> m_head{ 0 };
+   uint8 m_head_padding[60]{};
+   std::atomic<uint32> m_tail{ 0 };
+   uint8 m_tail_padding[60]{};
+};
+
+input_queue::~input_queue()
+{
+   destroy();
+}
+
+bool input_queue::create()
+{
+   if (m_state == nullptr) {
+      m_state = new state;
+   }
+
+   return true;
+}
+
+void input_queue::destroy()
+{
+   delete m_state;
+   m_state = nullptr;
+}
+
+bool input_queue::push(const input_event &event)
+{
+   if (m_state == nullptr) {
+      return false;
+   }
+
+   const uint32 tail = m_state->m_tail.load(std::memory_order_relaxed);
+   const uint32 head = m_state->m_head.load(std::memory_order_acquire);
+   if (tail - head >= uint32(CAPACITY)) {
+      return false;
+   }
+
+   m_events[tail & (CAPACITY - 1)] = event;
+   m_state->m_tail.store(tail + 1, std::memory_order_release);
+   return true;
+}
+
+bool input_queue::pop(input_event &event)
+{
+   const uint32 head = m_state->m_head.load(std::memory_order_relaxed);
+   const uint32 tail = m_state->m_tail.load(std::memory_order_acquire);
+   if (head == tail) {
+      return false;
+   }
+
+   event = m_events[head & (CAPACITY - 1)];
+   m_state->m_head.store(head + 1, std::memory_order_release);
+   return true;
+}
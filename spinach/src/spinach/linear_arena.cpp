@@ -0,0 +1,115 @@
+// linear_arena.cpp
+
+#include "spinach.hpp"
+
+#include <new>
+
+linear_arena::~linear_arena()
+{
+   destroy();
+}
+
+bool linear_arena::valid() const
+{
+   return m_base != nullptr;
+}
+
+bool linear_arena::create(const int64 capacity)
+{
+   if (valid() || capacity <= 0) {
+      return false;
+   }
+
+   m_base = new uint8[std::size_t(capacity)];
+   m_capacity = capacity;
+   m_offset = 0;
+   m_peak = 0;
+   m_overflow_count = 0;
+
+   return true;
+}
+
+void linear_arena::destroy()
+{
+   delete[] m_base;
+   m_base = nullptr;
+   m_capacity = 0;
+   m_offset = 0;
+}
+
+void linear_arena::reset()
+{
+   m_offset = 0;
+}
+
+bool linear_arena::owns(const void *pointer) const
+{
+   const uint8 *address = static_cast<const uint8 *>(pointer);
+   return address >= m_base && address < m_base + m_capacity;
+}
+
+void *linear_arena::allocate(const int64 size, const int64 alignment)
+{
+   assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+   // note: aligned by address, the block itself only has the default
+   //       alignment of new
+   const uint64 address = uint64(m_base) + uint64(m_offset);
+   const uint64 aligned = (address + uint64(alignment) - 1) & ~(uint64(alignment) - 1);
+   const int64 offset = m_offset + int64(aligned - address);
+   if (m_base == nullptr || offset + size > m_capacity) {
+      m_overflow_count++;
+      return ::operator new(std::size_t(size), std::align_val_t(alignment));
+   }
+
+   m_offset = offset + size;
+   m_peak = m_offset > m_peak ? m_offset : m_peak;
+
+   return m_base + offset;
+}
+
+void linear_arena::deallocate(void *pointer, const int64 alignment)
+{
+   if (pointer != nullptr && !owns(pointer)) {
+      ::operator delete(pointer, std::align_val_t(alignment));
+   }
+}
+
+bool double_buffered_arena::valid() const
+{
+   return m_arenas[0].valid() && m_arenas[1].valid();
+}
+
+bool double_buffered_arena::create(const int64 capacity)
+{
+   if (!m_arenas[0].create(capacity) || !m_arenas[1].create(capacity)) {
+      destroy();
+      return false;
+   }
+
+   m_current = 0;
+
+   return true;
+}
+
+void double_buffered_arena::destroy()
+{
+   m_arenas[0].destroy();
+   m_arenas[1].destroy();
+}
+
+void double_buffered_arena::swap()
+{
+   m_current ^= 1;
+   m_arenas[m_current].reset();
+}
+
+linear_arena &double_buffered_arena::current()
+{
+   return m_arenas[m_current];
+}
+
+const linear_arena &double_buffered_arena::previous() const
+{
+   return m_arenas[m_current ^ 1];
+}
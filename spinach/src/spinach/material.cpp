@@ -2,24 +2,40 @@
 
 #include "spinach.hpp"
 
-material::parameter::parameter(uniform_type type,
-                               std::string  name,
-                               const glm::vec4 &data)
-   : m_type(type)
-   , m_name(std::move(name))
-   , m_data{}
+#include <cstring>
+
+// note: std140 base alignment, vec3 takes the alignment of a vec4
+static int32
+get_block_alignment(const uniform_type type)
 {
-   m_data.m_v4 = data;
+   switch (type) {
+      case UNIFORM_TYPE_FLOAT:
+         return 4;
+      case UNIFORM_TYPE_VEC2:
+         return 8;
+      default:
+         return 16;
+   }
 }
 
-material::parameter::parameter(uniform_type type,
-                               std::string  name,
-                               const glm::mat4 &data)
-   : m_type(type)
-   , m_name(std::move(name))
-   , m_data{}
+static int32
+get_type_size(const uniform_type type)
 {
-   m_data.m_m4 = data;
+   switch (type) {
+      case UNIFORM_TYPE_FLOAT:
+         return int32(sizeof(float));
+      case UNIFORM_TYPE_VEC2:
+         return int32(sizeof(glm::vec2));
+      case UNIFORM_TYPE_VEC3:
+         return int32(sizeof(glm::vec3));
+      case UNIFORM_TYPE_VEC4:
+         return int32(sizeof(glm::vec4));
+      case UNIFORM_TYPE_MATRIX:
+         return int32(sizeof(glm::mat4));
+      default:
+         assert(!"unsupported material parameter type");
+         return 0;
+   }
 }
 
 material::material(const shader_program *program, const texture *texture, const sampler_state *sampler)
@@ -44,71 +60,147 @@ void material::set_sampler_state(const sampler_state *sampler)
    m_sampler = sampler;
 }
 
-void material::set_parameter(const std::string &name, const glm::vec2 &value)
+void material::set_texture_layer(const texture_array *array, const int32 layer)
 {
-   auto data = glm::vec4(value, 0, 0);
-   for (auto &param : m_parameters) {
-      if (param.m_name == name) {
-         assert(param.m_type == UNIFORM_TYPE_VEC2);
-         param.m_data.m_v4 = data;
-         return;
-      }
+   m_texture_array = array;
+   m_layer = layer;
+}
+
+void material::set_parameter(const uint64 id, const float value)
+{
+   write(id, UNIFORM_TYPE_FLOAT, &value, int32(sizeof(value)));
+}
+
+void material::set_parameter(const uint64 id, const glm::vec2 &value)
+{
+   write(id, UNIFORM_TYPE_VEC2, &value, int32(sizeof(value)));
+}
+
+void material::set_parameter(const uint64 id, const glm::vec3 &value)
+{
+   write(id, UNIFORM_TYPE_VEC3, &value, int32(sizeof(value)));
+}
+
+void material::set_parameter(const uint64 id, const glm::vec4 &value)
+{
+   write(id, UNIFORM_TYPE_VEC4, &value, int32(sizeof(value)));
+}
+
+void material::set_parameter(const uint64 id, const glm::mat4 &value)
+{
+   write(id, UNIFORM_TYPE_MATRIX, &value, int32(sizeof(value)));
+}
+
+void material::bind(render_backend &backend, streaming_buffer &stream)
+{
+   backend.set_shader_program(*m_program);
+   bind_parameters(backend, stream);
+   backend.set_texture(*m_texture);
+   backend.set_sampler_state(*m_sampler);
+}
+
+void material::bind_parameters(render_backend &backend, streaming_buffer &stream)
+{
+   if (m_block_program != m_program->id_) {
+      apply_program_layout(backend);
    }
 
-   m_parameters.push_back(parameter{ UNIFORM_TYPE_VEC2, name, data });
+   if (m_size > 0) {
+      const int32 offset = stream.write(m_size, m_data, render_backend::uniform_buffer_alignment());
+      if (offset >= 0) {
+         backend.set_uniform_buffer(stream, BLOCK_BINDING, offset, m_size);
+      }
+   }
 }
 
-void material::set_parameter(const std::string &name, const glm::vec3 &value)
+void material::write(const uint64 id, const uniform_type type, const void *data, const int32 size)
 {
-   auto data = glm::vec4(value, 0);
-   for (auto &param : m_parameters) {
-      if (param.m_name == name) {
-         assert(param.m_type == UNIFORM_TYPE_VEC3);
-         param.m_data.m_v4 = data;
+   for (int32 index = 0; index < m_parameter_count; index++) {
+      const auto &param = m_parameters[index];
+      if (param.m_id == id) {
+         assert(param.m_type == type);
+         if (param.m_offset >= 0) {
+            memcpy(m_data + param.m_offset, data, std::size_t(size));
+         }
          return;
       }
    }
 
-   m_parameters.push_back(parameter{ UNIFORM_TYPE_VEC3, name, data });
-}
+   if (m_parameter_count >= PARAMETER_LIMIT) {
+      assert(!"material parameters exhausted");
+      return;
+   }
 
-void material::set_parameter(const std::string &name, const glm::vec4 &value)
-{
-   auto data = value;
-   for (auto &param : m_parameters) {
-      if (param.m_name == name) {
-         assert(param.m_type == UNIFORM_TYPE_VEC4);
-         param.m_data.m_v4 = data;
+   // note: with the layout of the program known the member decides, 
+   //       before that the value is packed behind the previous one
+   int32 offset = -1;
+   if (m_block_program != 0) {
+      offset = find_member(id, size);
+   }
+   else {
+      const int32 alignment = get_block_alignment(type);
+      offset = (m_size + alignment - 1) & ~(alignment - 1);
+      if (offset + size > BLOCK_SIZE) {
+         assert(!"material parameters exhausted");
          return;
       }
+      m_size = offset + size;
    }
 
-   m_parameters.push_back(parameter{ UNIFORM_TYPE_VEC4, name, data });
+   auto &param = m_parameters[m_parameter_count++];
+   param.m_id = id;
+   param.m_type = type;
+   param.m_offset = offset;
+   if (offset >= 0) {
+      memcpy(m_data + offset, data, std::size_t(size));
+   }
 }
 
-void material::set_parameter(const std::string &name, const glm::mat4 &value)
+void material::apply_program_layout(render_backend &backend)
 {
-   for (auto &param : m_parameters) {
-      if (param.m_name == name) {
-         assert(param.m_type == UNIFORM_TYPE_MATRIX);
-         param.m_data.m_m4 = value;
-         return;
-      }
+   m_block_program = m_program->id_;
+
+   // note: a block larger than the storage can not be written at all
+   int32 block_size = backend.set_uniform_block(*m_program, "material", BLOCK_BINDING);
+   if (block_size > BLOCK_SIZE) {
+      debug::log("material block is %d bytes, at most %d are supported", block_size, BLOCK_SIZE);
+      block_size = -1;
+   }
+
+   uniform_block_member members[PARAMETER_LIMIT];
+   const int32 member_count = block_size > 0 ? backend.uniform_block_members(*m_program, "material", members, PARAMETER_LIMIT) : 0;
+   m_member_count = 0;
+   for (int32 index = 0; index < member_count; index++) {
+      m_members[m_member_count++] = { utility::hash_fnv1a(members[index].name_), members[index].offset_ };
    }
 
-   m_parameters.push_back(parameter{ UNIFORM_TYPE_MATRIX, name, value });
+   // note: values move from where they were to where the program reads them
+   uint8 previous[BLOCK_SIZE];
+   memcpy(previous, m_data, sizeof(previous));
+   memset(m_data, 0, sizeof(m_data));
+   m_size = block_size > 0 ? block_size : 0;
+   for (int32 index = 0; index < m_parameter_count; index++) {
+      auto &param = m_parameters[index];
+      const int32 size = get_type_size(param.m_type);
+      const int32 offset = find_member(param.m_id, size);
+      if (offset < 0 && block_size > 0) {
+         debug::log("material parameter %016llx is not a member of the block of program %u", param.m_id, m_block_program);
+      }
+      if (offset >= 0 && param.m_offset >= 0) {
+         memcpy(m_data + offset, previous + param.m_offset, std::size_t(size));
+      }
+      param.m_offset = offset;
+   }
 }
 
-void material::bind(render_backend &backend)
+int32 material::find_member(const uint64 id, const int32 size) const
 {
-   backend.set_shader_program(*m_program);
-   for (auto &param : m_parameters) {
-      backend.set_shader_uniform(*m_program, 
-                                 param.m_type, 
-                                 param.m_name.c_str(), 
-                                 1, 
-                                 (const void *)&param.m_data);
+   for (int32 index = 0; index < m_member_count; index++) {
+      if (m_members[index].m_id == id) {
+         const int32 offset = m_members[index].m_offset;
+         return (offset >= 0 && offset + size <= m_size) ? offset : -1;
+      }
    }
-   backend.set_texture(*m_texture);
-   backend.set_sampler_state(*m_sampler);
+
+   return -1;
 }
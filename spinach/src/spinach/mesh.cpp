@@ -1,39 +1,368 @@
 // model.cpp
 
 #include "spinach.hpp"
+#include "asset_format.hpp"
 
+#include <cmath>
+#include <cfloat>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
 #include <vector>
+#include <string_view>
+#include <unordered_map>
 #include <assimp/scene.h>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 struct model_vertex_t {
    float x, y, z;
    float u, v;
 };
 
-// static 
-bool mesh::create_from_file(mesh &model, const char *filename)
+// note: 12 bytes instead of 20, positions are unorm16 relative to the 
+//       mesh bounds, texcoords half floats. nothing is lit, so normals
+//       are not kept. the pad keeps the stride and the texcoords on a
+//       4 byte boundary, the gpu fetches those without splitting
+struct quantized_vertex_t {
+   uint16 position[3];
+   uint16 pad;
+   uint16 texcoord[2];
+};
+
+static_assert(sizeof(quantized_vertex_t) == 12, "unexpected quantized vertex size");
+static_assert(offsetof(quantized_vertex_t, texcoord) == 8, "unexpected quantized texcoord offset");
+
+// note: size of the simulated post-transform vertex cache, both for 
+//       the optimizer and for the acmr measurement
+static constexpr int32 k_vertex_cache_size = 32;
+
+static float
+average_cache_miss_ratio(const std::vector<uint32> &indices, const uint32 vertex_count)
 {
-   Assimp::Importer importer;
-   auto scene = importer.ReadFile(filename, aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_FlipUVs | aiProcess_FlipWindingOrder);
-   if (!scene || !scene->mRootNode || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE)) {
+   // note: fifo cache simulation, timestamp per vertex
+   std::vector<uint32> timestamps(vertex_count, 0);
+   uint32 timestamp = k_vertex_cache_size + 1;
+   uint32 misses = 0;
+   for (const uint32 index : indices) {
+      if (timestamp - timestamps[index] > k_vertex_cache_size) {
+         timestamps[index] = timestamp++;
+         misses++;
+      }
+   }
+
+   const uint32 triangle_count = uint32(indices.size() / 3);
+   return triangle_count ? float(misses) / float(triangle_count) : 0.0f;
+}
+
+static float
+vertex_cache_score(const int32 cache_position, const uint32 remaining_valence)
+{
+   if (remaining_valence == 0) {
+      return -1.0f;
+   }
+
+   float score = 0.0f;
+   if (cache_position >= 0) {
+      // note: the most recent triangle should not get a bonus, its 
+      //       vertices are used anyway
+      if (cache_position < 3) {
+         score = 0.75f;
+      }
+      else {
+         const float scale = 1.0f / float(k_vertex_cache_size - 3);
+         score = powf(1.0f - float(cache_position - 3) * scale, 1.5f);
+      }
+   }
+
+   // note: favour vertices with few triangles left, to get rid of them
+   score += 2.0f * powf(float(remaining_valence), -0.5f);
+   return score;
+}
+
+// note: forsyth's linear-speed vertex cache optimization 
+static void
+optimize_vertex_cache(std::vector<uint32> &indices, const uint32 vertex_count)
+{
+   const uint32 triangle_count = uint32(indices.size() / 3);
+   if (triangle_count == 0) {
+      return;
+   }
+
+   // note: vertex to triangle adjacency
+   std::vector<uint32> valence(vertex_count, 0);
+   for (const uint32 index : indices) {
+      valence[index]++;
+   }
+
+   std::vector<uint32> adjacency_offset(vertex_count + 1, 0);
+   for (uint32 vertex = 0; vertex < vertex_count; vertex++) {
+      adjacency_offset[vertex + 1] = adjacency_offset[vertex] + valence[vertex];
+   }
+
+   std::vector<uint32> adjacency(indices.size());
+   std::vector<uint32> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+   for (uint32 triangle = 0; triangle < triangle_count; triangle++) {
+      for (uint32 corner = 0; corner < 3; corner++) {
+         adjacency[fill[indices[triangle * 3 + corner]]++] = triangle;
+      }
+   }
+
+   std::vector<int32> cache_position(vertex_count, -1);
+   std::vector<float> vertex_score(vertex_count);
+   for (uint32 vertex = 0; vertex < vertex_count; vertex++) {
+      vertex_score[vertex] = vertex_cache_score(-1, valence[vertex]);
+   }
+
+   std::vector<float> triangle_score(triangle_count, 0.0f);
+   std::vector<bool> emitted(triangle_count, false);
+   for (uint32 triangle = 0; triangle < triangle_count; triangle++) {
+      for (uint32 corner = 0; corner < 3; corner++) {
+         triangle_score[triangle] += vertex_score[indices[triangle * 3 + corner]];
+      }
+   }
+
+   std::vector<uint32> result;
+   result.reserve(indices.size());
+
+   uint32 cache[k_vertex_cache_size + 3] = {};
+   int32 cache_count = 0;
+   uint32 scan_position = 0;
+
+   while (result.size() < indices.size()) {
+      // note: pick the best triangle touching the cache
+      int32 best_triangle = -1;
+      float best_score = -1.0f;
+      for (int32 slot = 0; slot < cache_count; slot++) {
+         const uint32 vertex = cache[slot];
+         for (uint32 at = adjacency_offset[vertex]; at < adjacency_offset[vertex] + valence[vertex]; at++) {
+            const uint32 triangle = adjacency[at];
+            if (triangle_score[triangle] > best_score) {
+               best_score = triangle_score[triangle];
+               best_triangle = int32(triangle);
+            }
+         }
+      }
+
+      // note: cache is cold, continue with the next unused triangle
+      if (best_triangle < 0) {
+         while (emitted[scan_position]) {
+            scan_position++;
+         }
+         best_triangle = int32(scan_position);
+      }
+
+      const uint32 *corners = &indices[best_triangle * 3];
+      emitted[best_triangle] = true;
+
+      // note: emit triangle and remove it from the adjacency of its vertices
+      uint32 new_cache[k_vertex_cache_size + 3] = {};
+      int32 new_cache_count = 0;
+      for (uint32 corner = 0; corner < 3; corner++) {
+         const uint32 vertex = corners[corner];
+         result.push_back(vertex);
+
+         const uint32 first = adjacency_offset[vertex];
+         const uint32 last = first + valence[vertex];
+         for (uint32 at = first; at < last; at++) {
+            if (adjacency[at] == uint32(best_triangle)) {
+               adjacency[at] = adjacency[last - 1];
+               break;
+            }
+         }
+         valence[vertex]--;
+
+         new_cache[new_cache_count++] = vertex;
+      }
+
+      for (int32 slot = 0; slot < cache_count; slot++) {
+         const uint32 vertex = cache[slot];
+         if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2]) {
+            new_cache[new_cache_count++] = vertex;
+         }
+      }
+
+      // note: vertices pushed out of the cache lose their position score
+      for (int32 slot = k_vertex_cache_size; slot < new_cache_count; slot++) {
+         cache_position[new_cache[slot]] = -1;
+         vertex_score[new_cache[slot]] = vertex_cache_score(-1, valence[new_cache[slot]]);
+      }
+
+      cache_count = new_cache_count < k_vertex_cache_size ? new_cache_count : k_vertex_cache_size;
+      for (int32 slot = 0; slot < cache_count; slot++) {
+         cache[slot] = new_cache[slot];
+         cache_position[cache[slot]] = slot;
+         vertex_score[cache[slot]] = vertex_cache_score(slot, valence[cache[slot]]);
+      }
+
+      // note: rescore triangles touched by the cache
+      for (int32 slot = 0; slot < cache_count; slot++) {
+         const uint32 vertex = cache[slot];
+         for (uint32 at = adjacency_offset[vertex]; at < adjacency_offset[vertex] + valence[vertex]; at++) {
+            const uint32 triangle = adjacency[at];
+            triangle_score[triangle] = vertex_score[indices[triangle * 3 + 0]] +
+                                       vertex_score[indices[triangle * 3 + 1]] +
+                                       vertex_score[indices[triangle * 3 + 2]];
+         }
+      }
+   }
+
+   indices.swap(result);
+}
+
+// note: reorder vertices in the order they are first referenced
+//       so that vertex fetch walks memory linearly
+template <typename T>
+static void
+optimize_vertex_fetch(std::vector<T> &vertices, std::vector<uint32> &indices)
+{
+   const uint32 unused = ~0u;
+   std::vector<uint32> remap(vertices.size(), unused);
+   std::vector<T> result;
+   result.reserve(vertices.size());
+
+   for (auto &index : indices) {
+      if (remap[index] == unused) {
+         remap[index] = uint32(result.size());
+         result.push_back(vertices[index]);
+      }
+      index = remap[index];
+   }
+
+   vertices.swap(result);
+}
+
+// note: result of an import, in the layout of the mesh container
+struct imported_mesh {
+   std::vector<quantized_vertex_t> m_vertices;
+   std::vector<uint32> m_indices;
+   std::vector<asset_format::mesh_submesh> m_submeshes;
+   glm::vec3 m_bounds_min{ 0.0f };
+   glm::vec3 m_bounds_max{ 0.0f };
+};
+
+static double
+get_elapsed_milliseconds(const std::chrono::steady_clock::time_point &start)
+{
+   return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static uint64
+align_offset(const uint64 offset)
+{
+   const uint64 alignment = asset_format::DATA_ALIGNMENT;
+   return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static std::string
+get_container_filename(const char *filename)
+{
+   std::string result(filename);
+   const auto dot = result.find_last_of('.');
+   const auto slash = result.find_last_of("/\\");
+   if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+      result.resize(dot);
+   }
+   result.append(".smesh");
+   return result;
+}
+
+// note: a gltf keeps its buffers and images in files of their own, those
+//       are part of the source as well. the uris are picked out of the
+//       text without a json parser, embedded data: uris are in the text
+static bool
+hash_source_files(const char *filename, uint64 &result)
+{
+   mapped_file source;
+   if (!source.open(filename)) {
       return false;
    }
 
-   const auto root_node = scene->mRootNode;
-   const auto mesh_index = root_node->mMeshes[0];
-   const auto mesh_data  = scene->mMeshes[mesh_index];
-   
+   const std::string_view text((const char *)source.m_data, source.m_size);
+   result = utility::hash_fnv1a(text);
+
+   const std::string_view name(filename);
+   if (!name.ends_with(".gltf")) {
+      return true;
+   }
+
+   const auto slash = name.find_last_of("/\\");
+   const std::string directory(slash == std::string_view::npos ? std::string_view() : name.substr(0, slash + 1));
+
+   constexpr std::string_view key = "\"uri\"";
+   std::size_t position = text.find(key);
+   while (position != std::string_view::npos) {
+      const auto open = text.find('"', position + key.size());
+      const auto close = open == std::string_view::npos ? open : text.find('"', open + 1);
+      if (close == std::string_view::npos) {
+         break;
+      }
+
+      const std::string_view uri = text.substr(open + 1, close - open - 1);
+      if (!uri.starts_with("data:")) {
+         // note: a missing file still changes the hash through its name
+         result = utility::hash_fnv1a(uri, result);
+
+         mapped_file dependency;
+         const std::string path = directory + std::string(uri);
+         if (dependency.open(path.c_str())) {
+            result = utility::hash_fnv1a(std::string_view((const char *)dependency.m_data, dependency.m_size), result);
+         }
+      }
+
+      position = text.find(key, close + 1);
+   }
+
+   return true;
+}
+
+// note: node hierarchy flattened into (scene mesh, node to model transform)
+static void
+collect_node_meshes(const aiNode *node, 
+                    const glm::mat4 &parent, 
+                    std::vector<std::pair<uint32, glm::mat4>> &instances)
+{
+   // note: assimp matrices are row major
+   const glm::mat4 transform = parent * glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+   for (uint32 index = 0; index < node->mNumMeshes; index++) {
+      instances.emplace_back(node->mMeshes[index], transform);
+   }
+
+   for (uint32 index = 0; index < node->mNumChildren; index++) {
+      collect_node_meshes(node->mChildren[index], transform, instances);
+   }
+}
+
+// note: one scene mesh, deduplicated and optimized on its own so its
+//       indices stay zero based
+static void
+import_scene_mesh(const aiMesh *mesh_data, 
+                  const char *filename, 
+                  std::vector<model_vertex_t> &vertices, 
+                  std::vector<uint32> &indices)
+{
    const bool has_texcoords = mesh_data->HasTextureCoords(0);
    const uint32 face_count  = mesh_data->mNumFaces;
-   const uint32 vertex_count = face_count * 3;
-   
-   uint32 offset = 0;
-   std::vector<model_vertex_t> vertices(vertex_count, model_vertex_t{});
+   const uint32 corner_count = face_count * 3;
+
+   // note: deduplicate on the attributes we actually keep, assimp
+   //       vertices may still differ in normals, tangents, ...
+   std::unordered_map<std::string_view, uint32> unique;
+   std::vector<model_vertex_t> corners(corner_count, model_vertex_t{});
+   vertices.reserve(mesh_data->mNumVertices);
+   indices.reserve(corner_count);
+   unique.reserve(mesh_data->mNumVertices);
+
    for (uint32 face_index = 0; face_index < face_count; face_index++) {
       const auto &face = mesh_data->mFaces[face_index];
+      if (face.mNumIndices != 3) {
+         continue;
+      }
+
       for (uint32 vertex_index = 0; vertex_index < 3; vertex_index++) {
          const auto at = face.mIndices[vertex_index];
          auto position = mesh_data->mVertices[at];
@@ -42,23 +371,535 @@ bool mesh::create_from_file(mesh &model, const char *filename)
             auto texcoord3 = mesh_data->mTextureCoords[0][at];
             texcoord = { texcoord3.x, texcoord3.y };
          }
-   
-         vertices[offset++] = model_vertex_t{ position.x, position.y, position.z, texcoord.x, texcoord.y };
+
+         auto &corner = corners[indices.size()];
+         corner = model_vertex_t{ position.x, position.y, position.z, 
+                                  texcoord.x, texcoord.y };
+
+         const std::string_view key((const char *)&corner, sizeof(corner));
+         auto [it, inserted] = unique.emplace(key, uint32(vertices.size()));
+         if (inserted) {
+            vertices.push_back(corner);
+         }
+         indices.push_back(it->second);
       }
    }
 
-   return model.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, sizeof(model_vertex_t), int(vertices.size()), vertices.data());
+   const uint32 vertex_count = uint32(vertices.size());
+   const float acmr_before = average_cache_miss_ratio(indices, vertex_count);
+   optimize_vertex_cache(indices, vertex_count);
+   const float acmr_after = average_cache_miss_ratio(indices, vertex_count);
+   optimize_vertex_fetch(vertices, indices);
+
+   debug::log("mesh: '%s' (%s) - vertices: %u -> %u, acmr: %.3f -> %.3f",
+              filename,
+              mesh_data->mName.C_Str(),
+              uint32(indices.size()),
+              uint32(vertices.size()),
+              acmr_before,
+              acmr_after);
+}
+
+static bool
+import_mesh(imported_mesh &imported, const char *filename)
+{
+   Assimp::Importer importer;
+   auto scene = importer.ReadFile(filename, aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_FlipUVs | aiProcess_FlipWindingOrder);
+   if (!scene || !scene->mRootNode || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE)) {
+      return false;
+   }
+
+   std::vector<std::pair<uint32, glm::mat4>> instances;
+   collect_node_meshes(scene->mRootNode, glm::mat4(1.0f), instances);
+
+   // note: every scene mesh is stored once, nodes referencing the same
+   //       mesh become submeshes sharing its range
+   struct mesh_range {
+      bool m_imported{};
+      uint32 m_first_index{};
+      uint32 m_index_count{};
+      uint32 m_base_vertex{};
+      uint32 m_vertex_count{};
+      glm::vec3 m_bounds_min{ 0.0f };
+      glm::vec3 m_bounds_max{ 0.0f };
+   };
+
+   std::vector<mesh_range> ranges(scene->mNumMeshes);
+   std::vector<model_vertex_t> vertices;
+   for (const auto &[mesh_index, transform] : instances) {
+      auto &range = ranges[mesh_index];
+      if (!range.m_imported) {
+         std::vector<model_vertex_t> mesh_vertices;
+         std::vector<uint32> mesh_indices;
+         import_scene_mesh(scene->mMeshes[mesh_index], filename, mesh_vertices, mesh_indices);
+
+         range.m_imported = true;
+         range.m_first_index = uint32(imported.m_indices.size());
+         range.m_index_count = uint32(mesh_indices.size());
+         range.m_base_vertex = uint32(vertices.size());
+         range.m_vertex_count = uint32(mesh_vertices.size());
+         if (!mesh_vertices.empty()) {
+            range.m_bounds_min = range.m_bounds_max = glm::vec3(mesh_vertices[0].x, mesh_vertices[0].y, mesh_vertices[0].z);
+         }
+         for (const auto &vertex : mesh_vertices) {
+            range.m_bounds_min = glm::min(range.m_bounds_min, glm::vec3(vertex.x, vertex.y, vertex.z));
+            range.m_bounds_max = glm::max(range.m_bounds_max, glm::vec3(vertex.x, vertex.y, vertex.z));
+         }
+
+         vertices.insert(vertices.end(), mesh_vertices.begin(), mesh_vertices.end());
+         imported.m_indices.insert(imported.m_indices.end(), mesh_indices.begin(), mesh_indices.end());
+      }
+
+      // note: point and line meshes have no triangles left
+      if (range.m_index_count == 0) {
+         continue;
+      }
+
+      asset_format::mesh_submesh submesh{};
+      submesh.first_index_ = range.m_first_index;
+      submesh.index_count_ = range.m_index_count;
+      submesh.base_vertex_ = int32(range.m_base_vertex);
+      submesh.vertex_count_ = range.m_vertex_count;
+      memcpy(submesh.transform_, glm::value_ptr(transform), sizeof(submesh.transform_));
+      memcpy(submesh.bounds_min_, glm::value_ptr(range.m_bounds_min), sizeof(submesh.bounds_min_));
+      memcpy(submesh.bounds_max_, glm::value_ptr(range.m_bounds_max), sizeof(submesh.bounds_max_));
+      imported.m_submeshes.push_back(submesh);
+   }
+
+   if (imported.m_submeshes.empty()) {
+      return false;
+   }
+
+   // note: one set of quantization bounds for all submeshes, so they 
+   //       share the vertex format and the dequantize transform
+   glm::vec3 bounds_min(vertices.empty() ? 0.0f : vertices[0].x,
+                        vertices.empty() ? 0.0f : vertices[0].y,
+                        vertices.empty() ? 0.0f : vertices[0].z);
+   glm::vec3 bounds_max = bounds_min;
+   for (const auto &vertex : vertices) {
+      bounds_min = glm::min(bounds_min, glm::vec3(vertex.x, vertex.y, vertex.z));
+      bounds_max = glm::max(bounds_max, glm::vec3(vertex.x, vertex.y, vertex.z));
+   }
+
+   glm::vec3 extent = bounds_max - bounds_min;
+   for (int axis = 0; axis < 3; axis++) {
+      if (extent[axis] <= 0.0f) {
+         extent[axis] = 1.0f;
+      }
+   }
+
+   imported.m_vertices.resize(vertices.size());
+   for (std::size_t index = 0; index < vertices.size(); index++) {
+      const auto &vertex = vertices[index];
+      const glm::vec3 position = (glm::vec3(vertex.x, vertex.y, vertex.z) - bounds_min) / extent;
+
+      auto &result = imported.m_vertices[index];
+      result.position[0] = glm::packUnorm1x16(position.x);
+      result.position[1] = glm::packUnorm1x16(position.y);
+      result.position[2] = glm::packUnorm1x16(position.z);
+      result.pad = 0;
+      result.texcoord[0] = glm::packHalf1x16(vertex.u);
+      result.texcoord[1] = glm::packHalf1x16(vertex.v);
+   }
+
+   imported.m_bounds_min = bounds_min;
+   imported.m_bounds_max = bounds_min + extent;
+
+   debug::log("mesh: '%s' - %u nodes, %u meshes, %u submeshes",
+              filename,
+              uint32(instances.size()),
+              scene->mNumMeshes,
+              uint32(imported.m_submeshes.size()));
+
+   return true;
+}
+
+// note: lays the import out exactly as the container file
+static void
+build_mesh_container(std::vector<uint8> &result, const uint64 source_hash, const imported_mesh &imported)
+{
+   using namespace asset_format;
+
+   // note: indices are relative to the base vertex of their submesh,
+   //       only the largest submesh has to fit in 16 bits
+   uint32 largest = 0;
+   for (const auto &submesh : imported.m_submeshes) {
+      largest = submesh.vertex_count_ > largest ? submesh.vertex_count_ : largest;
+   }
+
+   const bool narrow = largest <= 0xffff;
+   const uint64 index_size = narrow ? sizeof(uint16) : sizeof(uint32);
+
+   mesh_header header{};
+   header.magic_ = MESH_MAGIC;
+   header.version_ = MESH_VERSION;
+   header.source_hash_ = source_hash;
+   header.vertex_stride_ = sizeof(quantized_vertex_t);
+   header.vertex_count_ = uint32(imported.m_vertices.size());
+   header.index_type_ = narrow ? INDEX_TYPE_UNSIGNED_SHORT : INDEX_TYPE_UNSIGNED_INT;
+   header.index_count_ = uint32(imported.m_indices.size());
+   header.submesh_count_ = uint32(imported.m_submeshes.size());
+   header.submesh_offset_ = align_offset(sizeof(mesh_header));
+   header.vertex_offset_ = align_offset(header.submesh_offset_ + sizeof(mesh_submesh) * header.submesh_count_);
+   header.index_offset_ = align_offset(header.vertex_offset_ + uint64(header.vertex_stride_) * header.vertex_count_);
+   memcpy(header.bounds_min_, glm::value_ptr(imported.m_bounds_min), sizeof(header.bounds_min_));
+   memcpy(header.bounds_max_, glm::value_ptr(imported.m_bounds_max), sizeof(header.bounds_max_));
+
+   result.assign(std::size_t(header.index_offset_ + index_size * header.index_count_), 0);
+   memcpy(result.data(), &header, sizeof(header));
+   memcpy(result.data() + header.submesh_offset_, imported.m_submeshes.data(), sizeof(mesh_submesh) * header.submesh_count_);
+   memcpy(result.data() + header.vertex_offset_, imported.m_vertices.data(), sizeof(quantized_vertex_t) * header.vertex_count_);
+   if (narrow) {
+      auto indices = (uint16 *)(result.data() + header.index_offset_);
+      for (std::size_t index = 0; index < imported.m_indices.size(); index++) {
+         indices[index] = uint16(imported.m_indices[index]);
+      }
+   }
+   else {
+      memcpy(result.data() + header.index_offset_, imported.m_indices.data(), sizeof(uint32) * header.index_count_);
+   }
+}
+
+// note: validates the container, returns nullptr when it is not usable
+static const asset_format::mesh_header *
+get_mesh_header(const uint8 *data, const std::size_t size)
+{
+   using namespace asset_format;
+
+   if (size < sizeof(mesh_header)) {
+      return nullptr;
+   }
+
+   const auto header = (const mesh_header *)data;
+   if (header->magic_ != MESH_MAGIC ||
+       header->version_ != MESH_VERSION ||
+       header->vertex_stride_ != sizeof(quantized_vertex_t) ||
+       header->index_type_ > INDEX_TYPE_UNSIGNED_INT ||
+       header->submesh_count_ == 0)
+   {
+      return nullptr;
+   }
+
+   const uint64 index_size = header->index_type_ == INDEX_TYPE_UNSIGNED_SHORT ? 2 : 
+                             header->index_type_ == INDEX_TYPE_UNSIGNED_INT   ? 4 : 1;
+   if (header->submesh_offset_ + sizeof(mesh_submesh) * header->submesh_count_ > size ||
+       header->vertex_offset_ + uint64(header->vertex_stride_) * header->vertex_count_ > size ||
+       header->index_offset_ + index_size * header->index_count_ > size)
+   {
+      return nullptr;
+   }
+
+   // note: every submesh has to draw inside the sections, ranges are
+   //       summed in 64 bits so they cannot wrap past the check
+   const auto submeshes = (const mesh_submesh *)(data + header->submesh_offset_);
+   for (uint32 index = 0; index < header->submesh_count_; index++) {
+      const auto &submesh = submeshes[index];
+      if (uint64(submesh.first_index_) + submesh.index_count_ > header->index_count_ ||
+          submesh.base_vertex_ < 0 ||
+          uint64(submesh.base_vertex_) + submesh.vertex_count_ > header->vertex_count_)
+      {
+         return nullptr;
+      }
+   }
+
+   return header;
+}
+
+// note: uploads straight from the container, no parsing or copying
+static bool
+create_from_container(mesh &model, const uint8 *data, const std::size_t size, geometry_buffer *geometry)
+{
+   const auto header = get_mesh_header(data, size);
+   if (header == nullptr) {
+      return false;
+   }
+
+   const glm::vec3 bounds_min = glm::make_vec3(header->bounds_min_);
+   const glm::vec3 bounds_max = glm::make_vec3(header->bounds_max_);
+
+   model.m_layout = &mesh::quantized_vertex_layout();
+   model.m_dequantize = glm::scale(glm::translate(glm::mat4(1.0f), bounds_min), bounds_max - bounds_min);
+   model.set_transform(model.m_transform);
+
+   const auto submeshes = (const asset_format::mesh_submesh *)(data + header->submesh_offset_);
+   model.m_submeshes.clear();
+   model.m_submeshes.reserve(header->submesh_count_);
+   for (uint32 index = 0; index < header->submesh_count_; index++) {
+      mesh::submesh submesh;
+      submesh.m_first_index = int32(submeshes[index].first_index_);
+      submesh.m_index_count = int32(submeshes[index].index_count_);
+      submesh.m_base_vertex = submeshes[index].base_vertex_;
+      submesh.m_transform = glm::make_mat4(submeshes[index].transform_);
+      model.m_submeshes.push_back(submesh);
+   }
+
+   // note: model space box around every placed submesh, the sphere
+   //       around that is good enough for culling
+   glm::vec3 model_min(FLT_MAX);
+   glm::vec3 model_max(-FLT_MAX);
+   for (uint32 index = 0; index < header->submesh_count_; index++) {
+      const glm::vec3 part_min = glm::make_vec3(submeshes[index].bounds_min_);
+      const glm::vec3 part_max = glm::make_vec3(submeshes[index].bounds_max_);
+      for (int32 corner = 0; corner < 8; corner++) {
+         const glm::vec3 point((corner & 1) ? part_max.x : part_min.x,
+                               (corner & 2) ? part_max.y : part_min.y,
+                               (corner & 4) ? part_max.z : part_min.z);
+         const glm::vec3 placed = glm::vec3(model.m_submeshes[index].m_transform * glm::vec4(point, 1.0f));
+         model_min = glm::min(model_min, placed);
+         model_max = glm::max(model_max, placed);
+      }
+   }
+   if (header->submesh_count_ > 0) {
+      model.set_bounds((model_min + model_max) * 0.5f, glm::length(model_max - model_min) * 0.5f);
+   }
+
+   if (geometry && geometry->valid()) {
+      // note: the quantized position is the first 6 bytes of a vertex
+      std::vector<uint16> positions;
+      if (geometry->m_position_stride == mesh::quantized_position_layout().stride_) {
+         const uint8 *source = data + header->vertex_offset_;
+         positions.resize(std::size_t(header->vertex_count_) * 4);
+         for (std::size_t index = 0; index < header->vertex_count_; index++) {
+            std::memcpy(&positions[index * 4], source + index * header->vertex_stride_, sizeof(uint16) * 3);
+         }
+      }
+
+      int32 first_vertex = 0;
+      int32 first_index = 0;
+      if (geometry->m_vertex_stride == int32(header->vertex_stride_) &&
+          geometry->m_index_type == index_type(header->index_type_) &&
+          geometry->append(int32(header->vertex_count_),
+                           data + header->vertex_offset_,
+                           int32(header->index_count_),
+                           data + header->index_offset_,
+                           first_vertex,
+                           first_index,
+                           positions.empty() ? nullptr : positions.data()))
+      {
+         for (auto &submesh : model.m_submeshes) {
+            submesh.m_first_index += first_index;
+            submesh.m_base_vertex += first_vertex;
+         }
+
+         model.m_topology = PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+         model.m_index_type = index_type(header->index_type_);
+         model.m_primitive_count = int(header->index_count_);
+         model.m_shared_buffer = &geometry->m_vertices;
+         model.m_shared_index_buffer = &geometry->m_indices;
+         if (!positions.empty()) {
+            model.set_position_stream(&geometry->m_positions, &mesh::quantized_position_layout());
+         }
+         return true;
+      }
+
+      // note: still drawable, just with buffers of its own
+      debug::log("mesh: does not fit the geometry buffer, using own buffers");
+   }
+
+   return model.create(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 
+                       int(header->vertex_stride_), 
+                       int(header->vertex_count_), 
+                       data + header->vertex_offset_, 
+                       index_type(header->index_type_), 
+                       int(header->index_count_), 
+                       data + header->index_offset_);
+}
+
+// static 
+bool mesh::create_from_file(mesh &model, const char *filename, geometry_buffer *geometry)
+{
+   const auto start = std::chrono::steady_clock::now();
+
+   // note: the container is keyed by the contents of the source files
+   uint64 source_hash = 0;
+   if (!hash_source_files(filename, source_hash)) {
+      return false;
+   }
+
+   const std::string container_filename = get_container_filename(filename);
+   {
+      mapped_file container;
+      if (container.open(container_filename.c_str())) {
+         const auto header = get_mesh_header(container.m_data, container.m_size);
+         if (header && header->source_hash_ == source_hash) {
+            const bool result = create_from_container(model, container.m_data, container.m_size, geometry);
+            debug::log("mesh: '%s' - loaded from container in %.2fms", filename, get_elapsed_milliseconds(start));
+            return result;
+         }
+      }
+   }
+
+   imported_mesh imported;
+   if (!import_mesh(imported, filename)) {
+      return false;
+   }
+
+   const double import_time = get_elapsed_milliseconds(start);
+
+   std::vector<uint8> container;
+   build_mesh_container(container, source_hash, imported);
+
+   FILE *fout = nullptr;
+   fopen_s(&fout, container_filename.c_str(), "wb");
+   if (fout) {
+      fwrite(container.data(), 1, container.size(), fout);
+      fclose(fout);
+   }
+   else {
+      debug::log("could not write mesh container: '%s'", container_filename.c_str());
+   }
+
+   const double write_time = get_elapsed_milliseconds(start) - import_time;
+
+   // note: the first run loads through the container it just wrote, so
+   //       one log line holds both the import and the mapped load cost
+   const auto load_start = std::chrono::steady_clock::now();
+   bool result = false;
+   {
+      mapped_file written;
+      if (written.open(container_filename.c_str())) {
+         result = create_from_container(model, written.m_data, written.m_size, geometry);
+      }
+      else {
+         result = create_from_container(model, container.data(), container.size(), geometry);
+      }
+   }
+
+   debug::log("mesh: '%s' - imported in %.2fms, container written in %.2fms, loaded from container in %.2fms", 
+              filename, 
+              import_time, 
+              write_time,
+              get_elapsed_milliseconds(load_start));
+
+   return result;
+}
+
+// static
+void mesh::benchmark(const char *filename)
+{
+   // note: the cpu side of both paths, neither uploads. the import is
+   //       what every launch paid before the container, the container
+   //       load is what it pays now: hash the sources, map and validate.
+   //       the vertices are summed so the mapped pages are really read
+   const int32 rounds = 10;
+
+   uint64 source_hash = 0;
+   if (!hash_source_files(filename, source_hash)) {
+      debug::log("mesh: benchmark could not read '%s'", filename);
+      return;
+   }
+
+   imported_mesh imported;
+   auto start = std::chrono::steady_clock::now();
+   for (int32 round = 0; round < rounds; round++) {
+      imported = imported_mesh{};
+      uint64 hash = 0;
+      if (!hash_source_files(filename, hash) || !import_mesh(imported, filename)) {
+         debug::log("mesh: benchmark could not import '%s'", filename);
+         return;
+      }
+   }
+   const double import_time = get_elapsed_milliseconds(start) / double(rounds);
+
+   std::vector<uint8> container;
+   build_mesh_container(container, source_hash, imported);
+
+   const std::string container_filename = get_container_filename(filename);
+   FILE *fout = nullptr;
+   fopen_s(&fout, container_filename.c_str(), "wb");
+   if (fout == nullptr) {
+      debug::log("could not write mesh container: '%s'", container_filename.c_str());
+      return;
+   }
+   fwrite(container.data(), 1, container.size(), fout);
+   fclose(fout);
+
+   uint64 sum = 0;
+   start = std::chrono::steady_clock::now();
+   for (int32 round = 0; round < rounds; round++) {
+      uint64 hash = 0;
+      mapped_file mapped;
+      if (!hash_source_files(filename, hash) || !mapped.open(container_filename.c_str())) {
+         return;
+      }
+
+      const auto header = get_mesh_header(mapped.m_data, mapped.m_size);
+      if (header == nullptr || header->source_hash_ != hash) {
+         debug::log("mesh: benchmark container for '%s' is not valid", filename);
+         return;
+      }
+
+      const uint8 *vertices = mapped.m_data + header->vertex_offset_;
+      const uint64 vertex_size = uint64(header->vertex_stride_) * header->vertex_count_;
+      for (uint64 offset = 0; offset < vertex_size; offset++) {
+         sum += vertices[offset];
+      }
+   }
+   const double container_time = get_elapsed_milliseconds(start) / double(rounds);
+
+   debug::log("mesh: '%s' - import %.2fms, container %.2fms, %.1fx, %llu container bytes (checksum %llu)",
+              filename,
+              import_time,
+              container_time,
+              import_time / (container_time > 0.0 ? container_time : 1.0),
+              (unsigned long long)container.size(),
+              (unsigned long long)sum);
+}
+
+// static
+const vertex_layout &mesh::quantized_vertex_layout()
+{
+   static const vertex_layout layout = []() {
+      // note: the pad is the fourth position component, vec3 in the
+      //       shader drops it
+      vertex_layout result;
+      result.add_attribute(0, vertex_layout::ATTRIBUTE_FORMAT_UNSIGNED_SHORT, 4, true);
+      result.add_attribute(1, vertex_layout::ATTRIBUTE_FORMAT_HALF_FLOAT, 2, false);
+      return result;
+   }();
+
+   return layout;
+}
+
+const vertex_layout &mesh::quantized_position_layout()
+{
+   static const vertex_layout layout = []() {
+      vertex_layout result;
+      result.add_attribute(0, vertex_layout::ATTRIBUTE_FORMAT_UNSIGNED_SHORT, 4, true);
+      return result;
+   }();
+
+   return layout;
+}
+
+void mesh::set_draw_state(render_backend &backend, const uint32 flags)
+{
+   if (flags & DRAW_FLAGS_OVERDRAW) {
+      backend.set_blend_state(true, BLEND_EQUATION_ADD, BLEND_FACTOR_ONE, BLEND_FACTOR_ONE, BLEND_EQUATION_ADD, BLEND_FACTOR_ONE, BLEND_FACTOR_ONE);
+   }
+   else {
+      backend.set_blend_state(false);
+   }
+
+   if (flags & DRAW_FLAGS_DEPTH_PREPASSED) {
+      backend.set_depth_state(true, false, 0.0f, 1.0f, COMPARE_FUNC_LESS_EQUAL);
+   }
+   else {
+      backend.set_depth_state(true, true);
+   }
 }
 
 mesh::mesh(const vertex_layout *layout)
    : m_transform(1.0f)
+   , m_dequantize(1.0f)
+   , m_previous_transform(1.0f)
    , m_layout(layout)
 {
 }
 
 bool mesh::valid() const
 {
-   return m_buffer.is_valid();
+   return m_buffer.is_valid() || (m_shared_buffer && m_shared_buffer->is_valid());
 }
 
 bool mesh::create(const primitive_topology topology, const int stride, const int count, const void *data)
@@ -68,31 +909,201 @@ bool mesh::create(const primitive_topology topology, const int stride, const int
    return m_buffer.create(stride * count, data);
 }
 
-void mesh::update(const int stride, const int count, const void *data)
+bool mesh::create(const primitive_topology topology,
+                  const int stride,
+                  const int vertex_count,
+                  const void *vertices,
+                  const index_type type,
+                  const int index_count,
+                  const void *indices)
+{
+   const int index_size = type == INDEX_TYPE_UNSIGNED_BYTE  ? int(sizeof(uint8))  :
+                          type == INDEX_TYPE_UNSIGNED_SHORT ? int(sizeof(uint16)) :
+                                                              int(sizeof(uint32));
+
+   m_primitive_count = index_count;
+   m_topology = topology;
+   m_index_type = type;
+   if (!m_buffer.create(stride * vertex_count, vertices)) {
+      return false;
+   }
+
+   return m_index_buffer.create(index_size * index_count, indices);
+}
+
+bool mesh::create(const primitive_topology topology, const vertex_buffer *buffer, const int count)
+{
+   m_primitive_count = count;
+   m_topology = topology;
+   m_shared_buffer = buffer;
+   return valid();
+}
+
+void mesh::update(streaming_buffer &stream, const int stride, const int count, const void *data)
+{
+   const int32 offset = stream.write(stride * count, data, stride);
+   if (offset < 0) {
+      return;
+   }
+
+   m_stream = &stream;
+   m_stream_first = offset / stride;
+   m_stream_count = count;
+}
+
+void mesh::end_frame()
 {
-   m_buffer.update(stride * count, data);
+   m_stream = nullptr;
+   m_stream_first = 0;
+   m_stream_count = 0;
 }
 
 void mesh::destroy()
 {
    m_primitive_count = 0;
-   m_buffer.destroy();
+   m_shared_buffer = nullptr;
+   m_shared_index_buffer = nullptr;
+   m_submeshes.clear();
+   if (m_buffer.is_valid()) {
+      m_buffer.destroy();
+   }
+   if (m_index_buffer.is_valid()) {
+      m_index_buffer.destroy();
+   }
 }
 
 void mesh::set_transform(const glm::mat4 &transform)
 {
    m_transform = transform;
-   m_material.set_parameter("u_world", m_transform);
 }
 
-void mesh::draw(render_backend &backend)
+const glm::mat4 &mesh::previous_transform() const
 {
-   m_material.bind(backend);
+   return m_has_previous ? m_previous_transform : m_transform;
+}
 
-   backend.set_vertex_buffer(m_buffer);
+void mesh::store_previous_transform()
+{
+   m_previous_transform = m_transform;
+   m_has_previous = true;
+}
+
+void mesh::set_position_stream(const vertex_buffer *buffer, const vertex_layout *layout)
+{
+   m_position_buffer = buffer;
+   m_position_layout = layout;
+}
+
+void mesh::set_bounds(const glm::vec3 &center, const float radius, const float occluder_radius)
+{
+   m_bounds_center = center;
+   m_bounds_radius = radius;
+   m_occluder_radius = occluder_radius;
+}
+
+void mesh::world_bounds(glm::vec3 &center, float &radius, float &occluder_radius) const
+{
+   // note: the largest axis scale keeps the sphere around the mesh,
+   //       the smallest keeps the occluder inside it
+   const glm::vec3 scale(glm::length(glm::vec3(m_transform[0])),
+                         glm::length(glm::vec3(m_transform[1])),
+                         glm::length(glm::vec3(m_transform[2])));
+   center = glm::vec3(m_transform * glm::vec4(m_bounds_center, 1.0f));
+   radius = m_bounds_radius * glm::max(scale.x, glm::max(scale.y, scale.z));
+   occluder_radius = m_occluder_radius * glm::min(scale.x, glm::min(scale.y, scale.z));
+}
+
+void mesh::draw(render_backend &backend, streaming_buffer &stream, const uint32 flags)
+{
+   // note: the material is bound once with the world of the first part,
+   //       later parts only stream their world matrices again
+   const index_buffer *indices = m_shared_index_buffer ? m_shared_index_buffer : &m_index_buffer;
+   const bool has_parts = indices->is_valid() && !m_submeshes.empty();
+   const glm::mat4 first_part = has_parts ? m_submeshes.front().m_transform : glm::mat4(1.0f);
+
+   m_material.set_parameter(material::parameter_id("u_world"), m_transform * first_part * m_dequantize);
+   m_material.set_parameter(material::parameter_id("u_previous_world"), previous_transform() * first_part * m_dequantize);
+   m_material.bind(backend, stream);
+
+   if (m_stream) {
+      backend.set_vertex_buffer(*m_stream);
+   }
+   else if (m_shared_buffer) {
+      backend.set_vertex_buffer(*m_shared_buffer);
+   }
+   else {
+      backend.set_vertex_buffer(m_buffer);
+   }
    backend.set_vertex_layout(*m_layout);
+   backend.set_rasterizer_state(CULL_MODE_BACK, FRONT_FACE_CW);
+   set_draw_state(backend, flags);
+   if (has_parts) {
+      backend.set_index_buffer(*indices);
+      for (std::size_t index = 0; index < m_submeshes.size(); index++) {
+         const auto &part = m_submeshes[index];
+         if (index > 0) {
+            m_material.set_parameter(material::parameter_id("u_world"), m_transform * part.m_transform * m_dequantize);
+            m_material.set_parameter(material::parameter_id("u_previous_world"), previous_transform() * part.m_transform * m_dequantize);
+            m_material.bind_parameters(backend, stream);
+         }
+         backend.draw_indexed(m_topology, m_index_type, part.m_first_index, part.m_index_count, part.m_base_vertex);
+      }
+   }
+   else if (indices->is_valid()) {
+      backend.set_index_buffer(*indices);
+      backend.draw_indexed(m_topology, m_index_type, 0, m_primitive_count);
+   }
+   else if (m_stream) {
+      backend.draw(m_topology, m_stream_first, m_stream_count);
+   }
+   else {
+      backend.draw(m_topology, 0, m_primitive_count);
+   }
+
+   store_previous_transform();
+}
+
+void mesh::draw_depth(render_backend &backend, const shader_program &program)
+{
+   backend.set_shader_program(program);
+
+   if (m_stream) {
+      backend.set_vertex_buffer(*m_stream);
+      backend.set_vertex_layout(*m_layout);
+   }
+   else if (m_position_buffer) {
+      backend.set_vertex_buffer(*m_position_buffer);
+      backend.set_vertex_layout(*m_position_layout);
+   }
+   else {
+      backend.set_vertex_buffer(m_shared_buffer ? *m_shared_buffer : m_buffer);
+      backend.set_vertex_layout(*m_layout);
+   }
    backend.set_blend_state(false);
    backend.set_depth_state(true, true);
    backend.set_rasterizer_state(CULL_MODE_BACK, FRONT_FACE_CW);
-   backend.draw(m_topology, 0, m_primitive_count);
+
+   const index_buffer *indices = m_shared_index_buffer ? m_shared_index_buffer : &m_index_buffer;
+   if (indices->is_valid() && !m_submeshes.empty()) {
+      backend.set_index_buffer(*indices);
+      for (const auto &part : m_submeshes) {
+         const glm::mat4 world = m_transform * part.m_transform * m_dequantize;
+         backend.set_shader_uniform(program, UNIFORM_TYPE_MATRIX, "u_world", 1, glm::value_ptr(world));
+         backend.draw_indexed(m_topology, m_index_type, part.m_first_index, part.m_index_count, part.m_base_vertex);
+      }
+      return;
+   }
+
+   const glm::mat4 world = m_transform * m_dequantize;
+   backend.set_shader_uniform(program, UNIFORM_TYPE_MATRIX, "u_world", 1, glm::value_ptr(world));
+   if (indices->is_valid()) {
+      backend.set_index_buffer(*indices);
+      backend.draw_indexed(m_topology, m_index_type, 0, m_primitive_count);
+   }
+   else if (m_stream) {
+      backend.draw(m_topology, m_stream_first, m_stream_count);
+   }
+   else {
+      backend.draw(m_topology, 0, m_primitive_count);
+   }
 }
@@ -0,0 +1,196 @@
+// metrics.cpp
+
+#include "spinach.hpp"
+
+#include <bit>
+#include <cstdio>
+
+static const char *k_counter_names[] =
+{
+   "draw_calls",
+   "dispatches",
+   "state_changes",
+   "uniform_uploads",
+   "texture_binds",
+   "upload_bytes",
+   "bodies_updated",
+   "bodies_culled",
+   "bodies_visible",
+};
+
+static const char *k_timing_names[] =
+{
+   "frame",
+   "cpu",
+   "gpu",
+   "simulation",
+};
+
+static_assert(sizeof(k_counter_names) / sizeof(k_counter_names[0]) == metrics::COUNTER_COUNT, "counter without a name");
+static_assert(sizeof(k_timing_names) / sizeof(k_timing_names[0]) == metrics::TIMING_COUNT, "timing without a name");
+
+using histogram = metrics::histogram;
+
+// note: values below SUB_BUCKETS have a bucket each, above that the
+//       top SUB_BUCKET_BITS bits of the value pick the bucket within
+//       the magnitude of its highest bit
+static int32 bucket_index(const int64 value)
+{
+   const uint64 clamped = value < 0 ? 0 : (value >= (1ll << histogram::VALUE_BITS) ? (1ull << histogram::VALUE_BITS) - 1 : uint64(value));
+   if (clamped < uint64(histogram::SUB_BUCKETS)) {
+      return int32(clamped);
+   }
+
+   const int32 magnitude = int32(std::bit_width(clamped)) - histogram::SUB_BUCKET_BITS;
+   const int32 sub_bucket = int32(clamped >> magnitude);
+   return (magnitude << (histogram::SUB_BUCKET_BITS - 1)) + sub_bucket;
+}
+
+static int64 bucket_highest_value(const int32 index)
+{
+   if (index < histogram::SUB_BUCKETS) {
+      return index;
+   }
+
+   const int32 magnitude = (index >> (histogram::SUB_BUCKET_BITS - 1)) - 1;
+   const int32 sub_bucket = index - (magnitude << (histogram::SUB_BUCKET_BITS - 1));
+   return (int64(sub_bucket + 1) << magnitude) - 1;
+}
+
+void metrics::histogram::record(const int64 value)
+{
+   if (m_sample_count == WINDOW_SIZE) {
+      m_counts[bucket_index(m_window[m_window_index])]--;
+   }
+   else {
+      m_sample_count++;
+   }
+
+   m_counts[bucket_index(value)]++;
+   m_window[m_window_index] = value;
+   m_window_index = (m_window_index + 1) % WINDOW_SIZE;
+}
+
+int64 metrics::histogram::percentile(const float percent) const
+{
+   if (m_sample_count == 0) {
+      return 0;
+   }
+
+   // note: the rank of the sample, rounded up so p100 is the last one
+   const float clamped = percent < 0.0f ? 0.0f : (percent > 100.0f ? 100.0f : percent);
+   int32 rank = int32(clamped / 100.0f * float(m_sample_count) + 0.999f);
+   rank = rank < 1 ? 1 : rank;
+
+   int32 seen = 0;
+   for (int32 index = 0; index < BUCKET_COUNT; index++) {
+      seen += m_counts[index];
+      if (seen >= rank) {
+         return bucket_highest_value(index);
+      }
+   }
+
+   return bucket_highest_value(BUCKET_COUNT - 1);
+}
+
+int64 metrics::histogram::highest() const
+{
+   int64 result = 0;
+   for (int32 index = 0; index < m_sample_count; index++) {
+      result = m_window[index] > result ? m_window[index] : result;
+   }
+   return result;
+}
+
+// static
+const char *metrics::name(const counter index)
+{
+   return k_counter_names[index];
+}
+
+// static
+const char *metrics::name(const timing index)
+{
+   return k_timing_names[index];
+}
+
+void metrics::add(const counter index, const int64 value)
+{
+   m_counters[index] += value;
+}
+
+void metrics::record(const timing index, const int64 microseconds)
+{
+   m_timings[index].record(microseconds);
+
+   if (index == TIMING_FRAME) {
+      m_graph[m_graph_index] = float(microseconds) / 1000.0f;
+      m_graph_index = (m_graph_index + 1) % GRAPH_SIZE;
+      m_graph_count = m_graph_count < GRAPH_SIZE ? m_graph_count + 1 : GRAPH_SIZE;
+   }
+}
+
+void metrics::end_frame()
+{
+   for (int32 index = 0; index < COUNTER_COUNT; index++) {
+      m_last[index] = m_counters[index];
+      m_counters[index] = 0;
+   }
+   m_frame_count++;
+}
+
+int32 metrics::graph(float *milliseconds, const int32 capacity) const
+{
+   const int32 count = m_graph_count < capacity ? m_graph_count : capacity;
+   const int32 first = m_graph_index - count + GRAPH_SIZE;
+   for (int32 index = 0; index < count; index++) {
+      milliseconds[index] = m_graph[(first + index) % GRAPH_SIZE];
+   }
+   return count;
+}
+
+bool metrics::write_json(const char *filename) const
+{
+   FILE *fout = nullptr;
+   fopen_s(&fout, filename, "w");
+   if (fout == nullptr) {
+      debug::log("could not write metrics: '%s'", filename);
+      return false;
+   }
+
+   fprintf(fout, "{\n");
+   fprintf(fout, "  \"frame\": %lld,\n", m_frame_count);
+   fprintf(fout, "  \"counters\": {\n");
+   for (int32 index = 0; index < COUNTER_COUNT; index++) {
+      fprintf(fout, "    \"%s\": %lld%s\n",
+              name(counter(index)),
+              m_last[index],
+              index + 1 < COUNTER_COUNT ? "," : "");
+   }
+   fprintf(fout, "  },\n");
+   fprintf(fout, "  \"timings_us\": {\n");
+   for (int32 index = 0; index < TIMING_COUNT; index++) {
+      const histogram &entry = m_timings[index];
+      fprintf(fout, "    \"%s\": { \"samples\": %d, \"p50\": %lld, \"p95\": %lld, \"p99\": %lld, \"max\": %lld }%s\n",
+              name(metrics::timing(index)),
+              entry.m_sample_count,
+              entry.percentile(50.0f),
+              entry.percentile(95.0f),
+              entry.percentile(99.0f),
+              entry.highest(),
+              index + 1 < TIMING_COUNT ? "," : "");
+   }
+   fprintf(fout, "  },\n");
+
+   float frames[GRAPH_SIZE] = {};
+   const int32 count = graph(frames, GRAPH_SIZE);
+   fprintf(fout, "  \"frame_ms\": [");
+   for (int32 index = 0; index < count; index++) {
+      fprintf(fout, "%s%.3f", index > 0 ? ", " : "", frames[index]);
+   }
+   fprintf(fout, "]\n");
+   fprintf(fout, "}\n");
+   fclose(fout);
+
+   return true;
+}
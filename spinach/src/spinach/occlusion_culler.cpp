@@ -0,0 +1,185 @@
+// occlusion_culler.cpp
+
+#include "spinach.hpp"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <xmmintrin.h>
+
+static_assert((occlusion_culler::WIDTH >> (occlusion_culler::LEVEL_COUNT - 1)) % 4 == 0 &&
+              occlusion_culler::HEIGHT % (1 << (occlusion_culler::LEVEL_COUNT - 1)) == 0,
+              "every pyramid level is a whole number of four texel steps");
+
+// note: keeps the nearer depth inside the ellipse, four pixels a step.
+//       rows start at a multiple of four so loads never cross the row
+static void
+draw_disc(float *depth, const float center_x, const float center_y, const float radius_x, const float radius_y, const float value)
+{
+   const int32 x0 = int32(std::max(floorf(center_x - radius_x), 0.0f)) & ~3;
+   const int32 x1 = int32(std::min(ceilf(center_x + radius_x), float(occlusion_culler::WIDTH - 1)));
+   const int32 y0 = int32(std::max(floorf(center_y - radius_y), 0.0f));
+   const int32 y1 = int32(std::min(ceilf(center_y + radius_y), float(occlusion_culler::HEIGHT - 1)));
+
+   const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+   const __m128 center = _mm_set1_ps(center_x);
+   const __m128 inverse_radius = _mm_set1_ps(1.0f / radius_x);
+   const __m128 one = _mm_set1_ps(1.0f);
+   const __m128 depth_value = _mm_set1_ps(value);
+   for (int32 y = y0; y <= y1; y++) {
+      const float dy = (float(y) + 0.5f - center_y) / radius_y;
+      if (dy * dy > 1.0f) {
+         continue;
+      }
+
+      const __m128 dy2 = _mm_set1_ps(dy * dy);
+      float *row = depth + y * occlusion_culler::WIDTH;
+      for (int32 x = x0; x <= x1; x += 4) {
+         const __m128 dx = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(float(x)), offsets), center), inverse_radius);
+         const __m128 inside = _mm_cmple_ps(_mm_add_ps(_mm_mul_ps(dx, dx), dy2), one);
+         const __m128 previous = _mm_loadu_ps(row + x);
+         const __m128 nearer = _mm_min_ps(previous, depth_value);
+         _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, previous)));
+      }
+   }
+}
+
+// note: every texel keeps the farthest depth of the four below it,
+//       four texels a step
+static void
+downsample(const float *source, float *destination, const int32 width, const int32 height)
+{
+   for (int32 y = 0; y < height; y++) {
+      const float *upper = source + (y * 2) * (width * 2);
+      const float *lower = upper + width * 2;
+      float *row = destination + y * width;
+      for (int32 x = 0; x < width; x += 4) {
+         const __m128 left = _mm_max_ps(_mm_loadu_ps(upper + x * 2), _mm_loadu_ps(lower + x * 2));
+         const __m128 right = _mm_max_ps(_mm_loadu_ps(upper + x * 2 + 4), _mm_loadu_ps(lower + x * 2 + 4));
+         const __m128 even = _mm_shuffle_ps(left, right, _MM_SHUFFLE(2, 0, 2, 0));
+         const __m128 odd = _mm_shuffle_ps(left, right, _MM_SHUFFLE(3, 1, 3, 1));
+         _mm_storeu_ps(row + x, _mm_max_ps(even, odd));
+      }
+   }
+}
+
+occlusion_culler::occlusion_culler()
+{
+   for (int32 level = 0; level < LEVEL_COUNT; level++) {
+      m_levels[level].resize(std::size_t((WIDTH >> level) * (HEIGHT >> level)));
+   }
+}
+
+void occlusion_culler::begin_frame(const camera &camera)
+{
+   m_start = utility::get_current_microseconds();
+   m_view = camera.m_view;
+   m_projection = camera.m_projection;
+   m_occluders.clear();
+   m_tested = 0;
+   m_culled = 0;
+}
+
+void occlusion_culler::add_occluder(const glm::vec3 &center, const float radius)
+{
+   // note: the camera is inside or right at it, nothing to rasterize
+   const glm::vec3 view = glm::vec3(m_view * glm::vec4(center, 1.0f));
+   const float depth = -view.z;
+   if (depth <= radius) {
+      return;
+   }
+
+   occluder entry;
+   entry.m_center = view;
+   entry.m_radius = radius;
+   entry.m_depth = depth;
+   entry.m_size = radius * m_projection[1][1] / depth * float(HEIGHT);
+   if (entry.m_size >= MIN_OCCLUDER_SIZE) {
+      m_occluders.push_back(entry);
+   }
+}
+
+void occlusion_culler::build()
+{
+   std::sort(m_occluders.begin(), m_occluders.end(), [](const occluder &lhs, const occluder &rhs) {
+      return lhs.m_size > rhs.m_size;
+   });
+   if (m_occluders.size() > OCCLUDER_LIMIT) {
+      m_occluders.resize(OCCLUDER_LIMIT);
+   }
+   m_occluder_count = int32(m_occluders.size());
+
+   std::fill(m_levels[0].begin(), m_levels[0].end(), FLT_MAX);
+
+   // note: the circle where the plane through the center cuts the 
+   //       sphere projects to a circle, every ray inside it hits the
+   //       sphere nearer than the center depth
+   for (const auto &entry : m_occluders) {
+      const glm::vec4 clip = m_projection * glm::vec4(entry.m_center, 1.0f);
+      const float center_x = (clip.x / clip.w * 0.5f + 0.5f) * float(WIDTH);
+      const float center_y = (clip.y / clip.w * 0.5f + 0.5f) * float(HEIGHT);
+      const float radius_x = entry.m_radius * m_projection[0][0] / entry.m_depth * 0.5f * float(WIDTH);
+      const float radius_y = entry.m_radius * m_projection[1][1] / entry.m_depth * 0.5f * float(HEIGHT);
+      if (center_x + radius_x < 0.0f || center_x - radius_x > float(WIDTH) ||
+          center_y + radius_y < 0.0f || center_y - radius_y > float(HEIGHT))
+      {
+         continue;
+      }
+
+      draw_disc(m_levels[0].data(), center_x, center_y, radius_x, radius_y, entry.m_depth);
+   }
+
+   for (int32 level = 1; level < LEVEL_COUNT; level++) {
+      downsample(m_levels[level - 1].data(), m_levels[level].data(), WIDTH >> level, HEIGHT >> level);
+   }
+}
+
+bool occlusion_culler::is_visible(const glm::vec3 &center, const float radius)
+{
+   m_tested++;
+
+   const glm::vec3 view = glm::vec3(m_view * glm::vec4(center, 1.0f));
+   const float nearest = -view.z - radius;
+   if (m_occluders.empty() || nearest <= 0.0f) {
+      return true;
+   }
+
+   // note: the nearest depth makes the screen bounds a little larger 
+   //       than the sphere, never smaller
+   const glm::vec4 clip = m_projection * glm::vec4(view, 1.0f);
+   const float center_x = (clip.x / clip.w * 0.5f + 0.5f) * float(WIDTH);
+   const float center_y = (clip.y / clip.w * 0.5f + 0.5f) * float(HEIGHT);
+   const float radius_x = radius * m_projection[0][0] / nearest * 0.5f * float(WIDTH);
+   const float radius_y = radius * m_projection[1][1] / nearest * 0.5f * float(HEIGHT);
+   const int32 x0 = int32(std::max(floorf(center_x - radius_x), 0.0f));
+   const int32 x1 = int32(std::min(floorf(center_x + radius_x), float(WIDTH - 1)));
+   const int32 y0 = int32(std::max(floorf(center_y - radius_y), 0.0f));
+   const int32 y1 = int32(std::min(floorf(center_y + radius_y), float(HEIGHT - 1)));
+   if (x0 > x1 || y0 > y1) {
+      return true;
+   }
+
+   int32 level = 0;
+   const int32 size = std::max(x1 - x0, y1 - y0);
+   while (level < LEVEL_COUNT - 1 && (size >> level) > 2) {
+      level++;
+   }
+
+   const int32 width = WIDTH >> level;
+   const float *depth = m_levels[level].data();
+   for (int32 y = y0 >> level; y <= (y1 >> level); y++) {
+      for (int32 x = x0 >> level; x <= (x1 >> level); x++) {
+         if (depth[y * width + x] >= nearest) {
+            return true;
+         }
+      }
+   }
+
+   m_culled++;
+   return false;
+}
+
+void occlusion_culler::end_frame()
+{
+   m_time = float(utility::get_current_microseconds() - m_start) / 1000.0f;
+}
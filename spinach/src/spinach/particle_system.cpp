@@ -0,0 +1,365 @@
+// particle_system.cpp
+
+#include "spinach.hpp"
+
+#include <cmath>
+#include <xmmintrin.h>
+#include <glm/gtc/type_ptr.hpp>
+
+static_assert(sizeof(particle_system::particle) == 36, "particle layout must match the captured outputs of particle_update.vs.glsl");
+
+// note: unborn particles are spread over this many seconds, so the
+//       emitters start out at a steady rate instead of in one burst
+static const float k_birth_spread = 4.0f;
+
+static float
+next_random(uint32 &state)
+{
+   state = state * 1664525u + 1013904223u;
+   return float(state >> 8) / float(1 << 24);
+}
+
+bool particle_pool::create(const int32 capacity)
+{
+   const int32 padded = (capacity + 3) & ~3;
+   for (auto &values : m_streams) {
+      values.assign(padded, 0.0f);
+   }
+
+   m_capacity = capacity;
+   m_count = 0;
+
+   return true;
+}
+
+void particle_pool::destroy()
+{
+   for (auto &values : m_streams) {
+      values.clear();
+      values.shrink_to_fit();
+   }
+
+   m_capacity = 0;
+   m_count = 0;
+}
+
+int32 particle_pool::allocate()
+{
+   if (m_count >= m_capacity) {
+      return -1;
+   }
+
+   return m_count++;
+}
+
+void particle_pool::release(const int32 index)
+{
+   assert(index >= 0 && index < m_count);
+
+   m_count--;
+   for (auto &values : m_streams) {
+      values[index] = values[m_count];
+   }
+}
+
+float *particle_pool::get(const stream which)
+{
+   return m_streams[which].data();
+}
+
+bool particle_system::create(const shader_program *update_program, const int32 capacity)
+{
+   m_update_program = (update_program && update_program->is_valid()) ? update_program : nullptr;
+   m_gpu = m_update_program != nullptr;
+   m_capacity = capacity;
+   m_current = 0;
+
+   m_layout.clear();
+   m_layout.add_attribute(0, vertex_layout::ATTRIBUTE_FORMAT_FLOAT, 4, false);
+   m_layout.add_attribute(1, vertex_layout::ATTRIBUTE_FORMAT_FLOAT, 4, false);
+   m_layout.add_attribute(2, vertex_layout::ATTRIBUTE_FORMAT_FLOAT, 1, false);
+
+   const int32 cpu_capacity = capacity < CPU_CAPACITY ? capacity : CPU_CAPACITY;
+   if (!m_pool.create(cpu_capacity)) {
+      return false;
+   }
+   m_staging.reserve(cpu_capacity);
+
+   if (!m_update_program) {
+      return true;
+   }
+
+   // note: everyone starts unborn and dead, the first update that sees
+   //       a particle come of age spawns it
+   std::vector<particle> initial(capacity);
+   for (int32 index = 0; index < capacity; index++) {
+      const float age = -k_birth_spread * float(index) / float(capacity);
+      initial[index] = particle{ glm::vec4(0.0f, 0.0f, 0.0f, age), glm::vec4(0.0f), 0.0f };
+   }
+
+   const int32 size = int32(sizeof(particle)) * capacity;
+   if (!m_buffers[0].create(size, initial.data(), BUFFER_USAGE_HINT_DYNAMIC) ||
+       !m_buffers[1].create(size, nullptr, BUFFER_USAGE_HINT_DYNAMIC))
+   {
+      debug::log("could not create particle buffers for %d particles", capacity);
+      return false;
+   }
+
+   return true;
+}
+
+void particle_system::destroy()
+{
+   for (auto &buffer : m_buffers) {
+      if (buffer.is_valid()) {
+         buffer.destroy();
+      }
+   }
+
+   m_pool.destroy();
+   m_staging.clear();
+   m_emitter_count = 0;
+}
+
+int32 particle_system::add_emitter(const emitter &source)
+{
+   if (m_emitter_count >= EMITTER_LIMIT) {
+      return -1;
+   }
+
+   m_emitters[m_emitter_count] = source;
+   return m_emitter_count++;
+}
+
+void particle_system::set_gpu(const bool enabled)
+{
+   m_gpu = enabled && m_update_program;
+}
+
+void particle_system::simulate(const float deltatime)
+{
+   if (m_gpu) {
+      m_pending_time += deltatime;
+      m_cpu_time = 0.0f;
+      return;
+   }
+
+   const int64 start = utility::get_current_microseconds();
+   integrate_cpu(deltatime);
+   emit_cpu(deltatime);
+   m_cpu_time = float(utility::get_current_microseconds() - start) / 1000.0f;
+}
+
+void particle_system::draw(render_backend &backend, streaming_buffer &stream, const shader_program &program)
+{
+   const int32 stride = int32(sizeof(particle));
+
+   int32 first = 0;
+   int32 count = 0;
+   if (m_gpu) {
+      update_gpu(backend);
+      backend.set_vertex_buffer(m_buffers[m_current]);
+      count = m_capacity;
+   }
+   else {
+      // note: less than all of them when the stream runs short
+      const int32 space = (stream.available() - stride) / stride;
+      count = m_pool.m_count < space ? m_pool.m_count : space;
+      if (count <= 0) {
+         return;
+      }
+
+      const float *x = m_pool.get(particle_pool::STREAM_POSITION_X);
+      const float *y = m_pool.get(particle_pool::STREAM_POSITION_Y);
+      const float *z = m_pool.get(particle_pool::STREAM_POSITION_Z);
+      const float *vx = m_pool.get(particle_pool::STREAM_VELOCITY_X);
+      const float *vy = m_pool.get(particle_pool::STREAM_VELOCITY_Y);
+      const float *vz = m_pool.get(particle_pool::STREAM_VELOCITY_Z);
+      const float *age = m_pool.get(particle_pool::STREAM_AGE);
+      const float *lifetime = m_pool.get(particle_pool::STREAM_LIFETIME);
+      const float *source = m_pool.get(particle_pool::STREAM_EMITTER);
+
+      m_staging.resize(count);
+      for (int32 index = 0; index < count; index++) {
+         m_staging[index] = particle{ glm::vec4(x[index], y[index], z[index], age[index]),
+                                      glm::vec4(vx[index], vy[index], vz[index], lifetime[index]),
+                                      source[index] };
+      }
+
+      const int32 offset = stream.write(stride * count, m_staging.data(), stride);
+      if (offset < 0) {
+         return;
+      }
+
+      backend.set_vertex_buffer(stream);
+      first = offset / stride;
+   }
+
+   glm::vec4 colors[EMITTER_LIMIT] = {};
+   for (int32 index = 0; index < m_emitter_count; index++) {
+      colors[index] = m_emitters[index].m_color;
+   }
+
+   backend.set_shader_program(program);
+   backend.set_shader_uniform(program, UNIFORM_TYPE_VEC4, "u_emitter_color", EMITTER_LIMIT, colors);
+   backend.set_shader_uniform(program, UNIFORM_TYPE_FLOAT, "u_point_size", 1, &m_point_size);
+   backend.set_vertex_layout(m_layout);
+   backend.set_blend_state(true, BLEND_EQUATION_ADD, BLEND_FACTOR_ONE, BLEND_FACTOR_ONE, BLEND_EQUATION_ADD, BLEND_FACTOR_ONE, BLEND_FACTOR_ONE);
+   backend.set_depth_state(true, false, 0.0f, 1.0f, COMPARE_FUNC_LESS_EQUAL);
+   backend.set_rasterizer_state(CULL_MODE_NONE);
+   backend.set_program_point_size(true);
+   backend.draw(PRIMITIVE_TOPOLOGY_POINT_LIST, first, count);
+}
+
+int32 particle_system::live_count() const
+{
+   return m_gpu ? m_capacity : m_pool.m_count;
+}
+
+void particle_system::update_gpu(render_backend &backend)
+{
+   if (m_pending_time <= 0.0f) {
+      return;
+   }
+
+   glm::vec4 positions[EMITTER_LIMIT] = {};
+   glm::vec4 velocities[EMITTER_LIMIT] = {};
+   float lifetimes[EMITTER_LIMIT] = {};
+   for (int32 index = 0; index < m_emitter_count; index++) {
+      const auto &source = m_emitters[index];
+      positions[index] = glm::vec4(source.m_position, source.m_radius);
+      velocities[index] = glm::vec4(source.m_velocity, source.m_speed);
+      lifetimes[index] = source.m_lifetime;
+   }
+
+   // note: a new seed every update, or a slot would respawn the same way
+   m_seed = m_seed * 1664525u + 1013904223u;
+   const int32 seed = int32(m_seed >> 1);
+
+   const auto &program = *m_update_program;
+   backend.set_shader_program(program);
+   backend.set_shader_uniform(program, UNIFORM_TYPE_VEC4, "u_emitter_position", EMITTER_LIMIT, positions);
+   backend.set_shader_uniform(program, UNIFORM_TYPE_VEC4, "u_emitter_velocity", EMITTER_LIMIT, velocities);
+   backend.set_shader_uniform(program, UNIFORM_TYPE_FLOAT, "u_emitter_lifetime", EMITTER_LIMIT, lifetimes);
+   backend.set_shader_uniform(program, UNIFORM_TYPE_INT, "u_emitter_count", 1, &m_emitter_count);
+   backend.set_shader_uniform(program, UNIFORM_TYPE_VEC3, "u_sun", 1, glm::value_ptr(m_sun));
+   backend.set_shader_uniform(program, UNIFORM_TYPE_FLOAT, "u_wind", 1, &m_wind);
+   backend.set_shader_uniform(program, UNIFORM_TYPE_FLOAT, "u_deltatime", 1, &m_pending_time);
+   backend.set_shader_uniform(program, UNIFORM_TYPE_INT, "u_seed", 1, &seed);
+
+   const int32 next = 1 - m_current;
+   backend.set_vertex_buffer(m_buffers[m_current]);
+   backend.set_vertex_layout(m_layout);
+   backend.begin_feedback(m_buffers[next]);
+   backend.draw(PRIMITIVE_TOPOLOGY_POINT_LIST, 0, m_capacity);
+   backend.end_feedback();
+
+   m_current = next;
+   m_pending_time = 0.0f;
+}
+
+void particle_system::emit_cpu(const float deltatime)
+{
+   if (m_emitter_count == 0) {
+      return;
+   }
+
+   float *x = m_pool.get(particle_pool::STREAM_POSITION_X);
+   float *y = m_pool.get(particle_pool::STREAM_POSITION_Y);
+   float *z = m_pool.get(particle_pool::STREAM_POSITION_Z);
+   float *vx = m_pool.get(particle_pool::STREAM_VELOCITY_X);
+   float *vy = m_pool.get(particle_pool::STREAM_VELOCITY_Y);
+   float *vz = m_pool.get(particle_pool::STREAM_VELOCITY_Z);
+   float *age = m_pool.get(particle_pool::STREAM_AGE);
+   float *lifetime = m_pool.get(particle_pool::STREAM_LIFETIME);
+   float *source = m_pool.get(particle_pool::STREAM_EMITTER);
+
+   // note: each emitter replaces its share of the pool once per lifetime,
+   //       the same rate the gpu path ends up at
+   const float share = float(m_pool.m_capacity) / float(m_emitter_count);
+   for (int32 emitter_index = 0; emitter_index < m_emitter_count; emitter_index++) {
+      const auto &origin = m_emitters[emitter_index];
+      float &accumulator = m_emit_accumulator[emitter_index];
+      accumulator += share / origin.m_lifetime * deltatime;
+
+      for (; accumulator >= 1.0f; accumulator -= 1.0f) {
+         const int32 index = m_pool.allocate();
+         if (index < 0) {
+            accumulator = 0.0f;
+            break;
+         }
+
+         const float dz = next_random(m_seed) * 2.0f - 1.0f;
+         const float angle = next_random(m_seed) * 6.2831853f;
+         const float ring = sqrtf(1.0f - dz * dz);
+         const glm::vec3 direction(ring * cosf(angle), ring * sinf(angle), dz);
+         const glm::vec3 position = origin.m_position + direction * origin.m_radius;
+         const glm::vec3 velocity = origin.m_velocity + direction * (origin.m_speed * (0.5f + next_random(m_seed)));
+
+         x[index] = position.x;
+         y[index] = position.y;
+         z[index] = position.z;
+         vx[index] = velocity.x;
+         vy[index] = velocity.y;
+         vz[index] = velocity.z;
+         age[index] = 0.0f;
+         lifetime[index] = origin.m_lifetime * (0.75f + next_random(m_seed) * 0.5f);
+         source[index] = float(emitter_index);
+      }
+   }
+}
+
+void particle_system::integrate_cpu(const float deltatime)
+{
+   float *x = m_pool.get(particle_pool::STREAM_POSITION_X);
+   float *y = m_pool.get(particle_pool::STREAM_POSITION_Y);
+   float *z = m_pool.get(particle_pool::STREAM_POSITION_Z);
+   float *vx = m_pool.get(particle_pool::STREAM_VELOCITY_X);
+   float *vy = m_pool.get(particle_pool::STREAM_VELOCITY_Y);
+   float *vz = m_pool.get(particle_pool::STREAM_VELOCITY_Z);
+   float *age = m_pool.get(particle_pool::STREAM_AGE);
+   const float *lifetime = m_pool.get(particle_pool::STREAM_LIFETIME);
+
+   // note: the padding past the last live particle is integrated too,
+   //       it is never drawn and overwritten on allocation
+   const __m128 dt = _mm_set1_ps(deltatime);
+   const __m128 push = _mm_set1_ps(m_wind * deltatime);
+   const __m128 epsilon = _mm_set1_ps(1e-6f);
+   const __m128 sun_x = _mm_set1_ps(m_sun.x);
+   const __m128 sun_y = _mm_set1_ps(m_sun.y);
+   const __m128 sun_z = _mm_set1_ps(m_sun.z);
+   for (int32 index = 0; index < m_pool.m_count; index += 4) {
+      __m128 px = _mm_loadu_ps(x + index);
+      __m128 py = _mm_loadu_ps(y + index);
+      __m128 pz = _mm_loadu_ps(z + index);
+
+      // note: solar wind, away from the sun
+      const __m128 ax = _mm_sub_ps(px, sun_x);
+      const __m128 ay = _mm_sub_ps(py, sun_y);
+      const __m128 az = _mm_sub_ps(pz, sun_z);
+      const __m128 length_squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(ay, ay)), _mm_add_ps(_mm_mul_ps(az, az), epsilon));
+      const __m128 scale = _mm_mul_ps(_mm_rsqrt_ps(length_squared), push);
+
+      const __m128 wx = _mm_add_ps(_mm_loadu_ps(vx + index), _mm_mul_ps(ax, scale));
+      const __m128 wy = _mm_add_ps(_mm_loadu_ps(vy + index), _mm_mul_ps(ay, scale));
+      const __m128 wz = _mm_add_ps(_mm_loadu_ps(vz + index), _mm_mul_ps(az, scale));
+      px = _mm_add_ps(px, _mm_mul_ps(wx, dt));
+      py = _mm_add_ps(py, _mm_mul_ps(wy, dt));
+      pz = _mm_add_ps(pz, _mm_mul_ps(wz, dt));
+
+      _mm_storeu_ps(vx + index, wx);
+      _mm_storeu_ps(vy + index, wy);
+      _mm_storeu_ps(vz + index, wz);
+      _mm_storeu_ps(x + index, px);
+      _mm_storeu_ps(y + index, py);
+      _mm_storeu_ps(z + index, pz);
+      _mm_storeu_ps(age + index, _mm_add_ps(_mm_loadu_ps(age + index), dt));
+   }
+
+   // note: backwards, the particle moved into a freed slot was checked
+   for (int32 index = m_pool.m_count - 1; index >= 0; index--) {
+      if (age[index] >= lifetime[index]) {
+         m_pool.release(index);
+      }
+   }
+}
@@ -0,0 +1,277 @@
+// render_graph.cpp
+
+#include "spinach.hpp"
+
+#include <algorithm>
+
+static bool
+is_same_desc(const render_graph::target_desc &lhs, const render_graph::target_desc &rhs)
+{
+   if (lhs.m_width != rhs.m_width ||
+       lhs.m_height != rhs.m_height ||
+       lhs.m_format_count != rhs.m_format_count)
+   {
+      return false;
+   }
+
+   for (int32 index = 0; index < lhs.m_format_count; index++) {
+      if (lhs.m_formats[index] != rhs.m_formats[index]) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+void render_graph::destroy()
+{
+   for (auto &entry : m_pool) {
+      entry.m_framebuffer.destroy();
+   }
+   m_pool.clear();
+   m_targets.clear();
+   m_passes.clear();
+}
+
+void render_graph::begin_frame(const int32 width, const int32 height, linear_arena &arena)
+{
+   m_arena = &arena;
+   m_width = width;
+   m_height = height;
+   m_frame++;
+   m_targets.clear();
+   m_passes.clear();
+}
+
+render_graph::target_id render_graph::create_target(const char *name, const target_desc &desc)
+{
+   assert(desc.m_format_count > 0 && desc.m_format_count < framebuffer::ATTACHMENT_LIMIT);
+
+   target entry;
+   entry.m_name = name;
+   entry.m_desc = desc;
+   m_targets.push_back(entry);
+   return target_id(m_targets.size() - 1);
+}
+
+render_graph::target_id render_graph::import_target(const char *name, framebuffer &handle)
+{
+   target entry;
+   entry.m_name = name;
+   entry.m_desc.m_width = handle.width_;
+   entry.m_desc.m_height = handle.height_;
+   entry.m_imported = &handle;
+   m_targets.push_back(entry);
+   return target_id(m_targets.size() - 1);
+}
+
+int32 render_graph::add_pass(const char *name,
+                             const target_id output,
+                             std::initializer_list<target_id> inputs,
+                             std::function<void(render_backend &)> execute)
+{
+   assert(output == BACKBUFFER || (output >= 0 && output < target_id(m_targets.size())));
+
+   pass entry;
+   entry.m_name = name;
+   entry.m_output = output;
+   entry.m_inputs = arena_vector<target_id>(inputs, arena_allocator<target_id>(*m_arena));
+   entry.m_execute = std::move(execute);
+   m_passes.push_back(std::move(entry));
+   return int32(m_passes.size() - 1);
+}
+
+void render_graph::set_clear(const int32 pass_index, const glm::vec4 &color, const bool covers_output, const bool uses_depth)
+{
+   auto &entry = m_passes[pass_index];
+   entry.m_clear = true;
+   entry.m_clear_color = color;
+   entry.m_covers_output = covers_output;
+   entry.m_uses_depth = uses_depth;
+}
+
+void render_graph::compile()
+{
+   m_culled_count = 0;
+   m_physical_count = 0;
+
+   // note: a pass is kept when it writes something visible outside the
+   //       graph, or a target read by a pass that is kept
+   arena_vector<bool> needed(m_targets.size(), false, arena_allocator<bool>(*m_arena));
+   for (int32 index = int32(m_passes.size()) - 1; index >= 0; index--) {
+      auto &entry = m_passes[index];
+      const bool visible = entry.m_output == BACKBUFFER || m_targets[entry.m_output].m_imported;
+      entry.m_culled = !visible && !needed[entry.m_output];
+      if (entry.m_culled) {
+         m_culled_count++;
+         continue;
+      }
+
+      for (const auto &input : entry.m_inputs) {
+         needed[input] = true;
+      }
+   }
+
+   for (int32 index = 0; index < int32(m_passes.size()); index++) {
+      const auto &entry = m_passes[index];
+      if (entry.m_culled) {
+         continue;
+      }
+
+      auto touch = [this, index](const target_id id) {
+         auto &resource = m_targets[id];
+         resource.m_first_use = resource.m_first_use < 0 ? index : resource.m_first_use;
+         resource.m_last_use = index;
+      };
+
+      if (entry.m_output != BACKBUFFER) {
+         touch(entry.m_output);
+         if (entry.m_uses_depth) {
+            m_targets[entry.m_output].m_last_depth_use = index;
+         }
+      }
+      for (const auto &input : entry.m_inputs) {
+         touch(input);
+      }
+   }
+
+   // note: release framebuffers no frame has asked for in a while,
+   //       before any index into the pool is handed out
+   for (auto it = m_pool.begin(); it != m_pool.end();) {
+      if (m_frame - it->m_last_frame > TARGET_LIFETIME) {
+         it->m_framebuffer.destroy();
+         it = m_pool.erase(it);
+         continue;
+      }
+      it->m_busy_until = -1;
+      ++it;
+   }
+
+   // note: in order of first use, so a framebuffer freed by one target
+   //       can be picked up by the next
+   arena_vector<target_id> order{ arena_allocator<target_id>(*m_arena) };
+   order.reserve(m_targets.size());
+   for (target_id id = 0; id < target_id(m_targets.size()); id++) {
+      if (!m_targets[id].m_imported && m_targets[id].m_first_use >= 0) {
+         order.push_back(id);
+      }
+   }
+   std::stable_sort(order.begin(), order.end(), [this](const target_id lhs, const target_id rhs) {
+      return m_targets[lhs].m_first_use < m_targets[rhs].m_first_use;
+   });
+
+   for (const auto &id : order) {
+      auto &resource = m_targets[id];
+      for (int32 index = 0; index < int32(m_pool.size()); index++) {
+         auto &entry = m_pool[index];
+         if (entry.m_busy_until < resource.m_first_use && is_same_desc(entry.m_desc, resource.m_desc)) {
+            resource.m_physical = index;
+            break;
+         }
+      }
+
+      if (resource.m_physical < 0) {
+         physical entry;
+         entry.m_desc = resource.m_desc;
+         if (!entry.m_framebuffer.create(resource.m_desc.m_width,
+                                         resource.m_desc.m_height,
+                                         resource.m_desc.m_format_count,
+                                         resource.m_desc.m_formats))
+         {
+            debug::log("could not create render target '%s' (%dx%d)", resource.m_name, resource.m_desc.m_width, resource.m_desc.m_height);
+            continue;
+         }
+
+         m_pool.push_back(entry);
+         resource.m_physical = int32(m_pool.size() - 1);
+      }
+
+      auto &entry = m_pool[resource.m_physical];
+      if (entry.m_last_frame != m_frame) {
+         m_physical_count++;
+      }
+      entry.m_busy_until = resource.m_last_use;
+      entry.m_last_frame = m_frame;
+   }
+}
+
+void render_graph::execute(render_backend &backend)
+{
+   m_elided_clears = 0;
+   m_invalidations = 0;
+
+   int32 last_backbuffer_pass = -1;
+   for (int32 index = 0; index < int32(m_passes.size()); index++) {
+      if (!m_passes[index].m_culled && m_passes[index].m_output == BACKBUFFER) {
+         last_backbuffer_pass = index;
+      }
+   }
+
+   for (int32 index = 0; index < int32(m_passes.size()); index++) {
+      auto &entry = m_passes[index];
+      if (entry.m_culled) {
+         continue;
+      }
+
+      if (entry.m_output == BACKBUFFER) {
+         backend.reset_framebuffer();
+         backend.set_viewport(0, 0, m_width, m_height);
+      }
+      else {
+         backend.set_framebuffer(get(entry.m_output));
+      }
+
+      if (entry.m_clear) {
+         if (entry.m_uses_depth) {
+            backend.clear_depth();
+         }
+
+         if (entry.m_covers_output) {
+            m_elided_clears++;
+         }
+         else {
+            const auto &color = entry.m_clear_color;
+            backend.clear_color(color.r, color.g, color.b, color.a);
+         }
+      }
+
+      entry.m_execute(backend);
+
+      // note: transient contents past their last use are dead, depth
+      //       is never read so it dies with its last writer
+      for (const auto &resource : m_targets) {
+         if (resource.m_imported || resource.m_physical < 0) {
+            continue;
+         }
+
+         const bool color = resource.m_last_use == index;
+         const bool depth = resource.m_last_depth_use == index || (color && resource.m_last_depth_use < 0);
+         if (color || depth) {
+            backend.invalidate_framebuffer(m_pool[resource.m_physical].m_framebuffer, color, depth);
+            m_invalidations++;
+         }
+      }
+
+      if (index == last_backbuffer_pass) {
+         backend.invalidate_backbuffer(false, true);
+         m_invalidations++;
+      }
+   }
+}
+
+const framebuffer &render_graph::get(const target_id id) const
+{
+   assert(id >= 0 && id < target_id(m_targets.size()));
+   const auto &resource = m_targets[id];
+   if (resource.m_imported) {
+      return *resource.m_imported;
+   }
+
+   assert(resource.m_physical >= 0);
+   return m_pool[resource.m_physical].m_framebuffer;
+}
+
+texture render_graph::get_texture(const target_id id, const int32 attachment) const
+{
+   return get(id).color_attachment_as_texture(attachment);
+}
@@ -0,0 +1,317 @@
+// resource_manager.cpp
+
+#include "spinach.hpp"
+
+#include <cstring>
+
+enum resource_type {
+   RESOURCE_TYPE_TEXTURE,
+   RESOURCE_TYPE_BUFFER,
+   RESOURCE_TYPE_PROGRAM,
+   RESOURCE_TYPE_SAMPLER,
+};
+
+template <typename T>
+static T *
+get_resource(resource_pool<T> &pool, const resource_handle<T> id)
+{
+   auto entry = pool.find(id);
+   assert(entry || !id.valid());
+   return entry ? &entry->m_resource : nullptr;
+}
+
+// note: the check hash runs the bytes backwards from another seed, so a
+//       pair that collides on the forward hash is not also likely to
+//       collide on the check
+static resource_key
+make_key(const char *prefix, const std::string_view content, uint64 seed = 0)
+{
+   resource_key result;
+   result.m_hash = utility::hash_fnv1a(content, seed ^ utility::hash_fnv1a(prefix));
+   result.m_size = content.size();
+   result.m_check = utility::hash_fnv1a("check:", seed);
+   for (auto it = content.rbegin(); it != content.rend(); ++it) {
+      result.m_check = (result.m_check ^ uint8(*it)) * 1099511628211ull;
+   }
+   return result;
+}
+
+template <typename T>
+static void
+add_resource_reference(resource_pool<T> &pool, const resource_handle<T> id)
+{
+   auto entry = pool.find(id);
+   assert(entry && entry->m_references > 0);
+   if (entry) {
+      entry->m_references++;
+   }
+}
+
+// note: the entry stays cached until it is destroyed, so a new request
+//       for the same key within the delay revives it
+template <typename T>
+static void
+release_resource(resource_pool<T> &pool,
+                 const resource_handle<T> id,
+                 const uint32 type,
+                 const uint64 frame,
+                 std::vector<resource_manager::pending_destroy> &pending)
+{
+   auto entry = pool.find(id);
+   assert(entry && entry->m_references > 0);
+   if (entry && --entry->m_references == 0) {
+      pending.push_back({ type, id.m_value, frame });
+   }
+}
+
+// note: revives a cached entry, or returns an invalid handle
+template <typename T>
+static resource_handle<T>
+acquire_cached(resource_pool<T> &pool, const resource_key &key)
+{
+   const auto id = pool.find_key(key);
+   if (id.valid()) {
+      pool.find(id)->m_references++;
+   }
+   return id;
+}
+
+template <typename T>
+static void
+destroy_unreferenced(resource_pool<T> &pool, const uint32 value)
+{
+   resource_handle<T> id;
+   id.m_value = value;
+
+   auto entry = pool.find(id);
+   if (entry == nullptr || entry->m_references > 0) {
+      return;
+   }
+
+   entry->m_resource.destroy();
+   pool.free(id);
+}
+
+bool resource_manager::create(texture_streamer *streamer)
+{
+   m_streamer = streamer;
+   return m_streamer != nullptr;
+}
+
+// note: returns how many were still referenced
+template <typename T>
+static int
+destroy_all(resource_pool<T> &pool)
+{
+   int referenced = 0;
+   for (auto &entry : pool.m_slots) {
+      if (entry.m_alive) {
+         referenced += entry.m_references > 0 ? 1 : 0;
+         entry.m_resource.destroy();
+      }
+   }
+
+   pool = {};
+   return referenced;
+}
+
+void resource_manager::destroy()
+{
+   int referenced = 0;
+   referenced += destroy_all(m_textures);
+   referenced += destroy_all(m_buffers);
+   referenced += destroy_all(m_programs);
+   referenced += destroy_all(m_samplers);
+   m_pending.clear();
+
+   if (referenced > 0) {
+      debug::log("resources: %d still referenced when destroyed", referenced);
+   }
+}
+
+texture_handle resource_manager::load_texture(const char *filename)
+{
+   const auto key = make_key("texture:", filename);
+   auto id = acquire_cached(m_textures, key);
+   if (id.valid()) {
+      m_reused++;
+      return id;
+   }
+
+   id = m_textures.allocate(key);
+   m_streamer->load(m_textures.find(id)->m_resource, filename);
+   m_created++;
+
+   return id;
+}
+
+buffer_handle resource_manager::create_vertex_buffer(const int32 size, const void *data)
+{
+   const auto key = make_key("buffer:", std::string_view((const char *)data, std::size_t(size)));
+   auto id = acquire_cached(m_buffers, key);
+
+   // note: a hit is compared against the caller's bytes, read back from
+   //       the gpu. only a hit pays for it and the bytes are not kept
+   if (id.valid()) {
+      std::vector<uint8> stored(static_cast<std::size_t>(size));
+      if (m_buffers.find(id)->m_resource.read(0, size, stored.data()) &&
+          memcmp(stored.data(), data, std::size_t(size)) == 0)
+      {
+         m_reused++;
+         return id;
+      }
+
+      release(id);
+   }
+
+   id = m_buffers.allocate(key);
+   if (!m_buffers.find(id)->m_resource.create(size, data)) {
+      m_buffers.free(id);
+      return buffer_handle{};
+   }
+   m_created++;
+
+   return id;
+}
+
+sampler_handle resource_manager::create_sampler(const sampler_filter_mode filter,
+                                                const sampler_address_mode address_u,
+                                                const sampler_address_mode address_v)
+{
+   // note: the whole state fits the hash, equal keys are equal states
+   resource_key key;
+   key.m_hash = (uint64(filter) << 32) | (uint64(address_u) << 16) | uint64(address_v);
+   auto id = acquire_cached(m_samplers, key);
+   if (id.valid()) {
+      m_reused++;
+      return id;
+   }
+
+   id = m_samplers.allocate(key);
+   if (!m_samplers.find(id)->m_resource.create(filter, address_u, address_v)) {
+      m_samplers.free(id);
+      return sampler_handle{};
+   }
+   m_created++;
+
+   return id;
+}
+
+program_handle resource_manager::acquire_program(const char *vertex_source,
+                                                 const char *fragment_source,
+                                                 bool &created)
+{
+   // note: the sources go in one after the other, the vertex hash seeds
+   //       the fragment one so that swapping them is a different key
+   const auto vertex = make_key("program:", vertex_source);
+   auto key = make_key("program:", fragment_source, vertex.m_hash ^ vertex.m_check);
+   key.m_size += vertex.m_size;
+
+   auto id = acquire_cached(m_programs, key);
+   created = !id.valid();
+   if (id.valid()) {
+      m_reused++;
+      return id;
+   }
+
+   m_created++;
+   return m_programs.allocate(key);
+}
+
+texture *resource_manager::get(const texture_handle id)
+{
+   return get_resource(m_textures, id);
+}
+
+vertex_buffer *resource_manager::get(const buffer_handle id)
+{
+   return get_resource(m_buffers, id);
+}
+
+shader_program *resource_manager::get(const program_handle id)
+{
+   return get_resource(m_programs, id);
+}
+
+sampler_state *resource_manager::get(const sampler_handle id)
+{
+   return get_resource(m_samplers, id);
+}
+
+void resource_manager::add_reference(const texture_handle id)
+{
+   add_resource_reference(m_textures, id);
+}
+
+void resource_manager::add_reference(const buffer_handle id)
+{
+   add_resource_reference(m_buffers, id);
+}
+
+void resource_manager::add_reference(const program_handle id)
+{
+   add_resource_reference(m_programs, id);
+}
+
+void resource_manager::add_reference(const sampler_handle id)
+{
+   add_resource_reference(m_samplers, id);
+}
+
+void resource_manager::release(const texture_handle id)
+{
+   release_resource(m_textures, id, RESOURCE_TYPE_TEXTURE, m_frame, m_pending);
+}
+
+void resource_manager::release(const buffer_handle id)
+{
+   release_resource(m_buffers, id, RESOURCE_TYPE_BUFFER, m_frame, m_pending);
+}
+
+void resource_manager::release(const program_handle id)
+{
+   release_resource(m_programs, id, RESOURCE_TYPE_PROGRAM, m_frame, m_pending);
+}
+
+void resource_manager::release(const sampler_handle id)
+{
+   release_resource(m_samplers, id, RESOURCE_TYPE_SAMPLER, m_frame, m_pending);
+}
+
+void resource_manager::end_frame()
+{
+   m_frame++;
+
+   for (auto it = m_pending.begin(); it != m_pending.end();) {
+      if (it->m_frame + DESTROY_DELAY > m_frame) {
+         ++it;
+         continue;
+      }
+
+      bool done = true;
+      switch (it->m_type) {
+         case RESOURCE_TYPE_TEXTURE: {
+            // note: a texture still streaming in keeps its slot
+            texture_handle id;
+            id.m_value = it->m_handle;
+            auto entry = m_textures.find(id);
+            if (entry && m_streamer->is_pending(entry->m_resource)) {
+               done = false;
+               break;
+            }
+            destroy_unreferenced(m_textures, it->m_handle);
+         } break;
+         case RESOURCE_TYPE_BUFFER:
+            destroy_unreferenced(m_buffers, it->m_handle);
+            break;
+         case RESOURCE_TYPE_PROGRAM:
+            destroy_unreferenced(m_programs, it->m_handle);
+            break;
+         case RESOURCE_TYPE_SAMPLER:
+            destroy_unreferenced(m_samplers, it->m_handle);
+            break;
+      }
+
+      it = done ? m_pending.erase(it) : it + 1;
+   }
+}
@@ -0,0 +1,116 @@
+// self_test.cpp
+
+#include "spinach.hpp"
+
+// note: every stride the renderer streams, over every segment a ring can
+//       have. the segment size is the one the application creates
+static bool
+check_streaming_offsets()
+{
+   const int32 segment_size = 1024 * 1024;
+   const int32 alignments[] = { 4, 10, 12, 16, 20, 36, 256 };
+
+   bool result = true;
+   for (int32 segment = 0; segment < streaming_buffer::FRAME_LIMIT; segment++) {
+      const int32 segment_start = segment * segment_size;
+      for (const int32 alignment : alignments) {
+         for (int32 head = 0; head < 3 * alignment; head++) {
+            const int32 offset = streaming_buffer::align_offset(segment_start + head, alignment);
+            if (offset % alignment != 0 || offset < segment_start + head || offset >= segment_start + head + alignment) {
+               debug::log("self test: segment %d, head %d, alignment %d gives offset %d", segment, head, alignment, offset);
+               result = false;
+            }
+         }
+      }
+   }
+
+   return result;
+}
+
+// note: what does not fit falls through to the heap, aligned the same
+static bool
+check_arena_overflow()
+{
+   linear_arena arena;
+   if (!arena.create(64)) {
+      return false;
+   }
+
+   bool result = true;
+   const int64 alignments[] = { 1, 16, 64, 256 };
+   for (const int64 alignment : alignments) {
+      void *pointer = arena.allocate(128, alignment);
+      if (arena.owns(pointer) || uint64(pointer) % uint64(alignment) != 0) {
+         debug::log("self test: arena overflow of alignment %lld at %p", alignment, pointer);
+         result = false;
+      }
+      arena.deallocate(pointer, alignment);
+   }
+
+   return result && arena.m_overflow_count == int32(sizeof(alignments) / sizeof(alignments[0]));
+}
+
+// note: the overlay formats into the frame arena the way the application
+//       does, no context is needed to lay it out. after the first frame
+//       set the parameters no frame may allocate, the counter only
+//       counts in debug builds
+static bool
+check_frame_allocations()
+{
+   double_buffered_arena memory;
+   if (!memory.create(64 * 1024)) {
+      return false;
+   }
+
+   debug_overlay overlay(nullptr, nullptr, nullptr, nullptr);
+   float graph[metrics::GRAPH_SIZE] = {};
+
+   bool result = true;
+   for (int32 frame = 0; frame < 16; frame++) {
+      const int64 before = debug::allocation_count();
+
+      memory.swap();
+      overlay.pre_frame(1920, 1080, memory.current());
+      overlay.push_line("FPS: %d (%dms), p50: %.2fms", 60 + frame, 16, 16.6f + float(frame) * 0.01f);
+      overlay.push_line("static line");
+      overlay.push_line("%.*s", frame * 4, "growing line, longer every frame until the end of the text runs out here");
+      for (int32 line = 0; line < frame % 4; line++) {
+         overlay.push_line("optional line %d", line);
+      }
+      graph[frame % metrics::GRAPH_SIZE] = float(frame);
+      overlay.push_graph(graph, metrics::GRAPH_SIZE, 16.6f);
+      overlay.build();
+
+      arena_vector<int32> order{ arena_allocator<int32>(memory.current()) };
+      for (int32 index = 0; index < 100; index++) {
+         order.push_back(index);
+      }
+
+      const int64 allocations = debug::allocation_count() - before;
+      if (frame > 0 && allocations > 0) {
+         debug::log("self test: frame %d made %lld allocations", frame, allocations);
+         result = false;
+      }
+   }
+
+   if (memory.current().m_overflow_count > 0 || memory.previous().m_overflow_count > 0) {
+      debug::log("self test: frame arena overflowed");
+      result = false;
+   }
+
+   return result;
+}
+
+namespace debug
+{
+   bool self_test()
+   {
+      bool result = true;
+      result = check_streaming_offsets() && result;
+      result = check_arena_overflow() && result;
+      result = check_frame_allocations() && result;
+
+      debug::log("self test: %s", result ? "passed" : "failed");
+      return result;
+   }
+} // !debug
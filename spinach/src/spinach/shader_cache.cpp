@@ -0,0 +1,171 @@
+// shader_cache.cpp
+
+#include "spinach.hpp"
+#include "asset_format.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <filesystem>
+
+// note: cache entry, written by and for this machine only
+struct shader_cache_header {
+   uint32 magic_;
+   uint32 version_;
+   uint32 format_;  // note: driver binary format
+   uint32 size_;
+   uint64 key_;
+};
+
+static_assert(sizeof(shader_cache_header) == 24, "shader cache header layout changed");
+
+static const uint32 k_shader_cache_magic = asset_format::make_fourcc('S', 'P', 'R', 'G');
+static const uint32 k_shader_cache_version = 1;
+
+bool shader_cache::create(const char *directory, const render_backend &backend)
+{
+   m_directory = directory;
+   if (!m_directory.empty() && m_directory.back() != '/' && m_directory.back() != '\\') {
+      m_directory.append("/");
+   }
+
+   const char *vendor = backend.vendor();
+   const char *renderer = backend.renderer();
+   const char *version = backend.version();
+   m_driver_hash = utility::hash_fnv1a(vendor ? vendor : "");
+   m_driver_hash = utility::hash_fnv1a(renderer ? renderer : "", m_driver_hash);
+   m_driver_hash = utility::hash_fnv1a(version ? version : "", m_driver_hash);
+
+   if (!shader_program::is_binary_supported()) {
+      return true;
+   }
+
+   std::error_code error;
+   std::filesystem::create_directories(m_directory, error);
+   return true;
+}
+
+bool shader_cache::create_programs(const int count, const entry *entries)
+{
+   const int64 start = utility::get_current_tick();
+
+   struct pending_program {
+      const entry *m_entry;
+      uint64 m_key;
+   };
+
+   std::vector<pending_program> pending;
+   for (int index = 0; index < count; index++) {
+      const auto &item = entries[index];
+      const uint64 hash = key(item.m_vertex_source, item.m_fragment_source);
+      if (load(*item.m_program, hash)) {
+         continue;
+      }
+
+      if (!item.m_program->begin(item.m_vertex_source, item.m_fragment_source)) {
+         return false;
+      }
+
+      pending.push_back({ &item, hash });
+   }
+
+   const int compiled = int(pending.size());
+   bool result = true;
+   while (!pending.empty()) {
+      for (auto it = pending.begin(); it != pending.end();) {
+         auto &program = *it->m_entry->m_program;
+         if (!program.is_ready()) {
+            ++it;
+            continue;
+         }
+
+         if (program.finish()) {
+            store(program, it->m_key);
+         }
+         else {
+            result = false;
+         }
+
+         it = pending.erase(it);
+      }
+
+      if (!pending.empty()) {
+         std::this_thread::yield();
+      }
+   }
+
+   debug::log("shader cache: %d cached, %d compiled%s in %dms",
+              count - compiled,
+              compiled,
+              shader_program::is_parallel_compile_supported() ? " in parallel" : "",
+              int(utility::get_current_tick() - start));
+
+   return result;
+}
+
+uint64 shader_cache::key(const char *vertex_source, const char *fragment_source) const
+{
+   uint64 result = utility::hash_fnv1a(vertex_source, m_driver_hash);
+   result = utility::hash_fnv1a(std::string_view("\0", 1), result);
+   return utility::hash_fnv1a(fragment_source, result);
+}
+
+std::string shader_cache::filename(const uint64 key) const
+{
+   char name[32] = {};
+   sprintf_s(name, "%016llx.bin", key);
+   return m_directory + name;
+}
+
+bool shader_cache::load(shader_program &program, const uint64 key) const
+{
+   if (!shader_program::is_binary_supported()) {
+      return false;
+   }
+
+   mapped_file file;
+   if (!file.open(filename(key).c_str())) {
+      return false;
+   }
+
+   const auto header = (const shader_cache_header *)file.m_data;
+   if (file.m_size < sizeof(shader_cache_header) ||
+       header->magic_ != k_shader_cache_magic ||
+       header->version_ != k_shader_cache_version ||
+       header->key_ != key ||
+       file.m_size < sizeof(shader_cache_header) + header->size_)
+   {
+      return false;
+   }
+
+   return program.create_from_binary(header->format_,
+                                     file.m_data + sizeof(shader_cache_header),
+                                     int32(header->size_));
+}
+
+void shader_cache::store(const shader_program &program, const uint64 key) const
+{
+   const int32 size = program.binary_size();
+   if (size <= 0) {
+      return;
+   }
+
+   std::vector<uint8> data(sizeof(shader_cache_header) + size);
+   uint32 format = 0;
+   if (!program.get_binary(format, data.data() + sizeof(shader_cache_header), size)) {
+      return;
+   }
+
+   const shader_cache_header header = { k_shader_cache_magic, k_shader_cache_version, format, uint32(size), key };
+   memcpy(data.data(), &header, sizeof(header));
+
+   FILE *fout = nullptr;
+   fopen_s(&fout, filename(key).c_str(), "wb");
+   if (fout == nullptr) {
+      debug::log("could not write shader cache entry: '%s'", filename(key).c_str());
+      return;
+   }
+
+   fwrite(data.data(), 1, data.size(), fout);
+   fclose(fout);
+}
@@ -11,7 +11,13 @@ bool skybox::valid() const
       m_buffer.is_valid();
 }
 
-bool skybox::create(const char *path)
+static const char *k_face_names[CUBEMAP_FACE_COUNT] =
+{
+   "xpos.jpg", "xneg.jpg", "ypos.jpg", "yneg.jpg", "zpos.jpg", "zneg.jpg"
+};
+
+static std::string
+get_base_path(const char *path)
 {
    std::string base_path(path);
    if (base_path.back() != '/' ||
@@ -19,29 +25,71 @@ bool skybox::create(const char *path)
    {
       base_path.append("/");
    }
+   return base_path;
+}
 
-   std::string vsource_path = base_path + "shader.vs.glsl";
-   std::string fsource_path = base_path + "shader.fs.glsl";
-
-   // note: create shader program
-   if (!utility::create_shader_program_from_files(m_program, vsource_path.c_str(), fsource_path.c_str())) {
+bool skybox::create(const char *path)
+{
+   std::string base_path = get_base_path(path);
+   if (!create_program(base_path)) {
       debug::log("could not create shader program - path: '%s'", path);
       return false;
    }
 
-   // note: load images and create cubemap
-   std::string faces[6];
-   const char *names[6] = { "xpos.jpg", "xneg.jpg", "ypos.jpg", "yneg.jpg", "zpos.jpg", "zneg.jpg" };
-   const char *files[6] = { nullptr };
-   for (int i = 0; i < 6; i++) {
-      faces[i] = base_path + names[i];
+   // note: prefer the baked container, load images and create cubemap otherwise
+   std::string baked_path = base_path + "skybox.stex";
+   if (utility::create_cubemap_from_baked_file(m_cubemap, baked_path.c_str())) {
+      return create_sampler_and_buffer();
+   }
+
+   std::string faces[CUBEMAP_FACE_COUNT];
+   const char *files[CUBEMAP_FACE_COUNT] = { nullptr };
+   for (int i = 0; i < CUBEMAP_FACE_COUNT; i++) {
+      faces[i] = base_path + k_face_names[i];
       files[i] = faces[i].c_str();
    }
 
-   if (!utility::create_cubemap_from_files(m_cubemap, 6, files)) {
+   if (!utility::create_cubemap_from_files(m_cubemap, CUBEMAP_FACE_COUNT, files)) {
+      return false;
+   }
+
+   return create_sampler_and_buffer();
+}
+
+bool skybox::create(const char *path, texture_streamer &streamer)
+{
+   // note: the program may have been created up front, e.g. batched
+   //       with other programs
+   std::string base_path = get_base_path(path);
+   if (!m_program.is_valid() && !create_program(base_path)) {
+      debug::log("could not create shader program - path: '%s'", path);
       return false;
    }
 
+   // note: a black placeholder is drawn until the faces have streamed in
+   std::string baked_path = base_path + "skybox.stex";
+   std::string faces[CUBEMAP_FACE_COUNT];
+   const char *files[CUBEMAP_FACE_COUNT] = { nullptr };
+   for (int i = 0; i < CUBEMAP_FACE_COUNT; i++) {
+      faces[i] = base_path + k_face_names[i];
+      files[i] = faces[i].c_str();
+   }
+
+   streamer.load(m_cubemap, baked_path.c_str(), CUBEMAP_FACE_COUNT, files);
+
+   return create_sampler_and_buffer();
+}
+
+bool skybox::create_program(const std::string &base_path)
+{
+   std::string vsource_path = base_path + "shader.vs.glsl";
+   std::string fsource_path = base_path + "shader.fs.glsl";
+
+   return utility::create_shader_program_from_files(m_program, vsource_path.c_str(), fsource_path.c_str());
+}
+
+bool skybox::create_sampler_and_buffer()
+{
    // note: create sampler state
    if (!m_sampler.create(SAMPLER_FILTER_MODE_LINEAR, SAMPLER_ADDRESS_MODE_CLAMP, SAMPLER_ADDRESS_MODE_CLAMP)) {
       return false;
@@ -120,21 +168,32 @@ void skybox::destroy()
    m_buffer.destroy();
 }
 
-void skybox::draw(render_backend &backend, const camera &camera)
+void skybox::draw(render_backend &backend, const camera &camera, const uint32 flags)
 {
-   glm::mat4 proj = camera.m_projection;
+   glm::mat4 proj = camera.m_jittered_projection;
    glm::mat4 view = camera.m_view;
    view[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
+   // note: rotation only, the sky moves with the camera orientation
+   glm::mat4 previous_view = camera.m_has_previous ? camera.m_previous_view : camera.m_view;
+   previous_view[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+   const glm::mat4 view_projection = camera.m_projection * view;
+   const glm::mat4 previous_view_projection = camera.m_projection * previous_view;
+
    backend.set_shader_program(m_program);
    backend.set_shader_uniform(m_program, UNIFORM_TYPE_MATRIX, "u_projection", 1, glm::value_ptr(proj));
    backend.set_shader_uniform(m_program, UNIFORM_TYPE_MATRIX, "u_view", 1, glm::value_ptr(view));
+   backend.set_shader_uniform(m_program, UNIFORM_TYPE_MATRIX, "u_view_projection", 1, glm::value_ptr(view_projection));
+   backend.set_shader_uniform(m_program, UNIFORM_TYPE_MATRIX, "u_previous_view_projection", 1, glm::value_ptr(previous_view_projection));
+   const float overdraw = (flags & DRAW_FLAGS_OVERDRAW) ? mesh::OVERDRAW_STEP : 0.0f;
+   backend.set_shader_uniform(m_program, UNIFORM_TYPE_FLOAT, "u_overdraw", 1, &overdraw);
    backend.set_vertex_buffer(m_buffer);
    backend.set_vertex_layout(m_layout);
    backend.set_cubemap(m_cubemap);
    backend.set_sampler_state(m_sampler);
-   backend.set_blend_state(false);
-   backend.set_depth_state(false, false);
    backend.set_rasterizer_state(CULL_MODE_NONE, FRONT_FACE_CCW, POLYGON_MODE_FILL);
+   // note: the vertex shader puts the sky on the far plane, less equal
+   //       passes only where the cleared depth is still there
+   mesh::set_draw_state(backend, flags | DRAW_FLAGS_DEPTH_PREPASSED);
    backend.draw(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, m_primitive_count);
 }
@@ -0,0 +1,99 @@
+// snapshot_buffer.cpp
+
+#include "spinach.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdarg>
+
+// note: the middle slot index, with a bit set while it holds a snapshot
+//       the reader has not taken yet
+static const uint32 k_fresh_bit = 4u;
+static const uint32 k_index_mask = 3u;
+
+struct snapshot_buffer::state {
+   std::atomic<uint32> m_middle{ 2 };
+};
+
+void frame_snapshot::clear_text()
+{
+   m_text[0] = '\0';
+   m_text_size = 0;
+}
+
+void frame_snapshot::push_text(const char *format, ...)
+{
+   const int32 space = TEXT_LIMIT - m_text_size;
+   if (space <= 1) {
+      return;
+   }
+
+   va_list args;
+   va_start(args, format);
+   const int written = vsnprintf(m_text + m_text_size, size_t(space - 1), format, args);
+   va_end(args);
+   if (written < 0) {
+      m_text[m_text_size] = '\0';
+      return;
+   }
+
+   // note: a line that does not fit is cut short
+   m_text_size += written < space - 1 ? written : space - 2;
+   m_text[m_text_size++] = '\n';
+   m_text[m_text_size] = '\0';
+}
+
+snapshot_buffer::~snapshot_buffer()
+{
+   destroy();
+}
+
+bool snapshot_buffer::create(const int32 belt_capacity)
+{
+   if (m_state == nullptr) {
+      m_state = new state;
+   }
+
+   for (auto &slot : m_slots) {
+      slot.m_belt.resize(belt_capacity);
+      slot.m_belt_count = 0;
+   }
+
+   m_write = 0;
+   m_read = 1;
+   return true;
+}
+
+void snapshot_buffer::destroy()
+{
+   delete m_state;
+   m_state = nullptr;
+}
+
+frame_snapshot &snapshot_buffer::write_slot()
+{
+   return m_slots[m_write];
+}
+
+void snapshot_buffer::publish()
+{
+   // note: release, the slot contents are visible before the swap is
+   const uint32 previous = m_state->m_middle.exchange(uint32(m_write) | k_fresh_bit, std::memory_order_acq_rel);
+   m_write = int32(previous & k_index_mask);
+}
+
+bool snapshot_buffer::acquire()
+{
+   if ((m_state->m_middle.load(std::memory_order_relaxed) & k_fresh_bit) == 0) {
+      return false;
+   }
+
+   const uint32 previous = m_state->m_middle.exchange(uint32(m_read), std::memory_order_acq_rel);
+   m_read = int32(previous & k_index_mask);
+   return true;
+}
+
+const frame_snapshot &snapshot_buffer::read_slot() const
+{
+   return m_slots[m_read];
+}
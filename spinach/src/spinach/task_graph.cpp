@@ -0,0 +1,172 @@
+// task_graph.cpp
+
+#include "spinach.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+static int64
+get_microseconds(const std::chrono::steady_clock::time_point &origin)
+{
+   return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+// note: bookkeeping for a single run, everything but the work itself
+//       happens under the lock
+struct task_graph_run {
+   task_graph_run(std::vector<task_graph::task> &tasks, worker_pool &pool)
+      : m_tasks(tasks)
+      , m_pool(pool)
+      , m_remaining(int(tasks.size()))
+      , m_origin(std::chrono::steady_clock::now())
+   {
+   }
+
+   void dispatch(const int index)
+   {
+      // note: without workers everything runs on the context thread
+      if (m_tasks[index].m_thread == TASK_THREAD_WORKER && m_pool.valid()) {
+         m_pool.submit([this, index]() {
+            execute(index);
+         });
+      }
+      else {
+         m_context.push_back(index);
+         m_condition.notify_all();
+      }
+   }
+
+   void execute(const int index)
+   {
+      auto &task = m_tasks[index];
+      task.m_start = get_microseconds(m_origin);
+      const bool result = !task.m_skipped && task.m_work();
+      task.m_end = get_microseconds(m_origin);
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      task.m_result = result;
+      for (const int dependent : task.m_dependents) {
+         auto &next = m_tasks[dependent];
+         next.m_skipped = next.m_skipped || !result;
+         if (--next.m_waiting == 0) {
+            dispatch(dependent);
+         }
+      }
+
+      m_remaining--;
+      m_condition.notify_all();
+   }
+
+   std::vector<task_graph::task> &m_tasks;
+   worker_pool &m_pool;
+   std::mutex m_mutex;
+   std::condition_variable m_condition;
+   std::vector<int> m_context;
+   int m_remaining{};
+   std::chrono::steady_clock::time_point m_origin;
+};
+
+int task_graph::add(const char *name,
+                    const task_thread thread,
+                    std::function<bool()> work,
+                    std::initializer_list<int> dependencies)
+{
+   const int index = int(m_tasks.size());
+
+   task result;
+   result.m_name = name;
+   result.m_thread = thread;
+   result.m_work = std::move(work);
+   for (const int dependency : dependencies) {
+      assert(dependency >= 0 && dependency < index);
+      result.m_dependencies.push_back(dependency);
+      m_tasks[dependency].m_dependents.push_back(index);
+   }
+   m_tasks.push_back(std::move(result));
+
+   return index;
+}
+
+bool task_graph::run(worker_pool &pool)
+{
+   task_graph_run state(m_tasks, pool);
+
+   std::unique_lock<std::mutex> lock(state.m_mutex);
+   for (int index = 0; index < int(m_tasks.size()); index++) {
+      auto &entry = m_tasks[index];
+      entry.m_waiting = int(entry.m_dependencies.size());
+      entry.m_skipped = false;
+      entry.m_result = false;
+   }
+
+   for (int index = 0; index < int(m_tasks.size()); index++) {
+      if (m_tasks[index].m_waiting == 0) {
+         state.dispatch(index);
+      }
+   }
+
+   while (state.m_remaining > 0) {
+      state.m_condition.wait(lock, [&state]() {
+         return !state.m_context.empty() || state.m_remaining == 0;
+      });
+
+      while (!state.m_context.empty()) {
+         const int index = state.m_context.front();
+         state.m_context.erase(state.m_context.begin());
+
+         lock.unlock();
+         state.execute(index);
+         lock.lock();
+      }
+   }
+
+   m_duration = get_microseconds(state.m_origin);
+
+   bool result = true;
+   for (const auto &entry : m_tasks) {
+      if (!entry.m_result) {
+         debug::log("task '%s' %s", entry.m_name.c_str(), entry.m_skipped ? "skipped" : "failed");
+         result = false;
+      }
+   }
+
+   return result;
+}
+
+void task_graph::log_timings() const
+{
+   debug::log("task graph: %d tasks in %.2fms", int(m_tasks.size()), double(m_duration) / 1000.0);
+   for (const auto &entry : m_tasks) {
+      debug::log("  %-16s %-7s start %7.2fms  took %7.2fms",
+                 entry.m_name.c_str(),
+                 entry.m_thread == TASK_THREAD_WORKER ? "worker" : "context",
+                 double(entry.m_start) / 1000.0,
+                 double(entry.m_end - entry.m_start) / 1000.0);
+   }
+
+   // note: walk back from the last task to finish through whichever
+   //       dependency finished last, that chain bounds the whole graph
+   int current = -1;
+   for (int index = 0; index < int(m_tasks.size()); index++) {
+      if (current < 0 || m_tasks[index].m_end > m_tasks[current].m_end) {
+         current = index;
+      }
+   }
+
+   std::string path;
+   while (current >= 0) {
+      const auto &entry = m_tasks[current];
+      path = path.empty() ? entry.m_name : entry.m_name + " -> " + path;
+
+      int previous = -1;
+      for (const int dependency : entry.m_dependencies) {
+         if (previous < 0 || m_tasks[dependency].m_end > m_tasks[previous].m_end) {
+            previous = dependency;
+         }
+      }
+      current = previous;
+   }
+
+   debug::log("  critical path: %s", path.c_str());
+}
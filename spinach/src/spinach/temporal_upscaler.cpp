@@ -0,0 +1,118 @@
+// temporal_upscaler.cpp
+
+#include "spinach.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+static float
+halton(uint32 index, const uint32 base)
+{
+   float result = 0.0f;
+   float fraction = 1.0f;
+   while (index > 0) {
+      fraction /= float(base);
+      result += fraction * float(index % base);
+      index /= base;
+   }
+   return result;
+}
+
+bool temporal_upscaler::create(const shader_program *program,
+                               const vertex_buffer *quad,
+                               const vertex_layout *layout,
+                               const sampler_state *nearest,
+                               const sampler_state *linear)
+{
+   m_program = program;
+   m_quad = quad;
+   m_layout = layout;
+   m_nearest = nearest;
+   m_linear = linear;
+   m_history_valid = false;
+
+   return m_program && m_quad && m_layout && m_nearest && m_linear;
+}
+
+void temporal_upscaler::destroy()
+{
+   for (auto &history : m_history) {
+      if (history.is_valid()) {
+         history.destroy();
+      }
+   }
+   m_history_valid = false;
+}
+
+glm::vec2 temporal_upscaler::next_jitter()
+{
+   // note: halton 2,3 starting at one, zero would put every phase
+   //       in the same corner
+   const uint32 phase = (m_frame++ % JITTER_PHASES) + 1;
+   m_jitter = glm::vec2(halton(phase, 2), halton(phase, 3)) - 0.5f;
+   return m_jitter;
+}
+
+void temporal_upscaler::reset()
+{
+   m_history_valid = false;
+}
+
+framebuffer &temporal_upscaler::next_history(const int32 width, const int32 height)
+{
+   // note: output size changed, the old history is of no use
+   if (m_history[0].width_ != width || m_history[0].height_ != height) {
+      const framebuffer_format formats[] = { FRAMEBUFFER_FORMAT_RGBA16F };
+      for (auto &history : m_history) {
+         if (history.is_valid()) {
+            history.destroy();
+         }
+         if (!history.create(width, height, 1, formats)) {
+            debug::log("could not create %dx%d history target", width, height);
+         }
+      }
+      m_history_valid = false;
+   }
+
+   m_current = 1 - m_current;
+   return m_history[m_current];
+}
+
+void temporal_upscaler::resolve(render_backend &backend,
+                                const texture &color,
+                                const texture &velocity,
+                                const glm::vec2 &source_size)
+{
+   const int32 previous = 1 - m_current;
+   const int32 units[] = { 0, 1, 2 };
+   const glm::vec2 texcoord_scale(1.0f);
+   const float history_valid = m_history_valid ? 1.0f : 0.0f;
+
+   backend.set_shader_program(*m_program);
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_SAMPLER, "u_current", 1, &units[0]);
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_SAMPLER, "u_velocity", 1, &units[1]);
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_SAMPLER, "u_history", 1, &units[2]);
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_VEC2, "u_texcoord_scale", 1, glm::value_ptr(texcoord_scale));
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_VEC2, "u_source_size", 1, glm::value_ptr(source_size));
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_VEC2, "u_jitter", 1, glm::value_ptr(m_jitter));
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_FLOAT, "u_blend", 1, &m_blend);
+   backend.set_shader_uniform(*m_program, UNIFORM_TYPE_FLOAT, "u_history_valid", 1, &history_valid);
+   backend.set_texture(color, 0);
+   backend.set_texture(velocity, 1);
+   backend.set_texture(m_history[previous].color_attachment_as_texture(0), 2);
+   backend.set_sampler_state(*m_nearest, 0);
+   backend.set_sampler_state(*m_nearest, 1);
+   backend.set_sampler_state(*m_linear, 2);
+   backend.set_vertex_buffer(*m_quad);
+   backend.set_vertex_layout(*m_layout);
+   backend.set_blend_state(false);
+   backend.set_depth_state(false, false);
+   backend.set_rasterizer_state(CULL_MODE_NONE, FRONT_FACE_CW);
+   backend.draw(PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, 6);
+
+   m_history_valid = true;
+}
+
+texture temporal_upscaler::output() const
+{
+   return m_history[m_current].color_attachment_as_texture(0);
+}
@@ -0,0 +1,408 @@
+// texture_streamer.cpp
+
+#include "spinach.hpp"
+#include "asset_format.hpp"
+
+#include <atomic>
+#include <stb_image.h>
+
+enum request_state {
+   REQUEST_STATE_DECODING,
+   REQUEST_STATE_READY,
+   REQUEST_STATE_FAILED,
+};
+
+static const int32 k_staging_alignment = 16;
+
+struct texture_streamer::request {
+   struct image {
+      uint8 *m_data{};
+      int m_width{};
+      int m_height{};
+      int m_components{};
+   };
+
+   struct subresource {
+      int32 m_face{};
+      int32 m_level{};
+      int32 m_width{};
+      int32 m_height{};
+      int32 m_size{};
+      const uint8 *m_data{};
+   };
+
+   ~request()
+   {
+      for (auto &decoded : m_images) {
+         stbi_image_free(decoded.m_data);
+      }
+   }
+
+   // note: shared between the streamer and the jobs working on it
+   std::atomic<int> m_references{ 1 };
+
+   // note: written by the workers until m_state leaves decoding
+   texture *m_texture{};
+   cubemap *m_cubemap{};
+   std::string m_baked_filename;
+   std::vector<std::string> m_filenames;
+   std::vector<image> m_images;
+   std::atomic<int> m_remaining{};
+   std::atomic<int> m_state{ REQUEST_STATE_DECODING };
+   mapped_file m_file;
+   texture_format m_format{};
+   int32 m_width{};
+   int32 m_height{};
+   int32 m_mip_count{};
+   bool m_generate_mipmaps{};
+   std::vector<subresource> m_subresources;
+
+   // note: owned by the context thread
+   std::size_t m_next{};
+   bool m_allocated{};
+   texture m_staging_texture;
+   cubemap m_staging_cubemap;
+   int64 m_start{};
+};
+
+static void
+release_request(texture_streamer::request *req)
+{
+   if (req->m_references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete req;
+   }
+}
+
+// note: keeps the request alive for as long as a job holds it, 
+//       including jobs dropped by the pool without running
+struct request_reference {
+   explicit request_reference(texture_streamer::request *req)
+      : m_request(req)
+   {
+      m_request->m_references.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   request_reference(const request_reference &rhs)
+      : request_reference(rhs.m_request)
+   {
+   }
+
+   request_reference &operator=(const request_reference &) = delete;
+
+   ~request_reference()
+   {
+      release_request(m_request);
+   }
+
+   texture_streamer::request *operator->() const { return m_request; }
+   texture_streamer::request &operator*() const { return *m_request; }
+
+   texture_streamer::request *m_request;
+};
+
+static int32
+get_mip_count(const int32 width, const int32 height)
+{
+   const int32 largest = width > height ? width : height;
+   int32 result = 1;
+   while ((largest >> result) > 0) {
+      result++;
+   }
+   return result;
+}
+
+static bool
+prepare_baked(texture_streamer::request &req)
+{
+   const uint32 face_count = req.m_cubemap ? CUBEMAP_FACE_COUNT : 1;
+   if (req.m_baked_filename.empty() || !req.m_file.open(req.m_baked_filename.c_str())) {
+      return false;
+   }
+
+   const auto levels = utility::get_texture_levels(req.m_file, face_count);
+   if (levels == nullptr) {
+      debug::log("invalid texture container: '%s'", req.m_baked_filename.c_str());
+      req.m_file.close();
+      return false;
+   }
+
+   // note: uploaded straight from the mapping, no decode step
+   const auto header = (const asset_format::texture_header *)req.m_file.m_data;
+   req.m_format = texture_format(header->format_);
+   req.m_width = int32(header->width_);
+   req.m_height = int32(header->height_);
+   req.m_mip_count = int32(header->mip_count_);
+   req.m_generate_mipmaps = false;
+   for (int32 face = 0; face < int32(face_count); face++) {
+      for (int32 level = 0; level < req.m_mip_count; level++) {
+         const auto &entry = levels[face * req.m_mip_count + level];
+
+         texture_streamer::request::subresource sub;
+         sub.m_face = face;
+         sub.m_level = level;
+         sub.m_width = (req.m_width >> level) > 0 ? (req.m_width >> level) : 1;
+         sub.m_height = (req.m_height >> level) > 0 ? (req.m_height >> level) : 1;
+         sub.m_size = int32(entry.size_);
+         sub.m_data = req.m_file.m_data + entry.offset_;
+         req.m_subresources.push_back(sub);
+      }
+   }
+
+   return true;
+}
+
+static void
+finish_decode(texture_streamer::request &req)
+{
+   const auto &first = req.m_images.front();
+   for (const auto &image : req.m_images) {
+      if (image.m_data == nullptr ||
+          image.m_width != first.m_width ||
+          image.m_height != first.m_height ||
+          image.m_components != first.m_components ||
+          (image.m_components != 3 && image.m_components != 4))
+      {
+         req.m_state.store(REQUEST_STATE_FAILED, std::memory_order_release);
+         return;
+      }
+   }
+
+   // note: only the top level is uploaded, the chain is generated on
+   //       the gpu once it has arrived. the skybox is sampled without mips
+   req.m_format = first.m_components == 3 ? TEXTURE_FORMAT_RGB8 : TEXTURE_FORMAT_RGBA8;
+   req.m_width = first.m_width;
+   req.m_height = first.m_height;
+   req.m_mip_count = req.m_texture ? get_mip_count(req.m_width, req.m_height) : 1;
+   req.m_generate_mipmaps = req.m_mip_count > 1;
+   for (std::size_t index = 0; index < req.m_images.size(); index++) {
+      texture_streamer::request::subresource sub;
+      sub.m_face = int32(index);
+      sub.m_level = 0;
+      sub.m_width = req.m_width;
+      sub.m_height = req.m_height;
+      sub.m_size = texture::level_size(req.m_format, req.m_width, req.m_height);
+      sub.m_data = req.m_images[index].m_data;
+      req.m_subresources.push_back(sub);
+   }
+
+   req.m_state.store(REQUEST_STATE_READY, std::memory_order_release);
+}
+
+static void
+decode_image(texture_streamer::request &req, const std::size_t index)
+{
+   auto &image = req.m_images[index];
+   image.m_data = stbi_load(req.m_filenames[index].c_str(),
+                            &image.m_width,
+                            &image.m_height,
+                            &image.m_components,
+                            STBI_default);
+
+   // note: the last image to finish publishes the request
+   if (req.m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      finish_decode(req);
+   }
+}
+
+static void
+start_request(worker_pool &pool, texture_streamer::request *request)
+{
+   const request_reference req(request);
+   pool.submit([&pool, req]() {
+      if (prepare_baked(*req)) {
+         req->m_state.store(REQUEST_STATE_READY, std::memory_order_release);
+         return;
+      }
+
+      // note: faces decode in parallel
+      const std::size_t count = req->m_filenames.size();
+      req->m_images.resize(count);
+      req->m_remaining.store(int(count), std::memory_order_relaxed);
+      for (std::size_t index = 1; index < count; index++) {
+         pool.submit([req, index]() {
+            decode_image(*req, index);
+         });
+      }
+
+      decode_image(*req, 0);
+   });
+}
+
+bool texture_streamer::create(worker_pool *pool, const int32 upload_budget)
+{
+   m_pool = pool;
+   m_upload_budget = upload_budget;
+
+   // note: room for a full budget plus one oversized level per frame
+   return m_pool != nullptr && m_staging.create(upload_budget * 2, 3);
+}
+
+void texture_streamer::destroy()
+{
+   for (auto &req : m_requests) {
+      req->m_staging_texture.destroy();
+      req->m_staging_cubemap.destroy();
+      release_request(req);
+   }
+   m_requests.clear();
+   m_staging.destroy();
+}
+
+void texture_streamer::load(texture &texture, const char *filename)
+{
+   const uint8 placeholder[4] = { 128, 128, 128, 255 };
+   texture.create(TEXTURE_FORMAT_RGBA8, 1, 1, placeholder);
+
+   auto req = new request;
+   req->m_texture = &texture;
+   req->m_baked_filename = utility::get_baked_filename(filename);
+   req->m_filenames.emplace_back(filename);
+   req->m_start = utility::get_current_tick();
+   m_requests.push_back(req);
+
+   start_request(*m_pool, req);
+}
+
+void texture_streamer::load(cubemap &cubemap, const char *baked_filename, const int count, const char **filenames)
+{
+   assert(count == CUBEMAP_FACE_COUNT);
+
+   const uint8 placeholder[4] = { 0, 0, 0, 255 };
+   const void *faces[CUBEMAP_FACE_COUNT] = {};
+   for (auto &face : faces) {
+      face = placeholder;
+   }
+   cubemap.create(TEXTURE_FORMAT_RGBA8, 1, 1, faces);
+
+   auto req = new request;
+   req->m_cubemap = &cubemap;
+   req->m_baked_filename = baked_filename ? baked_filename : "";
+   for (int index = 0; index < count; index++) {
+      req->m_filenames.emplace_back(filenames[index]);
+   }
+   req->m_start = utility::get_current_tick();
+   m_requests.push_back(req);
+
+   start_request(*m_pool, req);
+}
+
+void texture_streamer::update()
+{
+   if (m_requests.empty()) {
+      return;
+   }
+
+   m_staging.begin_frame();
+
+   // note: one level larger than the budget is still let through when
+   //       nothing else went this frame, otherwise it would never arrive
+   int32 budget = m_upload_budget;
+   bool first = true;
+   for (auto it = m_requests.begin(); it != m_requests.end() && budget > 0;) {
+      auto &req = **it;
+      const int state = req.m_state.load(std::memory_order_acquire);
+      if (state == REQUEST_STATE_DECODING) {
+         ++it;
+         continue;
+      }
+
+      if (state == REQUEST_STATE_FAILED) {
+         debug::log("could not stream texture: '%s'", req.m_filenames.front().c_str());
+         release_request(*it);
+         it = m_requests.erase(it);
+         continue;
+      }
+
+      if (!req.m_allocated) {
+         req.m_allocated = req.m_texture ?
+            req.m_staging_texture.allocate(req.m_format, req.m_width, req.m_height, req.m_mip_count) :
+            req.m_staging_cubemap.allocate(req.m_format, req.m_width, req.m_height, req.m_mip_count);
+         if (!req.m_allocated) {
+            debug::log("could not allocate texture: '%s'", req.m_filenames.front().c_str());
+            release_request(*it);
+            it = m_requests.erase(it);
+            continue;
+         }
+      }
+
+      while (req.m_next < req.m_subresources.size()) {
+         const auto &sub = req.m_subresources[req.m_next];
+         if (sub.m_size > budget && !first) {
+            budget = 0;
+            break;
+         }
+
+         // note: levels that do not fit the staging segment go direct
+         int32 offset = -1;
+         if (sub.m_size + k_staging_alignment <= m_staging.available()) {
+            offset = m_staging.write(sub.m_size, sub.m_data, k_staging_alignment);
+         }
+
+         if (req.m_texture) {
+            if (offset >= 0) {
+               req.m_staging_texture.upload(req.m_format, sub.m_level, sub.m_width, sub.m_height, m_staging, offset, sub.m_size);
+            }
+            else {
+               req.m_staging_texture.upload(req.m_format, sub.m_level, sub.m_width, sub.m_height, sub.m_data, sub.m_size);
+            }
+         }
+         else {
+            if (offset >= 0) {
+               req.m_staging_cubemap.upload(req.m_format, sub.m_face, sub.m_level, sub.m_width, sub.m_height, m_staging, offset, sub.m_size);
+            }
+            else {
+               req.m_staging_cubemap.upload(req.m_format, sub.m_face, sub.m_level, sub.m_width, sub.m_height, sub.m_data, sub.m_size);
+            }
+         }
+
+         budget -= sub.m_size;
+         first = false;
+         req.m_next++;
+      }
+
+      if (req.m_next < req.m_subresources.size()) {
+         break;
+      }
+
+      // note: swap the object in place so everything pointing at the
+      //       target picks up the real data
+      if (req.m_texture) {
+         if (req.m_generate_mipmaps) {
+            req.m_staging_texture.generate_mipmaps();
+         }
+         req.m_texture->destroy();
+         req.m_texture->id_ = req.m_staging_texture.id_;
+      }
+      else {
+         req.m_cubemap->destroy();
+         req.m_cubemap->id_ = req.m_staging_cubemap.id_;
+      }
+
+      debug::log("streamed '%s' (%dx%d) in %dms",
+                 req.m_file.valid() ? req.m_baked_filename.c_str() : req.m_filenames.front().c_str(),
+                 req.m_width,
+                 req.m_height,
+                 int(utility::get_current_tick() - req.m_start));
+
+      release_request(*it);
+      it = m_requests.erase(it);
+   }
+
+   m_staging.end_frame();
+}
+
+int texture_streamer::pending() const
+{
+   return int(m_requests.size());
+}
+
+bool texture_streamer::is_pending(const texture &texture) const
+{
+   for (const auto &req : m_requests) {
+      if (req->m_texture == &texture) {
+         return true;
+      }
+   }
+
+   return false;
+}
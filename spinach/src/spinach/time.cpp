@@ -5,7 +5,7 @@
 // static
 time time::now()
 {
-   return time{ utility::get_current_tick() };
+   return time{ utility::get_current_microseconds() };
 }
 
 time time::deltatime()
@@ -42,10 +42,10 @@ time time::operator-(const time & rhs) const
 
 float time::as_seconds() const
 {
-   return float(m_duration) / 1000.0f;
+   return float(m_duration) / 1000000.0f;
 }
 
 float time::as_milliseconds() const
 {
-   return float(m_duration);
+   return float(m_duration) / 1000.0f;
 }
\ No newline at end of file
@@ -0,0 +1,381 @@
+// transform_batch.cpp
+
+#include "spinach.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+static const int32 k_matrix_size = int32(sizeof(float)) * 16;
+
+static bool
+detect_avx2()
+{
+#if defined(_MSC_VER)
+   // note: the cpu has to report avx2 and the os has to save the ymm
+   //       registers on a context switch
+   int info[4] = {};
+   __cpuid(info, 0);
+   if (info[0] < 7) {
+      return false;
+   }
+
+   __cpuid(info, 1);
+   const bool osxsave = (info[2] & (1 << 27)) != 0;
+   const bool avx = (info[2] & (1 << 28)) != 0;
+   if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+      return false;
+   }
+
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+#else
+   return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// note: one body at a time, for the tail that does not fill a batch
+static void
+compose_one(const float *const *streams, const int32 index, uint8 *output)
+{
+   const float x = streams[transform_batch::STREAM_ROTATION_X][index];
+   const float y = streams[transform_batch::STREAM_ROTATION_Y][index];
+   const float z = streams[transform_batch::STREAM_ROTATION_Z][index];
+   const float w = streams[transform_batch::STREAM_ROTATION_W][index];
+   const float s = streams[transform_batch::STREAM_SCALE][index];
+
+   const float matrix[16] = {
+      s * (1.0f - 2.0f * (y * y + z * z)), s * 2.0f * (x * y + w * z), s * 2.0f * (x * z - w * y), 0.0f,
+      s * 2.0f * (x * y - w * z), s * (1.0f - 2.0f * (x * x + z * z)), s * 2.0f * (y * z + w * x), 0.0f,
+      s * 2.0f * (x * z + w * y), s * 2.0f * (y * z - w * x), s * (1.0f - 2.0f * (x * x + y * y)), 0.0f,
+      streams[transform_batch::STREAM_POSITION_X][index],
+      streams[transform_batch::STREAM_POSITION_Y][index],
+      streams[transform_batch::STREAM_POSITION_Z][index],
+      1.0f,
+   };
+   memcpy(output, matrix, sizeof(matrix));
+}
+
+// note: the scaled rotation part of the matrix, in columns. c[n][m] is
+//       row m of column n for four bodies
+static void
+compose_sse(const float *const *streams, const int32 count, uint8 *output, const int32 stride)
+{
+   const __m128 one = _mm_set1_ps(1.0f);
+   const __m128 two = _mm_set1_ps(2.0f);
+   const __m128 zero = _mm_setzero_ps();
+
+   for (int32 index = 0; index + 4 <= count; index += 4) {
+      const __m128 x = _mm_load_ps(streams[transform_batch::STREAM_ROTATION_X] + index);
+      const __m128 y = _mm_load_ps(streams[transform_batch::STREAM_ROTATION_Y] + index);
+      const __m128 z = _mm_load_ps(streams[transform_batch::STREAM_ROTATION_Z] + index);
+      const __m128 w = _mm_load_ps(streams[transform_batch::STREAM_ROTATION_W] + index);
+      const __m128 s = _mm_load_ps(streams[transform_batch::STREAM_SCALE] + index);
+      const __m128 s2 = _mm_mul_ps(s, two);
+
+      const __m128 xx = _mm_mul_ps(x, x);
+      const __m128 yy = _mm_mul_ps(y, y);
+      const __m128 zz = _mm_mul_ps(z, z);
+      const __m128 xy = _mm_mul_ps(x, y);
+      const __m128 xz = _mm_mul_ps(x, z);
+      const __m128 yz = _mm_mul_ps(y, z);
+      const __m128 wx = _mm_mul_ps(w, x);
+      const __m128 wy = _mm_mul_ps(w, y);
+      const __m128 wz = _mm_mul_ps(w, z);
+
+      __m128 c[4][4] = {
+         { _mm_sub_ps(s, _mm_mul_ps(s2, _mm_add_ps(yy, zz))), _mm_mul_ps(s2, _mm_add_ps(xy, wz)), _mm_mul_ps(s2, _mm_sub_ps(xz, wy)), zero },
+         { _mm_mul_ps(s2, _mm_sub_ps(xy, wz)), _mm_sub_ps(s, _mm_mul_ps(s2, _mm_add_ps(xx, zz))), _mm_mul_ps(s2, _mm_add_ps(yz, wx)), zero },
+         { _mm_mul_ps(s2, _mm_add_ps(xz, wy)), _mm_mul_ps(s2, _mm_sub_ps(yz, wx)), _mm_sub_ps(s, _mm_mul_ps(s2, _mm_add_ps(xx, yy))), zero },
+         { _mm_load_ps(streams[transform_batch::STREAM_POSITION_X] + index),
+           _mm_load_ps(streams[transform_batch::STREAM_POSITION_Y] + index),
+           _mm_load_ps(streams[transform_batch::STREAM_POSITION_Z] + index),
+           one },
+      };
+
+      // note: from a column of four bodies to that column of each body
+      uint8 *destination = output + std::size_t(index) * std::size_t(stride);
+      for (int32 column = 0; column < 4; column++) {
+         _MM_TRANSPOSE4_PS(c[column][0], c[column][1], c[column][2], c[column][3]);
+         for (int32 body = 0; body < 4; body++) {
+            _mm_storeu_ps(reinterpret_cast<float *>(destination + body * stride + column * 16), c[column][body]);
+         }
+      }
+   }
+}
+
+TARGET_AVX2 static void
+compose_avx2(const float *const *streams, const int32 count, uint8 *output, const int32 stride)
+{
+   const __m256 one = _mm256_set1_ps(1.0f);
+   const __m256 two = _mm256_set1_ps(2.0f);
+   const __m256 zero = _mm256_setzero_ps();
+
+   for (int32 index = 0; index + 8 <= count; index += 8) {
+      const __m256 x = _mm256_load_ps(streams[transform_batch::STREAM_ROTATION_X] + index);
+      const __m256 y = _mm256_load_ps(streams[transform_batch::STREAM_ROTATION_Y] + index);
+      const __m256 z = _mm256_load_ps(streams[transform_batch::STREAM_ROTATION_Z] + index);
+      const __m256 w = _mm256_load_ps(streams[transform_batch::STREAM_ROTATION_W] + index);
+      const __m256 s = _mm256_load_ps(streams[transform_batch::STREAM_SCALE] + index);
+      const __m256 s2 = _mm256_mul_ps(s, two);
+
+      const __m256 xx = _mm256_mul_ps(x, x);
+      const __m256 yy = _mm256_mul_ps(y, y);
+      const __m256 zz = _mm256_mul_ps(z, z);
+      const __m256 xy = _mm256_mul_ps(x, y);
+      const __m256 xz = _mm256_mul_ps(x, z);
+      const __m256 yz = _mm256_mul_ps(y, z);
+      const __m256 wx = _mm256_mul_ps(w, x);
+      const __m256 wy = _mm256_mul_ps(w, y);
+      const __m256 wz = _mm256_mul_ps(w, z);
+
+      const __m256 c[4][4] = {
+         { _mm256_sub_ps(s, _mm256_mul_ps(s2, _mm256_add_ps(yy, zz))), _mm256_mul_ps(s2, _mm256_add_ps(xy, wz)), _mm256_mul_ps(s2, _mm256_sub_ps(xz, wy)), zero },
+         { _mm256_mul_ps(s2, _mm256_sub_ps(xy, wz)), _mm256_sub_ps(s, _mm256_mul_ps(s2, _mm256_add_ps(xx, zz))), _mm256_mul_ps(s2, _mm256_add_ps(yz, wx)), zero },
+         { _mm256_mul_ps(s2, _mm256_add_ps(xz, wy)), _mm256_mul_ps(s2, _mm256_sub_ps(yz, wx)), _mm256_sub_ps(s, _mm256_mul_ps(s2, _mm256_add_ps(xx, yy))), zero },
+         { _mm256_load_ps(streams[transform_batch::STREAM_POSITION_X] + index),
+           _mm256_load_ps(streams[transform_batch::STREAM_POSITION_Y] + index),
+           _mm256_load_ps(streams[transform_batch::STREAM_POSITION_Z] + index),
+           one },
+      };
+
+      // note: transposed within each 128-bit half, the low half holds
+      //       bodies 0 to 3 and the high half bodies 4 to 7
+      uint8 *destination = output + std::size_t(index) * std::size_t(stride);
+      for (int32 column = 0; column < 4; column++) {
+         const __m256 t0 = _mm256_unpacklo_ps(c[column][0], c[column][1]);
+         const __m256 t1 = _mm256_unpackhi_ps(c[column][0], c[column][1]);
+         const __m256 t2 = _mm256_unpacklo_ps(c[column][2], c[column][3]);
+         const __m256 t3 = _mm256_unpackhi_ps(c[column][2], c[column][3]);
+         const __m256 rows[4] = {
+            _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+            _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+            _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+            _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)),
+         };
+         for (int32 body = 0; body < 4; body++) {
+            _mm_storeu_ps(reinterpret_cast<float *>(destination + body * stride + column * 16), _mm256_castps256_ps128(rows[body]));
+            _mm_storeu_ps(reinterpret_cast<float *>(destination + (body + 4) * stride + column * 16), _mm256_extractf128_ps(rows[body], 1));
+         }
+      }
+   }
+}
+
+bool transform_batch::create(const int32 capacity)
+{
+   // note: padding starts out as the identity rotation, so integrating
+   //       it never divides by zero
+   const int32 padded = (capacity + 7) & ~7;
+   for (int32 index = 0; index < STREAM_COUNT; index++) {
+      m_streams[index].assign(std::size_t(padded) + 8, index == STREAM_ROTATION_W ? 1.0f : 0.0f);
+   }
+
+   m_capacity = capacity;
+   m_count = 0;
+   m_path = is_avx2_supported() ? PATH_AVX2 : PATH_SSE;
+
+   return true;
+}
+
+void transform_batch::destroy()
+{
+   for (auto &values : m_streams) {
+      values.clear();
+      values.shrink_to_fit();
+   }
+
+   m_capacity = 0;
+   m_count = 0;
+}
+
+int32 transform_batch::add(const glm::vec3 &position,
+                           const glm::vec4 &rotation,
+                           const float scale,
+                           const glm::vec3 &angular_velocity)
+{
+   if (m_count >= m_capacity) {
+      return -1;
+   }
+
+   const float values[STREAM_COUNT] = {
+      position.x, position.y, position.z,
+      rotation.x, rotation.y, rotation.z, rotation.w,
+      scale,
+      angular_velocity.x, angular_velocity.y, angular_velocity.z,
+   };
+   for (int32 index = 0; index < STREAM_COUNT; index++) {
+      get(stream(index))[m_count] = values[index];
+   }
+
+   return m_count++;
+}
+
+float *transform_batch::get(const stream which)
+{
+   // note: the vector storage is only 16 byte aligned, the streams start
+   //       at the first 32 byte boundary so avx loads can be aligned
+   const uintptr_t address = uintptr_t(m_streams[which].data());
+   return reinterpret_cast<float *>((address + 31) & ~uintptr_t(31));
+}
+
+const float *transform_batch::get(const stream which) const
+{
+   const uintptr_t address = uintptr_t(m_streams[which].data());
+   return reinterpret_cast<const float *>((address + 31) & ~uintptr_t(31));
+}
+
+void transform_batch::integrate(const float deltatime)
+{
+   float *x = get(STREAM_ROTATION_X);
+   float *y = get(STREAM_ROTATION_Y);
+   float *z = get(STREAM_ROTATION_Z);
+   float *w = get(STREAM_ROTATION_W);
+   const float *ax = get(STREAM_ANGULAR_VELOCITY_X);
+   const float *ay = get(STREAM_ANGULAR_VELOCITY_Y);
+   const float *az = get(STREAM_ANGULAR_VELOCITY_Z);
+
+   // note: q += dt / 2 * (w, 0) * q, then renormalized. first order,
+   //       which is plenty for steps of a frame, and no trig
+   const __m128 half = _mm_set1_ps(deltatime * 0.5f);
+   for (int32 index = 0; index < m_count; index += 4) {
+      const __m128 qx = _mm_load_ps(x + index);
+      const __m128 qy = _mm_load_ps(y + index);
+      const __m128 qz = _mm_load_ps(z + index);
+      const __m128 qw = _mm_load_ps(w + index);
+      const __m128 wx = _mm_load_ps(ax + index);
+      const __m128 wy = _mm_load_ps(ay + index);
+      const __m128 wz = _mm_load_ps(az + index);
+
+      const __m128 dx = _mm_add_ps(_mm_mul_ps(qw, wx), _mm_sub_ps(_mm_mul_ps(wy, qz), _mm_mul_ps(wz, qy)));
+      const __m128 dy = _mm_add_ps(_mm_mul_ps(qw, wy), _mm_sub_ps(_mm_mul_ps(wz, qx), _mm_mul_ps(wx, qz)));
+      const __m128 dz = _mm_add_ps(_mm_mul_ps(qw, wz), _mm_sub_ps(_mm_mul_ps(wx, qy), _mm_mul_ps(wy, qx)));
+      const __m128 dw = _mm_add_ps(_mm_mul_ps(wx, qx), _mm_add_ps(_mm_mul_ps(wy, qy), _mm_mul_ps(wz, qz)));
+
+      const __m128 nx = _mm_add_ps(qx, _mm_mul_ps(half, dx));
+      const __m128 ny = _mm_add_ps(qy, _mm_mul_ps(half, dy));
+      const __m128 nz = _mm_add_ps(qz, _mm_mul_ps(half, dz));
+      const __m128 nw = _mm_sub_ps(qw, _mm_mul_ps(half, dw));
+
+      const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+                                                   _mm_add_ps(_mm_mul_ps(nz, nz), _mm_mul_ps(nw, nw))));
+      _mm_store_ps(x + index, _mm_div_ps(nx, length));
+      _mm_store_ps(y + index, _mm_div_ps(ny, length));
+      _mm_store_ps(z + index, _mm_div_ps(nz, length));
+      _mm_store_ps(w + index, _mm_div_ps(nw, length));
+   }
+}
+
+void transform_batch::compose(void *output, const int32 stride) const
+{
+   compose(output, stride, m_path);
+}
+
+void transform_batch::compose(void *output, const int32 stride, const path which) const
+{
+   assert(stride >= k_matrix_size);
+
+   const float *streams[STREAM_COUNT] = {};
+   for (int32 index = 0; index < STREAM_COUNT; index++) {
+      streams[index] = get(stream(index));
+   }
+
+   uint8 *destination = static_cast<uint8 *>(output);
+   int32 done = 0;
+   if (which == PATH_AVX2) {
+      compose_avx2(streams, m_count, destination, stride);
+      done = m_count & ~7;
+   }
+   else if (which == PATH_SSE) {
+      compose_sse(streams, m_count, destination, stride);
+      done = m_count & ~3;
+   }
+
+   for (int32 index = done; index < m_count; index++) {
+      compose_one(streams, index, destination + std::size_t(index) * std::size_t(stride));
+   }
+}
+
+// static
+bool transform_batch::is_avx2_supported()
+{
+   static const bool supported = detect_avx2();
+   return supported;
+}
+
+// static
+void transform_batch::benchmark()
+{
+   const int32 counts[] = { 1000, 100 * 1000, 1000 * 1000 };
+   const char *names[] = { "scalar", "sse", "avx2" };
+
+   for (const int32 count : counts) {
+      uint32 state = 0x9e3779b9u;
+      auto random = [&state]() {
+         state = state * 1664525u + 1013904223u;
+         return float(state >> 8) / float(1 << 24);
+      };
+
+      transform_batch batch;
+      batch.create(count);
+      std::vector<glm::vec3> positions(count);
+      std::vector<glm::quat> rotations(count);
+      std::vector<float> scales(count);
+      for (int32 index = 0; index < count; index++) {
+         positions[index] = glm::vec3(random(), random(), random()) * 100.0f;
+         rotations[index] = glm::angleAxis(random() * 6.0f, glm::normalize(glm::vec3(random(), random(), random()) + 0.01f));
+         scales[index] = 0.1f + random();
+         const auto &q = rotations[index];
+         batch.add(positions[index], glm::vec4(q.x, q.y, q.z, q.w), scales[index], glm::vec3(0.0f));
+      }
+
+      // note: enough rounds that every path runs for a while
+      const int32 rounds = count < 100 * 1000 ? 1000 : (count < 1000 * 1000 ? 20 : 4);
+      std::vector<glm::mat4> expected(count);
+      std::vector<glm::mat4> result(count);
+
+      int64 start = utility::get_current_microseconds();
+      for (int32 round = 0; round < rounds; round++) {
+         for (int32 index = 0; index < count; index++) {
+            expected[index] = glm::scale(glm::translate(glm::mat4(1.0f), positions[index]) * glm::mat4_cast(rotations[index]), glm::vec3(scales[index]));
+         }
+      }
+      const double reference = double(utility::get_current_microseconds() - start) / double(rounds);
+      debug::log("transforms: %7d bodies, glm    %9.1fus", count, reference);
+
+      for (int32 which = PATH_SCALAR; which <= PATH_AVX2; which++) {
+         if (which == PATH_AVX2 && !is_avx2_supported()) {
+            continue;
+         }
+
+         start = utility::get_current_microseconds();
+         for (int32 round = 0; round < rounds; round++) {
+            batch.compose(result.data(), k_matrix_size, path(which));
+         }
+         const double elapsed = double(utility::get_current_microseconds() - start) / double(rounds);
+
+         float error = 0.0f;
+         for (int32 index = 0; index < count; index++) {
+            for (int32 column = 0; column < 4; column++) {
+               const glm::vec4 difference = glm::abs(result[index][column] - expected[index][column]);
+               error = glm::max(error, glm::max(glm::max(difference.x, difference.y), glm::max(difference.z, difference.w)));
+            }
+         }
+
+         debug::log("transforms: %7d bodies, %-6s %9.1fus, %5.2fx, max error %g",
+                    count,
+                    names[which],
+                    elapsed,
+                    reference / (elapsed > 0.0 ? elapsed : 1.0),
+                    double(error));
+      }
+   }
+}
@@ -0,0 +1,102 @@
+// worker_pool.cpp
+
+#include "spinach.hpp"
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct worker_pool::state {
+   std::vector<std::thread> m_threads;
+   std::deque<std::function<void()>> m_jobs;
+   std::mutex m_mutex;
+   std::condition_variable m_condition;
+   bool m_quit{};
+};
+
+static void
+worker_main(worker_pool::state &state)
+{
+   while (true) {
+      std::function<void()> job;
+      {
+         std::unique_lock<std::mutex> lock(state.m_mutex);
+         state.m_condition.wait(lock, [&state]() { return state.m_quit || !state.m_jobs.empty(); });
+         if (state.m_quit) {
+            return;
+         }
+
+         job = std::move(state.m_jobs.front());
+         state.m_jobs.pop_front();
+      }
+
+      job();
+   }
+}
+
+worker_pool::~worker_pool()
+{
+   destroy();
+}
+
+bool worker_pool::valid() const
+{
+   return m_state != nullptr && !m_state->m_threads.empty();
+}
+
+bool worker_pool::create(const int thread_count)
+{
+   // note: leave one hardware thread for the main (context) thread
+   int count = thread_count;
+   if (count <= 0) {
+      count = int(std::thread::hardware_concurrency()) - 1;
+   }
+   if (count <= 0) {
+      count = 1;
+   }
+
+   m_state = new state;
+   for (int index = 0; index < count; index++) {
+      m_state->m_threads.emplace_back(worker_main, std::ref(*m_state));
+   }
+
+   return valid();
+}
+
+void worker_pool::destroy()
+{
+   if (m_state == nullptr) {
+      return;
+   }
+
+   {
+      // note: jobs not yet started are dropped
+      std::lock_guard<std::mutex> lock(m_state->m_mutex);
+      m_state->m_quit = true;
+      m_state->m_jobs.clear();
+   }
+   m_state->m_condition.notify_all();
+
+   for (auto &thread : m_state->m_threads) {
+      thread.join();
+   }
+
+   delete m_state;
+   m_state = nullptr;
+}
+
+void worker_pool::submit(std::function<void()> job)
+{
+   assert(m_state);
+   {
+      std::lock_guard<std::mutex> lock(m_state->m_mutex);
+      m_state->m_jobs.push_back(std::move(job));
+   }
+   m_state->m_condition.notify_one();
+}
+
+int worker_pool::thread_count() const
+{
+   return m_state ? int(m_state->m_threads.size()) : 0;
+}
@@ -1,11 +1,25 @@
 // utility.cpp
 
 #include "spinach.hpp"
+#include "asset_format.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #include <cstdio>
+#include <cmath>
+#include <algorithm>
 #include <string>
 #include <chrono>
 
@@ -16,49 +30,263 @@ struct defer {
    ~defer() { m_f(); }
 };
 
+mapped_file::~mapped_file()
+{
+   close();
+}
+
+bool mapped_file::valid() const
+{
+   return m_data != nullptr;
+}
+
+bool mapped_file::open(const char *filename)
+{
+   close();
+
+#if defined(_WIN32)
+   HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+   if (file == INVALID_HANDLE_VALUE) {
+      return false;
+   }
+
+   LARGE_INTEGER size{};
+   if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+      CloseHandle(file);
+      return false;
+   }
+
+   HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+   if (mapping == nullptr) {
+      CloseHandle(file);
+      return false;
+   }
+
+   const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+   if (data == nullptr) {
+      CloseHandle(mapping);
+      CloseHandle(file);
+      return false;
+   }
+
+   m_file = file;
+   m_mapping = mapping;
+   m_data = (const uint8 *)data;
+   m_size = std::size_t(size.QuadPart);
+#else
+   const int file = ::open(filename, O_RDONLY);
+   if (file < 0) {
+      return false;
+   }
+
+   struct stat info{};
+   if (fstat(file, &info) != 0 || info.st_size == 0) {
+      ::close(file);
+      return false;
+   }
+
+   void *data = mmap(nullptr, std::size_t(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+   ::close(file);
+   if (data == MAP_FAILED) {
+      return false;
+   }
+
+   m_data = (const uint8 *)data;
+   m_size = std::size_t(info.st_size);
+#endif
+
+   return true;
+}
+
+void mapped_file::close()
+{
+   if (m_data == nullptr) {
+      return;
+   }
+
+#if defined(_WIN32)
+   UnmapViewOfFile(m_data);
+   CloseHandle((HANDLE)m_mapping);
+   CloseHandle((HANDLE)m_file);
+#else
+   munmap((void *)m_data, m_size);
+#endif
+
+   m_data = nullptr;
+   m_size = 0;
+   m_file = nullptr;
+   m_mapping = nullptr;
+}
+
 namespace utility
 {
-   bool create_shader_program_from_files(shader_program &program,
-                                         const char *vertex_filename,
-                                         const char *fragment_filename)
+   const asset_format::texture_level *get_texture_levels(const mapped_file &file, const uint32 face_count)
    {
-      std::size_t size = 0;
-      FILE *fin = nullptr;
+      using namespace asset_format;
+
+      if (file.m_size < sizeof(texture_header)) {
+         return nullptr;
+      }
+
+      const auto header = (const texture_header *)file.m_data;
+      if (header->magic_ != TEXTURE_MAGIC ||
+          header->version_ != TEXTURE_VERSION ||
+          header->format_ >= TEXTURE_FORMAT_COUNT ||
+          header->face_count_ != face_count ||
+          header->mip_count_ == 0 ||
+          header->width_ == 0 ||
+          header->height_ == 0)
+      {
+         return nullptr;
+      }
 
-      fopen_s(&fin, vertex_filename, "r");
+      const std::size_t level_count = std::size_t(header->mip_count_) * header->face_count_;
+      if (file.m_size < sizeof(texture_header) + level_count * sizeof(texture_level)) {
+         return nullptr;
+      }
+
+      const auto levels = (const texture_level *)(file.m_data + sizeof(texture_header));
+      for (std::size_t index = 0; index < level_count; index++) {
+         if (levels[index].offset_ + levels[index].size_ > file.m_size) {
+            return nullptr;
+         }
+      }
+
+      return levels;
+   }
+
+   std::string get_baked_filename(const char *filename)
+   {
+      std::string result(filename);
+      const auto dot = result.find_last_of('.');
+      const auto slash = result.find_last_of("/\\");
+      if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+         result.resize(dot);
+      }
+      result.append(".stex");
+      return result;
+   }
+
+   bool read_text_file(std::string &result,
+                       const char *filename)
+   {
+      FILE *fin = nullptr;
+      fopen_s(&fin, filename, "r");
       if (fin == nullptr) {
          return false;
       }
 
+      // note: text mode may translate line endings, size by what was read
       fseek(fin, 0, SEEK_END);
-      size = ftell(fin);
+      const long size = ftell(fin);
       fseek(fin, 0, SEEK_SET);
-      std::string vertex_source;
-      vertex_source.resize(size + 1);
-      fread(vertex_source.data(), 1, size, fin);
+      result.resize(std::size_t(size));
+      result.resize(fread(result.data(), 1, result.size(), fin));
       fclose(fin);
-      fin = nullptr;
 
-      fopen_s(&fin, fragment_filename, "r");
-      if (fin == nullptr) {
+      return true;
+   }
+
+   bool create_shader_program_from_files(shader_program &program,
+                                         const char *vertex_filename,
+                                         const char *fragment_filename)
+   {
+      std::string vertex_source;
+      if (!read_text_file(vertex_source, vertex_filename)) {
          return false;
       }
 
-      fseek(fin, 0, SEEK_END);
-      size = ftell(fin);
-      fseek(fin, 0, SEEK_SET);
       std::string fragment_source;
-      fragment_source.resize(size + 1);
-      fread(fragment_source.data(), 1, size, fin);
-      fclose(fin);
-      fin = nullptr;
+      if (!read_text_file(fragment_source, fragment_filename)) {
+         return false;
+      }
 
       return program.create(vertex_source.c_str(), fragment_source.c_str());
    }
 
+   bool load_image_from_file(image_data &image,
+                             const char *filename)
+   {
+      int width = 0, height = 0, components = 0;
+      auto data = stbi_load(filename, &width, &height, &components, STBI_default);
+      if (data == nullptr) {
+         return false;
+      }
+
+      defer release([&]() {
+         stbi_image_free(data);
+      });
+
+      if (components != 3 && components != 4) {
+         return false;
+      }
+
+      image.m_format = components == 3 ? TEXTURE_FORMAT_RGB8 : TEXTURE_FORMAT_RGBA8;
+      image.m_width = width;
+      image.m_height = height;
+      image.m_pixels.assign(data, data + std::size_t(width) * height * components);
+
+      return true;
+   }
+
+   bool bake_sdf_font(image_data &result,
+                      const image_data &bitmap,
+                      const int cell_size)
+   {
+      const int components = bitmap.m_format == TEXTURE_FORMAT_RGBA8 ? 4 : 0;
+      if (components == 0 || cell_size <= 0 || bitmap.m_width != bitmap.m_height || bitmap.m_width % 16 != 0) {
+         return false;
+      }
+
+      const int source_cell = bitmap.m_width / 16;
+      auto is_set = [&](const int x, const int y) {
+         return bitmap.m_pixels[(std::size_t(y) * bitmap.m_width + x) * components + 3] > 127;
+      };
+
+      result.m_format = TEXTURE_FORMAT_R8;
+      result.m_width = cell_size * 16;
+      result.m_height = cell_size * 16;
+      result.m_pixels.assign(std::size_t(result.m_width) * result.m_height, 0);
+
+      // note: distances in source pixels, to the nearest pixel square of
+      //       the other kind. cells stay apart, outside a cell is empty
+      for (int y = 0; y < result.m_height; y++) {
+         for (int x = 0; x < result.m_width; x++) {
+            const int cell_x = (x / cell_size) * source_cell;
+            const int cell_y = (y / cell_size) * source_cell;
+            const float px = (float(x % cell_size) + 0.5f) * float(source_cell) / float(cell_size);
+            const float py = (float(y % cell_size) + 0.5f) * float(source_cell) / float(cell_size);
+            const bool inside = is_set(cell_x + int(px), cell_y + int(py));
+
+            float nearest = inside ? std::min(std::min(px, py), std::min(float(source_cell) - px, float(source_cell) - py)) : 2.0f;
+            for (int sy = 0; sy < source_cell; sy++) {
+               for (int sx = 0; sx < source_cell; sx++) {
+                  if (is_set(cell_x + sx, cell_y + sy) == inside) {
+                     continue;
+                  }
+
+                  const float dx = std::max(std::max(float(sx) - px, px - float(sx + 1)), 0.0f);
+                  const float dy = std::max(std::max(float(sy) - py, py - float(sy + 1)), 0.0f);
+                  nearest = std::min(nearest, std::sqrt(dx * dx + dy * dy));
+               }
+            }
+
+            const float distance = inside ? nearest : -nearest;
+            const float value = std::clamp(0.5f + distance * 0.5f, 0.0f, 1.0f);
+            result.m_pixels[std::size_t(y) * result.m_width + x] = uint8(value * 255.0f + 0.5f);
+         }
+      }
+
+      return true;
+   }
+
    bool create_texture_from_file(texture &texture,
                                  const char *filename)
    {
+      if (create_texture_from_baked_file(texture, get_baked_filename(filename).c_str())) {
+         return true;
+      }
+
       int width = 0, height = 0, components = 0;
       auto data = stbi_load(filename, &width, &height, &components, STBI_default);
       assert(data);
@@ -70,7 +298,113 @@ namespace utility
 
       texture_format format = components == 3 ? TEXTURE_FORMAT_RGB8 : TEXTURE_FORMAT_RGBA8;
 
-      return texture.create(format, width, height, data);
+      if (!texture.create(format, width, height, data)) {
+         return false;
+      }
+
+      texture.generate_mipmaps();
+      return true;
+   }
+
+   bool create_texture_from_baked_file(texture &texture,
+                                       const char *filename)
+   {
+      mapped_file file;
+      if (!file.open(filename)) {
+         return false;
+      }
+
+      const auto levels = get_texture_levels(file, 1);
+      if (levels == nullptr) {
+         debug::log("invalid texture container: '%s'", filename);
+         return false;
+      }
+
+      // note: upload straight from the mapping, no decode step
+      const auto header = (const asset_format::texture_header *)file.m_data;
+      const texture_format format = texture_format(header->format_);
+      const int32 mip_count = int32(header->mip_count_);
+
+      std::vector<const void *> data(mip_count);
+      std::vector<int32> sizes(mip_count);
+      for (int32 index = 0; index < mip_count; index++) {
+         data[index] = file.m_data + levels[index].offset_;
+         sizes[index] = int32(levels[index].size_);
+      }
+
+      if (texture::is_compressed(format)) {
+         return texture.create_compressed(format, int32(header->width_), int32(header->height_), mip_count, data.data(), sizes.data());
+      }
+
+      return texture.create(format, int32(header->width_), int32(header->height_), mip_count, data.data());
+   }
+
+   bool create_cubemap_from_baked_file(cubemap &cubemap,
+                                       const char *filename)
+   {
+      mapped_file file;
+      if (!file.open(filename)) {
+         return false;
+      }
+
+      const auto levels = get_texture_levels(file, CUBEMAP_FACE_COUNT);
+      if (levels == nullptr) {
+         debug::log("invalid cubemap container: '%s'", filename);
+         return false;
+      }
+
+      const auto header = (const asset_format::texture_header *)file.m_data;
+      const texture_format format = texture_format(header->format_);
+      if (!texture::is_compressed(format)) {
+         return false;
+      }
+
+      const int32 level_count = int32(header->mip_count_) * CUBEMAP_FACE_COUNT;
+      std::vector<const void *> data(level_count);
+      std::vector<int32> sizes(level_count);
+      for (int32 index = 0; index < level_count; index++) {
+         data[index] = file.m_data + levels[index].offset_;
+         sizes[index] = int32(levels[index].size_);
+      }
+
+      return cubemap.create_compressed(format, int32(header->width_), int32(header->height_), int32(header->mip_count_), data.data(), sizes.data());
+   }
+
+   bool create_texture_array_from_baked_file(texture_array &array,
+                                             const char *filename,
+                                             const int32 layer_count)
+   {
+      mapped_file file;
+      if (!file.open(filename)) {
+         return false;
+      }
+
+      const auto levels = get_texture_levels(file, uint32(layer_count));
+      if (levels == nullptr) {
+         debug::log("invalid texture array container: '%s'", filename);
+         return false;
+      }
+
+      const auto header = (const asset_format::texture_header *)file.m_data;
+      const texture_format format = texture_format(header->format_);
+      if (!texture::is_compressed(format)) {
+         return false;
+      }
+
+      // note: the layers of a level are written with one size each
+      const int32 level_count = int32(header->mip_count_) * layer_count;
+      std::vector<const void *> data(level_count);
+      std::vector<int32> sizes(level_count);
+      for (int32 index = 0; index < level_count; index++) {
+         data[index] = file.m_data + levels[index].offset_;
+         sizes[index] = int32(levels[index].size_);
+         if (sizes[index] != int32(levels[index % header->mip_count_].size_)) {
+            debug::log("invalid texture array container: '%s'", filename);
+            return false;
+         }
+      }
+
+      return array.create_compressed(format, int32(header->width_), int32(header->height_), layer_count, int32(header->mip_count_), data.data(), sizes.data());
    }
 
    bool create_cubemap_from_files(cubemap &cubemap,
@@ -145,4 +479,11 @@ namespace utility
       auto now = ms.time_since_epoch().count();
       return now - start;
    }
+
+   int64 get_current_microseconds()
+   {
+      using namespace std::chrono;
+      static const steady_clock::time_point start = steady_clock::now();
+      return duration_cast<microseconds>(steady_clock::now() - start).count();
+   }
 } // !utility